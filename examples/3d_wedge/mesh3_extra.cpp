@@ -258,7 +258,7 @@ jmm_error_e mesh3_init_from_3d_wedge_spec(mesh3_s *mesh,
   memcpy(data.verts, out.pointlist, data.nverts*sizeof(dbl3));
   memcpy(data.cells, out.tetrahedronlist, data.ncells*sizeof(uint4));
 
-  mesh3_init(mesh, &data, true, NULL);
+  mesh3_init(mesh, &data, true, true, NULL);
 
   /* Make sure the point source is actually included in the mesh! */
   assert(mesh3_has_vertex(mesh, addin.pointlist));
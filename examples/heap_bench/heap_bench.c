@@ -0,0 +1,220 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <jmm/eik2g1.h>
+#include <jmm/heap.h>
+#include <jmm/util.h>
+#include <jmm/vec.h>
+
+/* Compare the priority queue layouts in `heap.h` on two workloads:
+ *
+ * 1. Dijkstra's algorithm on an n x n grid with 8-point connectivity
+ *    and random edge weights. This exercises the heap on its own,
+ *    with the same insert/decrease-key/pop pattern as the marcher.
+ *
+ * 2. `eik2g1` solving for a point source on an n x n grid. Here the
+ *    heap competes with the cost of the local updates. */
+
+static char const *heap_type_name[] = {
+  [HEAP_TYPE_BINARY] = "binary",
+  [HEAP_TYPE_4ARY] = "4-ary",
+  [HEAP_TYPE_BUCKET] = "bucket"
+};
+
+typedef struct {
+  int n;
+  dbl *dist;
+  dbl *weight;
+  int *pos;
+  state_e *state;
+} dijkstra_s;
+
+static dbl value(void *context, int l) {
+  return ((dijkstra_s *)context)->dist[l];
+}
+
+static void setpos(void *context, int l, int pos) {
+  ((dijkstra_s *)context)->pos[l] = pos;
+}
+
+static int const di[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+static int const dj[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+/* Run Dijkstra's algorithm from the center of the grid, returning the
+ * sum of the distances as a checksum. */
+static dbl run_dijkstra(dijkstra_s *d, heap_type_e type) {
+  int n = d->n, N = n*n;
+
+  for (int l = 0; l < N; ++l) {
+    d->dist[l] = INFINITY;
+    d->pos[l] = NO_INDEX;
+    d->state[l] = FAR;
+  }
+
+  heap_s *heap;
+  heap_alloc(&heap);
+  heap_init(heap, type, 16, value, setpos, d);
+  if (type == HEAP_TYPE_BUCKET)
+    heap_set_bucket_width(heap, 1); /* the smallest edge weight */
+
+  int l0 = n*(n/2) + n/2;
+  d->dist[l0] = 0;
+  d->state[l0] = TRIAL;
+  heap_insert(heap, l0);
+
+  dbl checksum = 0;
+  while (heap_size(heap) > 0) {
+    l0 = heap_front(heap);
+    heap_pop(heap);
+    d->state[l0] = VALID;
+    checksum += d->dist[l0];
+
+    int i0 = l0/n, j0 = l0%n;
+    for (int k = 0; k < 8; ++k) {
+      int i = i0 + di[k], j = j0 + dj[k];
+      if (i < 0 || i >= n || j < 0 || j >= n)
+        continue;
+      int l = n*i + j;
+      if (d->state[l] == VALID)
+        continue;
+      dbl dist = d->dist[l0] + d->weight[8*l0 + k];
+      if (dist >= d->dist[l])
+        continue;
+      d->dist[l] = dist;
+      if (d->state[l] == FAR) {
+        d->state[l] = TRIAL;
+        heap_insert(heap, l);
+      } else {
+        heap_swim(heap, d->pos[l]);
+      }
+    }
+  }
+
+  heap_deinit(heap);
+  heap_dealloc(&heap);
+
+  return checksum;
+}
+
+static void bench_dijkstra(int n, int num_trials) {
+  dijkstra_s d = {.n = n};
+  d.dist = malloc(n*n*sizeof(dbl));
+  d.weight = malloc(8*n*n*sizeof(dbl));
+  d.pos = malloc(n*n*sizeof(int));
+  d.state = malloc(n*n*sizeof(state_e));
+
+  srand(0);
+  for (int l = 0; l < 8*n*n; ++l)
+    d.weight[l] = 1 + (dbl)rand()/RAND_MAX;
+
+  printf("dijkstra (n = %d):\n", n);
+  for (heap_type_e type = HEAP_TYPE_BINARY; type <= HEAP_TYPE_BUCKET; ++type) {
+    dbl checksum = 0;
+    toc();
+    for (int trial = 0; trial < num_trials; ++trial)
+      checksum = run_dijkstra(&d, type);
+    dbl t = toc()/num_trials;
+    printf("- %-6s: %0.4gs [checksum = %0.17g]\n",
+           heap_type_name[type], t, checksum);
+  }
+
+  free(d.dist);
+  free(d.weight);
+  free(d.pos);
+  free(d.state);
+}
+
+static jet22t get_jet_gt(dbl x, dbl y) {
+  dbl r = sqrt(x*x + y*y);
+  dbl rx = x/r, ry = y/r;
+  return (jet22t) {
+    .f = r,
+    .Df = {rx, ry},
+    .D2f = {
+      {(1 - rx*rx)/r, -ry*rx/r},
+      {-rx*ry/r, (1 - ry*ry)/r}
+    }
+  };
+}
+
+/* Solve for a point source at the origin, with the nodes in a disk of
+ * radius `rfac` initialized from the exact solution. Returns the sum
+ * of the eikonal as a checksum. */
+static dbl run_eik2g1(grid2_s const *grid, heap_type_e type, dbl rfac) {
+  eik2g1_s *eik;
+  eik2g1_alloc(&eik);
+  eik2g1_init(eik, grid, type);
+
+  dbl2 xy;
+  int2 ind, ind_nb;
+
+  for (size_t l = 0; l < grid2_nind(grid); ++l) {
+    grid2_l2xy(grid, l, xy);
+    if (dbl2_norm(xy) < rfac) {
+      grid2_l2ind(grid, l, ind);
+      eik2g1_add_valid(eik, ind, get_jet_gt(xy[0], xy[1]));
+    }
+  }
+
+  for (size_t l = 0; l < grid2_nind(grid); ++l) {
+    grid2_l2ind(grid, l, ind);
+    if (!eik2g1_is_valid(eik, ind))
+      continue;
+    for (int k = 0; k < 8; ++k) {
+      ind_nb[0] = ind[0] + di[k];
+      ind_nb[1] = ind[1] + dj[k];
+      if (!grid2_isind(grid, ind_nb) || !eik2g1_is_far(eik, ind_nb))
+        continue;
+      grid2_l2xy(grid, grid2_ind2l(grid, ind_nb), xy);
+      eik2g1_add_trial(eik, ind_nb, get_jet_gt(xy[0], xy[1]));
+    }
+  }
+
+  eik2g1_solve(eik);
+
+  dbl checksum = 0;
+  jet21t const *jet = eik2g1_get_jet_ptr(eik);
+  for (size_t l = 0; l < grid2_nind(grid); ++l)
+    checksum += jet[l].f;
+
+  eik2g1_deinit(eik);
+  eik2g1_dealloc(&eik);
+
+  return checksum;
+}
+
+static void bench_eik2g1(int n, int num_trials) {
+  grid2_s grid = {
+    .shape = {n, n},
+    .xymin = {-1, -1},
+    .h = 2.0/(n - 1),
+    .order = ORDER_ROW_MAJOR
+  };
+
+  printf("eik2g1 (n = %d):\n", n);
+  for (heap_type_e type = HEAP_TYPE_BINARY; type <= HEAP_TYPE_BUCKET; ++type) {
+    dbl checksum = 0;
+    toc();
+    for (int trial = 0; trial < num_trials; ++trial)
+      checksum = run_eik2g1(&grid, type, 0.1);
+    dbl t = toc()/num_trials;
+    printf("- %-6s: %0.4gs [checksum = %0.17g]\n",
+           heap_type_name[type], t, checksum);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: %s <n> [num_trials]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int n = atoi(argv[1]);
+  int num_trials = argc == 3 ? atoi(argv[2]) : 1;
+
+  bench_dijkstra(n, num_trials);
+  bench_eik2g1(n, num_trials);
+
+  return EXIT_SUCCESS;
+}
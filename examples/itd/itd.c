@@ -2,7 +2,7 @@
 #include <string.h>
 
 #include <jmm/bmesh.h>
-#include <jmm/eik3.h>
+#include <jmm/eik3_batch.h>
 #include <jmm/mesh3.h>
 
 static void
@@ -33,6 +33,7 @@ int main(int argc, char const *argv[]) {
   size_t num_el = atoi(argv[1]);
   size_t num_az = 2*num_el;
   dbl r_grid = 500; // mm
+  size_t num_threads = 2;
 
   char const *off_path = argv[2];
 
@@ -62,30 +63,37 @@ int main(int argc, char const *argv[]) {
   /* Set up tetrahedron mesh */
   mesh3_s *mesh;
   mesh3_alloc(&mesh);
-  mesh3_init(mesh, &data, true, &eps);
+  mesh3_init(mesh, &data, true, true, &eps);
 
   /* Write vertices and cells to disk in row-major order */
   mesh3_dump_verts(mesh, "verts.bin");
   mesh3_dump_cells(mesh, "cells.bin");
 
-  /* Solve the eikonal equation for the left ear */
-  eik3_s *eik_L;
-  eik3_alloc(&eik_L);
-  eik3_init(eik_L, mesh, &SFUNC_CONSTANT);
-  eik3_add_pt_src_bcs(eik_L, xsrc_L, rfac);
-  eik3_solve(eik_L);
-  eik3_dump_jet(eik_L, "jet_L.bin");
-
-  /* Solve the eikonal equation for the right ear */
-  eik3_s *eik_R;
-  eik3_alloc(&eik_R);
-  eik3_init(eik_R, mesh, &SFUNC_CONSTANT);
-  eik3_add_pt_src_bcs(eik_R, xsrc_R, rfac);
-  eik3_solve(eik_R);
-  eik3_dump_jet(eik_R, "jet_R.bin");
-
-  jet31t const *jet_L = eik3_get_jet_ptr(eik_L);
-  jet31t const *jet_R = eik3_get_jet_ptr(eik_R);
+  /* Solve the eikonal equation for both ears at once */
+  dbl3 xsrc[2] = {
+    {xsrc_L[0], xsrc_L[1], xsrc_L[2]},
+    {xsrc_R[0], xsrc_R[1], xsrc_R[2]}
+  };
+  dbl rfacs[2] = {rfac, rfac};
+
+  eik3_batch_s *batch;
+  eik3_batch_alloc(&batch);
+  eik3_batch_init(batch, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY,
+                  2, xsrc, rfacs, num_threads);
+  eik3_batch_solve(batch);
+
+  jet31t const *jet_L = eik3_batch_get_jet_ptr(batch, 0);
+  jet31t const *jet_R = eik3_batch_get_jet_ptr(batch, 1);
+
+  FILE *fp = NULL;
+
+  fp = fopen("jet_L.bin", "wb");
+  fwrite(jet_L, sizeof(jet31t), mesh3_nverts(mesh), fp);
+  fclose(fp);
+
+  fp = fopen("jet_R.bin", "wb");
+  fwrite(jet_R, sizeof(jet31t), mesh3_nverts(mesh), fp);
+  fclose(fp);
 
   /* Set up tetrahedral spline interpolating jet data for left ear */
   bmesh33_s *tau_L;
@@ -97,34 +105,47 @@ int main(int argc, char const *argv[]) {
   bmesh33_alloc(&tau_R);
   bmesh33_init_from_mesh3_and_jets(tau_R, mesh, jet_R);
 
-  FILE *fp = NULL;
-
-  fp = fopen("itd_grid.bin", "wb");
+  /* Evaluate the eikonals on the grid. Adjacent points in azimuth
+   * are stored next to each other so that locating each point is
+   * cheap. */
+  size_t num_points = num_el*num_az;
+  dbl3 *points = malloc(num_points*sizeof(dbl3));
   for (size_t i = 0; i < num_el; ++i) {
     dbl el = theta_grid[i];
     for (size_t j = 0; j < num_az; ++j) {
       dbl az = phi_grid[j];
-      dbl3 point = {cos(az)*sin(el), sin(az)*sin(el), cos(el)};
-      dbl3_dbl_mul_inplace(point, r_grid);
-      dbl T_L = bmesh33_f(tau_L, point)/c;
-      dbl T_R = bmesh33_f(tau_R, point)/c;
-      dbl itd = T_R - T_L;
-      fwrite(&itd, sizeof(dbl), 1, fp);
+      dbl *point = points[i*num_az + j];
+      point[0] = r_grid*cos(az)*sin(el);
+      point[1] = r_grid*sin(az)*sin(el);
+      point[2] = r_grid*cos(el);
     }
   }
+
+  dbl *T_L = malloc(num_points*sizeof(dbl));
+  bmesh33_f_many(tau_L, num_points, points, T_L, num_threads);
+
+  dbl *T_R = malloc(num_points*sizeof(dbl));
+  bmesh33_f_many(tau_R, num_points, points, T_R, num_threads);
+
+  fp = fopen("itd_grid.bin", "wb");
+  for (size_t i = 0; i < num_points; ++i) {
+    dbl itd = (T_R[i] - T_L[i])/c;
+    fwrite(&itd, sizeof(dbl), 1, fp);
+  }
   fclose(fp);
 
+  free(points);
+  free(T_L);
+  free(T_R);
+
   bmesh33_deinit(tau_R);
   bmesh33_dealloc(&tau_R);
 
   bmesh33_deinit(tau_L);
   bmesh33_dealloc(&tau_L);
 
-  eik3_deinit(eik_L);
-  eik3_dealloc(&eik_L);
-
-  eik3_deinit(eik_R);
-  eik3_dealloc(&eik_R);
+  eik3_batch_deinit(batch);
+  eik3_batch_dealloc(&batch);
 
   mesh3_deinit(mesh);
   mesh3_dealloc(&mesh);
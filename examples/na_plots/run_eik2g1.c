@@ -100,7 +100,7 @@ int main(int argc, char *argv[]) {
 
   eik2g1_s *eik;
   eik2g1_alloc(&eik);
-  eik2g1_init(eik, &grid);
+  eik2g1_init(eik, &grid, HEAP_TYPE_BINARY);
 
   dbl2 xy;
   int2 ind, ind_nb;
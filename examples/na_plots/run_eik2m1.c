@@ -38,7 +38,7 @@ int main(int argc, char *argv[]) {
 
   eik2m1_s *eik;
   eik2m1_alloc(&eik);
-  eik2m1_init(eik, mesh);
+  eik2m1_init(eik, mesh, HEAP_TYPE_BINARY);
 
   dbl2 xy;
 
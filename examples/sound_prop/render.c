@@ -7,6 +7,7 @@
 #include <jmm/array.h>
 #include <jmm/bmesh.h>
 #include <jmm/camera.h>
+#include <jmm/framesink.h>
 #include <jmm/mesh2.h>
 #include <jmm/mesh3.h>
 #include <jmm/rtree.h>
@@ -25,6 +26,9 @@ enum long_opts {
   LONG_OPT_FRAMES_PER_METER,
   LONG_OPT_VERTS_PATH,
   LONG_OPT_CELLS_PATH,
+  LONG_OPT_FORMAT,
+  LONG_OPT_CONTAINER_PATH,
+  LONG_OPT_BACKGROUND,
 };
 
 static struct argp_option options[] = {
@@ -42,6 +46,15 @@ static struct argp_option options[] = {
    "Path to binary file with vertices (default: \"verts.bin\")", 0},
   {"cells_path", LONG_OPT_CELLS_PATH, "CELLS_PATH", OPTION_ARG_OPTIONAL,
    "Path to binary file with vertices (default: \"cells.bin\")", 0},
+  {"format", LONG_OPT_FORMAT, "FORMAT", OPTION_ARG_OPTIONAL,
+   "Pixel format of the frames: one of \"dbl4\", \"rgba8\", or "
+   "\"rgba16\" (default: \"dbl4\")", 0},
+  {"container_path", LONG_OPT_CONTAINER_PATH, "CONTAINER_PATH",
+   OPTION_ARG_OPTIONAL,
+   "Append the frames to a single container file instead of writing "
+   "\"imageXXXX.bin\"", 0},
+  {"background", LONG_OPT_BACKGROUND, 0, OPTION_ARG_OPTIONAL,
+   "Write frames using a background thread", 0},
   {0}
 };
 
@@ -53,6 +66,9 @@ typedef struct render_spec {
   dbl frames_per_meter;
   char *verts_path;
   char *cells_path;
+  framesink_format_e format;
+  char *container_path;
+  bool background;
   array_s *branch_path_arr;
 } render_spec_s;
 
@@ -86,6 +102,24 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
     spec->cells_path = malloc(n + 1);
     strncpy(spec->cells_path, arg, n + 1);
     break;
+  case LONG_OPT_FORMAT:
+    if (!strcmp(arg, "dbl4"))
+      spec->format = FRAMESINK_FORMAT_DBL4;
+    else if (!strcmp(arg, "rgba8"))
+      spec->format = FRAMESINK_FORMAT_RGBA8;
+    else if (!strcmp(arg, "rgba16"))
+      spec->format = FRAMESINK_FORMAT_RGBA16;
+    else
+      argp_usage(state);
+    break;
+  case LONG_OPT_CONTAINER_PATH:
+    n = strlen(arg);
+    spec->container_path = malloc(n + 1);
+    strncpy(spec->container_path, arg, n + 1);
+    break;
+  case LONG_OPT_BACKGROUND:
+    spec->background = true;
+    break;
   case ARGP_KEY_ARG:
     n = strlen(arg);
     branch_path = malloc(n + 1);
@@ -104,6 +138,19 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
 
 static struct argp argp = {options, parse_opt, args_doc, doc, 0, 0, 0};
 
+/* Find the first intersection of `ray` with either the surface of the
+ * domain or the level sets of the eikonals at `tau`. */
+static void intersect_scene(rtree_s const *surf_rtree,
+                            rtree_s const *level_rtree, ray3 const *ray,
+                            dbl tau, isect *hit, robj_s const *skip_robj) {
+  rtree_intersect(surf_rtree, ray, hit, skip_robj);
+
+  isect level_hit;
+  rtree_intersect_at_level(level_rtree, ray, tau, &level_hit, skip_robj);
+  if (level_hit.t < hit->t)
+    *hit = level_hit;
+}
+
 int main(int argc, char *argv[]) {
   int code = EXIT_SUCCESS;
 
@@ -114,7 +161,10 @@ int main(int argc, char *argv[]) {
     .t1 = NAN,
     .frames_per_meter = 23.98,
     .verts_path = NULL,
-    .cells_path = NULL
+    .cells_path = NULL,
+    .format = FRAMESINK_FORMAT_DBL4,
+    .container_path = NULL,
+    .background = false
   };
 
   array_alloc(&spec.branch_path_arr);
@@ -147,7 +197,7 @@ int main(int argc, char *argv[]) {
 
   mesh3_s *mesh;
   mesh3_alloc(&mesh);
-  mesh3_init(mesh, &data, true, &eps);
+  mesh3_init(mesh, &data, true, false, &eps);
 
   array_s *bmesh_arr;
   array_alloc(&bmesh_arr);
@@ -225,29 +275,42 @@ int main(int argc, char *argv[]) {
   for (size_t i = 0; i < num_frames; ++i)
     tau[i] = tau0 + i/spec.frames_per_meter;
 
+  /* The surface and the eikonals' level sets are each put into an
+   * R-tree once. Each frame just queries `level_rtree` at a different
+   * level. */
+  rtree_s *surf_rtree;
+  rtree_alloc(&surf_rtree);
+  rtree_init(surf_rtree, 16, RTREE_SPLIT_STRATEGY_SAH_BINNED);
+  rtree_insert_mesh2(surf_rtree, surface_mesh);
+  rtree_build(surf_rtree);
+
+  rtree_s *level_rtree;
+  rtree_alloc(&level_rtree);
+  rtree_init(level_rtree, 16, RTREE_SPLIT_STRATEGY_SAH_BINNED);
+  for (size_t j = 0; j < array_size(bmesh_arr); ++j) {
+    bmesh33_s *bmesh;
+    array_get(bmesh_arr, j, &bmesh);
+    rtree_insert_bmesh33(level_rtree, bmesh);
+  }
+  rtree_build(level_rtree);
+
+  framesink_s *sink;
+  framesink_alloc(&sink);
+  jmm_error_e error = spec.container_path ?
+    framesink_init(sink, FRAMESINK_TYPE_CONTAINER, spec.container_path,
+                   spec.format, camera.dim, spec.background) :
+    framesink_init(sink, FRAMESINK_TYPE_FILES, "image", spec.format,
+                   camera.dim, spec.background);
+  if (error != JMM_ERROR_NONE) {
+    code = EXIT_FAILURE;
+    num_frames = 0;
+  }
+
   for (size_t i = 0; i < num_frames; ++i) {
     if (spec.verbose)
       printf("frame %lu/%lu (tau = %g m)\n", i + 1, num_frames, tau[i]);
 
-    rtree_s *rtree;
-    rtree_alloc(&rtree);
-    rtree_init(rtree, 16, RTREE_SPLIT_STRATEGY_SURFACE_AREA);
-
-    rtree_insert_mesh2(rtree, surface_mesh);
-
-    array_s *level_bmesh_arr;
-    array_alloc(&level_bmesh_arr);
-    array_init(level_bmesh_arr, sizeof(bmesh33_s *), ARRAY_DEFAULT_CAPACITY);
-
-    for (size_t j = 0; j < array_size(bmesh_arr); ++j) {
-      bmesh33_s *bmesh;
-      array_get(bmesh_arr, j, &bmesh);
-      bmesh33_s *level_bmesh = bmesh33_restrict_to_level(bmesh, tau[i]);
-      rtree_insert_bmesh33(rtree, level_bmesh);
-      array_append(level_bmesh_arr, &level_bmesh);
-    }
-
-    rtree_build(rtree);
+    dbl level = tau[i];
 
     size_t npix = camera.dim[0]*camera.dim[1];
 
@@ -264,7 +327,7 @@ int main(int argc, char *argv[]) {
         ray3 ray = camera_get_ray_for_index(&camera, i, j);
 
         isect isect;
-        rtree_intersect(rtree, &ray, &isect, NULL);
+        intersect_scene(surf_rtree, level_rtree, &ray, level, &isect, NULL);
 
         img[l][0] = 0;
         img[l][1] = 0;
@@ -302,23 +365,26 @@ int main(int argc, char *argv[]) {
             bmesh33_cell_s const *bmesh33_cell = robj_data;
             dbl spread_interp, org_interp;
 
-            /* Figure out which level mesh this cell belongs to :-( */
+            /* Figure out which bmesh this cell belongs to :-( */
             size_t k;
-            for (k = 0; k < array_size(level_bmesh_arr); ++k) {
-              bmesh33_s *level_bmesh;
-              array_get(level_bmesh_arr, k, &level_bmesh);
-              if (bmesh33_cell->bmesh == level_bmesh)
+            for (k = 0; k < array_size(bmesh_arr); ++k) {
+              bmesh33_s *bmesh;
+              array_get(bmesh_arr, k, &bmesh);
+              if (bmesh33_cell->bmesh == bmesh)
                 break;
             }
-            assert(k < array_size(level_bmesh_arr));
+            assert(k < array_size(bmesh_arr));
+
+            size_t lc = bmesh33_get_parent_cell(bmesh33_cell->bmesh,
+                                                bmesh33_cell->l);
 
             dbl const *spread;
             array_get(spread_arr, k, &spread);
-            spread_interp = mesh3_linterp(mesh, spread, ray.org);
+            spread_interp = mesh3_linterp_in_cell(mesh, spread, lc, ray.org);
 
             dbl const *org;
             array_get(org_arr, k, &org);
-            org_interp = mesh3_linterp(mesh, org, ray.org);
+            org_interp = mesh3_linterp_in_cell(mesh, org, lc, ray.org);
 
             // Convert the interpolated spreading factor to dB
             dbl spread_dB = 20*log10(fmax(1e-16, spread_interp));
@@ -358,35 +424,39 @@ int main(int argc, char *argv[]) {
            * NOTE: if we have multiple overlapping intersections, we
            * might trip them repeatedly, so we need to skip any
            * intersections with a distance of zero here. */
-          rtree_intersect(rtree, &ray, &isect, isect.obj);
+          intersect_scene(surf_rtree, level_rtree, &ray, level, &isect,
+                          isect.obj);
           while (isect.t < EPS) {
             dbl3_saxpy_inplace(EPS, ray.dir, ray.org);
-            rtree_intersect(rtree, &ray, &isect, isect.obj);
+            intersect_scene(surf_rtree, level_rtree, &ray, level, &isect,
+                            isect.obj);
           }
         }
       }
     }
 
-    char filename[128];
-    snprintf(filename, 128, "image%04lu.bin", i);
+    error = framesink_write(sink, img, tau[i]);
 
-    FILE *fp = fopen(filename, "wb");
-    fwrite(img, sizeof(dbl4), npix, fp);
-    fclose(fp);
+    free(img);
 
-    for (size_t i = 0; i < array_size(level_bmesh_arr); ++i) {
-      bmesh33_s *level_bmesh;
-      array_get(level_bmesh_arr, i, &level_bmesh);
-      bmesh33_deinit(level_bmesh);
-      bmesh33_dealloc(&level_bmesh);
+    if (error != JMM_ERROR_NONE) {
+      code = EXIT_FAILURE;
+      break;
     }
-    array_deinit(level_bmesh_arr);
-    array_dealloc(&level_bmesh_arr);
-
-    rtree_deinit(rtree);
-    rtree_dealloc(&rtree);
   }
 
+  /* Frames written in the background or the container's index may
+   * still fail to be written */
+  if (framesink_deinit(sink) != JMM_ERROR_NONE)
+    code = EXIT_FAILURE;
+  framesink_dealloc(&sink);
+
+  rtree_deinit(level_rtree);
+  rtree_dealloc(&level_rtree);
+
+  rtree_deinit(surf_rtree);
+  rtree_dealloc(&surf_rtree);
+
   mesh2_deinit(surface_mesh);
   mesh2_dealloc(&surface_mesh);
 
@@ -401,6 +471,7 @@ int main(int argc, char *argv[]) {
 
   if (spec.verts_path != NULL) free(spec.verts_path);
   if (spec.cells_path != NULL) free(spec.cells_path);
+  if (spec.container_path != NULL) free(spec.container_path);
 
   for (size_t i = 0; i < array_size(spec.branch_path_arr); ++i) {
     char *branch_path;
@@ -71,7 +71,7 @@ int main(int argc, char *argv[]) {
 
   mesh3_s *mesh;
   mesh3_alloc(&mesh);
-  mesh3_init(mesh, &data, true, &eps);
+  mesh3_init(mesh, &data, true, true, &eps);
 
   rect3 bbox;
   mesh3_get_bbox(mesh, &bbox);
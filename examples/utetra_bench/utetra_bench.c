@@ -0,0 +1,223 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <jmm/eik3.h>
+#include <jmm/mesh3.h>
+#include <jmm/utetra.h>
+#include <jmm/util.h>
+#include <jmm/vec.h>
+
+/* Compare the constant slowness tetrahedron update solver selected by
+ * `utetra_solve` with the general surrogate loop in
+ * `utetra_solve_generic`, and with solving the same updates in
+ * batches using `utetra_solve_batch`.
+ *
+ * The updates come from a point source problem on a Kuhn
+ * triangulation of [-1, 1]^3 with n intervals per side: once it's
+ * solved, every vertex of every cell is updated from the opposite
+ * face of that cell. Each update is solved with each solver, and the
+ * time taken and the largest differences between the values and
+ * minimizers found are reported. */
+
+static void make_kuhn_mesh(int n, mesh3_data_s *data) {
+  static size_t const perm[6][3] = {
+    {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+  };
+
+  size_t m = n + 1;
+  size_t num_cubes = n*n*n;
+
+  data->nverts = m*m*m;
+  data->verts = malloc(data->nverts*sizeof(dbl3));
+  for (size_t i = 0; i < m; ++i)
+    for (size_t j = 0; j < m; ++j)
+      for (size_t k = 0; k < m; ++k) {
+        dbl *x = data->verts[(i*m + j)*m + k];
+        x[0] = -1 + 2.0*i/n;
+        x[1] = -1 + 2.0*j/n;
+        x[2] = -1 + 2.0*k/n;
+      }
+
+  data->ncells = 6*num_cubes;
+  data->cells = malloc(data->ncells*sizeof(uint4));
+  size_t lc = 0;
+  for (size_t i = 0; i < m - 1; ++i)
+    for (size_t j = 0; j < m - 1; ++j)
+      for (size_t k = 0; k < m - 1; ++k)
+        for (size_t p = 0; p < 6; ++p) {
+          size_t ind[3] = {i, j, k};
+          data->cells[lc][0] = (ind[0]*m + ind[1])*m + ind[2];
+          for (size_t q = 0; q < 3; ++q) {
+            ++ind[perm[p][q]];
+            data->cells[lc][q + 1] = (ind[0]*m + ind[1])*m + ind[2];
+          }
+          ++lc;
+        }
+}
+
+typedef struct {
+  size_t lhat;
+  uint3 l;
+} update_s;
+
+static size_t get_updates(eik3_s const *eik, update_s *update) {
+  mesh3_s const *mesh = eik3_get_mesh(eik);
+
+  utetra_s *utetra;
+  utetra_alloc(&utetra);
+
+  size_t num_updates = 0;
+  for (size_t lc = 0; lc < mesh3_ncells(mesh); ++lc) {
+    uint4 cv;
+    mesh3_cv(mesh, lc, cv);
+    for (size_t i = 0; i < 4; ++i) {
+      update_s *u = &update[num_updates];
+      u->lhat = cv[i];
+      bool finite = true;
+      for (size_t j = 0, k = 0; j < 4; ++j) {
+        if (j == i)
+          continue;
+        u->l[k++] = cv[j];
+        jet31t jet = eik3_get_jet(eik, cv[j]);
+        finite = finite && jet31t_is_finite(&jet);
+      }
+      /* Skip updates from the vertex at the point source */
+      if (!finite)
+        continue;
+      utetra_init(utetra, eik, u->lhat, u->l);
+      if (!utetra_is_degenerate(utetra) && !utetra_is_backwards(utetra, eik))
+        ++num_updates;
+    }
+  }
+
+  utetra_dealloc(&utetra);
+
+  return num_updates;
+}
+
+typedef enum solver {
+  SOLVER_CONSTANT,
+  SOLVER_GENERIC,
+  SOLVER_BATCH,
+  NUM_SOLVERS
+} solver_e;
+
+/* The number of updates passed to each call to `utetra_solve_batch` */
+#define NUM_BATCH 16
+
+static void solve_updates(eik3_s const *eik, update_s const *update,
+                          size_t num_updates, solver_e solver,
+                          dbl *f, dbl (*lam)[2]) {
+  utetra_s *utetra[NUM_BATCH];
+  for (size_t j = 0; j < NUM_BATCH; ++j)
+    utetra_alloc(&utetra[j]);
+
+  dbl const *lam0[NUM_BATCH] = {NULL};
+
+  for (size_t i = 0; i < num_updates; i += NUM_BATCH) {
+    size_t n = num_updates - i < NUM_BATCH ? num_updates - i : NUM_BATCH;
+
+    for (size_t j = 0; j < n; ++j)
+      utetra_init(utetra[j], eik, update[i + j].lhat, update[i + j].l);
+
+    if (solver == SOLVER_BATCH)
+      utetra_solve_batch(utetra, lam0, n);
+    else if (solver == SOLVER_GENERIC)
+      for (size_t j = 0; j < n; ++j)
+        utetra_solve_generic(utetra[j], NULL);
+    else
+      for (size_t j = 0; j < n; ++j)
+        utetra_solve(utetra[j], NULL);
+
+    for (size_t j = 0; j < n; ++j) {
+      f[i + j] = utetra_get_value(utetra[j]);
+      par3_s par = utetra_get_parent(utetra[j]);
+      lam[i + j][0] = par.b[1];
+      lam[i + j][1] = par.b[2];
+    }
+  }
+
+  for (size_t j = 0; j < NUM_BATCH; ++j)
+    utetra_dealloc(&utetra[j]);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: %s <n> [num_trials]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  int n = atoi(argv[1]);
+  int num_trials = argc == 3 ? atoi(argv[2]) : 1;
+
+  mesh3_data_s data;
+  make_kuhn_mesh(n, &data);
+
+  mesh3_s *mesh;
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, true, true, NULL);
+
+  eik3_s *eik;
+  eik3_alloc(&eik);
+  eik3_init(eik, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
+
+  dbl3 xsrc = {0, 0, 0};
+  eik3_add_pt_src_bcs(eik, xsrc, 0.3);
+  eik3_solve(eik);
+
+  update_s *update = malloc(4*mesh3_ncells(mesh)*sizeof(update_s));
+  size_t num_updates = get_updates(eik, update);
+
+  dbl *f[NUM_SOLVERS], (*lam[NUM_SOLVERS])[2];
+  for (size_t k = 0; k < NUM_SOLVERS; ++k) {
+    f[k] = malloc(num_updates*sizeof(dbl));
+    lam[k] = malloc(num_updates*sizeof(dbl[2]));
+  }
+
+  printf("utetra_solve (n = %d, %lu updates):\n", n, num_updates);
+
+  char const *name[NUM_SOLVERS] = {
+    [SOLVER_CONSTANT] = "constant",
+    [SOLVER_GENERIC] = "generic",
+    [SOLVER_BATCH] = "batch"
+  };
+  for (size_t k = 0; k < NUM_SOLVERS; ++k) {
+    toc();
+    for (int trial = 0; trial < num_trials; ++trial)
+      solve_updates(eik, update, num_updates, k, f[k], lam[k]);
+    dbl t = toc()/num_trials;
+    printf("- %-8s: %0.4gs (%0.3g us/update)\n",
+           name[k], t, 1e6*t/num_updates);
+  }
+
+  for (size_t k = SOLVER_GENERIC; k < NUM_SOLVERS; ++k) {
+    dbl max_df = 0, max_dlam = 0;
+    size_t num_lower = 0;
+    for (size_t i = 0; i < num_updates; ++i) {
+      max_df = fmax(max_df, fabs(f[SOLVER_CONSTANT][i] - f[k][i]));
+      max_dlam = fmax(max_dlam, dbl2_dist(lam[SOLVER_CONSTANT][i], lam[k][i]));
+      num_lower += f[SOLVER_CONSTANT][i] < f[k][i];
+    }
+    printf("- max |f_constant - f_%s| = %0.3g\n", name[k], max_df);
+    printf("- max |lam_constant - lam_%s| = %0.3g\n", name[k], max_dlam);
+    printf("- constant solver found a lower value for %lu updates\n",
+           num_lower);
+  }
+
+  for (size_t k = 0; k < NUM_SOLVERS; ++k) {
+    free(f[k]);
+    free(lam[k]);
+  }
+  free(update);
+
+  eik3_deinit(eik);
+  eik3_dealloc(&eik);
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  mesh3_data_deinit(&data);
+
+  return EXIT_SUCCESS;
+}
@@ -87,7 +87,7 @@ int main(int argc, char *argv[]) {
 
   mesh3_s *mesh;
   mesh3_alloc(&mesh);
-  mesh3_init(mesh, &data, true, &spec.eps);
+  mesh3_init(mesh, &data, true, false, &spec.eps);
 
   if (spec.verbose) {
     rect3 bbox;
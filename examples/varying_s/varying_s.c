@@ -133,7 +133,7 @@ int main(int argc, char *argv[]) {
 
   mesh3_s *mesh;
   mesh3_alloc(&mesh);
-  mesh3_init(mesh, &data, true, &eps);
+  mesh3_init(mesh, &data, true, true, &eps);
 
   printf("average edge length = %g\n", mesh3_get_mean_edge_length(mesh));
 
@@ -152,7 +152,7 @@ int main(int argc, char *argv[]) {
   /* Solve the eikonal equation */
   eik3_s *eik;
   eik3_alloc(&eik);
-  eik3_init(eik, mesh, &sfunc);
+  eik3_init(eik, mesh, &sfunc, HEAP_TYPE_BINARY);
   eik3_add_pt_src_bcs(eik, spec.xsrc, spec.rfac);
   eik3_solve(eik);
   eik3_dump_jet(eik, "jet_T.bin");
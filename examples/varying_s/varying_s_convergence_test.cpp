@@ -134,7 +134,7 @@ mesh3_s *tetrahedralize_cube(dbl maxvol, dbl3 const xsrc) {
 
   mesh3_s *mesh;
   mesh3_alloc(&mesh);
-  mesh3_init(mesh, &data, true, NULL);
+  mesh3_init(mesh, &data, true, true, NULL);
 
   /* Make sure the point source is actually included in the mesh! */
   assert(mesh3_has_vertex(mesh, addin.pointlist));
@@ -190,7 +190,9 @@ int main(int argc, char *argv[]) {
   /* Set up the slowness functions */
   sfunc_s sfunc = {
     .stype = STYPE_FUNC_PTR,
-    .funcs = {.s = s, .Ds = Ds, .D2s = D2s}
+    .funcs = {.s = s, .Ds = Ds, .D2s = D2s},
+    .data_jet31t = nullptr,
+    .s_min = 0
   };
 
   mesh3_s *mesh = tetrahedralize_cube(spec.maxvol, xsrc);
@@ -204,7 +206,7 @@ int main(int argc, char *argv[]) {
   /* Solve the eikonal equation */
   eik3_s *eik;
   eik3_alloc(&eik);
-  eik3_init(eik, mesh, &sfunc);
+  eik3_init(eik, mesh, &sfunc, HEAP_TYPE_BINARY);
   eik3_add_pt_src_bcs(eik, xsrc, spec.rfac);
   eik3_solve(eik);
   eik3_dump_jet(eik, "jet_T.bin");
@@ -24,6 +24,8 @@ void *array_get_ptr(array_s const *arr, size_t i);
 void array_delete(array_s *arr, size_t i);
 void array_delete_all(array_s *arr, array_s const *i_arr);
 void array_pop_front(array_s *arr, void *elt);
+void array_pop_back(array_s *arr, void *elt);
+void array_clear(array_s *arr);
 void array_sort(array_s *arr, compar_t cmp);
 
 #ifdef __cplusplus
@@ -17,6 +17,9 @@ struct bmesh33_cell {
   dbl level;
 };
 
+bool bmesh33_cell_intersect_on_interval(bmesh33_cell_s const *cell,
+                                        dbl const s[2], dbl4 const b[2],
+                                        dbl *t);
 bool bmesh33_cell_intersect(bmesh33_cell_s const *cell, ray3 const *ray, dbl *t);
 void bmesh33_cell_Df(bmesh33_cell_s const *cell, dbl3 const x, dbl3 Df);
 bool bmesh33_cell_equal(bmesh33_cell_s const *c1, bmesh33_cell_s const *c2);
@@ -29,9 +32,16 @@ void bmesh33_deinit(bmesh33_s *bmesh);
 size_t bmesh33_num_cells(bmesh33_s const *bmesh);
 dbl bmesh33_get_level(bmesh33_s const *bmesh);
 mesh3_s const *bmesh33_get_mesh_ptr(bmesh33_s const *bmesh);
+mesh3_s const *bmesh33_get_parent_mesh_ptr(bmesh33_s const *bmesh);
+size_t bmesh33_get_parent_cell(bmesh33_s const *bmesh, size_t l);
 bmesh33_s *bmesh33_restrict_to_level(bmesh33_s const *bmesh, dbl level);
 bmesh33_cell_s bmesh33_get_cell(bmesh33_s const *bmesh, size_t l);
 dbl bmesh33_f(bmesh33_s const *bmesh, dbl3 const x);
+void bmesh33_Df(bmesh33_s const *bmesh, dbl3 const x, dbl3 Df);
+void bmesh33_f_many(bmesh33_s const *bmesh, size_t n, dbl3 const *x, dbl *f,
+                    size_t num_threads);
+void bmesh33_Df_many(bmesh33_s const *bmesh, size_t n, dbl3 const *x,
+                     dbl3 *Df, size_t num_threads);
 bb33 *bmesh33_get_bb_ptr(bmesh33_s const *bmesh, size_t lc);
 
 #ifdef __cplusplus
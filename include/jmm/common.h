@@ -12,11 +12,15 @@ typedef struct edgemap edgemap_s;
 typedef struct eik2g1 eik2g1_s;
 typedef struct eik2m1 eik2m1_s;
 typedef struct eik3 eik3_s;
+typedef struct eik3_batch eik3_batch_s;
 typedef struct eik31m eik31m_s;
+typedef struct eik3dd eik3dd_s;
 typedef struct eik3hh eik3hh_s;
 typedef struct eik3hh_branch eik3hh_branch_s;
+typedef struct eik3hh_branch_preview eik3hh_branch_preview_s;
 typedef struct field2 field2_s;
 typedef struct field3 field3_s;
+typedef struct framesink framesink_s;
 typedef struct grid3 grid3_s;
 typedef struct mesh1 mesh1_s;
 typedef struct mesh2 mesh2_s;
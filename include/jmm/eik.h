@@ -18,7 +18,8 @@ typedef struct eik eik_s;
 
 void eik_alloc(eik_s **eik);
 void eik_dealloc(eik_s **eik);
-void eik_init(eik_s *eik, field2_s const *slow, grid2_s const *grid);
+void eik_init(eik_s *eik, field2_s const *slow, grid2_s const *grid,
+              heap_type_e heap_type);
 void eik_deinit(eik_s *eik);
 size_t eik_peek(eik_s const *eik);
 void eik_step(eik_s *eik);
@@ -6,12 +6,13 @@ extern "C" {
 
 #include "common.h"
 #include "grid2.h"
+#include "heap.h"
 #include "jet.h"
 #include "par.h"
 
 void eik2g1_alloc(eik2g1_s **eik);
 void eik2g1_dealloc(eik2g1_s **eik);
-void eik2g1_init(eik2g1_s *eik, grid2_s const *grid);
+void eik2g1_init(eik2g1_s *eik, grid2_s const *grid, heap_type_e heap_type);
 void eik2g1_deinit(eik2g1_s *eik);
 size_t eik2g1_peek(eik2g1_s const *eik);
 size_t eik2g1_step(eik2g1_s *eik);
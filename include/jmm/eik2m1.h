@@ -5,13 +5,14 @@ extern "C" {
 #endif
 
 #include "common.h"
+#include "heap.h"
 #include "mesh22.h"
 #include "jet.h"
 #include "par.h"
 
 void eik2m1_alloc(eik2m1_s **eik);
 void eik2m1_dealloc(eik2m1_s **eik);
-void eik2m1_init(eik2m1_s *eik, mesh22_s const *mesh);
+void eik2m1_init(eik2m1_s *eik, mesh22_s const *mesh, heap_type_e heap_type);
 void eik2m1_deinit(eik2m1_s *eik);
 size_t eik2m1_peek(eik2m1_s const *eik);
 size_t eik2m1_step(eik2m1_s *eik);
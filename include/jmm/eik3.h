@@ -8,6 +8,7 @@ extern "C" {
 #include "bb.h"
 #include "common.h"
 #include "error.h"
+#include "heap.h"
 #include "jet.h"
 #include "par.h"
 #include "slow.h"
@@ -16,7 +17,8 @@ extern "C" {
 
 void eik3_alloc(eik3_s **eik);
 void eik3_dealloc(eik3_s **eik);
-void eik3_init(eik3_s *eik, mesh3_s const *mesh, sfunc_s const *sfunc);
+void eik3_init(eik3_s *eik, mesh3_s const *mesh, sfunc_s const *sfunc,
+               heap_type_e heap_type);
 void eik3_deinit(eik3_s *eik);
 bool eik3_is_initialized(eik3_s const *eik);
 
@@ -41,6 +43,8 @@ bool eik3_is_trial(eik3_s const *eik, size_t ind);
 bool eik3_is_valid(eik3_s const *eik, size_t ind);
 size_t eik3_num_trial(eik3_s const *eik);
 size_t eik3_num_valid(eik3_s const *eik);
+size_t eik3_num_utetra_skipped(eik3_s const *eik);
+size_t eik3_num_utri_skipped(eik3_s const *eik);
 
 mesh3_s const *eik3_get_mesh(eik3_s const *eik);
 array_s const *eik3_get_trial_inds(eik3_s const *eik);
@@ -87,6 +91,10 @@ void eik3_prop_A(eik3_s const *eik, dbl33 const *D2T, dbl *A);
 void eik3_get_t_in(eik3_s const *eik, dbl3 *t_in);
 void eik3_get_t_out(eik3_s const *eik, dbl3 *t_out);
 
+#if JMM_TEST
+void eik3_set_skip_updates(eik3_s *eik, bool skip_updates);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "error.h"
+#include "heap.h"
+#include "jet.h"
+#include "slow.h"
+
+/* Solve for many point sources on the same mesh at once.
+ *
+ * Each source is solved by its own `eik3` instance, and the solves
+ * are spread over a pool of threads. The mesh and the slowness
+ * function are shared by every solve and must not be modified while
+ * `eik3_batch_solve` is running. The jets are stored contiguously:
+ * the jet at node `l` for source `i` is at index `i*nverts + l`. */
+
+void eik3_batch_alloc(eik3_batch_s **batch);
+void eik3_batch_dealloc(eik3_batch_s **batch);
+void eik3_batch_init(eik3_batch_s *batch, mesh3_s const *mesh,
+                     sfunc_s const *sfunc, heap_type_e heap_type,
+                     size_t num_srcs, dbl3 const *xsrc, dbl const *rfac,
+                     size_t num_threads);
+void eik3_batch_deinit(eik3_batch_s *batch);
+jmm_error_e eik3_batch_solve(eik3_batch_s *batch);
+size_t eik3_batch_num_srcs(eik3_batch_s const *batch);
+size_t eik3_batch_num_threads(eik3_batch_s const *batch);
+jmm_error_e eik3_batch_get_error(eik3_batch_s const *batch, size_t i);
+jet31t const *eik3_batch_get_jet_ptr(eik3_batch_s const *batch, size_t i);
+jet31t const *eik3_batch_get_jets_ptr(eik3_batch_s const *batch);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "error.h"
+#include "jet.h"
+#include "slow.h"
+
+/* A parallel version of `eik3` based on domain decomposition.
+ *
+ * The mesh is split into subdomains, each of which is padded with a
+ * few layers of ghost cells and solved by its own `eik3` instance.
+ * The solver then proceeds in rounds. In each round, every subdomain
+ * whose ghost nodes have received smaller values of T from their
+ * owners is re-solved, using those jets as `TRIAL` data. The
+ * subdomains in a round are solved in parallel. This stops when no
+ * ghost node's value of T decreases by more than `tol`. */
+
+void eik3dd_alloc(eik3dd_s **dd);
+void eik3dd_dealloc(eik3dd_s **dd);
+void eik3dd_init(eik3dd_s *dd, mesh3_s const *mesh, sfunc_s const *sfunc,
+                 size_t num_subdomains, size_t num_threads);
+void eik3dd_deinit(eik3dd_s *dd);
+void eik3dd_add_pt_src_bcs(eik3dd_s *dd, dbl3 const xsrc, dbl rfac);
+jmm_error_e eik3dd_solve(eik3dd_s *dd, dbl tol);
+size_t eik3dd_num_subdomains(eik3dd_s const *dd);
+size_t eik3dd_num_threads(eik3dd_s const *dd);
+size_t eik3dd_num_rounds(eik3dd_s const *dd);
+size_t eik3dd_get_owner(eik3dd_s const *dd, size_t l);
+dbl eik3dd_get_T(eik3dd_s const *dd, size_t l);
+jet31t eik3dd_get_jet(eik3dd_s const *dd, size_t l);
+jet31t const *eik3dd_get_jet_ptr(eik3dd_s const *dd);
+
+#ifdef __cplusplus
+}
+#endif
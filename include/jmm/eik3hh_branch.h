@@ -2,6 +2,8 @@
 
 #include "array.h"
 #include "camera.h"
+#include "error.h"
+#include "framesink.h"
 #include "grid2.h"
 
 typedef enum eik3hh_branch_type {
@@ -31,7 +33,30 @@ void eik3hh_branch_dump_spread(eik3hh_branch_s const *branch, char const *path);
 void eik3hh_branch_dump_xy_slice(eik3hh_branch_s const *branch,
                                  grid2_to_mesh3_mapping_s const *mapping,
                                  field_e field, char const *path);
-void eik3hh_branch_render_frames(eik3hh_branch_s const *branch,
-                                 camera_s const *camera,
-                                 dbl t0, dbl t1, dbl frame_rate,
-                                 bool verbose);
+jmm_error_e eik3hh_branch_render_frames(eik3hh_branch_s const *branch,
+                                        camera_s const *camera,
+                                        dbl t0, dbl t1, dbl frame_rate,
+                                        framesink_s *sink, size_t num_threads,
+                                        bool verbose);
+void eik3hh_branch_preview_alloc(eik3hh_branch_preview_s **preview);
+void eik3hh_branch_preview_dealloc(eik3hh_branch_preview_s **preview);
+void eik3hh_branch_preview_init(eik3hh_branch_preview_s *preview,
+                                eik3hh_branch_s const *branch,
+                                size_t stride, size_t num_threads);
+void eik3hh_branch_preview_deinit(eik3hh_branch_preview_s *preview);
+void eik3hh_branch_preview_begin(eik3hh_branch_preview_s *preview,
+                                 camera_s const *camera, dbl T);
+bool eik3hh_branch_preview_refine(eik3hh_branch_preview_s *preview);
+void eik3hh_branch_preview_finish(eik3hh_branch_preview_s *preview);
+void eik3hh_branch_preview_get_image(eik3hh_branch_preview_s const *preview,
+                                     dbl4 *img);
+size_t eik3hh_branch_preview_get_num_traced(
+  eik3hh_branch_preview_s const *preview);
+
+#if JMM_TEST
+size_t eik3hh_branch_render_frame(eik3hh_branch_s const *branch,
+                                  camera_s const *camera, dbl T, bool cached,
+                                  dbl4 *img);
+bool eik3hh_branch_preview_is_sampled(eik3hh_branch_preview_s const *preview,
+                                      size_t i, size_t j);
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "common.h"
+#include "error.h"
+
+/* A destination for rendered frames (e.g., by
+ * `eik3hh_branch_render_frames`). Each frame is an image with `dim[0]`
+ * rows and `dim[1]` columns of RGBA pixels, given as `dbl4`s, which
+ * are written either as is or quantized to 8 or 16 bits per channel.
+ *
+ * Frames can be written to one file per frame, or appended to a
+ * single container file. If `background` is set when the sink is
+ * initialized, frames are written by a separate thread, so that
+ * writing a frame overlaps with rendering the next one. */
+
+typedef enum framesink_format {
+  /* Four doubles per pixel, as rendered. */
+  FRAMESINK_FORMAT_DBL4,
+
+  /* Each channel is clamped to [0, 1] and quantized to a `uint8_t` or
+   * `uint16_t`. */
+  FRAMESINK_FORMAT_RGBA8,
+  FRAMESINK_FORMAT_RGBA16
+} framesink_format_e;
+
+typedef enum framesink_type {
+  /* Frame `i` is written to `<path>XXXX.bin`, where `XXXX` is `i`
+   * padded to four digits, with no header. */
+  FRAMESINK_TYPE_FILES,
+
+  /* All frames are written to the container file at `path`. If it
+   * already exists, new frames are appended to it (its format and
+   * dimensions must match). All values are stored in the machine's
+   * byte order. The file consists of:
+   *
+   * - a header: the magic string `FRAMESINK_MAGIC` (8 bytes), the
+   *   version (`uint32_t`), the format (`uint32_t`), and `dim`
+   *   (`uint64_t[2]`),
+   * - the frames, one after the other,
+   * - the index: for each frame, its offset from the start of the
+   *   file (`uint64_t`) and its time (`double`, see
+   *   `framesink_write`),
+   * - a footer: the offset of the index (`uint64_t`), the number of
+   *   frames (`uint64_t`), and `FRAMESINK_MAGIC` again.
+   *
+   * New frames overwrite the index and footer, which are rewritten
+   * when the sink is deinitialized. */
+  FRAMESINK_TYPE_CONTAINER
+} framesink_type_e;
+
+#define FRAMESINK_MAGIC "JMMFRMS"
+#define FRAMESINK_VERSION 1
+
+void framesink_alloc(framesink_s **sink);
+void framesink_dealloc(framesink_s **sink);
+jmm_error_e framesink_init(framesink_s *sink, framesink_type_e type,
+                           char const *path, framesink_format_e format,
+                           size_t const dim[2], bool background);
+jmm_error_e framesink_deinit(framesink_s *sink);
+jmm_error_e framesink_write(framesink_s *sink, dbl4 const *img, dbl time);
+jmm_error_e framesink_flush(framesink_s *sink);
+size_t framesink_get_num_frames(framesink_s const *sink);
+size_t framesink_get_frame_size(framesink_s const *sink);
+size_t const *framesink_get_dim(framesink_s const *sink);
+
+#ifdef __cplusplus
+}
+#endif
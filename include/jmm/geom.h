@@ -48,6 +48,7 @@ typedef struct {
 rect3 tetra3_get_bounding_box(tetra3 const *tetra);
 bool tetra3_contains_point(tetra3 const *tetra, dbl const x[3], dbl const *eps);
 void tetra3_get_bary_coords(tetra3 const *tetra, dbl const x[3], dbl b[4]);
+void tetra3_get_bary_map(tetra3 const *tetra, dbl34 A);
 void tetra3_get_centroid(tetra3 const *tetra, dbl centroid[3]);
 void tetra3_get_point(tetra3 const *tetra, dbl const b[4], dbl x[3]);
 grid2_s tetra3_get_covering_xy_subgrid(tetra3 const *tetra, grid2_s const *grid,
@@ -72,6 +73,7 @@ void rect3_get_extent(rect3 const *rect, dbl extent[3]);
 void rect3_get_centroid(rect3 const *rect, dbl centroid[3]);
 void rect3_get_half_extent(rect3 const *rect, dbl half_extent[3]);
 void rect3_insert_point(rect3 *rect, dbl const x[3]);
+void rect3_insert_rect3(rect3 *rect, rect3 const *other);
 void rect3_insert_tri3(rect3 *rect, tri3 const *tri);
 void rect3_insert_tetra3(rect3 *rect, tetra3 const *tetra);
 void rect3_insert_mesh2_tri(rect3 *rect, mesh2_tri_s const *tri);
@@ -88,6 +90,8 @@ dbl ray3_intersect_rect3(ray3 const *ray, rect3 const *rect);
 bool ray3_intersects_mesh3_tetra(ray3 const *ray, mesh3_tetra_s const *tetra, dbl *t);
 bool ray3_intersects_tri3(ray3 const *ray, tri3 const *tri, dbl *t);
 bool ray3_intersects_tetra3(ray3 const *ray, tetra3 const *tetra, dbl *t);
+bool ray3_clip_to_bary_map(ray3 const *ray, dbl34 const A, dbl s[2],
+                           dbl4 b[2]);
 bool ray3_and_tri3_are_parallel(ray3 const *ray, tri3 const *tri);
 dbl ray3_closest_point_on_line(ray3 const *ray, line3 const *line,
                                dbl *t_ray, dbl *t_line);
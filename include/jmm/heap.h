@@ -8,19 +8,45 @@ extern "C" {
 
 typedef struct heap heap_s;
 
+/* Which priority queue layout to use:
+ *
+ * - `HEAP_TYPE_BINARY` is a binary heap which stores only node
+ *   indices, calling `value` each time it compares two nodes.
+ *
+ * - `HEAP_TYPE_4ARY` is a 4-ary heap which stores each node's key
+ *   next to its index. `value` is only called when a node is
+ *   inserted or swum, which is when its key may have changed. Since
+ *   it's shallower and siblings are contiguous in memory, it touches
+ *   fewer cache lines when sinking.
+ *
+ * - `HEAP_TYPE_BUCKET` sorts nodes into buckets of keys with a fixed
+ *   width (see `heap_set_bucket_width`), which costs O(1) per insert
+ *   and decrease-key. Only the nodes in the current bucket are kept
+ *   in a 4-ary heap, so the order nodes are popped in is still
+ *   exact. A node waiting in a later bucket has a negative position
+ *   other than `NO_INDEX`, which should be passed to `heap_swim` like
+ *   any other position. */
+typedef enum heap_type {
+  HEAP_TYPE_BINARY,
+  HEAP_TYPE_4ARY,
+  HEAP_TYPE_BUCKET
+} heap_type_e;
+
 typedef dbl (*value_f)(void *, int);
 typedef void (*setpos_f)(void *, int, int);
 
 void heap_alloc(heap_s **heap);
 void heap_dealloc(heap_s **heap);
-void heap_init(heap_s *heap, int capacity, value_f value, setpos_f setpos,
-               void *context);
+void heap_init(heap_s *heap, heap_type_e type, int capacity, value_f value,
+               setpos_f setpos, void *context);
 void heap_deinit(heap_s *heap);
+void heap_set_bucket_width(heap_s *heap, dbl width);
 void heap_insert(heap_s *heap, int ind);
 void heap_swim(heap_s *heap, int ind);
 int heap_front(heap_s *heap);
 void heap_pop(heap_s *heap);
 int heap_size(heap_s *heap);
+heap_type_e heap_get_type(heap_s const *heap);
 
 #ifdef __cplusplus
 }
@@ -49,7 +49,11 @@ error_e mesh3_data_insert_vert(mesh3_data_s *data, dbl3 const x, dbl eps);
 
 void mesh3_alloc(mesh3_s **mesh);
 void mesh3_dealloc(mesh3_s **mesh);
-void mesh3_init(mesh3_s *mesh, mesh3_data_s const *data, bool compute_bd_info, dbl const *eps);
+void mesh3_init(mesh3_s *mesh, mesh3_data_s const *data, bool compute_bd_info,
+                bool compute_topology, dbl const *eps);
+void mesh3_init_submesh(mesh3_s *submesh, mesh3_s const *mesh,
+                        size_t nverts, size_t const *l,
+                        size_t ncells, size_t const *lc);
 void mesh3_deinit(mesh3_s *mesh);
 dbl3 const *mesh3_get_verts_ptr(mesh3_s const *mesh);
 size_t const *mesh3_get_cells_ptr(mesh3_s const *mesh);
@@ -67,15 +71,20 @@ void mesh3_get_cell_bbox(mesh3_s const *mesh, size_t i, rect3 *bbox);
 bool mesh3_cell_contains_point(mesh3_s const *mesh, size_t i, dbl const x[3]);
 bool mesh3_contains_ball(mesh3_s const *mesh, dbl3 const x, dbl r);
 size_t mesh3_find_cell_containing_point(mesh3_s const *mesh, dbl const x[3], size_t lc);
+size_t mesh3_walk_to_point(mesh3_s const *mesh, dbl3 const x, size_t lc);
 bool mesh3_contains_point(mesh3_s const *mesh, dbl3 const x);
 int mesh3_nvc(mesh3_s const *mesh, size_t i);
 void mesh3_vc(mesh3_s const *mesh, size_t i, size_t *vc);
+size_t const *mesh3_get_vc_ptr(mesh3_s const *mesh, size_t i, size_t *nvc);
 int mesh3_nve(mesh3_s const *mesh, size_t lv);
 void mesh3_ve(mesh3_s const *mesh, size_t lv, size_t (*ve)[2]);
+uint2 const *mesh3_get_ve_ptr(mesh3_s const *mesh, size_t lv, size_t *nve);
 int mesh3_nvf(mesh3_s const *mesh, size_t i);
 void mesh3_vf(mesh3_s const *mesh, size_t i, size_t (*vf)[3]);
+size_t const *mesh3_get_vf_ptr(mesh3_s const *mesh, size_t i, size_t *nvf);
 int mesh3_nvv(mesh3_s const *mesh, size_t i);
 void mesh3_vv(mesh3_s const *mesh, size_t i, size_t *vv);
+size_t const *mesh3_get_vv_ptr(mesh3_s const *mesh, size_t i, size_t *nvv);
 int mesh3_ncc(mesh3_s const *mesh, size_t i);
 void mesh3_cc(mesh3_s const *mesh, size_t i, size_t *cc);
 void mesh3_cf(mesh3_s const *mesh, size_t lc, size_t lf[4][3]);
@@ -95,6 +104,10 @@ bool mesh3_ccfv(mesh3_s const *mesh, size_t lc, size_t const lf[3],
                 size_t *lv_out);
 bool mesh3_cvf(mesh3_s const *mesh, size_t lc, size_t lv, size_t lf[3]);
 bool mesh3_has_bd_info(mesh3_s const *mesh);
+bool mesh3_has_topology(mesh3_s const *mesh);
+size_t mesh3_nfaces(mesh3_s const *mesh);
+void mesh3_get_face(mesh3_s const *mesh, size_t i, uint3 lf);
+size_t mesh3_get_face_index(mesh3_s const *mesh, uint3 const lf);
 bool *mesh3_get_bdc_ptr(mesh3_s *mesh);
 bool mesh3_bdc(mesh3_s const *mesh, size_t i);
 bool *mesh3_get_bdv_ptr(mesh3_s *mesh);
@@ -155,6 +168,8 @@ void mesh3_dump_cells(mesh3_s const *mesh, char const *path);
 bool mesh3_has_vertex(mesh3_s const *mesh, dbl3 const x);
 size_t mesh3_get_vert_index(mesh3_s const *mesh, dbl3 const x);
 dbl mesh3_linterp(mesh3_s const *mesh, dbl const *values, dbl3 const x);
+dbl mesh3_linterp_in_cell(mesh3_s const *mesh, dbl const *values, size_t lc,
+                          dbl3 const x);
 dbl mesh3_diam_2approx(mesh3_s const *mesh, size_t l);
 dbl mesh3_diam_2approx_rand(mesh3_s const *mesh, size_t trials, size_t const *seed);
 dbl mesh3_get_diam(mesh3_s const *mesh);
@@ -39,9 +39,41 @@ typedef struct {
 } isect;
 
 typedef enum rtree_split_strategy {
-  RTREE_SPLIT_STRATEGY_SURFACE_AREA
+  RTREE_SPLIT_STRATEGY_SURFACE_AREA,
+  RTREE_SPLIT_STRATEGY_SAH_BINNED
 } rtree_split_strategy_e;
 
+/**
+ * The number of bins in `rtree_stats_s.leaf_size_hist`.
+ */
+#define RTREE_LEAF_SIZE_HIST_SIZE 8
+
+/**
+ * Statistics describing the quality of an R-tree, which can be used
+ * to compare split strategies.
+ */
+typedef struct {
+  size_t num_nodes;
+  size_t num_leaves;
+  size_t depth;
+
+  /**
+   * The expected cost of intersecting a ray with the R-tree under the
+   * surface area heuristic, in units of the cost of intersecting a
+   * single object. This assumes that a ray which hits the root's
+   * bounding box hits each node's bounding box with probability
+   * proportional to its surface area.
+   */
+  dbl sah_cost;
+
+  /**
+   * Entry `k` is the number of leaves holding between `2^k` and
+   * `2^(k + 1) - 1` objects. The first bin also counts empty leaves
+   * and the last bin counts all larger leaves.
+   */
+  size_t leaf_size_hist[RTREE_LEAF_SIZE_HIST_SIZE];
+} rtree_stats_s;
+
 /**
  * A "static" R-tree, in the sense that all contained objects must be
  * inserted before constructing the R-tree. Once the R-tree is
@@ -55,18 +87,58 @@ void rtree_dealloc(rtree_s **rtree);
 void rtree_init(rtree_s *rtree, size_t leaf_thresh,
                 rtree_split_strategy_e split_strategy);
 void rtree_deinit(rtree_s *rtree);
+void rtree_set_num_threads(rtree_s *rtree, size_t num_threads);
 rtree_s *rtree_copy(rtree_s const *rtree);
+
+/**
+ * Insert each element of a mesh into `rtree`. All objects must be
+ * inserted before `rtree_build` is called. Inserting into an R-tree
+ * which has already been built frees the flat arrays used for
+ * intersection queries (so `rtree_build` has to be called again
+ * before the next query), and asserts if the root has already been
+ * split (i.e., if more than `leaf_thresh` objects were inserted).
+ */
 void rtree_insert_bmesh33(rtree_s *rtree, bmesh33_s const *bmesh);
 void rtree_insert_mesh2(rtree_s *rtree, mesh2_s const *mesh);
 void rtree_insert_mesh3(rtree_s *rtree, mesh3_s const *mesh);
+
+/**
+ * Split the objects inserted into `rtree` into a tree of nodes, and
+ * flatten the tree into the arrays which the intersection queries
+ * traverse.
+ */
 void rtree_build(rtree_s *rtree);
 rect3 rtree_get_bbox(rtree_s const *rtree);
 size_t rtree_get_num_leaf_nodes(rtree_s const *rtree);
+void rtree_get_stats(rtree_s const *rtree, rtree_stats_s *stats);
 bool rtree_query_bbox(rtree_s const *rtree, rect3 const *bbox);
+
+/**
+ * Find the first object hit by `ray`, ignoring `skip_robj` (which may
+ * be `NULL`). If nothing is hit, `isect->t` is `INFINITY` and
+ * `isect->obj` is `NULL`. This and the other intersection queries
+ * below traverse the flattened tree, so `rtree_build` must be called
+ * after the last insertion and before the first query (this is
+ * checked with an assertion).
+ */
 void rtree_intersect(rtree_s const *rtree, ray3 const *ray, isect *isect,
                      robj_s const *skip_robj);
+void rtree_intersect_at_level(rtree_s const *rtree, ray3 const *ray, dbl level,
+                              isect *isect, robj_s const *skip_robj);
 void rtree_intersectN(rtree_s const *rtree, ray3 const *ray, size_t n,
                       isect *isects);
+void rtree_intersectN_at_level(rtree_s const *rtree, ray3 const *ray,
+                               size_t n, dbl level, isect *isects);
+
+#if JMM_TEST
+size_t rtree_get_num_flat_nodes(rtree_s const *rtree);
+rect3 rtree_get_flat_node_bbox(rtree_s const *rtree, size_t i);
+bool rtree_get_flat_node_children(rtree_s const *rtree, size_t i,
+                                  size_t ch[2]);
+size_t rtree_get_flat_node_num_objs(rtree_s const *rtree, size_t i);
+robj_s const *rtree_get_flat_node_obj(rtree_s const *rtree, size_t i,
+                                      size_t k);
+#endif
 
 #ifdef __cplusplus
 }
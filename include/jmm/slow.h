@@ -26,6 +26,11 @@ typedef struct sfunc {
     void (*D2s)(dbl3 x, dbl33 D2s);
   } funcs;
   jet31t *data_jet31t;
+
+  /* A lower bound for the slowness (for `STYPE_FUNC_PTR`), which is
+   * used to skip updates that can't improve on a node's current
+   * value. Leave this zero if no bound is known. */
+  dbl s_min;
 } sfunc_s;
 
 static sfunc_s const SFUNC_CONSTANT = {
@@ -34,7 +39,9 @@ static sfunc_s const SFUNC_CONSTANT = {
     .s = NULL,
     .Ds = NULL,
     .D2s = NULL
-  }
+  },
+  .data_jet31t = NULL,
+  .s_min = 0
 };
 
 #ifdef __cplusplus
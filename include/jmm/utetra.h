@@ -16,7 +16,11 @@ void utetra_alloc(utetra_s **cf);
 void utetra_dealloc(utetra_s **cf);
 void utetra_init(utetra_s *u, eik3_s const *eik, size_t lhat, uint3 const l);
 bool utetra_is_degenerate(utetra_s const *u);
+dbl utetra_get_lower_bound(utetra_s const *u);
+bool utetra_get_warm_start(utetra_s const *u, dbl lam[2]);
 void utetra_solve(utetra_s *cf, dbl const *lam);
+void utetra_solve_generic(utetra_s *u, dbl const *lam);
+void utetra_solve_batch(utetra_s **u, dbl const **lam, size_t n);
 dbl utetra_get_value(utetra_s const *cf);
 void utetra_get_jet31t(utetra_s const *cf, jet31t *jet);
 bool utetra_has_interior_point_solution(utetra_s const *cf);
@@ -38,9 +42,7 @@ bool utetras_have_same_minimizer(utetra_s const *u1, utetra_s const *u2);
 bool utetras_have_same_inds(utetra_s const *u1, utetra_s const *u2);
 
 #if JMM_TEST
-void utetra_step(utetra_s *u);
 void utetra_get_lambda(utetra_s const *u, dbl lam[2]);
-void utetra_set_lambda(utetra_s *u, dbl const lam[2]);
 size_t utetra_get_num_iter(utetra_s const *u);
 #endif
 
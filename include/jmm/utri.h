@@ -25,6 +25,7 @@ size_t utri_get_active_ind(utri_s const *utri);
 size_t utri_get_inactive_ind(utri_s const *utri);
 size_t utri_get_l(utri_s const *utri);
 bool utri_is_degenerate(utri_s const *u);
+dbl utri_get_lower_bound(utri_s const *u);
 bool utri_has_inds(utri_s const *u, size_t lhat, uint2 const l);
 
 bool utris_have_same_inds(utri_s const *u1, utri_s const *u2);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "array.h"
 #include "utri.h"
 
 #ifdef __cplusplus
@@ -15,7 +16,7 @@ void utri_cache_deinit(utri_cache_s *cache);
 bool utri_cache_contains_utri(utri_cache_s const *cache, utri_s const *utri);
 bool utri_cache_contains_inds(utri_cache_s const *cache, size_t lhat, uint2 l);
 utri_s *utri_cache_pop(utri_cache_s *cache, utri_s const *utri);
-void utri_cache_purge(utri_cache_s *cache, size_t l);
+void utri_cache_purge(utri_cache_s *cache, size_t l, array_s *purged);
 bool utri_cache_try_add_unique(utri_cache_s *cache, utri_s *utri);
 
 #ifdef __cplusplus
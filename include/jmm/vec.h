@@ -103,6 +103,7 @@ void dbl3_zero(dbl3 u);
 bool dbl4_is_rgba(dbl4 const u);
 bool dbl4_nonneg(dbl4 const u);
 bool dbl4_valid_bary_coord(dbl4 const b);
+size_t dbl4_argmin(dbl4 const u);
 dbl dbl4_dist(dbl4 const u, dbl4 const v);
 dbl dbl4_dot(dbl4 const u, dbl4 const v);
 dbl dbl4_norm(dbl4 const u);
@@ -105,6 +105,17 @@ void array_pop_front(array_s *arr, void *elt) {
   array_delete(arr, 0);
 }
 
+void array_pop_back(array_s *arr, void *elt) {
+  assert(arr->size > 0);
+  array_get(arr, arr->size - 1, elt);
+  --arr->size;
+}
+
+/* Remove all elements from `arr` without releasing its storage. */
+void array_clear(array_s *arr) {
+  arr->size = 0;
+}
+
 void array_sort(array_s *arr, compar_t cmp) {
   qsort(arr->data, arr->size, arr->eltsize, cmp);
 }
@@ -6,132 +6,95 @@
 
 #include <jmm/bb.h>
 #include <jmm/geom.h>
-#include <jmm/hybrid.h>
 #include <jmm/mat.h>
 #include <jmm/mesh3.h>
 #include <jmm/util.h>
 
-bool bmesh33_cell_intersect(bmesh33_cell_s const *cell, ray3 const *ray, dbl *t) {
+#include "macros.h"
+#include "parallel.h"
+
+/* Intersect `ray` with the level set of `cell` on the interval `[s[0],
+ * s[1]]` of ray parameters, where `b[0]` and `b[1]` are the
+ * barycentric coordinates of the endpoints of the interval (e.g., as
+ * computed by `ray3_clip_to_bary_map`). The Bezier tetra is
+ * restricted to a cubic along the interval, which is checked using
+ * its Bernstein coefficients before its roots are computed. */
+bool bmesh33_cell_intersect_on_interval(bmesh33_cell_s const *cell,
+                                        dbl const s[2], dbl4 const b[2],
+                                        dbl *t) {
   dbl const atol = 1e-13;
 
-  // TODO: this a first draft... can definitely be
-  // simplified/optimized/otherwise improved.
+  dbl4 b0, b1;
+  dbl4_copy(b[0], b0);
+  dbl4_copy(b[1], b1);
+
+  // If the ray grazes the tetrahedron, the interval collapses to a
+  // point, and we just check whether the Bezier tetra equals `level`
+  // there.
+  if (dbl4_dist(b0, b1) < atol) {
+    bool hit = fabs(bb33_f(cell->bb, b0) - cell->level) < atol;
+    if (hit)
+      *t = s[0];
+    return hit;
+  }
 
-  mesh3_tetra_s tetra = {cell->mesh, cell->l};
+  cubic_s cubic = bb33_restrict_along_interval(cell->bb, b0, b1);
+  cubic_add_constant(&cubic, -cell->level);
 
-  dbl t0, t1, x0[3], x1[3], b0[4], b1[4];
-
-  /**
-   * The first thing we need to do is define the interval which we're
-   * going to try to intersect with the level set.
-   *
-   * We try to shoot two rays, since a ray can intersect a tetrahedron
-   * in at most two points. If the first ray escapes, we missed. If
-   * the second ray (shot from just beyond the first intersection)
-   * misses, then we know that [0, t0] is our interval (in this case,
-   * we verify that r(0) is inside the tetrahedron---if it isn't, we
-   * get another case that we have to handle separately). Otherwise,
-   * [t0, t1] is our interval.
-   */
-  if (!ray3_intersects_mesh3_tetra(ray, &tetra, &t0))
+  /* The cubic lies in the convex hull of its Bernstein coefficients
+   * on [0, 1]. If they all have the same sign, there's no root, so
+   * we can skip the cubic solve. This is the common case, since most
+   * tetrahedra which a ray passes through only bracket `level` at
+   * their vertices. */
+  dbl const *a = cubic.a;
+  dbl c[4] = {
+    a[0],
+    a[0] + a[1]/3,
+    a[0] + (2*a[1] + a[2])/3,
+    a[0] + a[1] + a[2] + a[3]
+  };
+  dbl cmin, cmax;
+  dblN_minmax(c, 4, &cmin, &cmax);
+  if (cmin > 0 || cmax < 0)
     return false;
 
-  ray3_get_point(ray, t0, x0);
-
-  bool overlap[4];
-  int face_inds[4][3] = {{0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3}};
-  tri3 tetra_face[4];
-  for (int i = 0; i < 4; ++i) {
-    tetra_face[i] = mesh3_tetra_get_face(&tetra, face_inds[i]);
-    overlap[i] = tri3_contains_point(&tetra_face[i], x0);
-  }
-
-  t1 = INFINITY;
-  for (int i = 0; i < 4; ++i) {
-    if (overlap[i]) continue;
-    dbl tmp;
-    if (ray3_intersects_tri3(ray, &tetra_face[i], &tmp))
-      t1 = fmin(tmp, t1);
-  }
-
-  // If `t1` is infinity, we either grazed the tetrahedron or shot a
-  // ray from inside the tetrahedron (or from its boundary). First we
-  // set the interval of interest to [0, t0] and then try to handle
-  // special cases early.
-  if (isinf(t1)) {
-    dbl3_copy(x0, x1);
-    dbl3_copy(ray->org, x0);
-
-    t1 = t0;
-    t0 = 0;
-
-    // If `x0` isn't in `tetra` and we only found one intersection
-    // point, then the ray grazed the tetrahedron. We can immediately
-    // check whether we hit the level set by evaluating the Bezier
-    // tetra to check if the ray hit (which is now parametrized by t =
-    // t1) lies on the level set.
-    if (!mesh3_tetra_contains_point(&tetra, x0, &atol)) {
-      mesh3_tetra_get_bary_coords(&tetra, x1, b1);
-      bool hit = fabs(bb33_f(cell->bb, b1) - cell->level) < atol;
-      if (hit)
-        *t = t1;
-      return hit;
-    }
-  } else {
-    ray3_get_point(ray, t1, x1);
-  }
+  dbl root[3] = {INFINITY, INFINITY, INFINITY};
+  int num_roots = cubic_get_real_roots(&cubic, root);
 
-  mesh3_tetra_get_bary_coords(&tetra, x0, b0);
-  mesh3_tetra_get_bary_coords(&tetra, x1, b1);
+  /* Find the first root in [0, 1]. If there isn't one, `lam` is
+   * infinity, which makes `*t` infinite as well. */
+  dbl lam = INFINITY;
+  for (int i = 0; i < num_roots; ++i)
+    if (0 <= root[i] && root[i] <= 1)
+      lam = fmin(lam, root[i]);
 
-  // We should handle this case separately---i.e., just check whether
-  // the Bezier tetrahedron evaluated at the two coincident interval
-  // endpoints equals `level`.
-  if (dbl4_dist(b0, b1) < atol &&
-      fabs(bb33_f(cell->bb, b0) - cell->level) < atol) {
-    *t = t0;
-    return true;
-  }
+  *t = s[0] + lam*(s[1] - s[0]);
 
-  /**
-   * Now we want to use the hybrid rootfinder to check whether f([t0,
-   * t1]) contains `level`.
-   */
-  // TODO: It's probably possible to do this here without appealing to
-  // a hybrid rootfinder but we can look into that later. An idea is
-  // to restrict the Bezier tetra to an interval by pulling out the
-  // data for a univariate cubic, but I'm not sure whether a cubic has
-  // high enough degree to reproduce the 20-param Bezier tetra exactly
-  // or not and too lazy to check right now.
+  return isfinite(*t);
+}
 
-  cubic_s cubic = bb33_restrict_along_interval(cell->bb, b0, b1);
-  cubic_add_constant(&cubic, -cell->level);
+/* Intersect `ray` with the level set of `cell`. We check whether the
+ * cell's Bezier ordinates bracket `level` first, since this rejects
+ * almost every cell without looking at the ray. */
+bool bmesh33_cell_intersect(bmesh33_cell_s const *cell, ray3 const *ray, dbl *t) {
+  dbl const atol = 1e-13;
 
-  dbl root[3] = {INFINITY, INFINITY, INFINITY};
-  int num_roots = cubic_get_real_roots(&cubic, root);
+  dbl fmin_, fmax_;
+  dblN_minmax(cell->bb->c, 20, &fmin_, &fmax_);
+  if (cell->level < fmin_ - atol || fmax_ + atol < cell->level)
+    return false;
 
-  int bad_roots = 0;
-  for (int i = 0; i < num_roots; ++i) {
-    if (root[i] < 0 || 1 < root[i]) {
-      root[i] = INFINITY;
-      ++bad_roots;
-    }
-  }
-  num_roots -= bad_roots;
+  tetra3 tetra = mesh3_get_tetra(cell->mesh, cell->l);
 
-  dbl3_sort(root);
+  dbl34 A;
+  tetra3_get_bary_map(&tetra, A);
 
-  /* Compute `t` as the arc-length distance from the ray origin to the
-   * first intersection with the tetrahedron plus the arc length
-   * distance from `x0` to `xs`, which is just s scaled by
-   * `dbl3_dist(x0, x1)`.
-   *
-   * If we didn't find any roots in the interval [0, 1], root[0] will
-   * be infinity, which will keep *t set to infinity after
-   * returning. */
-  *t = t0 + root[0]*dbl3_dist(x0, x1);
+  dbl s[2];
+  dbl4 b[2];
+  if (!ray3_clip_to_bary_map(ray, A, s, b))
+    return false;
 
-  return isfinite(*t);
+  return bmesh33_cell_intersect_on_interval(cell, s, b, t);
 }
 
 void bmesh33_cell_Df(bmesh33_cell_s const *cell, dbl3 const x, dbl3 Df) {
@@ -144,7 +107,7 @@ void bmesh33_cell_Df(bmesh33_cell_s const *cell, dbl3 const x, dbl3 Df) {
   /* Set up transform matrix. The first three rows of A correspond to
    * the standard directions in R^3, which we use to compute the
    * gradient. */
-  static dbl44 A;
+  dbl44 A;
   size_t lv[4];
   mesh3_cv(cell->mesh, cell->l, lv);
   for (size_t i = 0; i < 4; ++i) {
@@ -177,6 +140,14 @@ struct bmesh33 {
   size_t num_cells;
   bb33 *bb;
   dbl level;
+
+  /* The mesh which the Bezier tetra were originally built on, and
+   * the index of each cell in that mesh. These differ from `mesh` and
+   * the cell's own index for a bmesh restricted to a level set (see
+   * `bmesh33_restrict_to_level`), in which case the cell is a copy of
+   * `parent_cell[l]`. Otherwise, `parent_cell` is `NULL`. */
+  mesh3_s const *parent_mesh;
+  size_t *parent_cell;
 };
 
 void bmesh33_alloc(bmesh33_s **bmesh) {
@@ -200,12 +171,18 @@ void bmesh33_init_from_mesh3_and_jets(bmesh33_s *bmesh, mesh3_s const *mesh,
     bb33_init_from_cell_and_jets(&bmesh->bb[l], mesh, jet, l);
 
   bmesh->level = NAN;
+
+  bmesh->parent_mesh = mesh;
+  bmesh->parent_cell = NULL;
 }
 
 void bmesh33_deinit(bmesh33_s *bmesh) {
   free(bmesh->bb);
   bmesh->bb = NULL;
 
+  free(bmesh->parent_cell);
+  bmesh->parent_cell = NULL;
+
   if (bmesh->mesh_owner) {
     mesh3_deinit((mesh3_s *)bmesh->mesh);
     mesh3_dealloc((mesh3_s **)&bmesh->mesh);
@@ -224,6 +201,22 @@ mesh3_s const *bmesh33_get_mesh_ptr(bmesh33_s const *bmesh) {
   return bmesh->mesh;
 }
 
+/* Get the mesh which `bmesh` was originally built on. This is the
+ * same as `bmesh33_get_mesh_ptr` unless `bmesh` was restricted to a
+ * level set. */
+mesh3_s const *bmesh33_get_parent_mesh_ptr(bmesh33_s const *bmesh) {
+  return bmesh->parent_mesh;
+}
+
+/* Get the index of the cell in the parent mesh (see
+ * `bmesh33_get_parent_mesh_ptr`) which the `l`th cell of `bmesh`
+ * comes from. This lets values defined on the parent mesh be
+ * interpolated at a point in cell `l` without searching for it. */
+size_t bmesh33_get_parent_cell(bmesh33_s const *bmesh, size_t l) {
+  assert(l < bmesh->num_cells);
+  return bmesh->parent_cell ? bmesh->parent_cell[l] : l;
+}
+
 bmesh33_s *bmesh33_restrict_to_level(bmesh33_s const *bmesh, dbl level) {
   // First, precompute which Bezier tetra *might* bracket the
   // level. Since the graph of each Bezier tetra is contained in the
@@ -241,6 +234,8 @@ bmesh33_s *bmesh33_restrict_to_level(bmesh33_s const *bmesh, dbl level) {
 
   bmesh33_s *level_bmesh = malloc(sizeof(bmesh33_s));
   level_bmesh->bb = malloc(num_brack*sizeof(bb33));
+  level_bmesh->parent_mesh = bmesh->parent_mesh;
+  level_bmesh->parent_cell = malloc(num_brack*sizeof(size_t));
 
   dbl3 *verts = malloc(4*num_brack*sizeof(dbl3));
   uint4 *cells = malloc(num_brack*sizeof(uint4));
@@ -254,6 +249,7 @@ bmesh33_s *bmesh33_restrict_to_level(bmesh33_s const *bmesh, dbl level) {
   for (size_t l = 0; l < bmesh->num_cells; ++l) {
     if (!brack[l]) continue;
     level_bmesh->bb[lc] = bmesh->bb[l]; // Copy Bezier tetra data
+    level_bmesh->parent_cell[lc] = bmesh33_get_parent_cell(bmesh, l);
     mesh3_cv(bmesh->mesh, l, cv); // Grab the inds for this cell
     for (int i = 0; i < 4; ++i) {
       mesh3_copy_vert(bmesh->mesh, cv[i], verts[4*lc + i]);
@@ -271,7 +267,7 @@ bmesh33_s *bmesh33_restrict_to_level(bmesh33_s const *bmesh, dbl level) {
   };
 
   mesh3_alloc((mesh3_s **)&level_bmesh->mesh);
-  mesh3_init((mesh3_s *)level_bmesh->mesh, &data, false, &eps);
+  mesh3_init((mesh3_s *)level_bmesh->mesh, &data, false, false, &eps);
 
   level_bmesh->mesh_owner = true;
   level_bmesh->num_cells = mesh3_ncells(level_bmesh->mesh);
@@ -300,16 +296,99 @@ bmesh33_cell_s bmesh33_get_cell(bmesh33_s const *bmesh, size_t l) {
 /* Evaluate `bmesh` at the point `x`. If `x` lies outside the mesh,
  * return `NAN`. */
 dbl bmesh33_f(bmesh33_s const *bmesh, dbl3 const x) {
-  // TODO: very inefficient implementation! Optimize this using rtree.
-  for (size_t l = 0; l < bmesh->num_cells; ++l) {
-    if (mesh3_cell_contains_point(bmesh->mesh, l, x)) {
-      tetra3 tetra = mesh3_get_tetra(bmesh->mesh, l);
+  size_t lc = mesh3_find_cell_containing_point(bmesh->mesh, x, (size_t)NO_INDEX);
+  if (lc == (size_t)NO_INDEX)
+    return NAN;
+  tetra3 tetra = mesh3_get_tetra(bmesh->mesh, lc);
+  dbl4 b;
+  tetra3_get_bary_coords(&tetra, x, b);
+  return bb33_f(&bmesh->bb[lc], b);
+}
+
+void bmesh33_Df(bmesh33_s const *bmesh, dbl3 const x, dbl3 Df) {
+  size_t lc = mesh3_find_cell_containing_point(bmesh->mesh, x, (size_t)NO_INDEX);
+  if (lc == (size_t)NO_INDEX) {
+    dbl3_nan(Df);
+    return;
+  }
+  bmesh33_cell_s cell = bmesh33_get_cell(bmesh, lc);
+  bmesh33_cell_Df(&cell, x, Df);
+}
+
+/** Evaluating at many points: */
+
+/* The points are split up into blocks of this size, each of which is
+ * evaluated by one thread. Within a block, each point is located by
+ * walking from the cell containing the previous point, so points
+ * which are close to each other should be passed in order. */
+#define POINTS_PER_TASK 256
+
+typedef struct eval_context {
+  bmesh33_s const *bmesh;
+  size_t n;
+  dbl3 const *x;
+  dbl *f;
+  dbl3 *Df;
+} eval_context_s;
+
+static void eval_task(void *ptr, size_t i) {
+  eval_context_s *context = (eval_context_s *)ptr;
+  bmesh33_s const *bmesh = context->bmesh;
+
+  size_t lc = (size_t)NO_INDEX;
+
+  size_t j0 = i*POINTS_PER_TASK;
+  size_t j1 = MIN(j0 + POINTS_PER_TASK, context->n);
+  for (size_t j = j0; j < j1; ++j) {
+    dbl const *x = context->x[j];
+
+    size_t lc_next = lc == (size_t)NO_INDEX ?
+      mesh3_find_cell_containing_point(bmesh->mesh, x, (size_t)NO_INDEX) :
+      mesh3_walk_to_point(bmesh->mesh, x, lc);
+
+    if (lc_next == (size_t)NO_INDEX) {
+      if (context->f)
+        context->f[j] = NAN;
+      if (context->Df)
+        dbl3_nan(context->Df[j]);
+      continue;
+    }
+
+    lc = lc_next;
+
+    if (context->f) {
+      tetra3 tetra = mesh3_get_tetra(bmesh->mesh, lc);
       dbl4 b;
       tetra3_get_bary_coords(&tetra, x, b);
-      return bb33_f(&bmesh->bb[l], b);
+      context->f[j] = bb33_f(&bmesh->bb[lc], b);
+    }
+
+    if (context->Df) {
+      bmesh33_cell_s cell = bmesh33_get_cell(bmesh, lc);
+      bmesh33_cell_Df(&cell, x, context->Df[j]);
     }
   }
-  return NAN;
+}
+
+static void eval_many(eval_context_s *context, size_t num_threads) {
+  size_t num_tasks = (context->n + POINTS_PER_TASK - 1)/POINTS_PER_TASK;
+  parallel_for(num_tasks, num_threads, eval_task, context);
+}
+
+/* Evaluate `bmesh` at each of the `n` points in `x`, storing the
+ * results in `f`, using up to `num_threads` threads. Points which
+ * aren't contained in the mesh get the value `NAN`. */
+void bmesh33_f_many(bmesh33_s const *bmesh, size_t n, dbl3 const *x, dbl *f,
+                    size_t num_threads) {
+  eval_context_s context = {.bmesh = bmesh, .n = n, .x = x, .f = f};
+  eval_many(&context, num_threads);
+}
+
+/* Like `bmesh33_f_many`, but evaluate the gradient instead. */
+void bmesh33_Df_many(bmesh33_s const *bmesh, size_t n, dbl3 const *x,
+                     dbl3 *Df, size_t num_threads) {
+  eval_context_s context = {.bmesh = bmesh, .n = n, .x = x, .Df = Df};
+  eval_many(&context, num_threads);
 }
 
 bb33 *bmesh33_get_bb_ptr(bmesh33_s const *bmesh, size_t lc) {
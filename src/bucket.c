@@ -42,9 +42,9 @@ void bucket_dealloc(bucket_s **bucket) {
 
 void bucket_grow(bucket_s *bucket) {
   int *new_l = malloc(2*sizeof(int)*bucket->capacity);
-  for (size_t i = 0, j = 0; i < bucket->size; ++i) {
+  for (size_t i = 0, j = bucket->start; i < bucket->size; ++i) {
     new_l[i] = bucket->l[j];
-    j = (j + 1) % bucket->size;
+    j = (j + 1) % bucket->capacity;
   }
   free(bucket->l);
   bucket->l = new_l;
@@ -71,6 +71,12 @@ int bucket_pop(bucket_s *bucket) {
   return l;
 }
 
+void bucket_clear(bucket_s *bucket) {
+  bucket->size = 0;
+  bucket->start = 0;
+  bucket->stop = 0;
+}
+
 bucket_s *bucket_get_next(bucket_s const *bucket) {
   return bucket->next;
 }
@@ -803,7 +803,8 @@ void eik_dealloc(eik_s **eik) {
 // to allocate an extra margin of cells, since they will never be
 // initialized (i.e., they will never have all of their vertex nodes
 // become VALID because of the margin...)
-void eik_init(eik_s *eik, field2_s const *slow, grid2_s const *grid) {
+void eik_init(eik_s *eik, field2_s const *slow, grid2_s const *grid,
+              heap_type_e heap_type) {
   eik->slow = slow;
   eik->grid = grid;
   eik->ncells = grid2_nindc(grid);
@@ -827,7 +828,7 @@ void eik_init(eik_s *eik, field2_s const *slow, grid2_s const *grid) {
   heap_alloc(&eik->heap);
 
   int capacity = (int) 3*sqrt(eik->nnodes);
-  heap_init(eik->heap, capacity, value, setpos, (void *)eik);
+  heap_init(eik->heap, heap_type, capacity, value, setpos, (void *)eik);
 
   eik->num_accepted = 0;
   eik->accepted = malloc(eik->nnodes*sizeof(size_t));
@@ -40,7 +40,7 @@ void eik2g1_dealloc(eik2g1_s **eik) {
   free(*eik);
 }
 
-void eik2g1_init(eik2g1_s *eik, grid2_s const *grid) {
+void eik2g1_init(eik2g1_s *eik, grid2_s const *grid, heap_type_e heap_type) {
   eik->grid = grid;
 
   grid2info_init(&eik->grid_info, grid);
@@ -60,7 +60,10 @@ void eik2g1_init(eik2g1_s *eik, grid2_s const *grid) {
     eik->pos[i] = NO_INDEX;
 
   heap_alloc(&eik->heap);
-  heap_init(eik->heap,3*sqrt(num_nodes),(value_f)value,(setpos_f)setpos,eik);
+  heap_init(eik->heap, heap_type, 3*sqrt(num_nodes), (value_f)value,
+            (setpos_f)setpos, eik);
+  if (heap_type == HEAP_TYPE_BUCKET)
+    heap_set_bucket_width(eik->heap, grid->h);
 
   eik->par = malloc(num_nodes*sizeof(par2_s));
   for (size_t i = 0; i < num_nodes; ++i)
@@ -38,7 +38,7 @@ void eik2m1_dealloc(eik2m1_s **eik) {
   free(*eik);
 }
 
-void eik2m1_init(eik2m1_s *eik, mesh22_s const *mesh) {
+void eik2m1_init(eik2m1_s *eik, mesh22_s const *mesh, heap_type_e heap_type) {
   eik->mesh = mesh;
 
   size_t nverts = mesh22_nverts(eik->mesh);
@@ -56,7 +56,8 @@ void eik2m1_init(eik2m1_s *eik, mesh22_s const *mesh) {
     eik->pos[l] = NO_INDEX;
 
   heap_alloc(&eik->heap);
-  heap_init(eik->heap, 3*sqrt(nverts), (value_f)value, (setpos_f)setpos, eik);
+  heap_init(eik->heap, heap_type, 3*sqrt(nverts), (value_f)value,
+            (setpos_f)setpos, eik);
 
   eik->par = malloc(nverts*sizeof(par2_s));
   for (size_t l = 0; l < nverts; ++l)
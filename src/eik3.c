@@ -27,6 +27,10 @@
 
 #include "log.h"
 #include "macros.h"
+#include "pool.h"
+#include "ukernel.h"
+
+#define SCRATCH_INITIAL_CAPACITY 4096
 
 static bool l_OK(size_t l) {
   return l != (size_t)NO_INDEX;
@@ -48,6 +52,7 @@ static bool is_face(uint3 const l) {
 struct eik3 {
   mesh3_s const *mesh;
   sfunc_s const *sfunc;
+  ukernel_s const *kernel;
 
   jet31t *jet;
   state_e *state;
@@ -55,6 +60,13 @@ struct eik3 {
   par3_s *par;
   heap_s *heap;
 
+  /* While `update_neighbors` is running, `adjust` only records which
+   * `TRIAL` nodes had their values change, and each of them is swum
+   * once before `update_neighbors` returns. */
+  bool defer_adjust;
+  bool *is_adjusted;
+  array_s *adjusted;
+
   /* In some cases, we'll skip old updates that might be useful at a
    * later stage. We keep track of them here. */
   utetra_cache_s *utetra_cache;
@@ -65,8 +77,26 @@ struct eik3 {
 
   array_s *trial_inds, *bc_inds;
 
+  /* Updates which are no longer needed are put back here instead of
+   * being freed, and are reused by later updates. Together with
+   * `scratch`, this keeps `eik3_step` from touching the heap once the
+   * solver has warmed up. */
+  array_s *utetra_pool, *utri_pool;
+  uline_s *uline;
+
+  /* Scratch memory for the index buffers used while updating a
+   * node. It's reset at the start of each call to `update`. */
+  pool_s *scratch;
+
+  /* Whether to skip updates which can't improve on a node's current
+   * value (see `cannot_improve`). This can only be turned off by
+   * tests, to check that skipping doesn't change the solution. */
+  bool skip_updates;
+
   /* Useful statistics for debugging */
   size_t num_accepted; /* number of nodes fixed by `eik3_step` */
+  size_t num_utetra_skipped; /* updates rejected without solving them */
+  size_t num_utri_skipped; /* (see `cannot_improve`) */
 
   /* An array containing the order in which the individual nodes were
    * accepted. That is, `accepted[i] == l` means that `eik3_step()`
@@ -100,10 +130,12 @@ static void setpos(void *ptr, int l, int pos) {
   eik->pos[l] = pos;
 }
 
-void eik3_init(eik3_s *eik, mesh3_s const *mesh, sfunc_s const *sfunc) {
+void eik3_init(eik3_s *eik, mesh3_s const *mesh, sfunc_s const *sfunc,
+               heap_type_e heap_type) {
   eik->mesh = mesh;
 
   eik->sfunc = sfunc;
+  eik->kernel = ukernel_get(sfunc->stype);
 
   size_t nverts = mesh3_nverts(mesh);
 
@@ -137,9 +169,28 @@ void eik3_init(eik3_s *eik, mesh3_s const *mesh, sfunc_s const *sfunc) {
   int capacity = (int)3*cbrt(nverts);
 
   heap_alloc(&eik->heap);
-  heap_init(eik->heap, capacity, value, setpos, (void *)eik);
+  heap_init(eik->heap, heap_type, capacity, value, setpos, (void *)eik);
+
+  /* Neighboring nodes' values of T differ by roughly the length of
+   * the edge between them, so this should put a single layer of the
+   * front in each bucket. */
+  if (heap_type == HEAP_TYPE_BUCKET)
+    heap_set_bucket_width(eik->heap, mesh3_get_min_edge_length(mesh));
+
+  eik->defer_adjust = false;
+
+  eik->is_adjusted = malloc(nverts*sizeof(bool));
+  for (size_t l = 0; l < nverts; ++l)
+    eik->is_adjusted[l] = false;
+
+  array_alloc(&eik->adjusted);
+  array_init(eik->adjusted, sizeof(size_t), ARRAY_DEFAULT_CAPACITY);
+
+  eik->skip_updates = true;
 
   eik->num_accepted = 0;
+  eik->num_utetra_skipped = 0;
+  eik->num_utri_skipped = 0;
 
   eik->accepted = malloc(nverts*sizeof(size_t));
   for (size_t i = 0; i < nverts; ++i)
@@ -163,6 +214,17 @@ void eik3_init(eik3_s *eik, mesh3_s const *mesh, sfunc_s const *sfunc) {
   alist_alloc(&eik->T_diff);
   alist_init(eik->T_diff, sizeof(size_t[2]), sizeof(bb31), ARRAY_DEFAULT_CAPACITY);
 
+  array_alloc(&eik->utetra_pool);
+  array_init(eik->utetra_pool, sizeof(utetra_s *), ARRAY_DEFAULT_CAPACITY);
+
+  array_alloc(&eik->utri_pool);
+  array_init(eik->utri_pool, sizeof(utri_s *), ARRAY_DEFAULT_CAPACITY);
+
+  uline_alloc(&eik->uline);
+
+  pool_alloc(&eik->scratch);
+  pool_init(eik->scratch, SCRATCH_INITIAL_CAPACITY);
+
   eik->is_initialized = true;
 }
 
@@ -185,6 +247,12 @@ void eik3_deinit(eik3_s *eik) {
   heap_deinit(eik->heap);
   heap_dealloc(&eik->heap);
 
+  free(eik->is_adjusted);
+  eik->is_adjusted = NULL;
+
+  array_deinit(eik->adjusted);
+  array_dealloc(&eik->adjusted);
+
   utetra_cache_deinit(eik->utetra_cache);
   utetra_cache_dealloc(&eik->utetra_cache);
 
@@ -203,6 +271,27 @@ void eik3_deinit(eik3_s *eik) {
   alist_deinit(eik->T_diff);
   alist_dealloc(&eik->T_diff);
 
+  for (size_t i = 0; i < array_size(eik->utetra_pool); ++i) {
+    utetra_s *utetra;
+    array_get(eik->utetra_pool, i, &utetra);
+    utetra_dealloc(&utetra);
+  }
+  array_deinit(eik->utetra_pool);
+  array_dealloc(&eik->utetra_pool);
+
+  for (size_t i = 0; i < array_size(eik->utri_pool); ++i) {
+    utri_s *utri;
+    array_get(eik->utri_pool, i, &utri);
+    utri_dealloc(&utri);
+  }
+  array_deinit(eik->utri_pool);
+  array_dealloc(&eik->utri_pool);
+
+  uline_dealloc(&eik->uline);
+
+  pool_deinit(eik->scratch);
+  pool_dealloc(&eik->scratch);
+
   eik->is_initialized = false;
 }
 
@@ -250,7 +339,62 @@ static void adjust(eik3_s *eik, size_t l) {
   assert(eik->state[l] == TRIAL);
   assert(l < mesh3_nverts(eik->mesh));
 
-  heap_swim(eik->heap, eik->pos[l]);
+  if (!eik->defer_adjust) {
+    heap_swim(eik->heap, eik->pos[l]);
+    return;
+  }
+
+  if (!eik->is_adjusted[l]) {
+    eik->is_adjusted[l] = true;
+    array_append(eik->adjusted, &l);
+  }
+}
+
+/* Swim each node whose adjustment was deferred. Values only ever
+ * decrease while updating, so swimming each node once is enough to
+ * restore the heap property. */
+static void adjust_deferred(eik3_s *eik) {
+  for (size_t i = 0, l; i < array_size(eik->adjusted); ++i) {
+    array_get(eik->adjusted, i, &l);
+    eik->is_adjusted[l] = false;
+    heap_swim(eik->heap, eik->pos[l]);
+  }
+  array_clear(eik->adjusted);
+}
+
+/** Reusing updates: */
+
+static utetra_s *get_utetra(eik3_s *eik) {
+  utetra_s *utetra;
+  if (array_is_empty(eik->utetra_pool))
+    utetra_alloc(&utetra);
+  else
+    array_pop_back(eik->utetra_pool, &utetra);
+  return utetra;
+}
+
+static void put_utetra(eik3_s *eik, utetra_s *utetra) {
+  array_append(eik->utetra_pool, &utetra);
+}
+
+static utri_s *get_utri(eik3_s *eik) {
+  utri_s *utri;
+  if (array_is_empty(eik->utri_pool))
+    utri_alloc(&utri);
+  else
+    array_pop_back(eik->utri_pool, &utri);
+  return utri;
+}
+
+static void put_utri(eik3_s *eik, utri_s *utri) {
+  array_append(eik->utri_pool, &utri);
+}
+
+/* Check whether an update of `l` whose value is bounded below by `lb`
+ * can't improve on `l`'s current value, in which case it doesn't need
+ * to be solved: it would just be rejected afterwards. */
+static bool cannot_improve(eik3_s const *eik, size_t l, dbl lb) {
+  return eik->skip_updates && lb >= eik->jet[l].f;
 }
 
 /** Functions for `do_utri`: */
@@ -264,17 +408,22 @@ static void commit_utri(eik3_s *eik, size_t lhat, utri_s const *utri) {
   eik3_set_par(eik, lhat, utri_get_par(utri));
 }
 
-static void
-get_valid_inc_edges(eik3_s const *eik, size_t l0, array_s *l1,
+/* Find the edges incident on `l0` which satisfy `pred` and whose
+ * other endpoint is `VALID`. The other endpoints are written to `l1`,
+ * which must have room for `mesh3_nvv(mesh, l0)` indices, and their
+ * number is returned. */
+static size_t
+get_valid_inc_edges(eik3_s const *eik, size_t l0, size_t *l1,
                     bool (*pred)(eik3_s const *, size_t const[2])) {
   mesh3_s const *mesh = eik3_get_mesh(eik);
 
-  int nvv = mesh3_nvv(mesh, l0);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(mesh, l0, vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, l0, &nvv);
+
+  size_t num_l1 = 0;
 
   size_t le[2] = {[0] = l0};
-  for (int i = 0; i < nvv; ++i) {
+  for (size_t i = 0; i < nvv; ++i) {
     le[1] = vv[i];
 
     if (!pred(eik, le))
@@ -283,10 +432,10 @@ get_valid_inc_edges(eik3_s const *eik, size_t l0, array_s *l1,
     if (!eik3_is_valid(eik, le[1]))
       continue;
 
-    array_append(l1, &le[1]);
+    l1[num_l1++] = le[1];
   }
 
-  free(vv);
+  return num_l1;
 }
 
 static void
@@ -298,8 +447,7 @@ do_utri(eik3_s *eik, size_t l, size_t l0, size_t l1, utri_cache_s *utri_cache,
   if (par != NULL)
     par3_init_empty(par);
 
-  utri_s *utri;
-  utri_alloc(&utri);
+  utri_s *utri = get_utri(eik);
   utri_init(utri, eik, l, (uint2) {l0, l1});
 
   if (utri_is_backwards(utri, eik))
@@ -308,6 +456,11 @@ do_utri(eik3_s *eik, size_t l, size_t l0, size_t l1, utri_cache_s *utri_cache,
   if (utri_is_degenerate(utri))
     goto cleanup;
 
+  if (cannot_improve(eik, l, utri_get_lower_bound(utri))) {
+    ++eik->num_utri_skipped;
+    goto cleanup;
+  }
+
   utri_solve(utri);
 
   if (par != NULL && utri_get_value(utri) < eik->jet[l].f)
@@ -334,17 +487,17 @@ do_utri(eik3_s *eik, size_t l, size_t l0, size_t l1, utri_cache_s *utri_cache,
   if (utri_other) {
     commit_utri(eik, l, utri);
     adjust(eik, l);
-    utri_dealloc(&utri_other);
+    put_utri(eik, utri_other);
     goto cleanup;
   }
 
   /* if we failed, we cache this update for later (... if we
    * haven't already) */
   if (utri_cache_try_add_unique(utri_cache, utri))
-    return; /* don't dealloc in this case! */
+    return; /* don't release in this case! */
 
 cleanup:
-  utri_dealloc(&utri);
+  put_utri(eik, utri);
 }
 
 static void do_utris_if(eik3_s *eik, size_t l, size_t l0, utri_cache_s *utri_cache,
@@ -352,21 +505,15 @@ static void do_utris_if(eik3_s *eik, size_t l, size_t l0, utri_cache_s *utri_cac
   assert(l != l0);
 
   /* find the diffracting edges incident on l0 with VALID indices */
-  array_s *l1_arr;
-  array_alloc(&l1_arr);
-  array_init(l1_arr, sizeof(size_t), ARRAY_DEFAULT_CAPACITY);
-  get_valid_inc_edges(eik, l0, l1_arr, pred);
-
-  for (size_t i = 0, l1; i < array_size(l1_arr); ++i) {
-    array_get(l1_arr, i, &l1);
-    if (l == l1)
+  size_t nvv = mesh3_nvv(eik->mesh, l0);
+  size_t *l1 = pool_get(eik->scratch, nvv*sizeof(size_t));
+  size_t num_l1 = get_valid_inc_edges(eik, l0, l1, pred);
+
+  for (size_t i = 0; i < num_l1; ++i) {
+    if (l == l1[i])
       continue;
-    do_utri(eik, l, l0, l1, utri_cache, /* par: */ NULL);
+    do_utri(eik, l, l0, l1[i], utri_cache, /* par: */ NULL);
   }
-
-  /* release array of VALID diff edges */
-  array_deinit(l1_arr);
-  array_dealloc(&l1_arr);
 }
 
 /** Functions for `do_freespace_utetra`: */
@@ -374,14 +521,13 @@ static void do_utris_if(eik3_s *eik, size_t l, size_t l0, utri_cache_s *utri_cac
 static bool face_is_on_valid_front(eik3_s const *eik, uint3 const lf) {
   mesh3_s const *mesh = eik3_get_mesh(eik);
 
-  /* If there's only one incident cell, `lf` isn't on the front */
-  size_t nfc = mesh3_nfc(mesh, lf);
-  if (nfc == 1)
-    return false;
-
   size_t fc[2];
   mesh3_fc(mesh, lf, fc);
 
+  /* If there's only one incident cell, `lf` isn't on the front */
+  if (fc[1] == (size_t)NO_INDEX)
+    return false;
+
   state_e state[2][4];
   for (size_t i = 0; i < 2; ++i) {
     size_t cv[4];
@@ -425,11 +571,18 @@ static bool face_is_on_valid_front(eik3_s const *eik, uint3 const lf) {
   assert(false);
 }
 
-static void get_update_fan(eik3_s const *eik, size_t l0, array_s *l_arr) {
+/* Get the fan of `VALID` triangles incident on `l0`. The non-`l0`
+ * vertices of each triangle are returned in a buffer taken from
+ * `eik->scratch`, and the number of triangles is written to
+ * `num_le`. */
+static uint2 *get_update_fan(eik3_s *eik, size_t l0, size_t *num_le) {
   /* Find all of the cells incident on `l0` */
-  size_t nvc = mesh3_nvc(eik->mesh, l0);
-  size_t *vc = malloc(nvc*sizeof(size_t));
-  mesh3_vc(eik->mesh, l0, vc);
+  size_t nvc;
+  size_t const *vc = mesh3_get_vc_ptr(eik->mesh, l0, &nvc);
+
+  /* There's at most one triangle per incident cell */
+  uint2 *le = pool_get(eik->scratch, nvc*sizeof(uint2));
+  *num_le = 0;
 
   /* Iterate over each cell incident on `l0` */
   for (size_t i = 0; i < nvc; ++i) {
@@ -458,14 +611,16 @@ static void get_update_fan(eik3_s const *eik, size_t l0, array_s *l_arr) {
     if (!face_is_on_valid_front(eik, lf))
       continue;
 
-    if (array_contains(l_arr, &l))
+    bool is_new = true;
+    for (size_t j = 0; is_new && j < *num_le; ++j)
+      is_new = le[j][0] != l[0] || le[j][1] != l[1];
+    if (!is_new)
       continue;
 
-    array_append(l_arr, &l);
+    memcpy(le[(*num_le)++], l, sizeof(uint2));
   }
 
-  /* Release the cell array */
-  free(vc);
+  return le;
 }
 
 static void commit_utetra(eik3_s *eik, size_t l, utetra_s const *utetra) {
@@ -497,32 +652,45 @@ static bool commit_utetra_if_bracketed(eik3_s *eik, utetra_s const *utetra) {
   for (size_t i = 0; i < array_size(bracket); ++i) {
     utetra_s *utetra_bracket;
     array_get(bracket, i, &utetra_bracket);
-    utetra_dealloc(&utetra_bracket);
+    put_utetra(eik, utetra_bracket);
   }
-  array_deinit(bracket);
-  array_dealloc(&bracket);
 
   return true;
 }
 
-void do_utetra(eik3_s *eik, size_t lhat, uint3 const l, par3_s *par) {
-  if (utetra_cache_contains_inds(eik->utetra_cache, lhat, l))
-    return;
+/* Set up the update `(lhat, l)` for solving and get a warm start for
+ * it, which is written to `lam`. If the update shouldn't be solved,
+ * `NULL` is returned. Otherwise, the returned update should be passed
+ * to `finish_utetra` after solving it.
+ *
+ * Unless the caller needs the minimizer (`need_par`), updates which
+ * can't improve on the current value of `lhat` aren't solved. */
+static utetra_s *prepare_utetra(eik3_s *eik, size_t lhat, uint3 const l,
+                                bool need_par, dbl lam[2], bool *warm) {
+  utetra_s *utetra = get_utetra(eik);
+  utetra_init(utetra, eik, lhat, l);
 
-  if (par != NULL)
-    par3_init_empty(par);
+  if (utetra_is_backwards(utetra, eik) || utetra_is_degenerate(utetra)) {
+    put_utetra(eik, utetra);
+    return NULL;
+  }
 
-  utetra_s *utetra;
-  utetra_alloc(&utetra);
-  utetra_init(utetra, eik, lhat, l);
+  if (!need_par && cannot_improve(eik, lhat, utetra_get_lower_bound(utetra))) {
+    ++eik->num_utetra_skipped;
+    put_utetra(eik, utetra);
+    return NULL;
+  }
 
-  if (utetra_is_backwards(utetra, eik))
-    goto cleanup;
+  *warm = utetra_get_warm_start(utetra, lam);
 
-  if (utetra_is_degenerate(utetra))
-    goto cleanup;
+  return utetra;
+}
 
-  utetra_solve(utetra, /* warm start: */ NULL);
+/* Commit the solved update `utetra` if it's an improvement and we can
+ * tell that it's valid, and otherwise either cache it (if it might be
+ * bracketed by later updates) or release it. */
+static void finish_utetra(eik3_s *eik, utetra_s *utetra, par3_s *par) {
+  size_t lhat = utetra_get_l(utetra);
 
   if (par != NULL)
     *par = utetra_get_parent(utetra);
@@ -543,19 +711,35 @@ void do_utetra(eik3_s *eik, size_t lhat, uint3 const l, par3_s *par) {
     goto cleanup;
 
   if (utetra_cache_try_add_unique(eik->utetra_cache, utetra))
-    return; /* don't dealloc! */
+    return; /* don't release! */
 
 cleanup:
-  utetra_dealloc(&utetra);
+  put_utetra(eik, utetra);
+}
+
+void do_utetra(eik3_s *eik, size_t lhat, uint3 const l, par3_s *par) {
+  if (utetra_cache_contains_inds(eik->utetra_cache, lhat, l))
+    return;
+
+  if (par != NULL)
+    par3_init_empty(par);
+
+  dbl2 lam;
+  bool warm;
+  utetra_s *utetra = prepare_utetra(eik, lhat, l, par != NULL, lam, &warm);
+  if (utetra == NULL)
+    return;
+
+  utetra_solve(utetra, warm ? lam : NULL);
+
+  finish_utetra(eik, utetra, par);
 }
 
 static void do_1pt_update(eik3_s *eik, size_t l, size_t l0) {
-  uline_s *u;
-  uline_alloc(&u);
-  uline_init(u, eik, l, l0);
-  uline_solve(u);
+  uline_init(eik->uline, eik, l, l0);
+  uline_solve(eik->uline);
 
-  jet31t jet = uline_get_jet(u);
+  jet31t jet = uline_get_jet(eik->uline);
   if (jet.f >= eik->jet[l].f)
     return;
 
@@ -576,22 +760,41 @@ static void do_utetra_fan(eik3_s *eik, size_t lhat, size_t l0) {
   assert(lhat != l0);
 
   /* Get the fan of `VALID` triangles incident on `l0`. */
-  array_s *le_arr;
-  array_alloc(&le_arr);
-  array_init(le_arr, sizeof(size_t[2]), ARRAY_DEFAULT_CAPACITY);
-  get_update_fan(eik, l0, le_arr);
+  size_t num_le;
+  uint2 const *le = get_update_fan(eik, l0, &num_le);
 
   size_t l[3] = {l0, (size_t)NO_INDEX, (size_t)NO_INDEX};
 
-  /* Array to track which vertices on the rim of the update fan are
+  /* Buffer to track which vertices on the rim of the update fan are
    * incident on `VALID` diffracting edges. */
-  array_s *l_diff;
-  array_alloc(&l_diff);
-  array_init(l_diff, sizeof(size_t), ARRAY_DEFAULT_CAPACITY);
-
-  /* Do them all */
-  for (size_t i = 0; i < array_size(le_arr); ++i) {
-    array_get(le_arr, i, &l[1]);
+  size_t *l_diff = pool_get(eik->scratch, 2*num_le*sizeof(size_t));
+  size_t num_l_diff = 0;
+
+  /* The update for each triangle in the fan (or `NULL` if it doesn't
+   * need to be solved), and whether it was skipped because it was
+   * already cached. The updates are also collected into `u`, along
+   * with their warm starts, so that they can be solved together. */
+  utetra_s **utetra = pool_get(eik->scratch, num_le*sizeof(utetra_s *));
+  utetra_s **u = pool_get(eik->scratch, num_le*sizeof(utetra_s *));
+  dbl2 *lam = pool_get(eik->scratch, num_le*sizeof(dbl2));
+  dbl const **lam_ptr = pool_get(eik->scratch, num_le*sizeof(dbl const *));
+  bool *cached = pool_get(eik->scratch, num_le*sizeof(bool));
+  size_t num_u = 0;
+
+  /* If a point source is on the rim of the fan, we stop there and do
+   * a 1-point update from it instead of the rest of the fan. */
+  size_t l_src = (size_t)NO_INDEX;
+
+  /* Set up all of the updates */
+  size_t num_fan = 0;
+  for (; num_fan < num_le; ++num_fan) {
+    size_t i = num_fan;
+
+    utetra[i] = NULL;
+    cached[i] = false;
+
+    l[1] = le[i][0];
+    l[2] = le[i][1];
 
     /* Skip degenerate updates */
     if (lhat == l[1] || lhat == l[2])
@@ -601,34 +804,64 @@ static void do_utetra_fan(eik3_s *eik, size_t lhat, size_t l0) {
     for (size_t j = 1; j < 3; ++j) {
       if (jet31t_is_point_source(&eik->jet[l[j]])) {
         assert(array_contains(eik->bc_inds, &l[j]));
-        do_1pt_update(eik, lhat, l[j]);
-        goto cleanup;
+        l_src = l[j];
+        break;
       }
     }
+    if (l_src != (size_t)NO_INDEX)
+      break;
 
     /* Accumulate `VALID` vertices incident on diffracting edges */
-    for (size_t j = 1; j < 3; ++j)
-      if (mesh3_vert_incident_on_diff_edge(eik->mesh, l[j])
-          && !array_contains(l_diff, &l[j]))
-        array_append(l_diff, &l[j]);
+    for (size_t j = 1; j < 3; ++j) {
+      if (!mesh3_vert_incident_on_diff_edge(eik->mesh, l[j]))
+        continue;
+      bool is_new = true;
+      for (size_t k = 0; is_new && k < num_l_diff; ++k)
+        is_new = l_diff[k] != l[j];
+      if (is_new)
+        l_diff[num_l_diff++] = l[j];
+    }
 
-    do_utetra(eik, lhat, l, /* par: */ NULL);
-  }
+    if (utetra_cache_contains_inds(eik->utetra_cache, lhat, l)) {
+      cached[i] = true;
+      continue;
+    }
 
-  /* Do 2-point diffraction updates */
-  for (size_t i = 0; i < array_size(l_diff); ++i) {
-    size_t l0;
-    array_get(l_diff, i, &l0);
-    do_utris_if(eik, lhat, l0, eik->diff_utri_cache, is_diff_edge);
+    bool warm;
+    utetra[i] = prepare_utetra(eik, lhat, l, /* need_par: */ false,
+                               lam[num_u], &warm);
+    if (utetra[i] == NULL)
+      continue;
+
+    u[num_u] = utetra[i];
+    lam_ptr[num_u] = warm ? lam[num_u] : NULL;
+    ++num_u;
   }
 
-cleanup:
+  /* Do them all */
+  utetra_solve_batch(u, lam_ptr, num_u);
+
+  /* Finish the updates in the same order as the fan. Finishing an
+   * update can evict updates from the cache which bracket it, so we
+   * need to check the updates we skipped again. */
+  for (size_t i = 0; i < num_fan; ++i) {
+    if (utetra[i] != NULL) {
+      finish_utetra(eik, utetra[i], /* par: */ NULL);
+    } else if (cached[i]) {
+      l[1] = le[i][0];
+      l[2] = le[i][1];
+      do_utetra(eik, lhat, l, /* par: */ NULL);
+    }
+  }
 
-  array_deinit(l_diff);
-  array_dealloc(&l_diff);
+  if (l_src != (size_t)NO_INDEX) {
+    do_1pt_update(eik, lhat, l_src);
+    return;
+  }
 
-  array_deinit(le_arr);
-  array_dealloc(&le_arr);
+  /* Do 2-point diffraction updates */
+  for (size_t i = 0; i < num_l_diff; ++i)
+    do_utris_if(eik, lhat, l_diff[i], eik->diff_utri_cache, is_diff_edge);
 }
 
 /* Check whether the edge indexed by `l` is:
@@ -642,9 +875,8 @@ static bool is_valid_front_bde(eik3_s const *eik, size_t const l[2]) {
   if (!mesh3_bde(mesh, l))
     return false;
 
-  size_t nvv = mesh3_nvv(mesh, l[1]);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(mesh, l[1], vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, l[1], &nvv);
 
   bool has_trial_nb = false;
   for (size_t i = 0; i < nvv; ++i) {
@@ -656,12 +888,13 @@ static bool is_valid_front_bde(eik3_s const *eik, size_t const l[2]) {
     }
   }
 
-  free(vv);
-
   return has_trial_nb;
 }
 
 static void update(eik3_s *eik, size_t l, size_t l0) {
+  /* Nothing allocated from the scratch pool outlives an update */
+  pool_reset(eik->scratch);
+
   if (jet31t_is_point_source(&eik->jet[l0])) {
     assert(array_contains(eik->bc_inds, &l0));
     do_1pt_update(eik, l, l0);
@@ -695,31 +928,26 @@ void update_neighbors(eik3_s *eik, size_t l0) {
   size_t l; // Node l is a neighbor of node l0
 
   // Get i0's neighboring nodes.
-  int nnb = mesh3_nvv(eik->mesh, l0);
-  size_t *nb = malloc(nnb*sizeof(size_t));
-  mesh3_vv(eik->mesh, l0, nb);
+  size_t nnb;
+  size_t const *nb = mesh3_get_vv_ptr(eik->mesh, l0, &nnb);
 
   // Set FAR nodes to TRIAL and insert them into the heap.
-  for (int i = 0; i < nnb; ++i) {
+  for (size_t i = 0; i < nnb; ++i) {
     if (eik->state[l = nb[i]] == FAR) {
       eik->state[l] = TRIAL;
       heap_insert(eik->heap, l);
     }
   }
 
-  // Update neighboring nodes.
-  for (int i = 0; i < nnb; ++i) {
-    if (eik->state[l = nb[i]] == TRIAL) {
+  // Update neighboring nodes. Each node whose value changes is
+  // adjusted once after all of the updates are done.
+  eik->defer_adjust = true;
+  for (size_t i = 0; i < nnb; ++i)
+    if (eik->state[l = nb[i]] == TRIAL)
       update(eik, l, l0);
-      adjust(eik, l); // TODO: we should avoid calling adjust
-                      // repeatedly here and above. Instead we should
-                      // use a flag to track which nodes actually had
-                      // their values change and then adjust before
-                      // finally returning from this function.
-    }
-  }
+  eik->defer_adjust = false;
 
-  free(nb);
+  adjust_deferred(eik);
 }
 
 jmm_error_e eik3_step(eik3_s *eik, size_t *l0) {
@@ -737,9 +965,9 @@ jmm_error_e eik3_step(eik3_s *eik, size_t *l0) {
   eik->state[*l0] = VALID;
 
   /* Purge cached updates to keep the cache size under control */
-  utetra_cache_purge(eik->utetra_cache, *l0);
-  utri_cache_purge(eik->bd_utri_cache, *l0);
-  utri_cache_purge(eik->diff_utri_cache, *l0);
+  utetra_cache_purge(eik->utetra_cache, *l0, eik->utetra_pool);
+  utri_cache_purge(eik->bd_utri_cache, *l0, eik->utri_pool);
+  utri_cache_purge(eik->diff_utri_cache, *l0, eik->utri_pool);
 
   update_neighbors(eik, *l0);
 
@@ -751,7 +979,7 @@ jmm_error_e eik3_step(eik3_s *eik, size_t *l0) {
 }
 
 jmm_error_e eik3_solve(eik3_s *eik) {
-  jmm_error_e error;
+  jmm_error_e error = JMM_ERROR_NONE;
   size_t l0;
   while (heap_size(eik->heap) > 0)
     if ((error = eik3_step(eik, &l0)) != JMM_ERROR_NONE)
@@ -780,7 +1008,7 @@ bool eik3_brute_force_remaining(eik3_s *eik) {
     uint3 *vf = malloc(nvf*sizeof(uint3));
     mesh3_vf(eik->mesh, l, vf);
 
-    utetra_cache_purge(eik->utetra_cache, l);
+    utetra_cache_purge(eik->utetra_cache, l, eik->utetra_pool);
 
     for (size_t i = 0; i < nvf; ++i)
       if (eik->state[vf[i][0]] == VALID &&
@@ -832,9 +1060,9 @@ static void reset_nodes(eik3_s *eik, array_s const *l_arr) {
     eik->state[l] = FAR;
     par3_init_empty(&eik->par[l]);
 
-    utetra_cache_purge(eik->utetra_cache, l);
-    utri_cache_purge(eik->bd_utri_cache, l);
-    utri_cache_purge(eik->diff_utri_cache, l);
+    utetra_cache_purge(eik->utetra_cache, l, eik->utetra_pool);
+    utri_cache_purge(eik->bd_utri_cache, l, eik->utri_pool);
+    utri_cache_purge(eik->diff_utri_cache, l, eik->utri_pool);
   }
 
   unaccept_nodes(eik, l_arr);
@@ -849,15 +1077,12 @@ static void fix_valid_front(eik3_s *eik) {
     if (eik->state[l] != FAR)
       continue;
 
-    size_t nvv = mesh3_nvv(eik->mesh, l);
-    size_t *vv = malloc(nvv*sizeof(size_t));
-    mesh3_vv(eik->mesh, l, vv);
+    size_t nvv;
+    size_t const *vv = mesh3_get_vv_ptr(eik->mesh, l, &nvv);
 
     for (size_t i = 0; i < nvv; ++i)
       if (eik->state[vv[i]] == VALID && !array_contains(l_arr, &vv[i]))
         array_append(l_arr, &vv[i]);
-
-    free(vv);
   }
 
   /* Reinsert these nodes into the heap */
@@ -1064,9 +1289,8 @@ void eik3_resolve_downwind_from_diff(eik3_s *eik, size_t diff_index, dbl rfac) {
       array_append(l_reset, &l);
 
     /* Get the neighbors of the current node */
-    size_t nvv = mesh3_nvv(mesh, l);
-    size_t *vv = malloc(nvv*sizeof(size_t));
-    mesh3_vv(mesh, l, vv);
+    size_t nvv;
+    size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
 
     /* For each neighbor... */
     for (size_t j = 0; j < nvv; ++j) {
@@ -1086,8 +1310,6 @@ void eik3_resolve_downwind_from_diff(eik3_s *eik, size_t diff_index, dbl rfac) {
         }
       }
     }
-
-    free(vv);
   }
 
   reset_nodes(eik, l_reset);
@@ -1121,6 +1343,10 @@ sfunc_s const *eik3_get_sfunc(eik3_s const *eik) {
   return eik->sfunc;
 }
 
+ukernel_s const *eik3_get_ukernel(eik3_s const *eik) {
+  return eik->kernel;
+}
+
 void eik3_add_trial(eik3_s *eik, size_t l, jet31t jet) {
   if (eik->state[l] == VALID) {
     log_warn("failed to add TRIAL node %lu (already VALID)", l);
@@ -1153,6 +1379,17 @@ size_t eik3_num_valid(eik3_s const *eik) {
   return eik->num_accepted;
 }
 
+/* Get the number of tetrahedron and triangle updates which were
+ * skipped because a lower bound showed they couldn't improve the
+ * value of the node being updated. */
+size_t eik3_num_utetra_skipped(eik3_s const *eik) {
+  return eik->num_utetra_skipped;
+}
+
+size_t eik3_num_utri_skipped(eik3_s const *eik) {
+  return eik->num_utri_skipped;
+}
+
 void eik3_add_bc(eik3_s *eik, size_t l, jet31t jet) {
   assert(!array_contains(eik->bc_inds, &l));
 
@@ -1164,9 +1401,8 @@ void eik3_add_bc(eik3_s *eik, size_t l, jet31t jet) {
 }
 
 static bool has_nb_with_state(eik3_s const *eik, size_t l, state_e state) {
-  size_t nvv = mesh3_nvv(eik->mesh, l);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(eik->mesh, l, vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(eik->mesh, l, &nvv);
 
   bool has_nb = false;
 
@@ -1177,8 +1413,6 @@ static bool has_nb_with_state(eik3_s const *eik, size_t l, state_e state) {
     }
   }
 
-  free(vv);
-
   return has_nb;
 }
 
@@ -1249,15 +1483,16 @@ void eik3_add_pt_src_bcs(eik3_s *eik, dbl3 const xsrc, dbl rfac) {
       continue;
 
     /* ... if we are, then add this node's neighbors to the queue. */
-    size_t nvv = mesh3_nvv(mesh, l);
-    size_t *vv = malloc(nvv*sizeof(size_t));
-    mesh3_vv(mesh, l, vv);
+    size_t nvv;
+    size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
     for (size_t i = 0; i < nvv; ++i)
       if (vv[i] != lsrc && isinf(eik->jet[vv[i]].f))
         array_append(queue, &vv[i]);
-    free(vv);
   }
 
+  array_deinit(queue);
+  array_dealloc(&queue);
+
   freeze_bc_layer(eik);
 
   /* Make sure we added some boundary data: */
@@ -1518,9 +1753,8 @@ void eik3_add_diff_bcs(eik3_s *eik, eik3_s const *eik_in, size_t diff_index, dbl
      * using the parent of `l` as a warm start for the reflector
      * updates for each added node. */
 
-    size_t nvv = mesh3_nvv(mesh, l);
-    size_t *vv = malloc(nvv*sizeof(size_t));
-    mesh3_vv(mesh, l, vv);
+    size_t nvv;
+    size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
 
     for (size_t i = 0; i < nvv; ++i) {
       /* Skip this node if we've already updated it */
@@ -1534,8 +1768,6 @@ void eik3_add_diff_bcs(eik3_s *eik, eik3_s const *eik_in, size_t diff_index, dbl
       if (!array_contains(queue, &child_update_inds))
         array_append(queue, &child_update_inds);
     }
-
-    free(vv);
   }
 
   freeze_bc_layer(eik);
@@ -1887,9 +2119,8 @@ void eik3_add_refl_bcs_with_fac(eik3_s *eik, eik3_s const *eik_in,
       continue;
 
     /* Get `l`'s neighbors */
-    size_t nvv = mesh3_nvv(eik->mesh, l);
-    size_t *vv = malloc(nvv*sizeof(size_t));
-    mesh3_vv(eik->mesh, l, vv);
+    size_t nvv;
+    size_t const *vv = mesh3_get_vv_ptr(eik->mesh, l, &nvv);
 
     /* Since we're in the "factoring tube" now, add this node's
      * neighbors to the queue, using the parent of `l` as a warm start
@@ -1904,8 +2135,6 @@ void eik3_add_refl_bcs_with_fac(eik3_s *eik, eik3_s const *eik_in,
       if (!array_contains(queue, &child_update_inds))
         array_append(queue, &child_update_inds);
     }
-
-    free(vv);
   }
 
   freeze_bc_layer(eik);
@@ -2449,3 +2678,9 @@ void eik3_get_t_out(eik3_s const *eik, dbl3 *t_out) {
 
   eik3_transport_unit_vector(eik, t_out, true);
 }
+
+#if JMM_TEST
+void eik3_set_skip_updates(eik3_s *eik, bool skip_updates) {
+  eik->skip_updates = skip_updates;
+}
+#endif
@@ -0,0 +1,139 @@
+#include <jmm/eik3_batch.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jmm/eik3.h>
+#include <jmm/mesh3.h>
+
+#include "parallel.h"
+
+struct eik3_batch {
+  mesh3_s const *mesh;
+  sfunc_s const *sfunc;
+  heap_type_e heap_type;
+
+  size_t num_srcs;
+  dbl3 *xsrc;
+  dbl *rfac;
+
+  size_t num_threads;
+
+  /* The jets for each source, stored one after the other, and the
+   * error returned by each source's solve. */
+  jet31t *jet;
+  jmm_error_e *error;
+};
+
+void eik3_batch_alloc(eik3_batch_s **batch) {
+  *batch = malloc(sizeof(eik3_batch_s));
+}
+
+void eik3_batch_dealloc(eik3_batch_s **batch) {
+  free(*batch);
+  *batch = NULL;
+}
+
+/* Set up a batch of `num_srcs` point sources. The `i`th source is
+ * located at `xsrc[i]`, which should be a vertex of `mesh`, and is
+ * initialized in a ball of radius `rfac[i]` (see
+ * `eik3_add_pt_src_bcs`). */
+void eik3_batch_init(eik3_batch_s *batch, mesh3_s const *mesh,
+                     sfunc_s const *sfunc, heap_type_e heap_type,
+                     size_t num_srcs, dbl3 const *xsrc, dbl const *rfac,
+                     size_t num_threads) {
+  assert(num_threads > 0);
+
+  batch->mesh = mesh;
+  batch->sfunc = sfunc;
+  batch->heap_type = heap_type;
+
+  batch->num_srcs = num_srcs;
+
+  batch->xsrc = malloc(num_srcs*sizeof(dbl3));
+  memcpy(batch->xsrc, xsrc, num_srcs*sizeof(dbl3));
+
+  batch->rfac = malloc(num_srcs*sizeof(dbl));
+  memcpy(batch->rfac, rfac, num_srcs*sizeof(dbl));
+
+  batch->num_threads = num_threads;
+
+  size_t nverts = mesh3_nverts(mesh);
+  batch->jet = malloc(num_srcs*nverts*sizeof(jet31t));
+  for (size_t l = 0; l < num_srcs*nverts; ++l)
+    batch->jet[l] = jet31t_make_empty();
+
+  batch->error = malloc(num_srcs*sizeof(jmm_error_e));
+  for (size_t i = 0; i < num_srcs; ++i)
+    batch->error[i] = JMM_ERROR_NONE;
+}
+
+void eik3_batch_deinit(eik3_batch_s *batch) {
+  free(batch->xsrc);
+  batch->xsrc = NULL;
+
+  free(batch->rfac);
+  batch->rfac = NULL;
+
+  free(batch->jet);
+  batch->jet = NULL;
+
+  free(batch->error);
+  batch->error = NULL;
+}
+
+static void solve_src(void *context, size_t i) {
+  eik3_batch_s *batch = (eik3_batch_s *)context;
+
+  eik3_s *eik;
+  eik3_alloc(&eik);
+  eik3_init(eik, batch->mesh, batch->sfunc, batch->heap_type);
+
+  eik3_add_pt_src_bcs(eik, batch->xsrc[i], batch->rfac[i]);
+  batch->error[i] = eik3_solve(eik);
+
+  size_t nverts = mesh3_nverts(batch->mesh);
+  memcpy(&batch->jet[i*nverts], eik3_get_jet_ptr(eik), nverts*sizeof(jet31t));
+
+  eik3_deinit(eik);
+  eik3_dealloc(&eik);
+}
+
+/* Solve for each point source. The sources are handed out to the
+ * threads one at a time. If any of the solves fail, the error for the
+ * first one which failed is returned, but the other solves still run
+ * to completion. Use `eik3_batch_get_error` to check each source. */
+jmm_error_e eik3_batch_solve(eik3_batch_s *batch) {
+  parallel_for(batch->num_srcs, batch->num_threads, solve_src, batch);
+
+  for (size_t i = 0; i < batch->num_srcs; ++i)
+    if (batch->error[i] != JMM_ERROR_NONE)
+      return batch->error[i];
+
+  return JMM_ERROR_NONE;
+}
+
+size_t eik3_batch_num_srcs(eik3_batch_s const *batch) {
+  return batch->num_srcs;
+}
+
+size_t eik3_batch_num_threads(eik3_batch_s const *batch) {
+  return batch->num_threads;
+}
+
+jmm_error_e eik3_batch_get_error(eik3_batch_s const *batch, size_t i) {
+  assert(i < batch->num_srcs);
+  return batch->error[i];
+}
+
+/* Get a pointer to the `nverts` jets for the `i`th source. */
+jet31t const *eik3_batch_get_jet_ptr(eik3_batch_s const *batch, size_t i) {
+  assert(i < batch->num_srcs);
+  return &batch->jet[i*mesh3_nverts(batch->mesh)];
+}
+
+/* Get a pointer to the full `num_srcs*nverts` array of jets. */
+jet31t const *eik3_batch_get_jets_ptr(eik3_batch_s const *batch) {
+  return batch->jet;
+}
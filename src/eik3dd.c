@@ -0,0 +1,540 @@
+#include <jmm/eik3dd.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jmm/array.h>
+#include <jmm/eik3.h>
+#include <jmm/mesh3.h>
+
+#include "parallel.h"
+
+/* The number of layers of ghost nodes each subdomain is padded
+ * with. Using more than one keeps the edge of the subdomain away from
+ * the nodes it owns, so that the updates they receive aren't
+ * restricted by it. */
+#define NUM_GHOST_LAYERS 2
+
+/* If the solver hasn't converged after this many rounds, give up */
+#define MAX_NUM_ROUNDS 1000
+
+typedef struct pt_src {
+  dbl3 xsrc;
+  dbl rfac;
+} pt_src_s;
+
+/* Each subdomain is solved by running `eik3` on its own mesh, made
+ * up of the cells of the full mesh whose vertices are all in the
+ * subdomain. Vertex `i` of `mesh` is vertex `l[i]` of the full
+ * mesh. Its boundary info is taken from the full mesh (see
+ * `mesh3_init_submesh`), so the solver sees the real boundary of the
+ * domain everywhere. */
+typedef struct subdomain {
+  /* The nodes in the subdomain. The first `num_owned` are owned by
+   * this subdomain, and the rest are ghosts. */
+  size_t *l;
+  size_t num_owned;
+  size_t num_nodes;
+
+  mesh3_s *mesh;
+
+  /* The values of T each ghost node was initialized with the last
+   * time the subdomain was solved */
+  dbl *ghost_T;
+
+  jmm_error_e error;
+  bool has_pt_src;
+  bool is_active;
+} subdomain_s;
+
+struct eik3dd {
+  mesh3_s const *mesh;
+  sfunc_s const *sfunc;
+
+  size_t num_subdomains;
+  subdomain_s *subdomain;
+  size_t *owner;
+
+  size_t num_threads;
+
+  array_s *pt_srcs;
+
+  /* The boundary data set up by the point sources: the state
+   * (`FAR`, `TRIAL`, or `VALID`) and jet of each node of the full
+   * mesh after calling `eik3_add_pt_src_bcs` */
+  state_e *src_state;
+  jet31t *src_jet;
+
+  /* The current solution. Each node's jet is copied from the
+   * subdomain which owns it. The subdomains solved in a round read
+   * their ghost nodes' jets from `jet` and write their owned nodes'
+   * jets to `jet_next`, which is copied back once they're done. */
+  jet31t *jet;
+  jet31t *jet_next;
+
+  size_t num_rounds;
+};
+
+void eik3dd_alloc(eik3dd_s **dd) {
+  *dd = malloc(sizeof(eik3dd_s));
+}
+
+void eik3dd_dealloc(eik3dd_s **dd) {
+  free(*dd);
+  *dd = NULL;
+}
+
+/** Partitioning the mesh: */
+
+typedef struct vkey {
+  dbl x;
+  size_t l;
+} vkey_s;
+
+static int vkey_cmp(void const *ptr1, void const *ptr2) {
+  dbl x1 = ((vkey_s const *)ptr1)->x, x2 = ((vkey_s const *)ptr2)->x;
+  return x1 < x2 ? -1 : x1 > x2 ? 1 : 0;
+}
+
+/* Recursive coordinate bisection: split the `n` vertices in `l` at
+ * the median of the axis along which they're most spread out, and
+ * divide the subdomains between the two halves in proportion. */
+static void bisect(eik3dd_s *dd, size_t *l, size_t n, size_t k0,
+                   size_t num_subdomains, vkey_s *vkey) {
+  if (num_subdomains == 1) {
+    for (size_t i = 0; i < n; ++i)
+      dd->owner[l[i]] = k0;
+    return;
+  }
+
+  dbl3 xmin = {INFINITY, INFINITY, INFINITY};
+  dbl3 xmax = {-INFINITY, -INFINITY, -INFINITY};
+  for (size_t i = 0; i < n; ++i) {
+    dbl const *x = mesh3_get_vert_ptr(dd->mesh, l[i]);
+    for (size_t j = 0; j < 3; ++j) {
+      xmin[j] = fmin(xmin[j], x[j]);
+      xmax[j] = fmax(xmax[j], x[j]);
+    }
+  }
+
+  size_t axis = 0;
+  for (size_t j = 1; j < 3; ++j)
+    if (xmax[j] - xmin[j] > xmax[axis] - xmin[axis])
+      axis = j;
+
+  for (size_t i = 0; i < n; ++i) {
+    vkey[i].x = mesh3_get_vert_ptr(dd->mesh, l[i])[axis];
+    vkey[i].l = l[i];
+  }
+  qsort(vkey, n, sizeof(vkey_s), vkey_cmp);
+  for (size_t i = 0; i < n; ++i)
+    l[i] = vkey[i].l;
+
+  size_t num_subdomains0 = num_subdomains/2;
+  size_t n0 = n*num_subdomains0/num_subdomains;
+
+  bisect(dd, l, n0, k0, num_subdomains0, vkey);
+  bisect(dd, l + n0, n - n0, k0 + num_subdomains0,
+         num_subdomains - num_subdomains0, vkey);
+}
+
+static void partition(eik3dd_s *dd) {
+  size_t nverts = mesh3_nverts(dd->mesh);
+
+  size_t *l = malloc(nverts*sizeof(size_t));
+  for (size_t i = 0; i < nverts; ++i)
+    l[i] = i;
+
+  vkey_s *vkey = malloc(nverts*sizeof(vkey_s));
+
+  bisect(dd, l, nverts, 0, dd->num_subdomains, vkey);
+
+  free(vkey);
+  free(l);
+}
+
+/* Collect the nodes of subdomain `k`, the nodes it owns followed by
+ * `NUM_GHOST_LAYERS` rings of ghost nodes surrounding them, and build
+ * its mesh. */
+static void init_subdomain(eik3dd_s *dd, size_t k) {
+  subdomain_s *sub = &dd->subdomain[k];
+
+  mesh3_s const *mesh = dd->mesh;
+  size_t nverts = mesh3_nverts(mesh);
+
+  bool *in_subdomain = calloc(nverts, sizeof(bool));
+
+  array_s *l_arr;
+  array_alloc(&l_arr);
+  array_init(l_arr, sizeof(size_t), ARRAY_DEFAULT_CAPACITY);
+
+  for (size_t l = 0; l < nverts; ++l) {
+    if (dd->owner[l] != k)
+      continue;
+    in_subdomain[l] = true;
+    array_append(l_arr, &l);
+  }
+  sub->num_owned = array_size(l_arr);
+
+  size_t begin = 0, end = sub->num_owned;
+  for (size_t layer = 0; layer < NUM_GHOST_LAYERS; ++layer) {
+    for (size_t i = begin, l; i < end; ++i) {
+      array_get(l_arr, i, &l);
+      size_t nvv;
+      size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
+      for (size_t j = 0; j < nvv; ++j) {
+        if (in_subdomain[vv[j]])
+          continue;
+        in_subdomain[vv[j]] = true;
+        array_append(l_arr, &vv[j]);
+      }
+    }
+    begin = end;
+    end = array_size(l_arr);
+  }
+
+  /* Collect the cells whose vertices are all in the subdomain. Only
+   * the cells incident on the owned nodes and the ghost nodes in all
+   * but the last layer are needed. */
+  array_s *lc_arr;
+  array_alloc(&lc_arr);
+  array_init(lc_arr, sizeof(size_t), ARRAY_DEFAULT_CAPACITY);
+
+  bool *has_cell = calloc(mesh3_ncells(mesh), sizeof(bool));
+  size_t end_inner = begin;
+  for (size_t i = 0, l; i < end_inner; ++i) {
+    array_get(l_arr, i, &l);
+    size_t nvc;
+    size_t const *vc = mesh3_get_vc_ptr(mesh, l, &nvc);
+    for (size_t j = 0; j < nvc; ++j) {
+      size_t cv[4];
+      mesh3_cv(mesh, vc[j], cv);
+      if (in_subdomain[cv[0]] && in_subdomain[cv[1]] &&
+          in_subdomain[cv[2]] && in_subdomain[cv[3]] && !has_cell[vc[j]]) {
+        has_cell[vc[j]] = true;
+        array_append(lc_arr, &vc[j]);
+      }
+    }
+  }
+  free(has_cell);
+
+  /* Keep the nodes of the subdomain which are in one of these
+   * cells, in the same order. Some of the ghost nodes in the last
+   * layer may be left out. */
+  for (size_t i = 0, l; i < array_size(l_arr); ++i) {
+    array_get(l_arr, i, &l);
+    in_subdomain[l] = false;
+  }
+  for (size_t i = 0, lc; i < array_size(lc_arr); ++i) {
+    array_get(lc_arr, i, &lc);
+    size_t cv[4];
+    mesh3_cv(mesh, lc, cv);
+    for (size_t j = 0; j < 4; ++j)
+      in_subdomain[cv[j]] = true;
+  }
+  sub->num_nodes = 0;
+  sub->l = malloc(array_size(l_arr)*sizeof(size_t));
+  for (size_t i = 0, l; i < array_size(l_arr); ++i) {
+    array_get(l_arr, i, &l);
+    if (in_subdomain[l])
+      sub->l[sub->num_nodes++] = l;
+  }
+  assert(sub->num_nodes >= sub->num_owned);
+
+  mesh3_alloc(&sub->mesh);
+  mesh3_init_submesh(sub->mesh, mesh, sub->num_nodes, sub->l,
+                     array_size(lc_arr), array_get_ptr(lc_arr, 0));
+
+  size_t num_ghosts = sub->num_nodes - sub->num_owned;
+  sub->ghost_T = malloc(num_ghosts*sizeof(dbl));
+  for (size_t i = 0; i < num_ghosts; ++i)
+    sub->ghost_T[i] = INFINITY;
+
+  sub->error = JMM_ERROR_NONE;
+  sub->has_pt_src = false;
+  sub->is_active = false;
+
+  array_deinit(lc_arr);
+  array_dealloc(&lc_arr);
+
+  array_deinit(l_arr);
+  array_dealloc(&l_arr);
+
+  free(in_subdomain);
+}
+
+static void deinit_subdomain(subdomain_s *sub) {
+  free(sub->l);
+  sub->l = NULL;
+
+  mesh3_deinit(sub->mesh);
+  mesh3_dealloc(&sub->mesh);
+
+  free(sub->ghost_T);
+  sub->ghost_T = NULL;
+}
+
+void eik3dd_init(eik3dd_s *dd, mesh3_s const *mesh, sfunc_s const *sfunc,
+                 size_t num_subdomains, size_t num_threads) {
+  assert(num_subdomains > 0);
+  assert(num_subdomains <= mesh3_nverts(mesh));
+  assert(num_threads > 0);
+
+  dd->mesh = mesh;
+  dd->sfunc = sfunc;
+
+  dd->num_subdomains = num_subdomains;
+  dd->num_threads = num_threads;
+
+  dd->owner = malloc(mesh3_nverts(mesh)*sizeof(size_t));
+  partition(dd);
+
+  dd->subdomain = malloc(num_subdomains*sizeof(subdomain_s));
+  for (size_t k = 0; k < num_subdomains; ++k)
+    init_subdomain(dd, k);
+
+  array_alloc(&dd->pt_srcs);
+  array_init(dd->pt_srcs, sizeof(pt_src_s), ARRAY_DEFAULT_CAPACITY);
+
+  dd->src_state = malloc(mesh3_nverts(mesh)*sizeof(state_e));
+  dd->src_jet = malloc(mesh3_nverts(mesh)*sizeof(jet31t));
+  for (size_t l = 0; l < mesh3_nverts(mesh); ++l) {
+    dd->src_state[l] = FAR;
+    dd->src_jet[l] = jet31t_make_empty();
+  }
+
+  dd->jet = malloc(mesh3_nverts(mesh)*sizeof(jet31t));
+  for (size_t l = 0; l < mesh3_nverts(mesh); ++l)
+    dd->jet[l] = jet31t_make_empty();
+
+  dd->jet_next = malloc(mesh3_nverts(mesh)*sizeof(jet31t));
+
+  dd->num_rounds = 0;
+}
+
+void eik3dd_deinit(eik3dd_s *dd) {
+  for (size_t k = 0; k < dd->num_subdomains; ++k)
+    deinit_subdomain(&dd->subdomain[k]);
+  free(dd->subdomain);
+  dd->subdomain = NULL;
+
+  free(dd->owner);
+  dd->owner = NULL;
+
+  array_deinit(dd->pt_srcs);
+  array_dealloc(&dd->pt_srcs);
+
+  free(dd->src_state);
+  dd->src_state = NULL;
+
+  free(dd->src_jet);
+  dd->src_jet = NULL;
+
+  free(dd->jet);
+  dd->jet = NULL;
+
+  free(dd->jet_next);
+  dd->jet_next = NULL;
+}
+
+/* Add a point source at `xsrc`, which should be a vertex of the
+ * mesh. See `eik3_add_pt_src_bcs`. The boundary data is also set up
+ * once on the full mesh, so that subdomains which overlap it but
+ * don't contain `xsrc` can start from their part of it. The other
+ * subdomains get their values from their ghosts. */
+void eik3dd_add_pt_src_bcs(eik3dd_s *dd, dbl3 const xsrc, dbl rfac) {
+  assert(mesh3_has_vertex(dd->mesh, xsrc));
+
+  pt_src_s pt_src = {.xsrc = {xsrc[0], xsrc[1], xsrc[2]}, .rfac = rfac};
+  array_append(dd->pt_srcs, &pt_src);
+
+  eik3_s *eik;
+  eik3_alloc(&eik);
+  eik3_init(eik, dd->mesh, dd->sfunc, HEAP_TYPE_BINARY);
+  eik3_add_pt_src_bcs(eik, xsrc, rfac);
+
+  /* If there's more than one point source, keep the smaller value
+   * at each node */
+  for (size_t l = 0; l < mesh3_nverts(dd->mesh); ++l) {
+    if (eik3_is_far(eik, l))
+      continue;
+    if (eik3_is_valid(eik, l))
+      dd->src_state[l] = VALID;
+    else if (dd->src_state[l] == FAR)
+      dd->src_state[l] = TRIAL;
+    if (eik3_get_T(eik, l) < dd->src_jet[l].f)
+      dd->src_jet[l] = eik3_get_jet(eik, l);
+  }
+
+  eik3_deinit(eik);
+  eik3_dealloc(&eik);
+
+  for (size_t k = 0; k < dd->num_subdomains; ++k) {
+    subdomain_s *sub = &dd->subdomain[k];
+    for (size_t i = 0; i < sub->num_nodes; ++i)
+      if (dd->src_state[sub->l[i]] != FAR)
+        sub->has_pt_src = true;
+  }
+}
+
+/* Solve from scratch on subdomain `k`, using the jets in `dd->jet` as
+ * `TRIAL` data at its ghost nodes. */
+static void solve_subdomain(eik3dd_s *dd, size_t k) {
+  subdomain_s *sub = &dd->subdomain[k];
+
+  eik3_s *eik;
+  eik3_alloc(&eik);
+  eik3_init(eik, sub->mesh, dd->sfunc, HEAP_TYPE_BINARY);
+
+  /* Set up the point sources which are nodes of the subdomain the
+   * same way `eik3` would, and fill in any other boundary data from
+   * the full mesh */
+  if (sub->has_pt_src) {
+    for (size_t i = 0; i < array_size(dd->pt_srcs); ++i) {
+      pt_src_s const *pt_src = array_get_ptr(dd->pt_srcs, i);
+      if (mesh3_has_vertex(sub->mesh, pt_src->xsrc))
+        eik3_add_pt_src_bcs(eik, pt_src->xsrc, pt_src->rfac);
+    }
+    for (size_t i = 0; i < sub->num_nodes; ++i) {
+      size_t l = sub->l[i];
+      if (!eik3_is_far(eik, i))
+        continue;
+      if (dd->src_state[l] == VALID)
+        eik3_add_bc(eik, i, dd->src_jet[l]);
+      else if (dd->src_state[l] == TRIAL)
+        eik3_add_trial(eik, i, dd->src_jet[l]);
+    }
+  }
+
+  for (size_t i = sub->num_owned; i < sub->num_nodes; ++i) {
+    jet31t jet = dd->jet[sub->l[i]];
+    sub->ghost_T[i - sub->num_owned] = jet.f;
+    if (isfinite(jet.f) && eik3_is_far(eik, i))
+      eik3_add_trial(eik, i, jet);
+  }
+
+  /* `eik3_step` fails if the node at the front of the heap has an
+   * infinite value. This can happen near the edge of a subdomain when
+   * nodes are only reachable from outside of it. Every node left in
+   * the heap is then infinite, too, so we're done. */
+  sub->error = eik3_solve(eik);
+  if (sub->error == JMM_ERROR_RUNTIME_ERROR &&
+      !isfinite(eik3_get_T(eik, eik3_peek(eik))))
+    sub->error = JMM_ERROR_NONE;
+
+  /* Keep the jets of the owned nodes which improve on the current
+   * solution. Since each node is owned by one subdomain, no two
+   * threads write to the same entry of `dd->jet_next`. */
+  for (size_t i = 0; i < sub->num_owned; ++i) {
+    size_t l = sub->l[i];
+    if (eik3_is_valid(eik, i) && eik3_get_T(eik, i) < dd->jet[l].f)
+      dd->jet_next[l] = eik3_get_jet(eik, i);
+  }
+
+  eik3_deinit(eik);
+  eik3_dealloc(&eik);
+}
+
+typedef struct solve_context {
+  eik3dd_s *dd;
+  size_t const *k;
+} solve_context_s;
+
+static void solve_subdomain_task(void *context, size_t i) {
+  solve_context_s *solve_context = (solve_context_s *)context;
+  solve_subdomain(solve_context->dd, solve_context->k[i]);
+}
+
+/* Check whether the value of T at any of the ghost nodes of
+ * subdomain `k` has decreased by more than `tol` since it was last
+ * solved. */
+static bool ghosts_have_changed(eik3dd_s const *dd, size_t k, dbl tol) {
+  subdomain_s const *sub = &dd->subdomain[k];
+  for (size_t i = sub->num_owned; i < sub->num_nodes; ++i)
+    if (dd->jet[sub->l[i]].f < sub->ghost_T[i - sub->num_owned] - tol)
+      return true;
+  return false;
+}
+
+/* Solve the eikonal equation for the point sources which have been
+ * added. The subdomains are solved repeatedly until no value of T at
+ * a ghost node decreases by more than `tol`. */
+jmm_error_e eik3dd_solve(eik3dd_s *dd, dbl tol) {
+  assert(tol >= 0);
+
+  size_t nverts = mesh3_nverts(dd->mesh);
+
+  size_t *k_active = malloc(dd->num_subdomains*sizeof(size_t));
+
+  for (size_t k = 0; k < dd->num_subdomains; ++k)
+    dd->subdomain[k].is_active = dd->subdomain[k].has_pt_src;
+
+  jmm_error_e error = JMM_ERROR_NONE;
+
+  for (dd->num_rounds = 0; ; ++dd->num_rounds) {
+    size_t num_active = 0;
+    for (size_t k = 0; k < dd->num_subdomains; ++k)
+      if (dd->subdomain[k].is_active)
+        k_active[num_active++] = k;
+
+    if (num_active == 0)
+      break;
+
+    if (dd->num_rounds == MAX_NUM_ROUNDS) {
+      error = JMM_ERROR_RUNTIME_ERROR;
+      break;
+    }
+
+    memcpy(dd->jet_next, dd->jet, nverts*sizeof(jet31t));
+
+    solve_context_s context = {.dd = dd, .k = k_active};
+    parallel_for(num_active, dd->num_threads, solve_subdomain_task, &context);
+
+    for (size_t i = 0; i < num_active; ++i)
+      if (dd->subdomain[k_active[i]].error != JMM_ERROR_NONE)
+        error = dd->subdomain[k_active[i]].error;
+    if (error != JMM_ERROR_NONE)
+      break;
+
+    memcpy(dd->jet, dd->jet_next, nverts*sizeof(jet31t));
+
+    for (size_t k = 0; k < dd->num_subdomains; ++k)
+      dd->subdomain[k].is_active = ghosts_have_changed(dd, k, tol);
+  }
+
+  free(k_active);
+
+  return error;
+}
+
+size_t eik3dd_num_subdomains(eik3dd_s const *dd) {
+  return dd->num_subdomains;
+}
+
+size_t eik3dd_num_threads(eik3dd_s const *dd) {
+  return dd->num_threads;
+}
+
+/* The number of rounds of subdomain solves the last call to
+ * `eik3dd_solve` took */
+size_t eik3dd_num_rounds(eik3dd_s const *dd) {
+  return dd->num_rounds;
+}
+
+size_t eik3dd_get_owner(eik3dd_s const *dd, size_t l) {
+  return dd->owner[l];
+}
+
+dbl eik3dd_get_T(eik3dd_s const *dd, size_t l) {
+  return dd->jet[l].f;
+}
+
+jet31t eik3dd_get_jet(eik3dd_s const *dd, size_t l) {
+  return dd->jet[l];
+}
+
+jet31t const *eik3dd_get_jet_ptr(eik3dd_s const *dd) {
+  return dd->jet;
+}
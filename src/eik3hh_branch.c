@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <jmm/array.h>
 #include <jmm/bmesh.h>
@@ -14,6 +15,10 @@
 
 #include <jmm/util.h>
 
+#include "log.h"
+#include "macros.h"
+#include "parallel.h"
+
 struct eik3hh_branch {
   eik3hh_s const *hh;
   eik3_s *eik;
@@ -38,7 +43,7 @@ static void init(eik3hh_branch_s *branch, eik3hh_s const *hh,
   branch->hh = hh;
 
   eik3_alloc(&branch->eik);
-  eik3_init(branch->eik, mesh, &SFUNC_CONSTANT);
+  eik3_init(branch->eik, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
 
   branch->type = type;
 
@@ -769,17 +774,436 @@ void eik3hh_branch_dump_xy_slice(eik3hh_branch_s const *branch,
   }
 }
 
-void eik3hh_branch_render_frames(eik3hh_branch_s const *branch,
-                                 camera_s const *camera,
-                                 dbl T0, dbl T1, dbl frames_per_meter,
-                                 bool verbose) {
+/* Find the first intersection of `ray` with either the surface of the
+ * domain or the level set of the eikonal at `T`. */
+static void intersect_scene(rtree_s const *surf_rtree,
+                            rtree_s const *level_rtree, ray3 const *ray,
+                            dbl T, isect *hit, robj_s const *skip_robj) {
+  rtree_intersect(surf_rtree, ray, hit, skip_robj);
+
+  isect level_hit;
+  rtree_intersect_at_level(level_rtree, ray, T, &level_hit, skip_robj);
+  if (level_hit.t < hit->t)
+    *hit = level_hit;
+}
+
+/* Square tiles of pixels are the unit of work for rendering a
+ * frame. Transparent layers make the cost per pixel very uneven, so
+ * there are many more tiles than threads and they're handed out one
+ * at a time. */
+#define RENDER_TILE_SIZE 16
+
+/* A hit with the surface of the domain, cached when rendering a
+ * sequence of frames. `t` is the parameter of the hit along the
+ * pixel's ray, and `rgb` and `alpha` are as computed by `shade_hit`,
+ * neither of which depend on the level. */
+typedef struct {
+  dbl t;
+  dbl3 rgb;
+  dbl alpha;
+} surf_hit_s;
+
+/* The most surface hits which are cached for one pixel. Since the
+ * surface is half opaque, it makes a pixel opaque after ten hits, so
+ * this is only reached by pixels whose rays graze the surface many
+ * times. Those pixels aren't cached, and are rendered from scratch
+ * each frame instead, which keeps the cache to at most this many hits
+ * per pixel. */
+#define RENDER_MAX_SURF_HITS 8
+
+/* The surface hits for the pixels of one tile, in row-major order
+ * within the tile: the hits for the `p`th pixel are `hit[offset[p]]`
+ * up to (but not including) `hit[offset[p + 1]]`, unless
+ * `cached[p]` is false, in which case there are none. */
+typedef struct {
+  size_t *offset;
+  surf_hit_s *hit;
+  bool *cached;
+} surf_hits_s;
+
+typedef struct {
+  eik3hh_branch_s const *branch;
+  camera_s const *camera;
+  mesh2_s *surface_mesh;
+  bmesh33_s *bmesh;
+  rtree_s *surf_rtree;
+  rtree_s *level_rtree;
+  dbl level;
+  size_t num_tiles[2];
+  surf_hits_s *surf_hits; // One for each tile, or NULL
+  dbl4 *img;
+} render_context_s;
+
+/* Set up everything needed to render `branch` which doesn't depend on
+ * the camera or the level: the surface and the eikonal's level sets
+ * are each put into an R-tree once, and each frame just queries
+ * `level_rtree` at a different level. */
+static void render_context_init(render_context_s *context,
+                                eik3hh_branch_s const *branch,
+                                size_t num_threads) {
   mesh3_s const *mesh = eik3_get_mesh(branch->eik);
 
-  mesh2_s *surface_mesh = mesh3_get_surface_mesh(mesh);
+  context->branch = branch;
+  context->camera = NULL;
 
-  bmesh33_s *bmesh;
-  bmesh33_alloc(&bmesh);
-  bmesh33_init_from_mesh3_and_jets(bmesh, mesh, eik3_get_jet_ptr(branch->eik));
+  context->surface_mesh = mesh3_get_surface_mesh(mesh);
+
+  bmesh33_alloc(&context->bmesh);
+  bmesh33_init_from_mesh3_and_jets(
+    context->bmesh, mesh, eik3_get_jet_ptr(branch->eik));
+
+  rtree_alloc(&context->surf_rtree);
+  rtree_init(context->surf_rtree, 16, RTREE_SPLIT_STRATEGY_SAH_BINNED);
+  rtree_set_num_threads(context->surf_rtree, num_threads);
+  rtree_insert_mesh2(context->surf_rtree, context->surface_mesh);
+  rtree_build(context->surf_rtree);
+
+  rtree_alloc(&context->level_rtree);
+  rtree_init(context->level_rtree, 16, RTREE_SPLIT_STRATEGY_SAH_BINNED);
+  rtree_set_num_threads(context->level_rtree, num_threads);
+  rtree_insert_bmesh33(context->level_rtree, context->bmesh);
+  rtree_build(context->level_rtree);
+
+  context->level = NAN;
+  context->num_tiles[0] = context->num_tiles[1] = 0;
+  context->surf_hits = NULL;
+  context->img = NULL;
+}
+
+static void render_context_deinit(render_context_s *context) {
+  rtree_deinit(context->level_rtree);
+  rtree_dealloc(&context->level_rtree);
+
+  rtree_deinit(context->surf_rtree);
+  rtree_dealloc(&context->surf_rtree);
+
+  bmesh33_deinit(context->bmesh);
+  bmesh33_dealloc(&context->bmesh);
+
+  mesh2_deinit(context->surface_mesh);
+  mesh2_dealloc(&context->surface_mesh);
+}
+
+/* Get the contribution to a pixel's color of the object `obj`, hit
+ * at `x` by a ray with direction `dir`, and the object's opacity. */
+static void shade_hit(render_context_s const *context, robj_s const *obj,
+                      dbl3 const x, dbl3 const dir, dbl3 rgb, dbl *alpha_out) {
+  mesh3_s const *mesh = eik3_get_mesh(context->branch->eik);
+
+  dbl3 surf_rgb = {0.54, 0.54, 0.54};
+  dbl3 eik_rgb = {1.0, 1.0, 1.0};
+
+  dbl surf_alpha = 0.5;
+  dbl eik_alpha = 1;
+
+  robj_type_e robj_type = robj_get_type(obj);
+  void const *robj_data = robj_get_data(obj);
+
+  dbl alpha = 1, scale = 1;
+  dbl const *base_rgb = NULL;
+  dbl3 n;
+
+  /* Update the current alpha and RGB value */
+  switch (robj_type) {
+  case ROBJ_MESH2_TRI:
+    alpha *= surf_alpha;
+    base_rgb = &surf_rgb[0];
+    break;
+  case ROBJ_BMESH33_CELL:
+    alpha *= eik_alpha;
+    base_rgb = &eik_rgb[0];
+    break;
+  default:
+    assert(false);
+  }
+
+  if (robj_type == ROBJ_BMESH33_CELL) {
+    bmesh33_cell_s const *bmesh33_cell = robj_data;
+    dbl spread_interp, org_interp;
+    if (bmesh33_cell->bmesh == context->bmesh) {
+      /* We already know which cell of `mesh` was hit, so we
+       * interpolate in it directly instead of looking it up. */
+      size_t lc = bmesh33_get_parent_cell(bmesh33_cell->bmesh,
+                                          bmesh33_cell->l);
+      spread_interp = mesh3_linterp_in_cell(
+        mesh, eik3hh_branch_get_spread(context->branch), lc, x);
+      org_interp = mesh3_linterp_in_cell(
+        mesh, eik3hh_branch_get_org(context->branch), lc, x);
+    } else {
+      assert(false);
+    }
+    /* Convert the interpolated spreading factor to dB */
+    dbl spread_dB = 20*log10(fmax(1e-16, spread_interp));
+    /* Clamp and map the range [-60 dB, 0 dB] to [0, 1] for
+     * use as a scaling factor */
+    dbl spread_mapped = fmax(0, fmin(1, 1 - spread_dB/(-90)));
+    alpha *= spread_mapped*squash(org_interp, 2);
+  }
+
+  /* Get the surface normal and dot it with the eye vector for
+   * Lambertian shading */
+  switch (robj_type) {
+  case ROBJ_MESH2_TRI:
+    mesh2_tri_s const *mesh2_tri = robj_data;
+    mesh2_get_unit_surface_normal(context->surface_mesh, mesh2_tri->l, n);
+    break;
+  case ROBJ_BMESH33_CELL:
+    bmesh33_cell_s const *bmesh33_cell = robj_data;
+    bmesh33_cell_Df(bmesh33_cell, x, n);
+    dbl3_normalize(n);
+    break;
+  default:
+    assert(false);
+  }
+  scale *= fabs(dbl3_dot(n, dir));
+
+  dbl3_dbl_mul(base_rgb, scale*alpha, rgb);
+  *alpha_out = alpha;
+}
+
+/* We're raymarching, so we do backwards alpha blending, and stop once
+ * the pixel is nearly opaque. */
+#define RENDER_MIN_TRANSPARENCY 1e-3
+
+/* Trace the ray for pixel `(i, j)` and write its color to
+ * `pixel`. Since `camera_get_ray_for_index` is defined for any pair
+ * of indices, `(i, j)` may lie outside of the image. If `first_hit`
+ * isn't `NULL`, the ray's first intersection is written to it. */
+static void render_pixel(render_context_s const *context, int i, int j,
+                         dbl *pixel, isect *first_hit) {
+  ray3 ray = camera_get_ray_for_index(context->camera, i, j);
+
+  isect isect;
+  intersect_scene(context->surf_rtree, context->level_rtree, &ray,
+                  context->level, &isect, NULL);
+
+  if (first_hit != NULL)
+    *first_hit = isect;
+
+  pixel[0] = 0;
+  pixel[1] = 0;
+  pixel[2] = 0;
+  pixel[3] = isfinite(isect.t) ? 1 : 0;
+
+  dbl transparency = 1;
+  dbl3 rgb;
+  dbl alpha;
+
+  while (isfinite(isect.t)) {
+    /* Increment the distance along the ray */
+    dbl3_saxpy_inplace(isect.t, ray.dir, ray.org);
+
+    shade_hit(context, isect.obj, ray.org, ray.dir, rgb, &alpha);
+    dbl3_add_inplace(pixel, rgb);
+
+    /* Update transparency for early stopping */
+    transparency *= 1 - alpha;
+    if (transparency < RENDER_MIN_TRANSPARENCY)
+      break;
+
+    /* Advance the start of the ray and keep tracing.
+     *
+     * NOTE: if we have multiple overlapping intersections, we
+     * might trip them repeatedly, so we need to skip any
+     * intersections with a distance of zero here. */
+    intersect_scene(context->surf_rtree, context->level_rtree, &ray,
+                    context->level, &isect, isect.obj);
+    while (isect.t < EPS) {
+      dbl3_saxpy_inplace(EPS, ray.dir, ray.org);
+      intersect_scene(context->surf_rtree, context->level_rtree, &ray,
+                      context->level, &isect, isect.obj);
+    }
+  }
+}
+
+/* Trace the surface of the domain along `ray`, appending the hits to
+ * `hits` (whose capacity is `*capacity`), stopping once the surface
+ * alone would make the pixel opaque: level set hits can only make it
+ * opaque sooner, so the rest of the surface hits could never be
+ * used. The hits are found exactly as in `render_pixel`. Returns
+ * `false` if the pixel would need more than `RENDER_MAX_SURF_HITS`
+ * hits, in which case none are appended. */
+static bool trace_surface(render_context_s const *context, ray3 ray,
+                          surf_hit_s **hits, size_t *num_hits,
+                          size_t *capacity) {
+  size_t num_hits0 = *num_hits;
+
+  isect isect;
+  rtree_intersect(context->surf_rtree, &ray, &isect, NULL);
+
+  dbl t = 0, transparency = 1;
+
+  while (isfinite(isect.t)) {
+    if (*num_hits - num_hits0 == RENDER_MAX_SURF_HITS) {
+      *num_hits = num_hits0;
+      return false;
+    }
+
+    t += isect.t;
+    dbl3_saxpy_inplace(isect.t, ray.dir, ray.org);
+
+    if (*num_hits == *capacity) {
+      *capacity *= 2;
+      *hits = realloc(*hits, *capacity*sizeof(surf_hit_s));
+    }
+
+    surf_hit_s *hit = &(*hits)[(*num_hits)++];
+    hit->t = t;
+    shade_hit(context, isect.obj, ray.org, ray.dir, hit->rgb, &hit->alpha);
+
+    transparency *= 1 - hit->alpha;
+    if (transparency < RENDER_MIN_TRANSPARENCY)
+      break;
+
+    rtree_intersect(context->surf_rtree, &ray, &isect, isect.obj);
+    while (isect.t < EPS) {
+      t += EPS;
+      dbl3_saxpy_inplace(EPS, ray.dir, ray.org);
+      rtree_intersect(context->surf_rtree, &ray, &isect, isect.obj);
+    }
+  }
+
+  return true;
+}
+
+static void get_tile_bounds(render_context_s const *context, size_t k,
+                            size_t i[2], size_t j[2]) {
+  i[0] = RENDER_TILE_SIZE*(k/context->num_tiles[1]);
+  j[0] = RENDER_TILE_SIZE*(k%context->num_tiles[1]);
+  i[1] = MIN(i[0] + RENDER_TILE_SIZE, context->camera->dim[0]);
+  j[1] = MIN(j[0] + RENDER_TILE_SIZE, context->camera->dim[1]);
+}
+
+static void trace_surface_tile(void *ptr, size_t k) {
+  render_context_s const *context = ptr;
+
+  size_t i[2], j[2];
+  get_tile_bounds(context, k, i, j);
+
+  surf_hits_s *hits = &context->surf_hits[k];
+  size_t num_pixels = (i[1] - i[0])*(j[1] - j[0]);
+  hits->offset = malloc((num_pixels + 1)*sizeof(size_t));
+  hits->cached = malloc(num_pixels*sizeof(bool));
+
+  size_t capacity = RENDER_TILE_SIZE*RENDER_TILE_SIZE;
+  hits->hit = malloc(capacity*sizeof(surf_hit_s));
+
+  size_t p = 0;
+  hits->offset[0] = 0;
+  for (size_t i_ = i[0]; i_ < i[1]; ++i_) {
+    for (size_t j_ = j[0]; j_ < j[1]; ++j_) {
+      ray3 ray = camera_get_ray_for_index(context->camera, i_, j_);
+      size_t num_hits = hits->offset[p];
+      hits->cached[p] = trace_surface(
+        context, ray, &hits->hit, &num_hits, &capacity);
+      hits->offset[p + 1] = num_hits;
+      ++p;
+    }
+  }
+}
+
+/* Like `render_pixel`, but using the cached surface hits `hit[0]`,
+ * ..., `hit[num_hits - 1]` for this pixel, so that only the level set
+ * needs to be traced. */
+static void render_pixel_cached(render_context_s const *context,
+                                size_t i, size_t j,
+                                surf_hit_s const *hit, size_t num_hits,
+                                dbl *pixel) {
+  ray3 ray = camera_get_ray_for_index(context->camera, i, j);
+
+  isect isect;
+  rtree_intersect_at_level(context->level_rtree, &ray, context->level,
+                           &isect, NULL);
+
+  pixel[0] = 0;
+  pixel[1] = 0;
+  pixel[2] = 0;
+  pixel[3] = num_hits > 0 || isfinite(isect.t) ? 1 : 0;
+
+  /* Distance along the ray to the current ray origin */
+  dbl t = 0;
+
+  dbl transparency = 1;
+  dbl3 rgb;
+  dbl alpha;
+
+  size_t k = 0;
+  while (k < num_hits || isfinite(isect.t)) {
+    if (k < num_hits && !(t + isect.t < hit[k].t)) {
+      /* The next hit is with the surface */
+      dbl3_add_inplace(pixel, hit[k].rgb);
+      alpha = hit[k].alpha;
+      ++k;
+    } else {
+      /* The next hit is with the level set */
+      t += isect.t;
+      dbl3_saxpy_inplace(isect.t, ray.dir, ray.org);
+
+      shade_hit(context, isect.obj, ray.org, ray.dir, rgb, &alpha);
+      dbl3_add_inplace(pixel, rgb);
+
+      rtree_intersect_at_level(context->level_rtree, &ray, context->level,
+                               &isect, isect.obj);
+      while (isect.t < EPS) {
+        t += EPS;
+        dbl3_saxpy_inplace(EPS, ray.dir, ray.org);
+        rtree_intersect_at_level(context->level_rtree, &ray, context->level,
+                                 &isect, isect.obj);
+      }
+    }
+
+    transparency *= 1 - alpha;
+    if (transparency < RENDER_MIN_TRANSPARENCY)
+      break;
+  }
+}
+
+static void render_tile(void *ptr, size_t k) {
+  render_context_s const *context = ptr;
+  camera_s const *camera = context->camera;
+
+  size_t i[2], j[2];
+  get_tile_bounds(context, k, i, j);
+
+  surf_hits_s const *hits = &context->surf_hits[k];
+
+  size_t p = 0;
+  for (size_t i_ = i[0]; i_ < i[1]; ++i_) {
+    for (size_t j_ = j[0]; j_ < j[1]; ++j_) {
+      dbl *pixel = context->img[i_*camera->dim[1] + j_];
+      size_t offset = hits->offset[p];
+      if (hits->cached[p])
+        render_pixel_cached(context, i_, j_, &hits->hit[offset],
+                            hits->offset[p + 1] - offset, pixel);
+      else
+        render_pixel(context, i_, j_, pixel, NULL);
+      ++p;
+    }
+  }
+}
+
+/* Render one frame for each level set of T in `[T0, T1)`, spaced
+ * `1/frames_per_meter` apart, and write each one to `sink`, whose
+ * dimensions should match `camera`'s. Each frame is split into tiles,
+ * which are rendered by `num_threads` threads. The surface of the
+ * domain is only traced once, for the first frame; after that, each
+ * frame only traces the level set. Rendering stops early if a frame
+ * can't be written, and the first error that occurred while writing a
+ * frame (including in the background) is returned. Frames which are
+ * still being written have been written when this returns. */
+jmm_error_e eik3hh_branch_render_frames(eik3hh_branch_s const *branch,
+                                        camera_s const *camera,
+                                        dbl T0, dbl T1, dbl frames_per_meter,
+                                        framesink_s *sink, size_t num_threads,
+                                        bool verbose) {
+  assert(num_threads > 0);
+
+  size_t const *sink_dim = framesink_get_dim(sink);
+  if (sink_dim[0] != camera->dim[0] || sink_dim[1] != camera->dim[1]) {
+    log_error("sink has dimensions %lu x %lu, but camera has %lu x %lu",
+              sink_dim[0], sink_dim[1], camera->dim[0], camera->dim[1]);
+    return JMM_ERROR_BAD_ARGUMENTS;
+  }
 
   size_t num_frames = floor(frames_per_meter*(T1 - T0));
   if (verbose)
@@ -789,145 +1213,411 @@ void eik3hh_branch_render_frames(eik3hh_branch_s const *branch,
   for (size_t i = 0; i < num_frames; ++i)
     T[i] = T0 + i/frames_per_meter;
 
+  render_context_s context;
+  render_context_init(&context, branch, num_threads);
+
+  context.camera = camera;
+  for (size_t k = 0; k < 2; ++k)
+    context.num_tiles[k] =
+      (camera->dim[k] + RENDER_TILE_SIZE - 1)/RENDER_TILE_SIZE;
+  context.img = malloc(camera->dim[0]*camera->dim[1]*sizeof(dbl4));
+
+  /* Only the level changes from frame to frame, so the surface hits
+   * for each pixel are traced once up front. */
+  size_t num_tiles = context.num_tiles[0]*context.num_tiles[1];
+  context.surf_hits = malloc(num_tiles*sizeof(surf_hits_s));
+  parallel_for(num_tiles, num_threads, trace_surface_tile, &context);
+
+  jmm_error_e error = JMM_ERROR_NONE;
+
   for (size_t i = 0; i < num_frames; ++i) {
     if (verbose)
       printf("frame %lu/%lu (T = %g s)\n", i + 1, num_frames, T[i]);
 
-    rtree_s *rtree;
-    rtree_alloc(&rtree);
-    rtree_init(rtree, 16, RTREE_SPLIT_STRATEGY_SURFACE_AREA);
-
-    rtree_insert_mesh2(rtree, surface_mesh);
-
-    bmesh33_s *level_bmesh = bmesh33_restrict_to_level(bmesh, T[i]);
-    rtree_insert_bmesh33(rtree, level_bmesh);
-
-    rtree_build(rtree);
-
-    size_t npix = camera->dim[0]*camera->dim[1];
-
-    dbl4 *img = malloc(npix*sizeof(dbl4));
-
-    dbl3 surf_rgb = {0.54, 0.54, 0.54};
-    dbl3 eik_rgb = {1.0, 1.0, 1.0};
-
-    dbl surf_alpha = 0.5;
-    dbl eik_alpha = 1;
-
-    for (size_t i = 0, l = 0; i < camera->dim[0]; ++i) {
-      for (size_t j = 0; j < camera->dim[1]; ++j, ++l) {
-        ray3 ray = camera_get_ray_for_index(camera, i, j);
-
-        isect isect;
-        rtree_intersect(rtree, &ray, &isect, NULL);
-
-        img[l][0] = 0;
-        img[l][1] = 0;
-        img[l][2] = 0;
-        img[l][3] = isfinite(isect.t) ? 1 : 0;
-
-        dbl transparency = 1;
-        dbl const *rgb = NULL;
-        dbl3 n;
-
-        while (isfinite(isect.t)) {
-          robj_type_e robj_type = robj_get_type(isect.obj);
-          void const *robj_data = robj_get_data(isect.obj);
-
-          dbl alpha = 1, scale = 1;
-
-          /* Increment the distance along the ray */
-          dbl3_saxpy_inplace(isect.t, ray.dir, ray.org);
-
-          /* Update the current alpha and RGB value */
-          switch (robj_type) {
-          case ROBJ_MESH2_TRI:
-            alpha *= surf_alpha;
-            rgb = &surf_rgb[0];
-            break;
-          case ROBJ_BMESH33_CELL:
-            alpha *= eik_alpha;
-            rgb = &eik_rgb[0];
-            break;
-          default:
-            assert(false);
-          }
-
-          if (robj_type == ROBJ_BMESH33_CELL) {
-            bmesh33_cell_s const *bmesh33_cell = robj_data;
-            dbl spread_interp, org_interp;
-            if (bmesh33_cell->bmesh == level_bmesh) {
-              spread_interp = mesh3_linterp(
-                mesh, eik3hh_branch_get_spread(branch), ray.org);
-              org_interp = mesh3_linterp(
-                mesh, eik3hh_branch_get_org(branch), ray.org);
-            } else {
-              assert(false);
-            }
-            /* Convert the interpolated spreading factor to dB */
-            dbl spread_dB = 20*log10(fmax(1e-16, spread_interp));
-            /* Clamp and map the range [-60 dB, 0 dB] to [0, 1] for
-             * use as a scaling factor */
-            dbl spread_mapped = fmax(0, fmin(1, 1 - spread_dB/(-90)));
-            alpha *= spread_mapped*squash(org_interp, 2);
-          }
-
-          /* Get the surface normal and dot it with the eye vector for
-           * Lambertian shading */
-          switch (robj_type) {
-          case ROBJ_MESH2_TRI:
-            mesh2_tri_s const *mesh2_tri = robj_data;
-            mesh2_get_unit_surface_normal(surface_mesh, mesh2_tri->l, n);
-            break;
-          case ROBJ_BMESH33_CELL:
-            bmesh33_cell_s const *bmesh33_cell = robj_data;
-            bmesh33_cell_Df(bmesh33_cell, ray.org, n);
-            dbl3_normalize(n);
-            break;
-          default:
-            assert(false);
-          }
-          scale *= fabs(dbl3_dot(n, ray.dir));
-
-          /* We're raymarching, so do backwards alpha blending */
-          dbl3_saxpy_inplace(scale*alpha, rgb, img[l]);
-
-          /* Update transparency for early stopping */
-          transparency *= 1 - alpha;
-          if (transparency < 1e-3)
-            break;
-
-          /* Advance the start of the ray and keep tracing.
-           *
-           * NOTE: if we have multiple overlapping intersections, we
-           * might trip them repeatedly, so we need to skip any
-           * intersections with a distance of zero here. */
-          rtree_intersect(rtree, &ray, &isect, isect.obj);
-          while (isect.t < EPS) {
-            dbl3_saxpy_inplace(EPS, ray.dir, ray.org);
-            rtree_intersect(rtree, &ray, &isect, isect.obj);
-          }
-        }
-      }
+    context.level = T[i];
+
+    parallel_for(num_tiles, num_threads, render_tile, &context);
+
+    error = framesink_write(sink, context.img, T[i]);
+    if (error != JMM_ERROR_NONE)
+      break;
+  }
+
+  /* The last frame may still be being written in the background. */
+  if (error == JMM_ERROR_NONE)
+    error = framesink_flush(sink);
+
+  for (size_t k = 0; k < num_tiles; ++k) {
+    free(context.surf_hits[k].offset);
+    free(context.surf_hits[k].hit);
+    free(context.surf_hits[k].cached);
+  }
+  free(context.surf_hits);
+
+  free(context.img);
+
+  render_context_deinit(&context);
+
+  free(T);
+
+  return error;
+}
+
+/* Two neighboring preview samples disagree if their rays first hit
+ * different kinds of objects, if the depths of their first hits
+ * differ by more than `PREVIEW_DEPTH_RTOL` relative to the nearer of
+ * the two, or if any of their channels differ by more than
+ * `PREVIEW_RGBA_ATOL`. */
+#define PREVIEW_DEPTH_RTOL 0.05
+#define PREVIEW_RGBA_ATOL 0.05
+
+struct eik3hh_branch_preview {
+  render_context_s context;
+  camera_s camera;
+  size_t num_threads;
+
+  /* The spacing of the coarsest lattice of samples, and of the
+   * lattice which is currently being refined. */
+  size_t stride;
+  size_t level_stride;
+
+  /* The samples are stored on a lattice which covers the image and
+   * whose dimensions are one more than a multiple of `stride`, so
+   * that every block of samples is complete. The rays for samples
+   * which lie outside of the image are still well-defined. */
+  size_t dim[2];
+  dbl4 *rgba;
+  dbl *depth;
+  int *hit_type;
+  bool *sampled;
+};
+
+void eik3hh_branch_preview_alloc(eik3hh_branch_preview_s **preview) {
+  *preview = malloc(sizeof(eik3hh_branch_preview_s));
+}
+
+void eik3hh_branch_preview_dealloc(eik3hh_branch_preview_s **preview) {
+  free(*preview);
+  *preview = NULL;
+}
+
+/* Set up a preview renderer for `branch`. This builds the R-trees
+ * used for rendering once, so that each preview after that only
+ * costs as much as tracing its rays. Each preview starts from a
+ * lattice of samples spaced `stride` pixels apart (which must be a
+ * power of two), and is refined by halving the spacing of the lattice
+ * wherever neighboring samples disagree. */
+void eik3hh_branch_preview_init(eik3hh_branch_preview_s *preview,
+                                eik3hh_branch_s const *branch,
+                                size_t stride, size_t num_threads) {
+  assert(stride > 0 && (stride & (stride - 1)) == 0);
+  assert(num_threads > 0);
+
+  render_context_init(&preview->context, branch, num_threads);
+  preview->context.camera = &preview->camera;
+
+  camera_reset(&preview->camera);
+  preview->num_threads = num_threads;
+
+  preview->stride = stride;
+  preview->level_stride = stride;
+
+  preview->dim[0] = preview->dim[1] = 0;
+  preview->rgba = NULL;
+  preview->depth = NULL;
+  preview->hit_type = NULL;
+  preview->sampled = NULL;
+}
+
+void eik3hh_branch_preview_deinit(eik3hh_branch_preview_s *preview) {
+  render_context_deinit(&preview->context);
+
+  free(preview->rgba);
+  preview->rgba = NULL;
+
+  free(preview->depth);
+  preview->depth = NULL;
+
+  free(preview->hit_type);
+  preview->hit_type = NULL;
+
+  free(preview->sampled);
+  preview->sampled = NULL;
+}
+
+static void preview_sample(eik3hh_branch_preview_s *preview,
+                           size_t i, size_t j) {
+  size_t p = i*preview->dim[1] + j;
+
+  isect hit;
+  render_pixel(&preview->context, i, j, preview->rgba[p], &hit);
+
+  preview->depth[p] = hit.t;
+  preview->hit_type[p] =
+    isfinite(hit.t) ? (int)robj_get_type(hit.obj) : NO_INDEX;
+  preview->sampled[p] = true;
+}
+
+static bool preview_samples_agree(eik3hh_branch_preview_s const *preview,
+                                  size_t p, size_t q) {
+  if (preview->hit_type[p] != preview->hit_type[q])
+    return false;
+
+  if (preview->hit_type[p] != NO_INDEX) {
+    dbl depth_min = fmin(preview->depth[p], preview->depth[q]);
+    dbl depth_diff = fabs(preview->depth[p] - preview->depth[q]);
+    if (depth_diff > PREVIEW_DEPTH_RTOL*depth_min)
+      return false;
+  }
+
+  for (size_t k = 0; k < 4; ++k)
+    if (fabs(preview->rgba[p][k] - preview->rgba[q][k]) > PREVIEW_RGBA_ATOL)
+      return false;
+
+  return true;
+}
+
+/* Get the indices of the corners of the block of samples spaced `s`
+ * apart whose top-left corner is `(i, j)`. */
+static void preview_get_block(eik3hh_branch_preview_s const *preview,
+                              size_t i, size_t j, size_t s, size_t p[4]) {
+  p[0] = i*preview->dim[1] + j;
+  p[1] = p[0] + s;
+  p[2] = p[0] + s*preview->dim[1];
+  p[3] = p[2] + s;
+}
+
+static bool preview_block_is_sampled(eik3hh_branch_preview_s const *preview,
+                                     size_t i, size_t j, size_t s) {
+  size_t p[4];
+  preview_get_block(preview, i, j, s, p);
+  for (size_t k = 0; k < 4; ++k)
+    if (!preview->sampled[p[k]])
+      return false;
+  return true;
+}
+
+/* A block needs to be refined if all of its corners have been
+ * sampled (otherwise, it lies inside of a larger block which was
+ * already accepted) and any two of them disagree. */
+static bool preview_block_needs_refinement(
+  eik3hh_branch_preview_s const *preview, size_t i, size_t j, size_t s) {
+  if (!preview_block_is_sampled(preview, i, j, s))
+    return false;
+
+  size_t p[4];
+  preview_get_block(preview, i, j, s, p);
+  for (size_t k = 0; k < 4; ++k)
+    for (size_t l = k + 1; l < 4; ++l)
+      if (!preview_samples_agree(preview, p[k], p[l]))
+        return true;
+  return false;
+}
+
+/* Sample row `k` of the coarsest lattice. */
+static void preview_sample_row(void *ptr, size_t k) {
+  eik3hh_branch_preview_s *preview = ptr;
+  size_t s = preview->stride;
+  for (size_t j = 0; j < preview->dim[1]; j += s)
+    preview_sample(preview, k*s, j);
+}
+
+/* Sample the points in row `k` of the lattice with spacing `s/2`
+ * which aren't in the lattice with spacing `s`, but only if they're
+ * on the boundary of or inside a block of the lattice with spacing
+ * `s` which needs refinement. The samples which are read and the
+ * samples which are written never overlap, so rows can be refined in
+ * parallel. */
+static void preview_refine_row(void *ptr, size_t k) {
+  eik3hh_branch_preview_s *preview = ptr;
+  size_t s = preview->level_stride, h = s/2;
+
+  size_t i = k*h;
+  for (size_t j = 0; j < preview->dim[1]; j += h) {
+    bool refine = false;
+    if (i % s == 0 && j % s == 0) {
+      continue;
+    } else if (i % s != 0 && j % s != 0) {
+      /* Center of a block */
+      refine = preview_block_needs_refinement(preview, i - h, j - h, s);
+    } else if (i % s == 0) {
+      /* Midpoint of a horizontal edge: check the blocks above and
+       * below */
+      if (i >= s)
+        refine |= preview_block_needs_refinement(preview, i - s, j - h, s);
+      if (i + s < preview->dim[0])
+        refine |= preview_block_needs_refinement(preview, i, j - h, s);
+    } else {
+      /* Midpoint of a vertical edge: check the blocks to the left and
+       * right */
+      if (j >= s)
+        refine |= preview_block_needs_refinement(preview, i - h, j - s, s);
+      if (j + s < preview->dim[1])
+        refine |= preview_block_needs_refinement(preview, i - h, j, s);
+    }
+    if (refine)
+      preview_sample(preview, i, j);
+  }
+}
+
+/* Start a new preview of the level set at `T`, viewed from `camera`,
+ * and sample the coarsest lattice. This can be called repeatedly
+ * (e.g., as the camera or `T` change) without reinitializing
+ * `preview`. */
+void eik3hh_branch_preview_begin(eik3hh_branch_preview_s *preview,
+                                 camera_s const *camera, dbl T) {
+  size_t s = preview->stride;
+
+  size_t dim[2];
+  for (size_t k = 0; k < 2; ++k)
+    dim[k] = s*MAX((size_t)1, (camera->dim[k] + s - 2)/s) + 1;
+
+  if (dim[0] != preview->dim[0] || dim[1] != preview->dim[1]) {
+    preview->dim[0] = dim[0];
+    preview->dim[1] = dim[1];
+
+    size_t n = dim[0]*dim[1];
+    preview->rgba = realloc(preview->rgba, n*sizeof(dbl4));
+    preview->depth = realloc(preview->depth, n*sizeof(dbl));
+    preview->hit_type = realloc(preview->hit_type, n*sizeof(int));
+    preview->sampled = realloc(preview->sampled, n*sizeof(bool));
+  }
+
+  memset(preview->sampled, 0x0, dim[0]*dim[1]*sizeof(bool));
+
+  preview->camera = *camera;
+  preview->context.level = T;
+  preview->level_stride = s;
+
+  parallel_for((dim[0] - 1)/s + 1, preview->num_threads,
+               preview_sample_row, preview);
+}
+
+/* Halve the spacing of the lattice of samples where neighboring
+ * samples disagree. Returns `false` without doing anything if the
+ * preview is already at full resolution. */
+bool eik3hh_branch_preview_refine(eik3hh_branch_preview_s *preview) {
+  size_t s = preview->level_stride;
+  if (s == 1)
+    return false;
+
+  parallel_for((preview->dim[0] - 1)/(s/2) + 1, preview->num_threads,
+               preview_refine_row, preview);
+
+  preview->level_stride = s/2;
+
+  return true;
+}
+
+/* Refine the preview until it's at full resolution. */
+void eik3hh_branch_preview_finish(eik3hh_branch_preview_s *preview) {
+  while (eik3hh_branch_preview_refine(preview));
+}
+
+static void preview_get_image_row(eik3hh_branch_preview_s const *preview,
+                                  size_t i, dbl4 *img) {
+  for (size_t j = 0; j < preview->camera.dim[1]; ++j) {
+    size_t p = i*preview->dim[1] + j;
+    dbl *pixel = img[i*preview->camera.dim[1] + j];
+
+    if (preview->sampled[p]) {
+      dbl4_copy(preview->rgba[p], pixel);
+      continue;
     }
 
-    char filename[128];
-    snprintf(filename, 128, "image%04lu.bin", i);
+    /* Find the smallest complete block containing this pixel and
+     * interpolate its corners. The coarsest lattice is always
+     * complete, so this terminates. */
+    size_t s = 1, i0, j0;
+    do {
+      s *= 2;
+      assert(s <= preview->stride);
+      i0 = MIN(i - i%s, preview->dim[0] - 1 - s);
+      j0 = MIN(j - j%s, preview->dim[1] - 1 - s);
+    } while (!preview_block_is_sampled(preview, i0, j0, s));
+
+    size_t q[4];
+    preview_get_block(preview, i0, j0, s, q);
+
+    dbl u = ((dbl)(i - i0))/s, v = ((dbl)(j - j0))/s;
+    for (size_t k = 0; k < 4; ++k)
+      pixel[k] =
+        (1 - u)*((1 - v)*preview->rgba[q[0]][k] + v*preview->rgba[q[1]][k]) +
+        u*((1 - v)*preview->rgba[q[2]][k] + v*preview->rgba[q[3]][k]);
+  }
+}
 
-    FILE *fp = fopen(filename, "wb");
-    fwrite(img, sizeof(dbl4), npix, fp);
-    fclose(fp);
+/* Write the current preview to `img`, which should have the
+ * dimensions of the camera passed to `eik3hh_branch_preview_begin`.
+ * Pixels which haven't been sampled yet are bilinearly interpolated
+ * from the corners of the smallest block containing them. */
+void eik3hh_branch_preview_get_image(eik3hh_branch_preview_s const *preview,
+                                     dbl4 *img) {
+  for (size_t i = 0; i < preview->camera.dim[0]; ++i)
+    preview_get_image_row(preview, i, img);
+}
 
-    bmesh33_deinit(level_bmesh);
-    bmesh33_dealloc(&level_bmesh);
+/* Get the number of rays which have been traced for the current
+ * preview. */
+size_t eik3hh_branch_preview_get_num_traced(
+  eik3hh_branch_preview_s const *preview) {
+  size_t num_traced = 0;
+  for (size_t p = 0; p < preview->dim[0]*preview->dim[1]; ++p)
+    num_traced += preview->sampled[p];
+  return num_traced;
+}
 
-    rtree_deinit(rtree);
-    rtree_dealloc(&rtree);
+#if JMM_TEST
+/* Render the frame for the level set at `T` to `img`, either tracing
+ * every pixel from scratch with `render_pixel`, or, if `cached` is
+ * set, tracing the surface once per pixel and then using the cached
+ * hits, as `eik3hh_branch_render_frames` does. Returns the number of
+ * pixels whose surface hits couldn't be cached. */
+size_t eik3hh_branch_render_frame(eik3hh_branch_s const *branch,
+                                  camera_s const *camera, dbl T, bool cached,
+                                  dbl4 *img) {
+  render_context_s context;
+  render_context_init(&context, branch, 1);
+
+  context.camera = camera;
+  context.level = T;
+  for (size_t k = 0; k < 2; ++k)
+    context.num_tiles[k] =
+      (camera->dim[k] + RENDER_TILE_SIZE - 1)/RENDER_TILE_SIZE;
+  context.img = img;
+
+  size_t num_uncached = 0;
+
+  if (cached) {
+    size_t num_tiles = context.num_tiles[0]*context.num_tiles[1];
+    context.surf_hits = malloc(num_tiles*sizeof(surf_hits_s));
+    for (size_t k = 0; k < num_tiles; ++k) {
+      trace_surface_tile(&context, k);
+      render_tile(&context, k);
+
+      size_t i[2], j[2];
+      get_tile_bounds(&context, k, i, j);
+      for (size_t p = 0; p < (i[1] - i[0])*(j[1] - j[0]); ++p)
+        num_uncached += !context.surf_hits[k].cached[p];
+
+      free(context.surf_hits[k].offset);
+      free(context.surf_hits[k].hit);
+      free(context.surf_hits[k].cached);
+    }
+    free(context.surf_hits);
+  } else {
+    for (size_t i = 0; i < camera->dim[0]; ++i)
+      for (size_t j = 0; j < camera->dim[1]; ++j)
+        render_pixel(&context, i, j, img[i*camera->dim[1] + j], NULL);
   }
 
-  mesh2_deinit(surface_mesh);
-  mesh2_dealloc(&surface_mesh);
+  render_context_deinit(&context);
 
-  bmesh33_deinit(bmesh);
-  bmesh33_dealloc(&bmesh);
+  return num_uncached;
 }
+
+bool eik3hh_branch_preview_is_sampled(eik3hh_branch_preview_s const *preview,
+                                      size_t i, size_t j) {
+  return preview->sampled[i*preview->dim[1] + j];
+}
+#endif
@@ -0,0 +1,452 @@
+#include <jmm/framesink.h>
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "macros.h"
+
+#define FRAMESINK_INITIAL_CAPACITY 64
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint64_t dim[2];
+} framesink_header_s;
+
+typedef struct {
+  uint64_t offset;
+  dbl time;
+} framesink_index_entry_s;
+
+typedef struct {
+  uint64_t index_offset;
+  uint64_t num_frames;
+  char magic[8];
+} framesink_footer_s;
+
+struct framesink {
+  framesink_type_e type;
+  framesink_format_e format;
+  size_t dim[2];
+  size_t frame_size; // Size of a frame in bytes
+  char *path;
+
+  /* The container file, and its index so far. New frames are written
+   * at `offset`. */
+  FILE *fp;
+  size_t num_frames, capacity;
+  framesink_index_entry_s *index;
+  uint64_t offset;
+
+  /* The first error that occurred while writing a frame. */
+  jmm_error_e error;
+
+  /* Frames are quantized into one of these buffers before being
+   * written. With a background writer, the caller fills one buffer
+   * while the writer writes the other. */
+  void *buf[2];
+  size_t cur;
+
+  /* State shared with the background writer. The caller hands off a
+   * frame by setting `pending`, and the writer clears it once it's
+   * written the frame. The caller sets `done` once there are no more
+   * frames. */
+  bool background;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool pending;
+  bool done;
+  void const *pending_buf;
+  dbl pending_time;
+};
+
+static size_t get_pixel_size(framesink_format_e format) {
+  switch (format) {
+  case FRAMESINK_FORMAT_DBL4:
+    return sizeof(dbl4);
+  case FRAMESINK_FORMAT_RGBA8:
+    return 4*sizeof(uint8_t);
+  case FRAMESINK_FORMAT_RGBA16:
+    return 4*sizeof(uint16_t);
+  default:
+    assert(false);
+    return 0;
+  }
+}
+
+static void quantize(framesink_s const *sink, dbl4 const *img, void *buf) {
+  size_t npix = sink->dim[0]*sink->dim[1];
+  dbl const *x = (dbl const *)img;
+
+  switch (sink->format) {
+  case FRAMESINK_FORMAT_DBL4:
+    memcpy(buf, img, npix*sizeof(dbl4));
+    break;
+  case FRAMESINK_FORMAT_RGBA8: {
+    uint8_t *q = buf;
+    for (size_t i = 0; i < 4*npix; ++i)
+      q[i] = round(UINT8_MAX*fmax(0, fmin(1, x[i])));
+    break;
+  }
+  case FRAMESINK_FORMAT_RGBA16: {
+    uint16_t *q = buf;
+    for (size_t i = 0; i < 4*npix; ++i)
+      q[i] = round(UINT16_MAX*fmax(0, fmin(1, x[i])));
+    break;
+  }
+  default:
+    assert(false);
+  }
+}
+
+static jmm_error_e write_files_frame(framesink_s *sink, void const *buf) {
+  size_t n = strlen(sink->path) + 32;
+  char *filename = malloc(n);
+  snprintf(filename, n, "%s%04lu.bin", sink->path, sink->num_frames);
+
+  jmm_error_e error = JMM_ERROR_NONE;
+
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    log_error("failed to open file \"%s\"", filename);
+    error = JMM_ERROR_RUNTIME_ERROR;
+    goto cleanup;
+  }
+
+  if (fwrite(buf, sink->frame_size, 1, fp) != 1) {
+    log_error("failed to write frame to \"%s\"", filename);
+    error = JMM_ERROR_RUNTIME_ERROR;
+  }
+
+  fclose(fp);
+
+cleanup:
+  free(filename);
+
+  return error;
+}
+
+static jmm_error_e write_container_frame(framesink_s *sink, void const *buf,
+                                         dbl time) {
+  if (fseek(sink->fp, sink->offset, SEEK_SET) != 0 ||
+      fwrite(buf, sink->frame_size, 1, sink->fp) != 1) {
+    log_error("failed to write frame to \"%s\"", sink->path);
+    return JMM_ERROR_RUNTIME_ERROR;
+  }
+
+  if (sink->num_frames == sink->capacity) {
+    sink->capacity *= 2;
+    sink->index = realloc(
+      sink->index, sink->capacity*sizeof(framesink_index_entry_s));
+  }
+  sink->index[sink->num_frames] = (framesink_index_entry_s) {
+    .offset = sink->offset,
+    .time = time
+  };
+
+  sink->offset += sink->frame_size;
+
+  return JMM_ERROR_NONE;
+}
+
+/* Write a frame which has already been quantized into `buf`. */
+static void write_frame(framesink_s *sink, void const *buf, dbl time) {
+  jmm_error_e error = JMM_ERROR_NONE;
+
+  if (sink->type == FRAMESINK_TYPE_FILES)
+    error = write_files_frame(sink, buf);
+  else if (sink->type == FRAMESINK_TYPE_CONTAINER)
+    error = write_container_frame(sink, buf, time);
+  else
+    assert(false);
+
+  if (error == JMM_ERROR_NONE)
+    ++sink->num_frames;
+  else if (sink->error == JMM_ERROR_NONE)
+    sink->error = error;
+}
+
+static void *writer(void *ptr) {
+  framesink_s *sink = ptr;
+
+  pthread_mutex_lock(&sink->lock);
+  while (true) {
+    while (!sink->pending && !sink->done)
+      pthread_cond_wait(&sink->cond, &sink->lock);
+    if (!sink->pending)
+      break;
+
+    /* The caller won't touch the sink's frame bookkeeping until we
+     * clear `pending`, so we can write without holding the lock. */
+    pthread_mutex_unlock(&sink->lock);
+    write_frame(sink, sink->pending_buf, sink->pending_time);
+    pthread_mutex_lock(&sink->lock);
+
+    sink->pending = false;
+    pthread_cond_broadcast(&sink->cond);
+  }
+  pthread_mutex_unlock(&sink->lock);
+
+  return NULL;
+}
+
+/* Wait for the background writer to finish writing the frame it's
+ * been handed, if any. */
+static void wait_for_writer(framesink_s *sink) {
+  pthread_mutex_lock(&sink->lock);
+  while (sink->pending)
+    pthread_cond_wait(&sink->cond, &sink->lock);
+  pthread_mutex_unlock(&sink->lock);
+}
+
+/* Open the container at `sink->path`, creating it if it doesn't
+ * exist. If it does, read its index so that we can append to it. */
+static jmm_error_e open_container(framesink_s *sink) {
+  framesink_header_s header = {
+    .magic = FRAMESINK_MAGIC,
+    .version = FRAMESINK_VERSION,
+    .format = sink->format,
+    .dim = {sink->dim[0], sink->dim[1]}
+  };
+
+  sink->fp = fopen(sink->path, "r+b");
+
+  // The container doesn't exist yet, so create it and write the
+  // header.
+  if (sink->fp == NULL) {
+    sink->fp = fopen(sink->path, "w+b");
+    if (sink->fp == NULL) {
+      log_error("failed to open file \"%s\"", sink->path);
+      return JMM_ERROR_RUNTIME_ERROR;
+    }
+    if (fwrite(&header, sizeof(header), 1, sink->fp) != 1) {
+      log_error("failed to write header to \"%s\"", sink->path);
+      return JMM_ERROR_RUNTIME_ERROR;
+    }
+    sink->offset = sizeof(header);
+    return JMM_ERROR_NONE;
+  }
+
+  // Otherwise, check that we can append to it...
+  framesink_header_s old_header;
+  if (fread(&old_header, sizeof(old_header), 1, sink->fp) != 1 ||
+      memcmp(&old_header, &header, sizeof(header)) != 0) {
+    log_error("\"%s\" isn't a container with matching format and dimensions",
+              sink->path);
+    return JMM_ERROR_BAD_ARGUMENTS;
+  }
+
+  framesink_footer_s footer;
+  if (fseek(sink->fp, -(long)sizeof(footer), SEEK_END) != 0 ||
+      fread(&footer, sizeof(footer), 1, sink->fp) != 1 ||
+      memcmp(footer.magic, FRAMESINK_MAGIC, sizeof(footer.magic)) != 0) {
+    log_error("\"%s\" has no footer (was it closed properly?)", sink->path);
+    return JMM_ERROR_RUNTIME_ERROR;
+  }
+
+  // ... and read its index. The next frame will be written over the
+  // old index.
+  sink->num_frames = footer.num_frames;
+  sink->capacity = MAX(sink->capacity, sink->num_frames);
+  sink->index = realloc(
+    sink->index, sink->capacity*sizeof(framesink_index_entry_s));
+  if (fseek(sink->fp, footer.index_offset, SEEK_SET) != 0 ||
+      fread(sink->index, sizeof(framesink_index_entry_s), sink->num_frames,
+            sink->fp) != sink->num_frames) {
+    log_error("failed to read index from \"%s\"", sink->path);
+    return JMM_ERROR_RUNTIME_ERROR;
+  }
+  sink->offset = footer.index_offset;
+
+  return JMM_ERROR_NONE;
+}
+
+static jmm_error_e close_container(framesink_s *sink) {
+  framesink_footer_s footer = {
+    .index_offset = sink->offset,
+    .num_frames = sink->num_frames,
+    .magic = FRAMESINK_MAGIC
+  };
+
+  jmm_error_e error = JMM_ERROR_NONE;
+  if (fseek(sink->fp, sink->offset, SEEK_SET) != 0 ||
+      fwrite(sink->index, sizeof(framesink_index_entry_s), sink->num_frames,
+             sink->fp) != sink->num_frames ||
+      fwrite(&footer, sizeof(footer), 1, sink->fp) != 1) {
+    log_error("failed to write index to \"%s\"", sink->path);
+    error = JMM_ERROR_RUNTIME_ERROR;
+  }
+
+  if (fclose(sink->fp) != 0)
+    error = JMM_ERROR_RUNTIME_ERROR;
+  sink->fp = NULL;
+
+  return error;
+}
+
+void framesink_alloc(framesink_s **sink) {
+  *sink = malloc(sizeof(framesink_s));
+}
+
+void framesink_dealloc(framesink_s **sink) {
+  free(*sink);
+  *sink = NULL;
+}
+
+/* Set up a sink for frames with `dim[0]` rows and `dim[1]` columns
+ * (see `framesink_type_e` for what `path` means). This fails if the
+ * container can't be opened or can't be appended to, in which case
+ * the sink should still be deinitialized. */
+jmm_error_e framesink_init(framesink_s *sink, framesink_type_e type,
+                           char const *path, framesink_format_e format,
+                           size_t const dim[2], bool background) {
+  sink->type = type;
+  sink->format = format;
+  sink->dim[0] = dim[0];
+  sink->dim[1] = dim[1];
+  sink->frame_size = dim[0]*dim[1]*get_pixel_size(format);
+
+  size_t n = strlen(path);
+  sink->path = malloc(n + 1);
+  strncpy(sink->path, path, n + 1);
+
+  sink->fp = NULL;
+  sink->num_frames = 0;
+  sink->capacity = FRAMESINK_INITIAL_CAPACITY;
+  sink->index = malloc(sink->capacity*sizeof(framesink_index_entry_s));
+  sink->offset = 0;
+
+  sink->error = JMM_ERROR_NONE;
+
+  sink->buf[0] = malloc(sink->frame_size);
+  sink->buf[1] = background ? malloc(sink->frame_size) : NULL;
+  sink->cur = 0;
+
+  sink->background = false;
+  sink->pending = false;
+  sink->done = false;
+
+  if (type == FRAMESINK_TYPE_CONTAINER) {
+    sink->error = open_container(sink);
+    if (sink->error != JMM_ERROR_NONE) {
+      // Leave an existing file alone if we can't append to it.
+      if (sink->fp != NULL)
+        fclose(sink->fp);
+      sink->fp = NULL;
+      return sink->error;
+    }
+  }
+
+  if (background) {
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->cond, NULL);
+    pthread_create(&sink->thread, NULL, writer, sink);
+    sink->background = true;
+  }
+
+  return JMM_ERROR_NONE;
+}
+
+/* Finish writing any frames which are still being written, and close
+ * the container (writing its index). This returns the first error
+ * that occurred while writing a frame (including in the background)
+ * or while closing the container. */
+jmm_error_e framesink_deinit(framesink_s *sink) {
+  if (sink->background) {
+    pthread_mutex_lock(&sink->lock);
+    sink->done = true;
+    pthread_cond_broadcast(&sink->cond);
+    pthread_mutex_unlock(&sink->lock);
+
+    pthread_join(sink->thread, NULL);
+    pthread_cond_destroy(&sink->cond);
+    pthread_mutex_destroy(&sink->lock);
+  }
+
+  jmm_error_e error = sink->error;
+
+  if (sink->fp != NULL) {
+    jmm_error_e close_error = close_container(sink);
+    if (error == JMM_ERROR_NONE)
+      error = close_error;
+  }
+
+  free(sink->path);
+  sink->path = NULL;
+
+  free(sink->index);
+  sink->index = NULL;
+
+  free(sink->buf[0]);
+  free(sink->buf[1]);
+  sink->buf[0] = sink->buf[1] = NULL;
+
+  return error;
+}
+
+/* Write the frame `img` (`dim[0]*dim[1]` pixels in row-major order),
+ * which was rendered at `time`. The time is only stored by a
+ * container. With a background writer, this returns once `img` has
+ * been copied, and `img` can then be reused. Errors which occur while
+ * a frame is being written in the background are returned by the
+ * next call. */
+jmm_error_e framesink_write(framesink_s *sink, dbl4 const *img, dbl time) {
+  void *buf = sink->buf[sink->cur];
+
+  // With a background writer, this overlaps with writing the
+  // previous frame, which uses the other buffer.
+  quantize(sink, img, buf);
+
+  if (!sink->background) {
+    write_frame(sink, buf, time);
+    return sink->error;
+  }
+
+  wait_for_writer(sink);
+
+  pthread_mutex_lock(&sink->lock);
+  jmm_error_e error = sink->error;
+  sink->pending = true;
+  sink->pending_buf = buf;
+  sink->pending_time = time;
+  pthread_cond_broadcast(&sink->cond);
+  pthread_mutex_unlock(&sink->lock);
+
+  sink->cur = 1 - sink->cur;
+
+  return error;
+}
+
+/* Wait for any frame being written in the background to finish, and
+ * return the first error that occurred while writing a frame. */
+jmm_error_e framesink_flush(framesink_s *sink) {
+  if (sink->background)
+    wait_for_writer(sink);
+  return sink->error;
+}
+
+/* Get the number of frames written so far. With a background writer,
+ * this waits for the frame being written to finish. */
+size_t framesink_get_num_frames(framesink_s const *sink) {
+  if (sink->background)
+    wait_for_writer((framesink_s *)sink);
+  return sink->num_frames;
+}
+
+/* Get the number of bytes in each frame. */
+size_t framesink_get_frame_size(framesink_s const *sink) {
+  return sink->frame_size;
+}
+
+/* Get the number of rows and columns in each frame. */
+size_t const *framesink_get_dim(framesink_s const *sink) {
+  return sink->dim;
+}
@@ -256,6 +256,27 @@ void tetra3_get_bary_coords(tetra3 const *tetra, dbl const x[3], dbl b[4]) {
   dbl4_normalize1(b);
 }
 
+/* Get the affine map taking a point to its barycentric coordinates
+ * with respect to `tetra`. The first three barycentric coordinates of
+ * `x` are `b[i] = A[i][0]*x[0] + A[i][1]*x[1] + A[i][2]*x[2] +
+ * A[i][3]`, and the last is `b[3] = 1 - b[0] - b[1] - b[2]`. Computing
+ * this once is much cheaper than calling `tetra3_get_bary_coords`
+ * for each point. */
+void tetra3_get_bary_map(tetra3 const *tetra, dbl34 A) {
+  dbl44 lhs;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 4; ++j)
+      lhs[i][j] = tetra->v[j][i];
+  for (int j = 0; j < 4; ++j)
+    lhs[3][j] = 1;
+
+  dbl44_invert(lhs);
+
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 4; ++j)
+      A[i][j] = lhs[i][j];
+}
+
 void tetra3_get_centroid(tetra3 const *tetra, dbl c[3]) {
   for (int j = 0; j < 3; ++j) {
     c[j] = 0;
@@ -354,6 +375,11 @@ void rect3_insert_point(rect3 *rect, dbl const x[3]) {
   dbl3_max(rect->max, x, rect->max);
 }
 
+void rect3_insert_rect3(rect3 *rect, rect3 const *other) {
+  dbl3_min(rect->min, other->min, rect->min);
+  dbl3_max(rect->max, other->max, rect->max);
+}
+
 void rect3_insert_tri3(rect3 *rect, tri3 const *tri) {
   for (int i = 0; i < 3; ++i) {
     dbl3_min(rect->min, tri->v[i], rect->min);
@@ -381,7 +407,7 @@ void rect3_insert_mesh3_tetra(rect3 *rect, mesh3_tetra_s const *tetra) {
 dbl rect3_surface_area(rect3 const *rect) {
   dbl extent[3];
   rect3_get_extent(rect, extent);
-  return 2*dbl3_normsq(extent);
+  return 2*(extent[0]*extent[1] + extent[1]*extent[2] + extent[2]*extent[0]);
 }
 
 bool rect3_is_empty(rect3 const *rect) {
@@ -449,67 +475,28 @@ void ray3_get_point(ray3 const *ray, dbl t, dbl x[3]) {
   dbl3_saxpy(t, ray->dir, ray->org, x);
 }
 
+/* Find the smallest `t >= 0` such that `ray->org + t*ray->dir` lies
+ * in `rect` using the slab test: the ray is clipped against each of
+ * the three slabs bounding `rect`, and it hits `rect` if what's left
+ * is nonempty. If the ray starts inside `rect`, this returns zero, and
+ * if it misses `rect`, it returns `INFINITY`. */
 dbl ray3_intersect_rect3(ray3 const *ray, rect3 const *rect) {
-  dbl x = ray->org[0], y = ray->org[1], z = ray->org[2];
-  dbl u = ray->dir[0], v = ray->dir[1], w = ray->dir[2];
-  dbl x0 = rect->min[0], y0 = rect->min[1], z0 = rect->min[2];
-  dbl x1 = rect->max[0], y1 = rect->max[1], z1 = rect->max[2];
-
-  /* ray parameters */
-  dbl s, t = INFINITY;
-  dbl xs, ys, zs;
-
-  dbl const atol = 1e-15;
-
-  if (fabs(u) > atol) {
-    /* Check for intersection with {x0} x [y0, y1] x [z0, z1] */
-    s = (x0 - x)/u;
-    ys = y + s*v;
-    zs = z + s*w;
-    if (s >= 0 && y0 <= ys && ys <= y1 && z0 <= zs && zs <= z1)
-      t = fmin(s, t);
-
-    /* Check for intersection with {x1} x [y0, y1] x [z0, z1] */
-    s = (x1 - x)/u;
-    ys = y + s*v;
-    zs = z + s*w;
-    if (s >= 0 && y0 <= ys && ys <= y1 && z0 <= zs && zs <= z1)
-      t = fmin(s, t);
-  }
-
-  if (fabs(v) > atol) {
-    /* Check for intersection with [x0, x1] x {y0} x [z0, z1] */
-    s = (y0 - y)/v;
-    xs = x + s*u;
-    zs = z + s*w;
-    if (s >= 0 && x0 <= xs && xs <= x1 && z0 <= zs && zs <= z1)
-      t = fmin(s, t);
-
-    /* Check for intersection with [x0, x1] x {y1} x [z0, z1] */
-    s = (y1 - y)/v;
-    xs = x + s*u;
-    zs = z + s*w;
-    if (s >= 0 && x0 <= xs && xs <= x1 && z0 <= zs && zs <= z1)
-      t = fmin(s, t);
-  }
-
-  if (fabs(w) > atol) {
-    /* Check for intersection with [x0, x1] x [y0, y1] x {z0} */
-    s = (z0 - z)/w;
-    xs = x + s*u;
-    ys = y + s*v;
-    if (s >= 0 && x0 <= xs && xs <= x1 && y0 <= ys && ys <= y1)
-      t = fmin(s, t);
-
-    /* Check for intersection with [x0, x1] x [y0, y1] x {z1} */
-    s = (z1 - z)/w;
-    xs = x + s*u;
-    ys = y + s*v;
-    if (s >= 0 && x0 <= xs && xs <= x1 && y0 <= ys && ys <= y1)
-      t = fmin(s, t);
+  dbl tmin = 0, tmax = INFINITY;
+  for (size_t i = 0; i < 3; ++i) {
+    /* A ray parallel to a slab either lies inside it or misses
+     * `rect` entirely. */
+    if (ray->dir[i] == 0) {
+      if (ray->org[i] < rect->min[i] || rect->max[i] < ray->org[i])
+        return INFINITY;
+      continue;
+    }
+    dbl inv_dir = 1/ray->dir[i];
+    dbl t0 = (rect->min[i] - ray->org[i])*inv_dir;
+    dbl t1 = (rect->max[i] - ray->org[i])*inv_dir;
+    tmin = fmax(tmin, fmin(t0, t1));
+    tmax = fmin(tmax, fmax(t0, t1));
   }
-
-  return t;
+  return tmin <= tmax ? tmin : INFINITY;
 }
 
 bool ray3_intersects_mesh3_tetra(ray3 const *ray, mesh3_tetra_s const *tetra, dbl *t) {
@@ -602,6 +589,51 @@ static void tetra3_get_face(tetra3 const *tetra, int p[3], tri3 *tri) {
   }
 }
 
+/* Clip `ray` to the tetrahedron whose barycentric map is `A` (see
+ * `tetra3_get_bary_map`). Each barycentric coordinate is an affine
+ * function of the ray parameter, so the part of the ray inside the
+ * tetrahedron (where they're all nonnegative) is an interval, which
+ * we find in one pass. If it's nonempty, its endpoints are returned
+ * in `s` (with `s[0] == 0` if the ray starts inside the
+ * tetrahedron), along with the barycentric coordinates of the
+ * corresponding points in `b`.
+ *
+ * A coordinate which varies by less than `atol` along the ray is
+ * treated as constant, and the ray is only outside if it's less than
+ * `-atol`. Otherwise, a ray lying in a face shared by two tetrahedra
+ * can miss both of them due to rounding error. */
+bool ray3_clip_to_bary_map(ray3 const *ray, dbl34 const A, dbl s[2],
+                           dbl4 b[2]) {
+  dbl const atol = 1e-13;
+
+  dbl p[4], q[4];
+  for (int i = 0; i < 3; ++i) {
+    p[i] = dbl3_dot(A[i], ray->org) + A[i][3];
+    q[i] = dbl3_dot(A[i], ray->dir);
+  }
+  p[3] = 1 - p[0] - p[1] - p[2];
+  q[3] = -q[0] - q[1] - q[2];
+
+  s[0] = 0;
+  s[1] = INFINITY;
+  for (int i = 0; i < 4; ++i) {
+    if (q[i] > atol)
+      s[0] = fmax(s[0], -p[i]/q[i]);
+    else if (q[i] < -atol)
+      s[1] = fmin(s[1], -p[i]/q[i]);
+    else if (p[i] < -atol)
+      return false;
+  }
+  if (s[0] > s[1] || isinf(s[1])) // (`isinf(s[1])` iff `ray->dir == 0`)
+    return false;
+
+  for (int j = 0; j < 2; ++j)
+    for (int i = 0; i < 4; ++i)
+      b[j][i] = p[i] + s[j]*q[i];
+
+  return true;
+}
+
 bool ray3_intersects_tetra3(ray3 const *ray, tetra3 const *tetra, dbl *t) {
   tri3 tri;
   dbl s;
@@ -1,13 +1,48 @@
 #include <jmm/heap.h>
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 
+#include <jmm/bucket.h>
+
+/* The number of buckets in the circular array used by
+ * `HEAP_TYPE_BUCKET`. Nodes whose keys are further ahead of the
+ * current bucket than this go straight into the current bucket's
+ * heap. */
+#define NUM_BUCKETS 64
+
+/* Value of `heap->lb[ind]` for nodes which aren't waiting in a
+ * bucket */
+#define NOT_DEFERRED INT_MIN
+
+/* A node of a `HEAP_TYPE_4ARY` or `HEAP_TYPE_BUCKET` heap. */
+typedef struct node {
+  dbl key;
+  int ind;
+} node_s;
+
 struct heap {
+  heap_type_e type;
   int capacity;
   int size;
-  int* inds;
+  int* inds; /* used by `HEAP_TYPE_BINARY` */
+  node_s *nodes; /* used by `HEAP_TYPE_4ARY` and `HEAP_TYPE_BUCKET` */
+
+  /* Used by `HEAP_TYPE_BUCKET`. The nodes in `nodes` are those in
+   * the current bucket (index `lb0`) along with any whose keys were
+   * too far ahead to bucket. The rest are in `bucket`, a circular
+   * array where bucket `lb` is `bucket[lb mod NUM_BUCKETS]`. A
+   * bucket can contain stale entries, so `lb[ind]` keeps track of
+   * the bucket that node `ind` is really in. */
+  dbl width;
+  int lb0;
+  bucket_s *bucket[NUM_BUCKETS];
+  int num_deferred;
+  int *lb;
+  int lb_capacity;
+
   value_f value;
   setpos_f setpos;
   void *context;
@@ -23,17 +58,43 @@ void heap_dealloc(heap_s **heap) {
   *heap = NULL;
 }
 
-void heap_init(heap_s *heap, int capacity, value_f value, setpos_f setpos,
-               void *context) {
+void heap_init(heap_s *heap, heap_type_e type, int capacity, value_f value,
+               setpos_f setpos, void *context) {
+  /* Make sure we can always grow the heap by doubling its capacity */
+  if (capacity < 1)
+    capacity = 1;
+
+  heap->type = type;
   heap->capacity = capacity;
   heap->size = 0;
-  heap->inds = malloc(heap->capacity*sizeof(int));
-  assert(heap->inds != NULL);
+  heap->inds = NULL;
+  heap->nodes = NULL;
+  if (heap->type == HEAP_TYPE_BINARY) {
+    heap->inds = malloc(heap->capacity*sizeof(int));
+    assert(heap->inds != NULL);
 #if SJS_DEBUG
-  for (int i = 0; i < heap->capacity; ++i) {
-    heap->inds[i] = NO_INDEX;
-  }
+    for (int i = 0; i < heap->capacity; ++i) {
+      heap->inds[i] = NO_INDEX;
+    }
 #endif
+  } else if (heap->type == HEAP_TYPE_4ARY) {
+    heap->nodes = malloc(heap->capacity*sizeof(node_s));
+    assert(heap->nodes != NULL);
+  } else if (heap->type == HEAP_TYPE_BUCKET) {
+    heap->nodes = malloc(heap->capacity*sizeof(node_s));
+    assert(heap->nodes != NULL);
+    heap->width = INFINITY;
+    heap->lb0 = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+      bucket_alloc(&heap->bucket[i]);
+      bucket_init(heap->bucket[i]);
+    }
+    heap->num_deferred = 0;
+    heap->lb = NULL;
+    heap->lb_capacity = 0;
+  } else {
+    assert(false);
+  }
   heap->value = value;
   heap->setpos = setpos;
   heap->context = context;
@@ -42,10 +103,37 @@ void heap_init(heap_s *heap, int capacity, value_f value, setpos_f setpos,
 void heap_deinit(heap_s *heap) {
   free(heap->inds);
   heap->inds = NULL;
+
+  free(heap->nodes);
+  heap->nodes = NULL;
+
+  if (heap->type == HEAP_TYPE_BUCKET) {
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+      bucket_deinit(heap->bucket[i]);
+      bucket_dealloc(&heap->bucket[i]);
+    }
+    free(heap->lb);
+    heap->lb = NULL;
+  }
+}
+
+/* Set the width of the buckets used by a `HEAP_TYPE_BUCKET` heap. By
+ * default, the width is infinite, which puts every node in the same
+ * bucket. The heap must be empty. */
+void heap_set_bucket_width(heap_s *heap, dbl width) {
+  assert(heap->type == HEAP_TYPE_BUCKET);
+  assert(heap_size(heap) == 0);
+  assert(width > 0);
+  heap->width = width;
 }
 
 void heap_grow(heap_s *heap) {
   heap->capacity *= 2;
+  if (heap->type == HEAP_TYPE_4ARY || heap->type == HEAP_TYPE_BUCKET) {
+    heap->nodes = realloc(heap->nodes, sizeof(node_s)*heap->capacity);
+    assert(heap->nodes != NULL);
+    return;
+  }
   heap->inds = realloc(heap->inds, sizeof(int)*heap->capacity);
   assert(heap->inds != NULL);
 #if SJS_DEBUG
@@ -55,6 +143,193 @@ void heap_grow(heap_s *heap) {
 #endif
 }
 
+/** Functions for `HEAP_TYPE_4ARY`: */
+
+/* Put `node` at `pos` and let the solver know where it ended up */
+static void node_set(heap_s *heap, int pos, node_s node) {
+  heap->nodes[pos] = node;
+  heap->setpos(heap->context, node.ind, pos);
+}
+
+/* Move `node` up from `pos` until its parent's key is no larger than
+ * its own. Nodes on the way are shifted down into the hole instead
+ * of being swapped. */
+static void node_swim(heap_s *heap, int pos, node_s node) {
+  while (pos > 0) {
+    int par = (pos - 1)/4;
+    if (heap->nodes[par].key <= node.key)
+      break;
+    node_set(heap, pos, heap->nodes[par]);
+    pos = par;
+  }
+  node_set(heap, pos, node);
+}
+
+/* Move `node` down from `pos` until none of its children has a
+ * smaller key. */
+static void node_sink(heap_s *heap, int pos, node_s node) {
+  int n = heap->size;
+  while (true) {
+    int ch = 4*pos + 1;
+    if (ch >= n)
+      break;
+
+    /* Find the child with the smallest key. The children of a node
+     * are contiguous, so this is a short linear scan. */
+    int ch_min = ch, ch_end = ch + 4 < n ? ch + 4 : n;
+    for (int i = ch + 1; i < ch_end; ++i)
+      if (heap->nodes[i].key < heap->nodes[ch_min].key)
+        ch_min = i;
+
+    if (heap->nodes[ch_min].key >= node.key)
+      break;
+
+    node_set(heap, pos, heap->nodes[ch_min]);
+    pos = ch_min;
+  }
+  node_set(heap, pos, node);
+}
+
+/** Functions for `HEAP_TYPE_BUCKET`: */
+
+/* Nodes which are waiting in a bucket are given a negative position
+ * from which their index can be recovered. This lets `heap_swim` find
+ * them. */
+static int deferred_pos(int ind) {
+  return -2 - ind;
+}
+
+/* Add node `ind` with key `key` to the current bucket's heap */
+static void node_insert(heap_s *heap, int ind, dbl key) {
+  if (heap->size == heap->capacity)
+    heap_grow(heap);
+  node_swim(heap, heap->size++, (node_s) {.key = key, .ind = ind});
+}
+
+static bucket_s *get_bucket(heap_s *heap, int lb) {
+  int i = lb % NUM_BUCKETS;
+  return heap->bucket[i < 0 ? i + NUM_BUCKETS : i];
+}
+
+/* Compute the index of the bucket which `key` falls into. Keys in or
+ * before the current bucket all map to `heap->lb0`. If `key` isn't
+ * finite or is too far ahead of the current bucket to be put in one,
+ * `INT_MAX` is returned instead. */
+static int get_lb(heap_s const *heap, dbl key) {
+  dbl lb = floor(key/heap->width);
+  if (lb <= heap->lb0)
+    return heap->lb0;
+  if (!(lb <= (dbl)heap->lb0 + NUM_BUCKETS))
+    return INT_MAX;
+  return (int)lb;
+}
+
+/* Put node `ind`, which isn't in any bucket yet, into bucket `lb` */
+static void defer(heap_s *heap, int ind, int lb) {
+  if (ind >= heap->lb_capacity) {
+    int lb_capacity = heap->lb_capacity;
+    heap->lb_capacity = ind + 1 > 2*lb_capacity ? ind + 1 : 2*lb_capacity;
+    heap->lb = realloc(heap->lb, heap->lb_capacity*sizeof(int));
+    assert(heap->lb != NULL);
+    for (int i = lb_capacity; i < heap->lb_capacity; ++i)
+      heap->lb[i] = NOT_DEFERRED;
+  }
+
+  bucket_push(get_bucket(heap, lb), ind);
+  heap->lb[ind] = lb;
+  ++heap->num_deferred;
+  heap->setpos(heap->context, ind, deferred_pos(ind));
+}
+
+/* Insert a node, either into a bucket or into the current bucket's
+ * heap, depending on its key. */
+static void bucket_heap_insert(heap_s *heap, int ind, dbl key) {
+  int lb = get_lb(heap, key);
+  if (lb <= heap->lb0 || lb == INT_MAX)
+    node_insert(heap, ind, key);
+  else
+    defer(heap, ind, lb);
+}
+
+/* Empty the buckets and start them over from the bucket containing
+ * `key`. This is only done when there are no nodes in the heap, so
+ * every entry left in a bucket is stale. */
+static void reset_buckets(heap_s *heap, dbl key) {
+  assert(heap->size == 0 && heap->num_deferred == 0);
+  for (int i = 0; i < NUM_BUCKETS; ++i)
+    bucket_clear(heap->bucket[i]);
+  dbl lb0 = floor(key/heap->width);
+  if (fabs(lb0) < INT_MAX/2)
+    heap->lb0 = (int)lb0;
+}
+
+/* Move on to the next bucket until the front of the current bucket's
+ * heap is in the current bucket. Since every bucketed node's key is
+ * in a later bucket, the front of the heap is then the node with the
+ * smallest key overall. */
+static void advance(heap_s *heap) {
+  while (heap->num_deferred > 0 &&
+         (heap->size == 0 || get_lb(heap, heap->nodes[0].key) > heap->lb0)) {
+    bucket_s *bucket = get_bucket(heap, ++heap->lb0);
+    while (!bucket_is_empty(bucket)) {
+      int ind = bucket_pop(bucket);
+      if (heap->lb[ind] != heap->lb0)
+        continue; /* stale */
+      heap->lb[ind] = NOT_DEFERRED;
+      --heap->num_deferred;
+      node_insert(heap, ind, heap->value(heap->context, ind));
+    }
+  }
+}
+
+/* Take the node at `pos` out of the current bucket's heap, filling
+ * the hole with the last node */
+static void node_remove(heap_s *heap, int pos) {
+  node_s last = heap->nodes[--heap->size];
+  if (pos == heap->size)
+    return;
+  if (pos > 0 && heap->nodes[(pos - 1)/4].key > last.key)
+    node_swim(heap, pos, last);
+  else
+    node_sink(heap, pos, last);
+}
+
+/* Called by `heap_swim` for a node in the current bucket's heap
+ * whose key has decreased. Nodes are usually inserted before they
+ * have a finite key (e.g., `eik3` inserts nodes with T = INFINITY
+ * and then updates them), so this is where most nodes first get a
+ * key which can be bucketed. If the new key is in a later bucket,
+ * the node is moved there. */
+static void node_decrease(heap_s *heap, int pos) {
+  node_s node = heap->nodes[pos];
+  node.key = heap->value(heap->context, node.ind);
+  int lb = get_lb(heap, node.key);
+  if (lb <= heap->lb0 || lb == INT_MAX) {
+    node_swim(heap, pos, node);
+  } else {
+    node_remove(heap, pos);
+    defer(heap, node.ind, lb);
+  }
+}
+
+/* Called by `heap_swim` for a bucketed node whose key has
+ * decreased */
+static void bucket_heap_decrease(heap_s *heap, int ind) {
+  dbl key = heap->value(heap->context, ind);
+  int lb = get_lb(heap, key);
+  if (lb <= heap->lb0) {
+    heap->lb[ind] = NOT_DEFERRED;
+    --heap->num_deferred;
+    node_insert(heap, ind, key);
+  } else if (lb < heap->lb[ind]) {
+    /* Leave the old entry behind: it's skipped by `advance` */
+    bucket_push(get_bucket(heap, lb), ind);
+    heap->lb[ind] = lb;
+  }
+}
+
+/** Functions for `HEAP_TYPE_BINARY`: */
+
 int left(int pos) {
   return 2*pos + 1;
 }
@@ -104,9 +379,29 @@ void heap_swap(heap_s *heap, int pos1, int pos2) {
 // TODO: this calls `value` and `heap_set` about 2x as many times as
 // necessary
 void heap_swim(heap_s *heap, int pos) {
+  if (heap->type == HEAP_TYPE_BUCKET && pos < 0) {
+    assert(pos != NO_INDEX);
+    bucket_heap_decrease(heap, deferred_pos(pos));
+    return;
+  }
+
   assert(pos >= 0);
   assert(pos < heap->size);
 
+  if (heap->type == HEAP_TYPE_BUCKET) {
+    node_decrease(heap, pos);
+    return;
+  }
+
+  /* The key of the node at `pos` may have changed, so refresh it
+   * before moving the node */
+  if (heap->type == HEAP_TYPE_4ARY) {
+    node_s node = heap->nodes[pos];
+    node.key = heap->value(heap->context, node.ind);
+    node_swim(heap, pos, node);
+    return;
+  }
+
   int par = parent(pos);
   while (pos > 0 && value(heap, par) > value(heap, pos)) {
     heap_swap(heap, par, pos);
@@ -116,16 +411,37 @@ void heap_swim(heap_s *heap, int pos) {
 }
 
 void heap_insert(heap_s *heap, int ind) {
+  if (heap->type == HEAP_TYPE_BUCKET) {
+    dbl key = heap->value(heap->context, ind);
+    if (heap_size(heap) == 0)
+      reset_buckets(heap, key);
+    bucket_heap_insert(heap, ind, key);
+    return;
+  }
+
   if (heap->size == heap->capacity) {
     heap_grow(heap);
   }
 
   int pos = heap->size++;
+
+  if (heap->type == HEAP_TYPE_4ARY) {
+    node_s node = {.key = heap->value(heap->context, ind), .ind = ind};
+    node_swim(heap, pos, node);
+    return;
+  }
+
   heap_set(heap, pos, ind);
   heap_swim(heap, pos);
 }
 
 int heap_front(heap_s *heap) {
+  if (heap->type == HEAP_TYPE_BUCKET)
+    advance(heap);
+
+  if (heap->type == HEAP_TYPE_4ARY || heap->type == HEAP_TYPE_BUCKET)
+    return heap->nodes[0].ind;
+
 #if SJS_DEBUG
   int ind = heap->inds[0];
   return ind;
@@ -159,6 +475,17 @@ void heap_sink(heap_s *heap, int pos) {
 }
 
 void heap_pop(heap_s *heap) {
+  if (heap->type == HEAP_TYPE_BUCKET)
+    advance(heap);
+
+  if (heap->type == HEAP_TYPE_4ARY || heap->type == HEAP_TYPE_BUCKET) {
+    int front_ind = heap->nodes[0].ind;
+    if (--heap->size > 0)
+      node_sink(heap, 0, heap->nodes[heap->size]);
+    heap->setpos(heap->context, front_ind, NO_INDEX);
+    return;
+  }
+
   size_t front_ind = heap->inds[0];
   heap_swap(heap, 0, heap->size - 1);
   if (--heap->size > 0) {
@@ -168,5 +495,11 @@ void heap_pop(heap_s *heap) {
 }
 
 int heap_size(heap_s *heap) {
+  if (heap->type == HEAP_TYPE_BUCKET)
+    return heap->size + heap->num_deferred;
   return heap->size;
 }
+
+heap_type_e heap_get_type(heap_s const *heap) {
+  return heap->type;
+}
@@ -65,9 +65,26 @@ struct mesh3 {
   size_t *vc;
   size_t *vc_offsets;
 
+  size_t *vv;
+  size_t *vv_offsets;
+
   size_t (*edges)[2];
   size_t nedges;
 
+  /* Full topology. This is only computed if `compute_topology` is
+   * passed to `mesh3_init`. The unique faces are stored in sorted
+   * order in `faces`, and the faces whose smallest vertex is `l` are
+   * `faces[face_offsets[l]], ..., faces[face_offsets[l + 1] - 1]`. */
+  bool has_topology;
+  size_t nfaces;
+  uint3 *faces;
+  size_t *face_offsets;
+  uint2 *fc; // Cells incident on each face (`fc[i][1]` is `NO_INDEX` for boundary faces)
+  uint4 *cf; // `cf[lc][i]` is the index of the face opposite `cells[lc][i]`
+  size_t *vf; // Indices of faces opposite each vertex (uses `vc_offsets`)
+  uint2 *ve; // Edges opposite each vertex
+  size_t *ve_offsets;
+
   bool has_bd_info;
   bool *bdc;
   bool *bdv;
@@ -91,6 +108,16 @@ struct mesh3 {
   dbl min_edge_length;
   dbl mean_edge_length;
   dbl diam;
+
+  /* A uniform grid of buckets covering the bounding box of the mesh,
+   * used for point location. The cells whose bounding boxes overlap
+   * bucket `i` are `loc_cells[loc_offsets[i]], ...,
+   * loc_cells[loc_offsets[i + 1] - 1]`, in increasing order. */
+  rect3 loc_bbox;
+  size_t loc_shape[3];
+  dbl loc_h[3];
+  size_t *loc_cells;
+  size_t *loc_offsets;
 };
 
 tri3 mesh3_tetra_get_face(mesh3_tetra_s const *tetra, int f[3]) {
@@ -241,6 +268,64 @@ static void init_vc(mesh3_s *mesh) {
   free(nvc);
 }
 
+/* Build the vertex-to-vertex adjacency table. This has the same
+ * compressed layout as `vc`/`vc_offsets` (and uses them, so
+ * `init_vc` must be called first). The neighbors of each vertex are
+ * stored in the order they're first encountered while traversing
+ * the incident cells, matching what `mesh3_vv` used to compute on
+ * the fly. */
+static void init_vv(mesh3_s *mesh) {
+  // `last[j] == i` means that we've already seen vertex `j` while
+  // traversing the cells incident on vertex `i`. This lets us dedup
+  // the neighbors in one pass without sorting.
+  size_t *last = malloc(mesh->nverts*sizeof(size_t));
+  for (size_t j = 0; j < mesh->nverts; ++j)
+    last[j] = (size_t)NO_INDEX;
+
+  // First pass: count the neighbors of each vertex and compute the
+  // offsets.
+  size_t *vv_offsets = malloc(sizeof(size_t)*(mesh->nverts + 1));
+  vv_offsets[0] = 0;
+  for (size_t i = 0; i < mesh->nverts; ++i) {
+    size_t nvv = 0;
+    for (size_t p = mesh->vc_offsets[i]; p < mesh->vc_offsets[i + 1]; ++p) {
+      size_t const *cell = mesh->cells[mesh->vc[p]];
+      for (int q = 0; q < 4; ++q) {
+        size_t j = cell[q];
+        if (i == j || last[j] == i)
+          continue;
+        last[j] = i;
+        ++nvv;
+      }
+    }
+    vv_offsets[i + 1] = vv_offsets[i] + nvv;
+  }
+
+  for (size_t j = 0; j < mesh->nverts; ++j)
+    last[j] = (size_t)NO_INDEX;
+
+  // Second pass: fill in the neighbors.
+  size_t *vv = malloc(sizeof(size_t)*vv_offsets[mesh->nverts]);
+  for (size_t i = 0, k = 0; i < mesh->nverts; ++i) {
+    for (size_t p = mesh->vc_offsets[i]; p < mesh->vc_offsets[i + 1]; ++p) {
+      size_t const *cell = mesh->cells[mesh->vc[p]];
+      for (int q = 0; q < 4; ++q) {
+        size_t j = cell[q];
+        if (i == j || last[j] == i)
+          continue;
+        last[j] = i;
+        vv[k++] = j;
+      }
+    }
+    assert(k == vv_offsets[i + 1]);
+  }
+
+  mesh->vv = vv;
+  mesh->vv_offsets = vv_offsets;
+
+  free(last);
+}
+
 static void init_edges(mesh3_s *mesh) {
   array_s *edge_arr;
   array_alloc(&edge_arr);
@@ -492,12 +577,10 @@ static void get_diff_bde_nbs(mesh3_s const *mesh, size_t le, array_s *nb) {
 
   assert(bde->diff);
 
-  for (size_t i = 0, l, nvv, *vv; i < 2; ++i) {
+  for (size_t i = 0, l, nvv; i < 2; ++i) {
     l = bde->le[i];
 
-    nvv = mesh3_nvv(mesh, l);
-    vv = malloc(nvv*sizeof(size_t));
-    mesh3_vv(mesh, l, vv);
+    size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
 
     for (size_t j = 0, le_nb; j < nvv; ++j) {
       nb_bde = make_bde(l, vv[j]);
@@ -509,8 +592,6 @@ static void get_diff_bde_nbs(mesh3_s const *mesh, size_t le, array_s *nb) {
           && !array_contains(nb, &le_nb))
         array_append(nb, &le_nb);
     }
-
-    free(vv);
   }
 }
 
@@ -598,27 +679,29 @@ static void init_bde_labels(mesh3_s *mesh) {
     ++mesh->num_bde_labels;
 }
 
-/**
- * In this function we figure out which cells (tetrahedra) and
- * vertices are on the boundary. This is slightly arbitrary. We
- * stipulate that a vertex is on the boundary if every ball
- * surrounding the vertex intersects the exterior of the domain. A
- * cell is a boundary cell if it has a face that's incident on the
- * boundary of the domain.
- *
- * Using this information we find the unique faces in the mesh. A
- */
-static void init_bd(mesh3_s *mesh) {
-  mesh->bdc = calloc(mesh->ncells, sizeof(bool));
-  mesh->bdv = calloc(mesh->nverts, sizeof(bool));
+static void get_opposite_edges(size_t const cv[4], size_t lv, edge_s edge[3]) {
+  size_t l[3];
+  for (int i = 0, j = 0; i < 4; ++i) {
+    if (cv[i] == lv)
+      continue;
+    l[j++] = cv[i];
+  }
+  edge[0] = make_edge(l[0], l[1]);
+  edge[1] = make_edge(l[1], l[2]);
+  edge[2] = make_edge(l[2], l[0]);
+}
 
+/* Make an array containing the four faces of each cell in the mesh,
+ * sorted into dictionary order. These faces are "tagged", meaning
+ * that they have a backpointer to the originating cell. Interior
+ * faces appear twice in a row, and boundary faces appear once. The
+ * caller is responsible for freeing the returned array. */
+static bdf_s *get_sorted_tagged_faces(mesh3_s const *mesh) {
   // Allocate some space for the faces of each cell in the mesh.
   size_t nf = 4*mesh->ncells;
   bdf_s *f = malloc(nf*sizeof(bdf_s));
 
-  // Traverse the cells in the mesh, and populate `f`. These faces are
-  // "tagged", meaning that they have a backpointer to the originating
-  // cell.
+  // Traverse the cells in the mesh, and populate `f`.
   size_t *C;
   for (size_t lc = 0; lc < mesh->ncells; ++lc) {
     C = mesh->cells[lc];
@@ -631,6 +714,129 @@ static void init_bd(mesh3_s *mesh) {
   // Sort the tagged faces themselves into a dictionary order.
   qsort(f, nf, sizeof(bdf_s), (compar_t)bdf_cmp);
 
+  return f;
+}
+
+/* Find the index of the face `lf` in `mesh->faces`. The indices in
+ * `lf` must be sorted. Returns `NO_INDEX` if `lf` isn't a face. */
+static size_t find_face(mesh3_s const *mesh, size_t const lf[3]) {
+  assert(lf[0] < lf[1] && lf[1] < lf[2]);
+  for (size_t i = mesh->face_offsets[lf[0]];
+       i < mesh->face_offsets[lf[0] + 1]; ++i)
+    if (mesh->faces[i][1] == lf[1] && mesh->faces[i][2] == lf[2])
+      return i;
+  return (size_t)NO_INDEX;
+}
+
+/* Build the unique face table and the face-cell, cell-face,
+ * vertex-face, and vertex-edge incidence tables from the sorted
+ * tagged faces `f` (see `get_sorted_tagged_faces`). */
+static void init_topology(mesh3_s *mesh, bdf_s const *f) {
+  size_t nf = 4*mesh->ncells;
+
+  /* Count the unique faces */
+  mesh->nfaces = 0;
+  for (size_t l = 0; l < nf; ++l)
+    if (l == 0 || bdf_cmp(&f[l - 1], &f[l]))
+      ++mesh->nfaces;
+
+  mesh->faces = malloc(mesh->nfaces*sizeof(uint3));
+  mesh->fc = malloc(mesh->nfaces*sizeof(uint2));
+  mesh->cf = malloc(mesh->ncells*sizeof(uint4));
+
+  /* Pull out the unique faces and their incident cells. We store the
+   * incident cells in increasing order so that `mesh3_fc` returns
+   * them in the same order as a search through `vc` would. */
+  for (size_t l = 0, i = (size_t)NO_INDEX; l < nf; ++l) {
+    if (l == 0 || bdf_cmp(&f[l - 1], &f[l])) {
+      memcpy(mesh->faces[++i], f[l].lf, sizeof(uint3));
+      mesh->fc[i][0] = f[l].lc;
+      mesh->fc[i][1] = (size_t)NO_INDEX;
+    } else {
+      assert(mesh->fc[i][1] == (size_t)NO_INDEX);
+      mesh->fc[i][1] = f[l].lc;
+      SORT2(mesh->fc[i][0], mesh->fc[i][1]);
+    }
+
+    /* Figure out which vertex of the cell this face is opposite */
+    size_t const *cv = mesh->cells[f[l].lc];
+    for (size_t j = 0; j < 4; ++j)
+      if (!point_in_face(cv[j], f[l].lf))
+        mesh->cf[f[l].lc][j] = i;
+  }
+
+  /* Compute the offsets of each run of faces with the same smallest
+   * vertex. Since the faces are sorted, these are contiguous. */
+  mesh->face_offsets = calloc(mesh->nverts + 1, sizeof(size_t));
+  for (size_t i = 0; i < mesh->nfaces; ++i)
+    ++mesh->face_offsets[mesh->faces[i][0] + 1];
+  for (size_t l = 0; l < mesh->nverts; ++l)
+    mesh->face_offsets[l + 1] += mesh->face_offsets[l];
+
+  /* The faces opposite each vertex line up with the cells incident on
+   * each vertex, so we can reuse `vc_offsets` here. */
+  mesh->vf = malloc(mesh->vc_offsets[mesh->nverts]*sizeof(size_t));
+  for (size_t l = 0; l < mesh->nverts; ++l) {
+    for (size_t p = mesh->vc_offsets[l]; p < mesh->vc_offsets[l + 1]; ++p) {
+      size_t const *cv = mesh->cells[mesh->vc[p]];
+      for (size_t j = 0; j < 4; ++j)
+        if (cv[j] == l)
+          mesh->vf[p] = mesh->cf[mesh->vc[p]][j];
+    }
+  }
+
+  /* Now find the edges opposite each vertex. Each opposite edge `e`
+   * of `l` corresponds to the unique face `{l, e[0], e[1]}`, so we
+   * can dedup them by marking faces. We use the same traversal order
+   * as `mesh3_ve` used before this table existed. */
+  size_t *last = malloc(mesh->nfaces*sizeof(size_t));
+  for (size_t i = 0; i < mesh->nfaces; ++i)
+    last[i] = (size_t)NO_INDEX;
+
+  /* Each incident cell contributes at most three edges */
+  mesh->ve = malloc(3*mesh->vc_offsets[mesh->nverts]*sizeof(uint2));
+  mesh->ve_offsets = malloc((mesh->nverts + 1)*sizeof(size_t));
+  mesh->ve_offsets[0] = 0;
+
+  size_t k = 0;
+  for (size_t l = 0; l < mesh->nverts; ++l) {
+    for (size_t p = mesh->vc_offsets[l]; p < mesh->vc_offsets[l + 1]; ++p) {
+      edge_s edge[3];
+      get_opposite_edges(mesh->cells[mesh->vc[p]], l, edge);
+      for (size_t j = 0; j < 3; ++j) {
+        size_t lf[3] = {l, edge[j].l[0], edge[j].l[1]};
+        SORT3(lf[0], lf[1], lf[2]);
+        size_t i = find_face(mesh, lf);
+        assert(i != (size_t)NO_INDEX);
+        if (last[i] == l)
+          continue;
+        last[i] = l;
+        memcpy(mesh->ve[k++], edge[j].l, sizeof(uint2));
+      }
+    }
+    mesh->ve_offsets[l + 1] = k;
+  }
+  mesh->ve = realloc(mesh->ve, k*sizeof(uint2));
+
+  free(last);
+}
+
+/**
+ * In this function we figure out which cells (tetrahedra) and
+ * vertices are on the boundary. This is slightly arbitrary. We
+ * stipulate that a vertex is on the boundary if every ball
+ * surrounding the vertex intersects the exterior of the domain. A
+ * cell is a boundary cell if it has a face that's incident on the
+ * boundary of the domain.
+ *
+ * Using this information we find the unique faces in the mesh. A
+ */
+static void init_bd(mesh3_s *mesh, bdf_s const *f) {
+  mesh->bdc = calloc(mesh->ncells, sizeof(bool));
+  mesh->bdv = calloc(mesh->nverts, sizeof(bool));
+
+  size_t nf = 4*mesh->ncells;
+
   /**
    * Set up the boundary vertex, cell, face data structures (stored in
    * `mesh->bdv`, `mesh->bdv`, and `mesh->bdf`, respectively).
@@ -730,7 +936,6 @@ static void init_bd(mesh3_s *mesh) {
 
   // Cleanup
   free(bde);
-  free(f);
 }
 
 static void compute_geometric_quantities(mesh3_s *mesh) {
@@ -765,8 +970,114 @@ static void compute_geometric_quantities(mesh3_s *mesh) {
   mesh->diam = mesh3_diam_2approx_rand(mesh, 100, NULL);
 }
 
+/* Find the range of buckets along axis `i` which overlap the interval
+ * `[xmin, xmax]`, clamping it to the grid. */
+static void get_loc_range(mesh3_s const *mesh, int i, dbl xmin, dbl xmax,
+                          size_t range[2]) {
+  dbl imax = mesh->loc_shape[i] - 1;
+  dbl lo = floor((xmin - mesh->loc_bbox.min[i])/mesh->loc_h[i]);
+  dbl hi = floor((xmax - mesh->loc_bbox.min[i])/mesh->loc_h[i]);
+  range[0] = fmax(0, fmin(imax, lo));
+  range[1] = fmax(0, fmin(imax, hi));
+}
+
+/* Get the bounding box of cell `lc`, padded so that it contains every
+ * point which `mesh3_cell_contains_point` would accept. A point is
+ * accepted if it's no further than `mesh->eps` outside the plane of
+ * any of the cell's faces. This region is the cell scaled about its incenter by a
+ * factor of `1 + eps/r`, where `r` is its inradius. */
+static rect3 get_loc_bbox(mesh3_s const *mesh, size_t lc) {
+  tetra3 tetra = mesh3_get_tetra(mesh, lc);
+
+  rect3 bbox = tetra3_get_bounding_box(&tetra);
+
+  dbl3 dx[3];
+  for (size_t i = 0; i < 3; ++i)
+    dbl3_sub(tetra.v[i + 1], tetra.v[0], dx[i]);
+
+  dbl3 n;
+  dbl3_cross(dx[0], dx[1], n);
+  dbl vol = fabs(dbl3_dot(n, dx[2]))/6;
+
+  dbl area = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    dbl3 e[2];
+    dbl3_sub(tetra.v[(i + 1) % 4], tetra.v[i], e[0]);
+    dbl3_sub(tetra.v[(i + 2) % 4], tetra.v[i], e[1]);
+    dbl3_cross(e[0], e[1], n);
+    area += dbl3_norm(n)/2;
+  }
+
+  dbl extent[3];
+  rect3_get_extent(&bbox, extent);
+
+  dbl pad = mesh->eps*(1 + area*dbl3_maxnorm(extent)/(3*vol));
+  for (size_t i = 0; i < 3; ++i) {
+    bbox.min[i] -= pad;
+    bbox.max[i] += pad;
+  }
+
+  return bbox;
+}
+
+/* Set up the grid of buckets used to locate points. The grid has
+ * about one bucket per cell, so that each bucket only overlaps a
+ * handful of cells. */
+static void init_loc(mesh3_s *mesh) {
+  mesh->loc_bbox = rect3_get_bounding_box_for_points(mesh->nverts, mesh->verts);
+
+  dbl extent[3];
+  rect3_get_extent(&mesh->loc_bbox, extent);
+
+  dbl h = cbrt(extent[0]*extent[1]*extent[2]/mesh->ncells);
+  if (h == 0)
+    h = dbl3_maxnorm(extent)/cbrt(mesh->ncells);
+
+  for (size_t i = 0; i < 3; ++i) {
+    mesh->loc_shape[i] = h > 0 ? MAX(1, ceil(extent[i]/h)) : 1;
+    mesh->loc_h[i] = extent[i] > 0 ? extent[i]/mesh->loc_shape[i] : 1;
+  }
+
+  size_t num_buckets =
+    mesh->loc_shape[0]*mesh->loc_shape[1]*mesh->loc_shape[2];
+
+  /* Find the range of buckets overlapping each cell */
+  size_t (*range)[3][2] = malloc(mesh->ncells*sizeof(size_t[3][2]));
+  for (size_t lc = 0; lc < mesh->ncells; ++lc) {
+    rect3 bbox = get_loc_bbox(mesh, lc);
+    for (int i = 0; i < 3; ++i)
+      get_loc_range(mesh, i, bbox.min[i], bbox.max[i], range[lc][i]);
+  }
+
+  /* Count the number of cells overlapping each bucket and compute the
+   * offsets */
+  mesh->loc_offsets = calloc(num_buckets + 1, sizeof(size_t));
+  for (size_t lc = 0; lc < mesh->ncells; ++lc)
+    for (size_t i = range[lc][0][0]; i <= range[lc][0][1]; ++i)
+      for (size_t j = range[lc][1][0]; j <= range[lc][1][1]; ++j)
+        for (size_t k = range[lc][2][0]; k <= range[lc][2][1]; ++k)
+          ++mesh->loc_offsets[(i*mesh->loc_shape[1] + j)*mesh->loc_shape[2] + k + 1];
+  for (size_t b = 0; b < num_buckets; ++b)
+    mesh->loc_offsets[b + 1] += mesh->loc_offsets[b];
+
+  /* Fill the buckets. Since we traverse the cells in order, each
+   * bucket's cells end up sorted. */
+  size_t *num_filled = calloc(num_buckets, sizeof(size_t));
+  mesh->loc_cells = malloc(mesh->loc_offsets[num_buckets]*sizeof(size_t));
+  for (size_t lc = 0; lc < mesh->ncells; ++lc)
+    for (size_t i = range[lc][0][0]; i <= range[lc][0][1]; ++i)
+      for (size_t j = range[lc][1][0]; j <= range[lc][1][1]; ++j)
+        for (size_t k = range[lc][2][0]; k <= range[lc][2][1]; ++k) {
+          size_t b = (i*mesh->loc_shape[1] + j)*mesh->loc_shape[2] + k;
+          mesh->loc_cells[mesh->loc_offsets[b] + num_filled[b]++] = lc;
+        }
+
+  free(num_filled);
+  free(range);
+}
+
 void mesh3_init(mesh3_s *mesh, mesh3_data_s const *data,
-                bool compute_bd_info, dbl const *eps) {
+                bool compute_bd_info, bool compute_topology, dbl const *eps) {
   mesh->verts = malloc(data->nverts*sizeof(dbl3));
   memcpy(mesh->verts, data->verts, data->nverts*sizeof(dbl3));
   mesh->nverts = data->nverts;
@@ -777,18 +1088,169 @@ void mesh3_init(mesh3_s *mesh, mesh3_data_s const *data,
 
   init_vc(mesh);
 
+  init_vv(mesh);
+
   init_edges(mesh);
 
   compute_geometric_quantities(mesh);
 
   mesh->eps = eps ? *eps : EPS;
 
+  init_loc(mesh);
+
+  /* The boundary info and the full topology are both computed from
+   * the same sorted array of tagged faces, so we only build it
+   * once. */
+  bdf_s *f = compute_bd_info || compute_topology ?
+    get_sorted_tagged_faces(mesh) : NULL;
+
+  mesh->has_topology = compute_topology;
+  if (compute_topology)
+    init_topology(mesh, f);
+
   mesh->has_bd_info = compute_bd_info;
   if (compute_bd_info) {
-    init_bd(mesh);
+    init_bd(mesh, f);
     init_bdf_labels(mesh);
     init_bde_labels(mesh);
   }
+
+  free(f);
+}
+
+/* A boundary face or edge along with its label, used to sort them
+ * without losing track of their labels */
+typedef struct {
+  bdf_s bdf;
+  size_t label;
+} labeled_bdf_s;
+
+typedef struct {
+  bde_s bde;
+  size_t label;
+} labeled_bde_s;
+
+static int labeled_bdf_cmp(labeled_bdf_s const *f1, labeled_bdf_s const *f2) {
+  return bdf_cmp(&f1->bdf, &f2->bdf);
+}
+
+static int labeled_bde_cmp(labeled_bde_s const *e1, labeled_bde_s const *e2) {
+  return bde_cmp(&e1->bde, &e2->bde);
+}
+
+/* Initialize `submesh` from part of `mesh`. Vertex `i` of `submesh`
+ * is vertex `l[i]` of `mesh`, and cell `j` is cell `lc[j]`. The cells
+ * in `lc` should only have vertices in `l`.
+ *
+ * Instead of being computed from scratch, the boundary info is taken
+ * from `mesh`, which must have it. A face, edge, or vertex of
+ * `submesh` is on its boundary if it's on the boundary of
+ * `mesh`. This way, the faces exposed by cutting `submesh` out of
+ * `mesh` aren't mistaken for reflectors, and the edges along the cut
+ * aren't mistaken for diffractors. */
+void mesh3_init_submesh(mesh3_s *submesh, mesh3_s const *mesh,
+                        size_t nverts, size_t const *l,
+                        size_t ncells, size_t const *lc) {
+  assert(mesh->has_bd_info);
+
+  size_t *local = malloc(mesh->nverts*sizeof(size_t));
+  for (size_t i = 0; i < mesh->nverts; ++i)
+    local[i] = (size_t)NO_INDEX;
+  for (size_t i = 0; i < nverts; ++i)
+    local[l[i]] = i;
+
+  size_t *local_cell = malloc(mesh->ncells*sizeof(size_t));
+  for (size_t i = 0; i < mesh->ncells; ++i)
+    local_cell[i] = (size_t)NO_INDEX;
+  for (size_t j = 0; j < ncells; ++j)
+    local_cell[lc[j]] = j;
+
+  mesh3_data_s data = {
+    .nverts = nverts,
+    .verts = malloc(nverts*sizeof(dbl3)),
+    .ncells = ncells,
+    .cells = malloc(ncells*sizeof(uint4))
+  };
+  for (size_t i = 0; i < nverts; ++i)
+    memcpy(data.verts[i], mesh->verts[l[i]], sizeof(dbl3));
+  for (size_t j = 0; j < ncells; ++j) {
+    for (size_t k = 0; k < 4; ++k) {
+      assert(local[mesh->cells[lc[j]][k]] != (size_t)NO_INDEX);
+      data.cells[j][k] = local[mesh->cells[lc[j]][k]];
+    }
+  }
+
+  mesh3_init(submesh, &data, false, false, &mesh->eps);
+
+  free(data.verts);
+  free(data.cells);
+
+  /* The tolerances returned by `mesh3_get_vertex_tol` and friends
+   * are scaled by the diameter, so use the same one as `mesh` */
+  submesh->diam = mesh->diam;
+
+  submesh->has_bd_info = true;
+
+  submesh->bdv = malloc(nverts*sizeof(bool));
+  for (size_t i = 0; i < nverts; ++i)
+    submesh->bdv[i] = mesh->bdv[l[i]];
+
+  submesh->bdc = malloc(ncells*sizeof(bool));
+  for (size_t j = 0; j < ncells; ++j)
+    submesh->bdc[j] = mesh->bdc[lc[j]];
+
+  /* Keep the boundary faces whose cells are in the submesh */
+  labeled_bdf_s *bdf = malloc(mesh->nbdf*sizeof(labeled_bdf_s));
+  submesh->nbdf = 0;
+  for (size_t i = 0; i < mesh->nbdf; ++i) {
+    size_t lc_local = local_cell[mesh->bdf[i].lc];
+    if (lc_local == (size_t)NO_INDEX)
+      continue;
+    size_t const *lf = mesh->bdf[i].lf;
+    labeled_bdf_s *f = &bdf[submesh->nbdf++];
+    f->bdf = make_bdf(local[lf[0]], local[lf[1]], local[lf[2]], lc_local);
+    f->label = mesh->bdf_label[i];
+  }
+  qsort(bdf, submesh->nbdf, sizeof(labeled_bdf_s), (compar_t)labeled_bdf_cmp);
+
+  submesh->bdf = malloc(submesh->nbdf*sizeof(bdf_s));
+  submesh->bdf_label = malloc(submesh->nbdf*sizeof(size_t));
+  for (size_t i = 0; i < submesh->nbdf; ++i) {
+    submesh->bdf[i] = bdf[i].bdf;
+    submesh->bdf_label[i] = bdf[i].label;
+  }
+  submesh->num_bdf_labels = mesh->num_bdf_labels;
+
+  free(bdf);
+
+  /* Keep the boundary edges which are edges of the submesh */
+  labeled_bde_s *bde = malloc(mesh->nbde*sizeof(labeled_bde_s));
+  submesh->nbde = 0;
+  for (size_t i = 0; i < mesh->nbde; ++i) {
+    size_t const *le = mesh->bde[i].le;
+    size_t le_local[2] = {local[le[0]], local[le[1]]};
+    if (le_local[0] == (size_t)NO_INDEX || le_local[1] == (size_t)NO_INDEX ||
+        !mesh3_is_edge(submesh, le_local))
+      continue;
+    labeled_bde_s *e = &bde[submesh->nbde++];
+    e->bde = make_bde(le_local[0], le_local[1]);
+    e->bde.diff = mesh->bde[i].diff;
+    e->label = mesh->bde_label[i];
+  }
+  qsort(bde, submesh->nbde, sizeof(labeled_bde_s), (compar_t)labeled_bde_cmp);
+
+  submesh->bde = malloc(submesh->nbde*sizeof(bde_s));
+  submesh->bde_label = malloc(submesh->nbde*sizeof(size_t));
+  for (size_t i = 0; i < submesh->nbde; ++i) {
+    submesh->bde[i] = bde[i].bde;
+    submesh->bde_label[i] = bde[i].label;
+  }
+  submesh->num_bde_labels = mesh->num_bde_labels;
+
+  free(bde);
+
+  free(local_cell);
+  free(local);
 }
 
 void mesh3_deinit(mesh3_s *mesh) {
@@ -797,12 +1259,40 @@ void mesh3_deinit(mesh3_s *mesh) {
   free(mesh->edges);
   free(mesh->vc);
   free(mesh->vc_offsets);
+  free(mesh->vv);
+  free(mesh->vv_offsets);
 
   mesh->verts = NULL;
   mesh->cells = NULL;
   mesh->edges = NULL;
   mesh->vc = NULL;
   mesh->vc_offsets = NULL;
+  mesh->vv = NULL;
+  mesh->vv_offsets = NULL;
+
+  free(mesh->loc_cells);
+  free(mesh->loc_offsets);
+
+  mesh->loc_cells = NULL;
+  mesh->loc_offsets = NULL;
+
+  if (mesh->has_topology) {
+    free(mesh->faces);
+    free(mesh->face_offsets);
+    free(mesh->fc);
+    free(mesh->cf);
+    free(mesh->vf);
+    free(mesh->ve);
+    free(mesh->ve_offsets);
+
+    mesh->faces = NULL;
+    mesh->face_offsets = NULL;
+    mesh->fc = NULL;
+    mesh->cf = NULL;
+    mesh->vf = NULL;
+    mesh->ve = NULL;
+    mesh->ve_offsets = NULL;
+  }
 
   if (mesh->has_bd_info) {
     free(mesh->bdc);
@@ -933,11 +1423,67 @@ size_t mesh3_find_cell_containing_point(mesh3_s const *mesh, dbl const x[3],
   if (lc != (size_t)NO_INDEX && mesh3_cell_contains_point(mesh, lc, x))
     return lc;
 
-  /* ... otherwise, proceed as usual */
-  for (size_t lc = 0; lc < mesh->ncells; ++lc)
+  /* ... otherwise, look up the bucket containing `x`. Every cell
+   * which could contain `x` overlaps this bucket, and they're listed
+   * in increasing order, so we find the same cell as a linear scan
+   * over all of the cells would. */
+  size_t ind[3], range[2];
+  for (int i = 0; i < 3; ++i) {
+    get_loc_range(mesh, i, x[i], x[i], range);
+    ind[i] = range[0];
+  }
+  size_t b = (ind[0]*mesh->loc_shape[1] + ind[1])*mesh->loc_shape[2] + ind[2];
+
+  for (size_t i = mesh->loc_offsets[b]; i < mesh->loc_offsets[b + 1]; ++i)
+    if (mesh3_cell_contains_point(mesh, mesh->loc_cells[i], x))
+      return mesh->loc_cells[i];
+  return (size_t)NO_INDEX;
+}
+
+/* If a walk takes more than this many steps, we give up on it and
+ * look the point up in the grid instead. */
+#define MAX_NUM_WALK_STEPS 32
+
+/* Get the cell sharing the face opposite `cells[lc][i]` with `lc`, or
+ * `NO_INDEX` if that's a boundary face. */
+static size_t get_cell_across_face(mesh3_s const *mesh, size_t lc, size_t i) {
+  uint2 fc;
+  if (mesh->has_topology) {
+    memcpy(fc, mesh->fc[mesh->cf[lc][i]], sizeof(uint2));
+  } else {
+    size_t lf[3];
+    for (size_t j = 0, k = 0; j < 4; ++j)
+      if (j != i)
+        lf[k++] = mesh->cells[lc][j];
+    mesh3_fc(mesh, lf, fc);
+  }
+  return fc[0] == lc ? fc[1] : fc[0];
+}
+
+/* Find a cell containing `x` by walking through the mesh from cell
+ * `lc`. At each step, we cross the face of the current cell opposite
+ * its most negative barycentric coordinate. This is fast when `x` is
+ * close to `lc` (e.g. when locating a sequence of nearby points), but
+ * unlike `mesh3_find_cell_containing_point`, a point lying on a face
+ * shared by two cells may be assigned to either of them. If the walk
+ * leaves the mesh or takes too long, we fall back to
+ * `mesh3_find_cell_containing_point`. */
+size_t mesh3_walk_to_point(mesh3_s const *mesh, dbl3 const x, size_t lc) {
+  for (size_t step = 0;
+       lc != (size_t)NO_INDEX && step < MAX_NUM_WALK_STEPS; ++step) {
     if (mesh3_cell_contains_point(mesh, lc, x))
       return lc;
-  return (size_t)NO_INDEX;
+
+    tetra3 tetra = mesh3_get_tetra(mesh, lc);
+
+    dbl4 b;
+    tetra3_get_bary_coords(&tetra, x, b);
+
+    size_t i = dbl4_argmin(b);
+    lc = get_cell_across_face(mesh, lc, i);
+  }
+
+  return mesh3_find_cell_containing_point(mesh, x, (size_t)NO_INDEX);
 }
 
 bool mesh3_contains_point(mesh3_s const *mesh, dbl3 const x) {
@@ -970,19 +1516,18 @@ void mesh3_vc(mesh3_s const *mesh, size_t i, size_t *vc) {
   memcpy((void *)vc, (void *)vci, sizeof(size_t)*nvc);
 }
 
-static void get_opposite_edges(size_t const cv[4], size_t lv, edge_s edge[3]) {
-  size_t l[3];
-  for (int i = 0, j = 0; i < 4; ++i) {
-    if (cv[i] == lv)
-      continue;
-    l[j++] = cv[i];
-  }
-  edge[0] = make_edge(l[0], l[1]);
-  edge[1] = make_edge(l[1], l[2]);
-  edge[2] = make_edge(l[2], l[0]);
+/* Get a pointer to the cells incident on vertex `i` without copying
+ * them (see `mesh3_get_vv_ptr`). */
+size_t const *mesh3_get_vc_ptr(mesh3_s const *mesh, size_t i, size_t *nvc) {
+  assert(i < mesh->nverts);
+  *nvc = mesh->vc_offsets[i + 1] - mesh->vc_offsets[i];
+  return &mesh->vc[mesh->vc_offsets[i]];
 }
 
 int mesh3_nve(mesh3_s const *mesh, size_t lv) {
+  if (mesh->has_topology)
+    return mesh->ve_offsets[lv + 1] - mesh->ve_offsets[lv];
+
   array_s *edges;
   array_alloc(&edges);
   array_init(edges, sizeof(edge_s), /* capacity */ 8);
@@ -1015,6 +1560,13 @@ int mesh3_nve(mesh3_s const *mesh, size_t lv) {
 }
 
 void mesh3_ve(mesh3_s const *mesh, size_t lv, size_t (*ve)[2]) {
+  if (mesh->has_topology) {
+    size_t nve;
+    uint2 const *ve_ptr = mesh3_get_ve_ptr(mesh, lv, &nve);
+    memcpy(ve, ve_ptr, nve*sizeof(uint2));
+    return;
+  }
+
   array_s *edges;
   array_alloc(&edges);
   array_init(edges, sizeof(edge_s), /* capacity */ 8);
@@ -1051,87 +1603,71 @@ void mesh3_ve(mesh3_s const *mesh, size_t lv, size_t (*ve)[2]) {
   array_dealloc(&edges);
 }
 
+/* Get a pointer to the edges opposite vertex `lv` (see `mesh3_ve`)
+ * without copying them. Requires the full topology. */
+uint2 const *mesh3_get_ve_ptr(mesh3_s const *mesh, size_t lv, size_t *nve) {
+  assert(mesh->has_topology);
+  assert(lv < mesh->nverts);
+  *nve = mesh->ve_offsets[lv + 1] - mesh->ve_offsets[lv];
+  return &mesh->ve[mesh->ve_offsets[lv]];
+}
+
 int mesh3_nvf(mesh3_s const *mesh, size_t l) {
   return mesh3_nvc(mesh, l);
 }
 
+/* Fill `vf` with the faces opposite `l` in each cell incident on
+ * `l`. The faces are in the same order as the cells returned by
+ * `mesh3_vc`, and the vertices of each face are in cell order. */
 void mesh3_vf(mesh3_s const *mesh, size_t l, size_t (*vf)[3]) {
-  // TODO: this is a very bad implementation!
-
+  size_t const *vc = &mesh->vc[mesh->vc_offsets[l]];
   int nvc = mesh3_nvc(mesh, l);
-  size_t *vc = malloc(nvc*sizeof(size_t));
-  mesh3_vc(mesh, l, vc);
-
-  size_t cv[4];
 
-  int k;
   for (int i = 0; i < nvc; ++i) {
-    mesh3_cv(mesh, vc[i], cv);
-
-    k = 0;
-    for (int j = 0; j < 4; ++j) {
-      if (cv[j] == l) {
-        continue;
-      }
-      vf[i][k++] = cv[j];
-    }
+    size_t const *cv = mesh->cells[vc[i]];
+    for (int j = 0, k = 0; j < 4; ++j)
+      if (cv[j] != l)
+        vf[i][k++] = cv[j];
   }
-
-  free(vc);
 }
 
-/**
- * TODO: the functions below are simple, unoptimized
- * implementations. There are lots of ways to improve these, but we
- * want to wait on that until later.
- */
+/* Get a pointer to the indices of the faces opposite `l` (see
+ * `mesh3_vf`) without copying them. The indices can be passed to
+ * `mesh3_get_face`. Requires the full topology. */
+size_t const *mesh3_get_vf_ptr(mesh3_s const *mesh, size_t l, size_t *nvf) {
+  assert(mesh->has_topology);
+  assert(l < mesh->nverts);
+  *nvf = mesh->vc_offsets[l + 1] - mesh->vc_offsets[l];
+  return &mesh->vf[mesh->vc_offsets[l]];
+}
 
 int mesh3_nvv(mesh3_s const *mesh, size_t i) {
-  int nvc = mesh3_nvc(mesh, i);
-  size_t *vc = malloc(sizeof(size_t)*nvc);
-  mesh3_vc(mesh, i, vc);
-
-  /* trivial upper bound: nvv <= 3*nvc */
-  size_t *vv = malloc(3*sizeof(size_t)*nvc);
-
-  int nvv = 0;
-  for (int p = 0; p < nvc; ++p) {
-    size_t const *cell = mesh->cells[vc[p]];
-    for (int q = 0; q < 4; ++q) {
-      size_t j = cell[q];
-      if (i == j || contains((void *)vv, nvv, &j, sizeof(size_t))) {
-        continue;
-      }
-      vv[nvv++] = j;
-    }
-  }
-
-  free(vv);
-  free(vc);
-
-  return nvv;
+  assert(i < mesh->nverts);
+  return mesh->vv_offsets[i + 1] - mesh->vv_offsets[i];
 }
 
 void mesh3_vv(mesh3_s const *mesh, size_t i, size_t *vv) {
-  int nvc = mesh3_nvc(mesh, i);
-  size_t *vc = malloc(sizeof(size_t)*nvc);
-  mesh3_vc(mesh, i, vc);
-
-  int k = 0;
-  for (int p = 0; p < nvc; ++p) {
-    size_t const *cell = mesh->cells[vc[p]];
-    for (int q = 0; q < 4; ++q) {
-      size_t j = cell[q];
-      if (i == j || contains((void *)vv, k, &j, sizeof(size_t))) {
-        continue;
-      }
-      vv[k++] = j;
-    }
-  }
+  int nvv = mesh3_nvv(mesh, i);
+  size_t *vvi = &mesh->vv[mesh->vv_offsets[i]];
+  memcpy((void *)vv, (void *)vvi, sizeof(size_t)*nvv);
+}
 
-  free(vc);
+/* Get a pointer to the vertices adjacent to vertex `i` without
+ * copying them. The number of neighbors is written to `nvv`. The
+ * returned pointer is owned by `mesh` and is valid until `mesh` is
+ * deinitialized. */
+size_t const *mesh3_get_vv_ptr(mesh3_s const *mesh, size_t i, size_t *nvv) {
+  assert(i < mesh->nverts);
+  *nvv = mesh->vv_offsets[i + 1] - mesh->vv_offsets[i];
+  return &mesh->vv[mesh->vv_offsets[i]];
 }
 
+/**
+ * TODO: the functions below are simple, unoptimized
+ * implementations. There are lots of ways to improve these, but we
+ * want to wait on that until later.
+ */
+
 static int num_shared_verts(size_t const *cell1, size_t const *cell2) {
   // TODO: speed up using SIMD?
   int n = 0;
@@ -1233,22 +1769,16 @@ void mesh3_cv(mesh3_s const *mesh, size_t i, size_t *cv) {
 int mesh3_nec(mesh3_s const *mesh, size_t const le[2]) {
   assert(le[0] != le[1]);
 
-  size_t i = le[0], j = le[1];
-
-  int nvci = mesh3_nvc(mesh, i);
-  size_t *vci = malloc(sizeof(size_t)*nvci);
-  mesh3_vc(mesh, i, vci);
-
-  int nvcj = mesh3_nvc(mesh, j);
-  size_t *vcj = malloc(sizeof(size_t)*nvcj);
-  mesh3_vc(mesh, j, vcj);
+  size_t nvci, nvcj;
+  size_t const *vci = mesh3_get_vc_ptr(mesh, le[0], &nvci);
+  size_t const *vcj = mesh3_get_vc_ptr(mesh, le[1], &nvcj);
 
   int nec = 0;
 
   size_t c;
-  for (int a = 0; a < nvci; ++a) {
+  for (size_t a = 0; a < nvci; ++a) {
     c = vci[a];
-    for (int b = 0; b < nvcj; ++b) {
+    for (size_t b = 0; b < nvcj; ++b) {
       if (c == vcj[b]) {
         ++nec;
         break;
@@ -1256,40 +1786,28 @@ int mesh3_nec(mesh3_s const *mesh, size_t const le[2]) {
     }
   }
 
-  free(vci);
-  free(vcj);
-
   return nec;
 }
 
 void mesh3_ec(mesh3_s const *mesh, size_t const le[2], size_t *lc) {
   assert(le[0] != le[1]);
 
-  size_t i = le[0], j = le[1];
-
-  int nvci = mesh3_nvc(mesh, i);
-  size_t *vci = malloc(sizeof(size_t)*nvci);
-  mesh3_vc(mesh, i, vci);
-
-  int nvcj = mesh3_nvc(mesh, j);
-  size_t *vcj = malloc(sizeof(size_t)*nvcj);
-  mesh3_vc(mesh, j, vcj);
+  size_t nvci, nvcj;
+  size_t const *vci = mesh3_get_vc_ptr(mesh, le[0], &nvci);
+  size_t const *vcj = mesh3_get_vc_ptr(mesh, le[1], &nvcj);
 
   int nec = 0;
 
   size_t c;
-  for (int a = 0; a < nvci; ++a) {
+  for (size_t a = 0; a < nvci; ++a) {
     c = vci[a];
-    for (int b = 0; b < nvcj; ++b) {
+    for (size_t b = 0; b < nvcj; ++b) {
       if (c == vcj[b]) {
         lc[nec++] = c;
         break;
       }
     }
   }
-
-  free(vci);
-  free(vcj);
 }
 
 bool mesh3_cee(mesh3_s const *mesh, size_t c, size_t const e[2],
@@ -1411,46 +1929,56 @@ void mesh3_ev(mesh3_s const *mesh, size_t const e[2], size_t *v) {
 }
 
 int mesh3_nfc(mesh3_s const *mesh, size_t const f[3]) {
+  if (mesh->has_topology) {
+    uint2 fc;
+    mesh3_fc(mesh, f, fc);
+    return (fc[0] != (size_t)NO_INDEX) + (fc[1] != (size_t)NO_INDEX);
+  }
+
   // We find the cells neighboring one of the vertices of the face and
   // then determine which ones are adjacent to the rest of the
   // vertices. It doesn't matter which vertex of `f` we use to do
   // this.
 
-  int nvc = mesh3_nvc(mesh, f[0]);
-  size_t *vc = malloc(nvc*sizeof(size_t)), cv[4];
-  mesh3_vc(mesh, f[0], vc);
+  size_t nvc, cv[4];
+  size_t const *vc = mesh3_get_vc_ptr(mesh, f[0], &nvc);
 
   int nfc = 0;
-  for (int i = 0; i < nvc; ++i) {
+  for (size_t i = 0; i < nvc; ++i) {
     mesh3_cv(mesh, vc[i], cv);
     nfc += face_in_cell(f, cv);
   }
   assert(nfc == 1 || nfc == 2);
 
-  free(vc);
-
   return nfc;
 }
 
 void mesh3_fc(mesh3_s const *mesh, size_t const f[3], uint2 fc) {
   fc[0] = fc[1] = (size_t)NO_INDEX;
 
+  /* If we have the face table, just look the face up */
+  if (mesh->has_topology) {
+    uint3 lf = {f[0], f[1], f[2]};
+    SORT3(lf[0], lf[1], lf[2]);
+    size_t i = find_face(mesh, lf);
+    if (i != (size_t)NO_INDEX)
+      memcpy(fc, mesh->fc[i], sizeof(uint2));
+    return;
+  }
+
   /* Find all of the cells which are incident on one of the faces */
-  int nvc = mesh3_nvc(mesh, f[0]);
-  size_t *vc = malloc(nvc*sizeof(size_t)), cv[4];
-  mesh3_vc(mesh, f[0], vc);
+  size_t nvc, cv[4];
+  size_t const *vc = mesh3_get_vc_ptr(mesh, f[0], &nvc);
 
   /* Iterate over each cell, accumulating the cells which contain the
      target face `f`. There can be at most two of these. If there's
      only one, the face is a boundary face. */
   int nfc = 0;
-  for (int i = 0; i < nvc; ++i) {
+  for (size_t i = 0; i < nvc; ++i) {
     mesh3_cv(mesh, vc[i], cv);
     if (face_in_cell(f, cv))
       fc[nfc++] = vc[i];
   }
-
-  free(vc);
 }
 
 bool mesh3_cfv(mesh3_s const *mesh, size_t lc, size_t const lf[3], size_t *lv) {
@@ -1504,6 +2032,31 @@ bool mesh3_has_bd_info(mesh3_s const *mesh) {
   return mesh->has_bd_info;
 }
 
+bool mesh3_has_topology(mesh3_s const *mesh) {
+  return mesh->has_topology;
+}
+
+size_t mesh3_nfaces(mesh3_s const *mesh) {
+  assert(mesh->has_topology);
+  return mesh->nfaces;
+}
+
+void mesh3_get_face(mesh3_s const *mesh, size_t i, uint3 lf) {
+  assert(mesh->has_topology);
+  assert(i < mesh->nfaces);
+  memcpy(lf, mesh->faces[i], sizeof(uint3));
+}
+
+/* Get the index of the face `lf` in the face table, or `NO_INDEX` if
+ * `lf` isn't a face of the mesh. The vertices of `lf` can be in any
+ * order. Requires the full topology. */
+size_t mesh3_get_face_index(mesh3_s const *mesh, uint3 const lf) {
+  assert(mesh->has_topology);
+  uint3 lf_sorted = {lf[0], lf[1], lf[2]};
+  SORT3(lf_sorted[0], lf_sorted[1], lf_sorted[2]);
+  return find_face(mesh, lf_sorted);
+}
+
 bool *mesh3_get_bdc_ptr(mesh3_s *mesh) {
   assert(mesh->has_bd_info);
   return mesh->bdc;
@@ -1576,20 +2129,17 @@ bool mesh3_is_bdf(mesh3_s const *mesh, size_t const lf[3]) {
 }
 
 bool mesh3_is_edge(mesh3_s const *mesh, size_t const l[2]) {
-  int nvv = mesh3_nvv(mesh, l[0]);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(mesh, l[0], vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, l[0], &nvv);
 
   bool is_edge = false;
-  for (int i = 0; i < nvv; ++i) {
+  for (size_t i = 0; i < nvv; ++i) {
     if (vv[i] == l[1]) {
       is_edge = true;
       break;
     }
   }
 
-  free(vv);
-
   return is_edge;
 }
 
@@ -1604,17 +2154,14 @@ bool mesh3_is_diff_edge(mesh3_s const *mesh, size_t const le[2]) {
 bool mesh3_vert_incident_on_diff_edge(mesh3_s const *mesh, size_t l) {
   assert(mesh->has_bd_info);
 
-  int nvv = mesh3_nvv(mesh, l);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(mesh, l, vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
 
   bool is_incident = false;
-  for (int i = 0; i < nvv; ++i)
+  for (size_t i = 0; i < nvv; ++i)
     if ((is_incident = mesh3_is_diff_edge(mesh, (size_t[2]) {l, vv[i]})))
       break;
 
-  free(vv);
-
   return is_incident;
 }
 
@@ -1624,36 +2171,31 @@ bool mesh3_vert_is_terminal_diff_edge_vert(mesh3_s const *mesh, size_t l) {
   if (!mesh3_vert_incident_on_diff_edge(mesh, l))
     return false;
 
-  array_s *diff_labels_seen;
-  array_alloc(&diff_labels_seen);
-  array_init(diff_labels_seen, sizeof(size_t), ARRAY_DEFAULT_CAPACITY);
-
-  size_t nvv = mesh3_nvv(mesh, l);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(mesh, l, vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
 
+  /* `l` is terminal unless two of its incident diffracting edges
+   * share a label. Compare each label with the labels of the
+   * diffracting edges seen so far (there are only a few of these). */
   bool terminal = true;
 
-  for (size_t i = 0; i < nvv; ++i) {
+  for (size_t i = 0; terminal && i < nvv; ++i) {
     if (!mesh3_is_diff_edge(mesh, (size_t[2]) {l, vv[i]}))
       continue;
     bde_s bde = make_bde(l, vv[i]);
-    size_t j = find_bde(mesh, &bde);
-    size_t bde_label = mesh->bde_label[j];
+    size_t bde_label = mesh->bde_label[find_bde(mesh, &bde)];
     assert(bde_label != NO_LABEL);
-    if (array_contains(diff_labels_seen, &bde_label)) {
-      terminal = false;
-      break;
-    } else {
-      array_append(diff_labels_seen, &bde_label);
+    for (size_t j = 0; j < i; ++j) {
+      if (!mesh3_is_diff_edge(mesh, (size_t[2]) {l, vv[j]}))
+        continue;
+      bde_s bde_other = make_bde(l, vv[j]);
+      if (mesh->bde_label[find_bde(mesh, &bde_other)] == bde_label) {
+        terminal = false;
+        break;
+      }
     }
   }
 
-  free(vv);
-
-  array_deinit(diff_labels_seen);
-  array_dealloc(&diff_labels_seen);
-
   return terminal;
 }
 
@@ -1690,17 +2232,14 @@ static bool local_ray_in_tetra_cone(mesh3_s const *mesh, dbl3 const p, size_t lc
 }
 
 bool mesh3_local_ray_in_vertex_cone(mesh3_s const *mesh, dbl3 const p, size_t lv) {
-  size_t nvc = mesh3_nvc(mesh, lv);
-  size_t *vc = malloc(mesh->nverts*sizeof(size_t));
-  mesh3_vc(mesh, lv, vc);
+  size_t nvc;
+  size_t const *vc = mesh3_get_vc_ptr(mesh, lv, &nvc);
 
   bool in_cone = false;
   for (size_t i = 0; i < nvc; ++i)
     if ((in_cone = local_ray_in_tetra_cone(mesh, p, vc[i], lv)))
       break;
 
-  free(vc);
-
   return in_cone;
 }
 
@@ -1708,16 +2247,17 @@ bool mesh3_ray_prop_from_edge_is_occluded(mesh3_s const *mesh, dbl3 const t,
                                           uint2 const l) {
   bool occluded = true;
 
-  /* gets cells incident on active edge */
-  size_t nec = mesh3_nec(mesh, l);
-  size_t *ec = malloc(nec*sizeof(size_t));
-  mesh3_ec(mesh, l, ec);
+  /* iterate over the cells incident on `l[0]`, skipping those which
+   * aren't incident on the active edge */
+  size_t nvc;
+  size_t const *vc = mesh3_get_vc_ptr(mesh, l[0], &nvc);
 
   /* check whether `dxhat` points into a tetrahedron incident on the
    * base of the active edge */
-  for (size_t i = 0, l_op[2]; i < nec; ++i) {
-    /* get the opposite edge */
-    mesh3_cee(mesh, ec[i], l, l_op);
+  for (size_t i = 0, l_op[2]; i < nvc; ++i) {
+    /* get the opposite edge (skipping cells which don't contain `l`) */
+    if (!mesh3_cee(mesh, vc[i], l, l_op))
+      continue;
 
     dbl3 x[2];
     mesh3_copy_vert(mesh, l[0], x[0]);
@@ -1766,8 +2306,6 @@ bool mesh3_ray_prop_from_edge_is_occluded(mesh3_s const *mesh, dbl3 const t,
     }
   }
 
-  free(ec);
-
   return occluded;
 }
 
@@ -1799,10 +2337,10 @@ bool mesh3_local_ray_is_occluded(mesh3_s const *mesh, size_t lhat, par3_s const
 
   /* interior minimizer */
   if (num_active_constraints == 0) {
-    /* get cells incident on base of update */
-    size_t nfc = mesh3_nfc(mesh, l_active);
-    size_t *fc = malloc(nfc*sizeof(size_t));
+    /* get cells incident on base of update (there are at most two) */
+    uint2 fc;
     mesh3_fc(mesh, l_active, fc);
+    size_t nfc = fc[1] == (size_t)NO_INDEX ? 1 : 2;
 
     /* check whether the `dxhat` points into a tetrahedron incident on
      * the base of the update */
@@ -1833,8 +2371,6 @@ bool mesh3_local_ray_is_occluded(mesh3_s const *mesh, size_t lhat, par3_s const
         break;
       }
     }
-
-    free(fc);
   }
 
   /* edge minimizer */
@@ -1957,17 +2493,14 @@ mesh2_s *mesh3_get_surface_mesh(mesh3_s const *mesh) {
 size_t mesh3_get_num_inc_diff_edges(mesh3_s const *mesh, size_t l) {
   assert(mesh->has_bd_info);
 
-  int nvv = mesh3_nvv(mesh, l);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(mesh, l, vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
 
   size_t num_inc_diff_edges = 0;
-  for (int i = 0; i < nvv; ++i)
+  for (size_t i = 0; i < nvv; ++i)
     if (mesh3_is_diff_edge(mesh, (size_t[2]) {l, vv[i]}))
       ++num_inc_diff_edges;
 
-  free(vv);
-
   return num_inc_diff_edges;
 }
 
@@ -1977,20 +2510,17 @@ size_t mesh3_get_num_inc_diff_edges(mesh3_s const *mesh, size_t l) {
 void mesh3_get_inc_diff_edges(mesh3_s const *mesh, size_t l, size_t (*le)[2]) {
   assert(mesh->has_bd_info);
 
-  int nvv = mesh3_nvv(mesh, l);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(mesh, l, vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, l, &nvv);
 
   int j = 0;
-  for (int i = 0; i < nvv; ++i) {
+  for (size_t i = 0; i < nvv; ++i) {
     if (mesh3_is_diff_edge(mesh, (size_t[2]) {l, vv[i]})) {
       le[j][0] = l;
       le[j][1] = vv[i];
       ++j;
     }
   }
-
-  free(vv);
 }
 
 size_t mesh3_get_num_inc_bdf(mesh3_s const *mesh, size_t l) {
@@ -2386,6 +2916,15 @@ size_t mesh3_get_vert_index(mesh3_s const *mesh, dbl3 const x) {
 
 dbl mesh3_linterp(mesh3_s const *mesh, dbl const *values, dbl3 const x) {
   size_t lc = mesh3_find_cell_containing_point(mesh, x, (size_t)NO_INDEX);
+  return mesh3_linterp_in_cell(mesh, values, lc, x);
+}
+
+/* Linearly interpolate `values` (one per vertex) at `x` using the
+ * vertices of cell `lc`, which should contain `x`. Use this instead
+ * of `mesh3_linterp` when the cell is already known (e.g., from a ray
+ * intersection) to avoid searching for it. */
+dbl mesh3_linterp_in_cell(mesh3_s const *mesh, dbl const *values, size_t lc,
+                          dbl3 const x) {
   tetra3 tetra = mesh3_get_tetra(mesh, lc);
   dbl4 b; tetra3_get_bary_coords(&tetra, x, b);
   size_t lv[4]; mesh3_cv(mesh, lc, lv);
@@ -2427,9 +2966,8 @@ dbl mesh3_get_diam(mesh3_s const *mesh) {
 }
 
 dbl mesh3_get_vertex_tol(mesh3_s const *mesh, size_t lv) {
-  size_t nvv = mesh3_nvv(mesh, lv);
-  size_t *vv = malloc(nvv*sizeof(size_t));
-  mesh3_vv(mesh, lv, vv);
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, lv, &nvv);
 
   dbl hmin = INFINITY;
   for (size_t i = 0; i < nvv; ++i) {
@@ -2437,8 +2975,6 @@ dbl mesh3_get_vertex_tol(mesh3_s const *mesh, size_t lv) {
     hmin = fmin(hmin, h);
   }
 
-  free(vv);
-
   dbl tol = pow(hmin/mesh->diam, 2);
 
   return tol;
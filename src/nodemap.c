@@ -0,0 +1,195 @@
+#include "nodemap.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <jmm/def.h>
+
+/* We use open addressing with linear probing. The number of slots is
+ * always a power of two, and we keep the load factor at or below
+ * 1/2. Keys are hashed using Fibonacci hashing. */
+
+typedef struct slot {
+  size_t l; /* `NO_INDEX` if the slot is empty */
+  array_s *arr;
+} slot_s;
+
+struct nodemap {
+  slot_s *slot;
+  size_t num_slots;
+  size_t shift;
+  size_t size;
+
+  /* Arrays belonging to nodes which were removed from the map. We
+   * hang on to them so that they can be reused. */
+  array_s *free_arrs;
+};
+
+void nodemap_alloc(nodemap_s **map) {
+  *map = malloc(sizeof(nodemap_s));
+}
+
+void nodemap_dealloc(nodemap_s **map) {
+  free(*map);
+  *map = NULL;
+}
+
+static size_t hash(nodemap_s const *map, size_t l) {
+  return ((uint64_t)l*UINT64_C(11400714819323198485)) >> map->shift;
+}
+
+static void init_slots(nodemap_s *map, size_t num_slots) {
+  assert(num_slots >= 2 && (num_slots & (num_slots - 1)) == 0);
+
+  map->slot = malloc(num_slots*sizeof(slot_s));
+  for (size_t i = 0; i < num_slots; ++i) {
+    map->slot[i].l = (size_t)NO_INDEX;
+    map->slot[i].arr = NULL;
+  }
+
+  map->num_slots = num_slots;
+
+  map->shift = 64;
+  while (num_slots > 1) {
+    --map->shift;
+    num_slots >>= 1;
+  }
+}
+
+void nodemap_init(nodemap_s *map, size_t capacity) {
+  size_t num_slots = 2;
+  while (num_slots < 2*capacity)
+    num_slots *= 2;
+
+  init_slots(map, num_slots);
+
+  map->size = 0;
+
+  array_alloc(&map->free_arrs);
+  array_init(map->free_arrs, sizeof(array_s *), ARRAY_DEFAULT_CAPACITY);
+}
+
+void nodemap_deinit(nodemap_s *map) {
+  for (size_t i = 0; i < map->num_slots; ++i) {
+    if (map->slot[i].arr == NULL)
+      continue;
+    array_deinit(map->slot[i].arr);
+    array_dealloc(&map->slot[i].arr);
+  }
+  free(map->slot);
+  map->slot = NULL;
+
+  array_s *arr;
+  for (size_t i = 0; i < array_size(map->free_arrs); ++i) {
+    array_get(map->free_arrs, i, &arr);
+    array_deinit(arr);
+    array_dealloc(&arr);
+  }
+  array_deinit(map->free_arrs);
+  array_dealloc(&map->free_arrs);
+}
+
+/* Return the number of nodes with an entry in `map`. */
+size_t nodemap_size(nodemap_s const *map) {
+  return map->size;
+}
+
+/* Find the slot holding `l`, or the empty slot where `l` would be
+ * inserted if it isn't in `map`. */
+static size_t find_slot(nodemap_s const *map, size_t l) {
+  size_t mask = map->num_slots - 1;
+  size_t i = hash(map, l);
+  while (map->slot[i].l != (size_t)NO_INDEX && map->slot[i].l != l)
+    i = (i + 1) & mask;
+  return i;
+}
+
+/* Get the array associated with node `l`, or `NULL` if there isn't
+ * one. */
+array_s *nodemap_get(nodemap_s const *map, size_t l) {
+  return map->slot[find_slot(map, l)].arr;
+}
+
+static void grow(nodemap_s *map) {
+  slot_s *old_slot = map->slot;
+  size_t old_num_slots = map->num_slots;
+
+  init_slots(map, 2*old_num_slots);
+
+  for (size_t i = 0; i < old_num_slots; ++i)
+    if (old_slot[i].l != (size_t)NO_INDEX)
+      map->slot[find_slot(map, old_slot[i].l)] = old_slot[i];
+
+  free(old_slot);
+}
+
+/* Get the array associated with node `l`, adding an empty array for
+ * `l` first if there isn't one already. */
+array_s *nodemap_get_or_insert(nodemap_s *map, size_t l) {
+  assert(l != (size_t)NO_INDEX);
+
+  size_t i = find_slot(map, l);
+  if (map->slot[i].arr != NULL)
+    return map->slot[i].arr;
+
+  if (2*(map->size + 1) > map->num_slots) {
+    grow(map);
+    i = find_slot(map, l);
+  }
+
+  array_s *arr;
+  if (array_is_empty(map->free_arrs)) {
+    array_alloc(&arr);
+    array_init(arr, sizeof(void *), 4);
+  } else {
+    array_pop_back(map->free_arrs, &arr);
+  }
+
+  map->slot[i].l = l;
+  map->slot[i].arr = arr;
+  ++map->size;
+
+  return arr;
+}
+
+/* Remove node `l` from `map`. Its array is cleared and kept for
+ * reuse. Nothing happens if `l` isn't in `map`. */
+void nodemap_remove(nodemap_s *map, size_t l) {
+  size_t mask = map->num_slots - 1;
+
+  size_t i = find_slot(map, l);
+  if (map->slot[i].arr == NULL)
+    return;
+
+  array_clear(map->slot[i].arr);
+  array_append(map->free_arrs, &map->slot[i].arr);
+  --map->size;
+
+  /* Shift back any entries following `i` which would no longer be
+   * reachable from their home slot once `i` is emptied */
+  for (size_t j = i, k;;) {
+    j = (j + 1) & mask;
+    if (map->slot[j].l == (size_t)NO_INDEX)
+      break;
+    k = hash(map, map->slot[j].l);
+    if (i <= j ? i < k && k <= j : i < k || k <= j)
+      continue;
+    map->slot[i] = map->slot[j];
+    i = j;
+  }
+
+  map->slot[i].l = (size_t)NO_INDEX;
+  map->slot[i].arr = NULL;
+}
+
+/* Slots can be iterated over using these two functions. An empty
+ * slot's array is `NULL`. */
+size_t nodemap_num_slots(nodemap_s const *map) {
+  return map->num_slots;
+}
+
+array_s *nodemap_get_slot(nodemap_s const *map, size_t i) {
+  assert(i < map->num_slots);
+  return map->slot[i].arr;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <jmm/array.h>
+
+/* A hash table mapping node indices to arrays of pointers. This is
+ * used to index cached updates by their target node. Each node's
+ * array is owned by the map, but the pointers stored in it aren't. */
+typedef struct nodemap nodemap_s;
+
+void nodemap_alloc(nodemap_s **map);
+void nodemap_dealloc(nodemap_s **map);
+void nodemap_init(nodemap_s *map, size_t capacity);
+void nodemap_deinit(nodemap_s *map);
+size_t nodemap_size(nodemap_s const *map);
+array_s *nodemap_get(nodemap_s const *map, size_t l);
+array_s *nodemap_get_or_insert(nodemap_s *map, size_t l);
+void nodemap_remove(nodemap_s *map, size_t l);
+size_t nodemap_num_slots(nodemap_s const *map);
+array_s *nodemap_get_slot(nodemap_s const *map, size_t i);
+
+#ifdef __cplusplus
+}
+#endif
@@ -144,24 +144,29 @@ void triqp2_solve(triqp2_s *qp, dbl tol) {
     x[1] = 1 - x11_opt;
   }
 
+  /* The remaining cases are ties, which happen when the minimizer is
+   * the vertex shared by two edges. The optimum on each edge is only
+   * computed up to rounding error, so we compare them to the vertex
+   * using `tol`. */
+
   else if (p_x10_opt == p_y01_opt) {
-    assert(x10_opt == 0 && y01_opt == 0);
+    assert(fabs(x10_opt) < tol && fabs(y01_opt) < tol);
     x[0] = 0;
     x[1] = 0;
   }
 
   else if (p_x10_opt == p_x11_opt) {
-    assert(fabs(1 - x10_opt) < tol && x11_opt == 1);
+    assert(fabs(1 - x10_opt) < tol && fabs(1 - x11_opt) < tol);
     x[0] = 1;
     x[1] = 0;
   }
 
   else if (p_y01_opt == p_x11_opt) {
-    if (x11_opt == 0 && y01_opt == 1) {
+    if (fabs(x11_opt) < tol && fabs(1 - y01_opt) < tol) {
       x[0] = 0;
       x[1] = 1;
-    } else if (x11_opt == 1 && y01_opt == 0) {
-      assert(x10_opt == 0.5);
+    } else if (fabs(1 - x11_opt) < tol && fabs(y01_opt) < tol) {
+      assert(fabs(x10_opt - 0.5) < tol);
       x[0] = 0.5;
       x[1] = 0;
     }
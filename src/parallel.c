@@ -0,0 +1,55 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "macros.h"
+
+typedef struct work {
+  parallel_task_f task;
+  void *context;
+  size_t num_tasks;
+  size_t next;
+  pthread_mutex_t lock;
+} work_s;
+
+static void *worker(void *ptr) {
+  work_s *work = (work_s *)ptr;
+  while (true) {
+    pthread_mutex_lock(&work->lock);
+    size_t i = work->next++;
+    pthread_mutex_unlock(&work->lock);
+    if (i >= work->num_tasks)
+      break;
+    work->task(work->context, i);
+  }
+  return NULL;
+}
+
+/* Run `task` for each index in `[0, num_tasks)` using up to
+ * `num_threads` threads, one of which is the calling thread. Tasks
+ * are handed out one at a time, so they don't need to take the same
+ * amount of time. This returns once every task has finished. */
+void parallel_for(size_t num_tasks, size_t num_threads, parallel_task_f task,
+                  void *context) {
+  work_s work = {.task = task, .context = context, .num_tasks = num_tasks,
+                 .next = 0};
+  pthread_mutex_init(&work.lock, NULL);
+
+  num_threads = MIN(num_threads, num_tasks);
+  pthread_t *thread = NULL;
+  if (num_threads > 1)
+    thread = malloc((num_threads - 1)*sizeof(pthread_t));
+
+  for (size_t i = 0; i + 1 < num_threads; ++i)
+    pthread_create(&thread[i], NULL, worker, &work);
+
+  worker(&work);
+
+  for (size_t i = 0; i + 1 < num_threads; ++i)
+    pthread_join(thread[i], NULL);
+
+  free(thread);
+  pthread_mutex_destroy(&work.lock);
+}
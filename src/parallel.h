@@ -0,0 +1,18 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* A task run by `parallel_for`. It's called once for each `i` in
+ * `[0, num_tasks)`, possibly from different threads. */
+typedef void (*parallel_task_f)(void *context, size_t i);
+
+void parallel_for(size_t num_tasks, size_t num_threads, parallel_task_f task,
+                  void *context);
+
+#ifdef __cplusplus
+}
+#endif
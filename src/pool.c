@@ -5,6 +5,20 @@
 
 #include <jmm/array.h>
 
+/* A type with the strictest alignment of any type (like C11's
+ * `max_align_t`, which isn't available to us in C99). `pool_get`
+ * rounds each request up to a multiple of its alignment, so that
+ * every pointer it hands out is suitably aligned for anything, no
+ * matter what was requested before it. */
+typedef union {
+  long double ld;
+  long long ll;
+  void *ptr;
+  void (*fptr)(void);
+} max_align_u;
+
+#define POOL_ALIGNMENT __alignof__(max_align_u)
+
 typedef struct block {
   void *ptr;
   size_t size;
@@ -73,7 +87,9 @@ void pool_deinit(pool_s *pool) {
 }
 
 void *pool_get(pool_s *pool, size_t num_bytes) {
-  block_s *block;
+  num_bytes = POOL_ALIGNMENT*((num_bytes + POOL_ALIGNMENT - 1)/POOL_ALIGNMENT);
+
+  block_s *block = NULL;
 
   // First, traverse the block list and see if we can allocate from
   // any of the existing blocks
@@ -96,3 +112,32 @@ void *pool_get(pool_s *pool, size_t num_bytes) {
   assert(block->capacity >= num_bytes);
   return block_get(block, num_bytes);
 }
+
+/* Release everything that was handed out by `pool_get` at once,
+ * keeping the memory around for reuse. If the pool had to grow since
+ * it was last reset, its blocks are merged into a single block with
+ * the same total capacity, so that a pool which is reset once per
+ * unit of work stops allocating after a brief warm-up period. */
+void pool_reset(pool_s *pool) {
+  size_t num_blocks = array_size(pool->blocks);
+
+  block_s *block;
+
+  if (num_blocks == 1) {
+    block = array_get_ptr(pool->blocks, 0);
+    block->size = 0;
+    return;
+  }
+
+  size_t capacity = 0;
+  for (size_t i = 0; i < num_blocks; ++i) {
+    block = array_get_ptr(pool->blocks, i);
+    capacity += block->capacity;
+    block_deinit(block);
+  }
+
+  array_deinit(pool->blocks);
+  array_init(pool->blocks, sizeof(block_s), 1);
+
+  pool_append_block(pool, capacity);
+}
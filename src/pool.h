@@ -13,6 +13,7 @@ void pool_dealloc(pool_s **pool);
 void pool_init(pool_s *pool, size_t initial_capacity);
 void pool_deinit(pool_s *pool);
 void *pool_get(pool_s *pool, size_t num_bytes);
+void pool_reset(pool_s *pool);
 
 #ifdef __cplusplus
 }
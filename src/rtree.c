@@ -14,6 +14,7 @@
 
 #include "log.h"
 #include "macros.h"
+#include "parallel.h"
 #include "pool.h"
 
 // Section: robj_s
@@ -190,6 +191,23 @@ robj_equal_t _robj_equal[] = {
   (robj_equal_t)tetra3_equal
 };
 
+/** robj_get_level_range: */
+
+/* Get the range of values taken by a level-set object (a bmesh33
+ * cell). This is the range of its Bezier ordinates, which bounds the
+ * values of the polynomial since the graph of a Bezier tetra lies in
+ * the convex hull of its control points. Other kinds of objects don't
+ * depend on the level, so their range is everything. */
+static void robj_get_level_range(robj_s const *obj, dbl range[2]) {
+  if (obj->type == ROBJ_BMESH33_CELL) {
+    bmesh33_cell_s const *cell = obj->data;
+    dblN_minmax(cell->bb->c, 20, &range[0], &range[1]);
+  } else {
+    range[0] = -INFINITY;
+    range[1] = INFINITY;
+  }
+}
+
 bool robj_equal(robj_s const *obj1, robj_s const *obj2) {
   if (obj1 == NULL || obj2 == NULL)
     return false;
@@ -331,60 +349,6 @@ static bool rnode_query_bbox(rnode_s const *node, rect3 const *bbox) {
   return false;
 }
 
-static void
-rnode_intersect_leaf(rnode_s const *node, ray3 const *ray, isect *isect,
-                     robj_s const *skip_robj) {
-  dbl t;
-  robj_s const *obj;
-  for (size_t i = 0; i < node->leaf_data.size; ++i) {
-    obj = &node->leaf_data.obj[i];
-    if (robj_equal(skip_robj, obj))
-      continue;
-    if (robj_intersect(obj, ray, &t) && 0 <= t && t < isect->t) {
-      isect->t = t;
-      isect->obj = obj;
-    }
-  }
-}
-
-static void
-rnode_intersect(rnode_s const *node, ray3 const *ray, isect *isect,
-                robj_s const *skip_robj) {
-  /* First, check whether the ray intersects the current node's
-   * bounding box. If it doesn't, we don't want to update the
-   * intersection's t value or check for intersections below this
-   * node, so we return early. */
-  dbl t = ray3_intersect_rect3(ray, &node->bbox);
-  if (isinf(t))
-    return;
-
-  /* If this is a leaf node, then we've bottomed out in the recursion:
-   * time to check for intersections with each contained object. */
-  if (node->type == RNODE_TYPE_LEAF) {
-    rnode_intersect_leaf(node, ray, isect, skip_robj);
-    return;
-  }
-
-  /* Intersect the bounding boxes of the two child nodes. */
-  dbl t_child[2] = {
-    ray3_intersect_rect3(ray, &node->child[0]->bbox),
-    ray3_intersect_rect3(ray, &node->child[1]->bbox)
-  };
-
-  /* Sort the pair of intersection parameters, and grab pointers to
-   * the child nodes in the same order. */
-  rnode_s *child[2] = {node->child[0], node->child[1]};
-  if (t_child[1] < t_child[0]) {
-    SWAP(t_child[0], t_child[1]);
-    SWAP(child[0], child[1]);
-  }
-
-  /* Intersect the child nodes in sorted order. */
-  for (int i = 0; i < 2; ++i)
-    if (isfinite(t_child[i]))
-      rnode_intersect(child[i], ray, isect, skip_robj);
-}
-
 /**
  * The number of bins to use when using one pass of Tibshirani's
  * binmedian algorithm to approximate the median along each axis when
@@ -433,6 +397,82 @@ cleanup:
   return success;
 }
 
+// Section: flattened tree
+
+/* `rtree_build` refines a tree of individually allocated `rnode_s`s,
+ * and then copies it into flat arrays, which are what rays are traced
+ * through. The nodes are stored in depth-first order, so an
+ * internal node's first child immediately follows it, and the
+ * objects in the leaves are stored contiguously in leaf order, each
+ * with a copy of its vertices. Tracing a ray then walks forward
+ * through arrays instead of chasing pointers from nodes to objects to
+ * meshes. */
+
+/* A node of the flattened tree. This is 64 bytes, so that each node
+ * (and its 32-byte aligned bounding box) fits in a cache line. */
+typedef struct {
+  rect3 bbox;
+
+  /* For an internal node, the index of its second child. For a leaf,
+   * the index of its first object in `rtree->flat_obj`. */
+  size_t offset;
+
+  /* The number of objects in a leaf, or `NO_INDEX` for an internal
+   * node. */
+  size_t num_objs;
+} __attribute__((aligned(32))) flat_node_s;
+
+typedef struct {
+  robj_s obj;
+
+  /* A copy of the object's vertices. Triangles use `tri`, bmesh33
+   * cells use their tetrahedron's barycentric map (see
+   * `tetra3_get_bary_map`), and everything else uses `tetra`. */
+  union {
+    tri3 tri;
+    tetra3 tetra;
+    dbl34 bary_map;
+  };
+} __attribute__((aligned(32))) flat_obj_s;
+
+static void flat_obj_init(flat_obj_s *fobj, robj_s const *obj) {
+  fobj->obj = *obj;
+
+  switch (obj->type) {
+  case ROBJ_BMESH33_CELL: {
+    bmesh33_cell_s const *cell = obj->data;
+    tetra3 tetra = mesh3_get_tetra(cell->mesh, cell->l);
+    tetra3_get_bary_map(&tetra, fobj->bary_map);
+    break;
+  }
+  case ROBJ_MESH2_TRI: {
+    mesh2_tri_s const *mesh_tri = obj->data;
+    fobj->tri = mesh2_get_tri(mesh_tri->mesh, mesh_tri->l);
+    break;
+  }
+  case ROBJ_MESH3_TETRA: {
+    mesh3_tetra_s const *mesh_tetra = obj->data;
+    fobj->tetra = mesh3_get_tetra(mesh_tetra->mesh, mesh_tetra->l);
+    break;
+  }
+  case ROBJ_TRI3:
+    fobj->tri = *(tri3 const *)obj->data;
+    break;
+  case ROBJ_TETRA3:
+    fobj->tetra = *(tetra3 const *)obj->data;
+    break;
+  default:
+    assert(false);
+  }
+}
+
+static void *malloc_aligned(size_t size) {
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, 64, size) != 0)
+    return NULL;
+  return ptr;
+}
+
 // Section: rtree_s
 
 #define RTREE_POOL_INITIAL_CAPACITY 4096
@@ -443,8 +483,108 @@ struct rtree {
   rtree_split_strategy_e split_strategy;
   pool_s *pool;
   bool pool_owner;
+  size_t num_threads; // Number of threads used by `rtree_build`
+
+  /* The flattened tree (see `flat_node_s`), which is filled in by
+   * `rtree_build`. When intersecting a level set, we can skip any
+   * node or object whose level range (the range of values taken by
+   * the objects below it, see `robj_get_level_range`) doesn't contain
+   * the level. These are kept in separate arrays since most objects
+   * are rejected using their level range alone. */
+  size_t num_flat_nodes;
+  flat_node_s *flat_node;
+  dbl (*flat_node_level_range)[2];
+  size_t num_flat_objs;
+  flat_obj_s *flat_obj;
+  dbl (*flat_obj_level_range)[2];
+  size_t depth; // Number of levels below the root
 };
 
+static void rtree_free_flat(rtree_s *rtree) {
+  free(rtree->flat_node);
+  rtree->flat_node = NULL;
+
+  free(rtree->flat_node_level_range);
+  rtree->flat_node_level_range = NULL;
+
+  free(rtree->flat_obj);
+  rtree->flat_obj = NULL;
+
+  free(rtree->flat_obj_level_range);
+  rtree->flat_obj_level_range = NULL;
+
+  rtree->num_flat_nodes = 0;
+  rtree->num_flat_objs = 0;
+  rtree->depth = 0;
+}
+
+static void rnode_count(rnode_s const *node, size_t *num_nodes,
+                        size_t *num_objs) {
+  ++*num_nodes;
+  if (node->type == RNODE_TYPE_INTERNAL) {
+    rnode_count(node->child[0], num_nodes, num_objs);
+    rnode_count(node->child[1], num_nodes, num_objs);
+  } else {
+    *num_objs += node->leaf_data.size;
+  }
+}
+
+/* Append `node` and everything below it to the flattened tree,
+ * returning the index of `node`. */
+static size_t rtree_flatten_node(rtree_s *rtree, rnode_s const *node,
+                                 size_t depth) {
+  size_t i = rtree->num_flat_nodes++;
+
+  flat_node_s *fnode = &rtree->flat_node[i];
+  fnode->bbox = node->bbox;
+
+  dbl *range = rtree->flat_node_level_range[i];
+  range[0] = INFINITY;
+  range[1] = -INFINITY;
+
+  rtree->depth = MAX(rtree->depth, depth);
+
+  if (node->type == RNODE_TYPE_INTERNAL) {
+    fnode->num_objs = (size_t)NO_INDEX;
+    for (int ch = 0; ch < 2; ++ch) {
+      if (ch == 1)
+        fnode->offset = rtree->num_flat_nodes;
+      size_t j = rtree_flatten_node(rtree, node->child[ch], depth + 1);
+      range[0] = fmin(range[0], rtree->flat_node_level_range[j][0]);
+      range[1] = fmax(range[1], rtree->flat_node_level_range[j][1]);
+    }
+  } else {
+    fnode->offset = rtree->num_flat_objs;
+    fnode->num_objs = node->leaf_data.size;
+    for (size_t k = 0; k < node->leaf_data.size; ++k) {
+      size_t l = rtree->num_flat_objs++;
+      robj_s const *obj = &node->leaf_data.obj[k];
+      flat_obj_init(&rtree->flat_obj[l], obj);
+      robj_get_level_range(obj, rtree->flat_obj_level_range[l]);
+      range[0] = fmin(range[0], rtree->flat_obj_level_range[l][0]);
+      range[1] = fmax(range[1], rtree->flat_obj_level_range[l][1]);
+    }
+  }
+
+  return i;
+}
+
+static void rtree_flatten(rtree_s *rtree) {
+  rtree_free_flat(rtree);
+
+  size_t num_nodes = 0, num_objs = 0;
+  rnode_count(&rtree->root, &num_nodes, &num_objs);
+
+  rtree->flat_node = malloc_aligned(num_nodes*sizeof(flat_node_s));
+  rtree->flat_node_level_range = malloc(num_nodes*sizeof(dbl[2]));
+  rtree->flat_obj = malloc_aligned(num_objs*sizeof(flat_obj_s));
+  rtree->flat_obj_level_range = malloc(num_objs*sizeof(dbl[2]));
+
+  rtree_flatten_node(rtree, &rtree->root, 0);
+  assert(rtree->num_flat_nodes == num_nodes);
+  assert(rtree->num_flat_objs == num_objs);
+}
+
 void rtree_alloc(rtree_s **rtree) {
   *rtree = malloc(sizeof(rtree_s));
 }
@@ -459,6 +599,13 @@ void rtree_init(rtree_s *rtree, size_t leaf_thresh,
   rnode_init(&rtree->root, RNODE_TYPE_LEAF);
   rtree->leaf_thresh = leaf_thresh;
   rtree->split_strategy = split_strategy;
+  rtree->num_threads = 1;
+
+  rtree->flat_node = NULL;
+  rtree->flat_node_level_range = NULL;
+  rtree->flat_obj = NULL;
+  rtree->flat_obj_level_range = NULL;
+  rtree_free_flat(rtree);
 
   pool_alloc(&rtree->pool);
   pool_init(rtree->pool, RTREE_POOL_INITIAL_CAPACITY);
@@ -467,6 +614,7 @@ void rtree_init(rtree_s *rtree, size_t leaf_thresh,
 
 void rtree_deinit(rtree_s *rtree) {
   rnode_deinit(&rtree->root);
+  rtree_free_flat(rtree);
 
   if (rtree->pool_owner) {
     pool_deinit(rtree->pool);
@@ -474,6 +622,15 @@ void rtree_deinit(rtree_s *rtree) {
   }
 }
 
+/* Set the number of threads used to build the tree. This only has an
+ * effect for split strategies which build subtrees in parallel (at
+ * the moment, just `RTREE_SPLIT_STRATEGY_SAH_BINNED`). The tree which
+ * is built doesn't depend on the number of threads. */
+void rtree_set_num_threads(rtree_s *rtree, size_t num_threads) {
+  assert(num_threads > 0);
+  rtree->num_threads = num_threads;
+}
+
 rtree_s *rtree_copy(rtree_s const *rtree) {
   rtree_s *copy = malloc(sizeof(rtree_s));
   rnode_copy_deep(&rtree->root, &copy->root);
@@ -482,10 +639,34 @@ rtree_s *rtree_copy(rtree_s const *rtree) {
   copy->pool = rtree->pool;
   copy->pool_owner = false; // The original rtree is responsible for
                             // freeing the pool
+  copy->num_threads = rtree->num_threads;
+
+  copy->num_flat_nodes = rtree->num_flat_nodes;
+  copy->flat_node = NULL;
+  copy->flat_node_level_range = NULL;
+  copy->num_flat_objs = rtree->num_flat_objs;
+  copy->flat_obj = NULL;
+  copy->flat_obj_level_range = NULL;
+  copy->depth = rtree->depth;
+  if (rtree->flat_node != NULL) {
+    size_t num_nodes = rtree->num_flat_nodes, num_objs = rtree->num_flat_objs;
+    copy->flat_node = malloc_aligned(num_nodes*sizeof(flat_node_s));
+    memcpy(copy->flat_node, rtree->flat_node, num_nodes*sizeof(flat_node_s));
+    copy->flat_node_level_range = malloc(num_nodes*sizeof(dbl[2]));
+    memcpy(copy->flat_node_level_range, rtree->flat_node_level_range,
+           num_nodes*sizeof(dbl[2]));
+    copy->flat_obj = malloc_aligned(num_objs*sizeof(flat_obj_s));
+    memcpy(copy->flat_obj, rtree->flat_obj, num_objs*sizeof(flat_obj_s));
+    copy->flat_obj_level_range = malloc(num_objs*sizeof(dbl[2]));
+    memcpy(copy->flat_obj_level_range, rtree->flat_obj_level_range,
+           num_objs*sizeof(dbl[2]));
+  }
+
   return copy;
 }
 
 void rtree_insert_bmesh33(rtree_s *rtree, bmesh33_s const *bmesh) {
+  rtree_free_flat(rtree); // Stale until `rtree_build` is called again
   rnode_s *node = &rtree->root;
   assert(node->type == RNODE_TYPE_LEAF);
   size_t num_cells = bmesh33_num_cells(bmesh);
@@ -500,6 +681,7 @@ void rtree_insert_bmesh33(rtree_s *rtree, bmesh33_s const *bmesh) {
 }
 
 void rtree_insert_mesh2(rtree_s *rtree, mesh2_s const *mesh) {
+  rtree_free_flat(rtree); // Stale until `rtree_build` is called again
   rnode_s *node = &rtree->root;
   assert(node->type == RNODE_TYPE_LEAF);
   size_t num_faces = mesh2_nfaces(mesh);
@@ -515,6 +697,7 @@ void rtree_insert_mesh2(rtree_s *rtree, mesh2_s const *mesh) {
 }
 
 void rtree_insert_mesh3(rtree_s *rtree, mesh3_s const *mesh) {
+  rtree_free_flat(rtree); // Stale until `rtree_build` is called again
   rnode_s *node = &rtree->root;
   assert(node->type == RNODE_TYPE_LEAF);
   size_t num_cells = mesh3_ncells(mesh);
@@ -599,18 +782,241 @@ static void refine_node_surface_area(rtree_s const *rtree, rnode_s *node) {
   }
 }
 
+/**
+ * The number of bins along each axis used to approximate the surface
+ * area heuristic when splitting a node.
+ */
+#define SAH_NUM_BINS 16
+
+/**
+ * The number of subtrees per thread to refine in parallel when
+ * building a tree using `RTREE_SPLIT_STRATEGY_SAH_BINNED`. Subtrees
+ * can be very different sizes, so we make more of them than there
+ * are threads to balance the load.
+ */
+#define SAH_TASKS_PER_THREAD 4
+
+static size_t sah_get_bin(dbl c, dbl cmin, dbl cext) {
+  size_t b = SAH_NUM_BINS*(c - cmin)/cext;
+  return MIN(b, (size_t)SAH_NUM_BINS - 1);
+}
+
+/* Split the leaf `node` into two children using a binned
+ * approximation of the surface area heuristic, where `bbox[i]` is
+ * the bounding box of the `i`th object in `node`. We bin the objects
+ * along each axis using the centers of their bounding boxes, and
+ * pick the split between two bins which minimizes the sum of the
+ * surface area of each child weighted by the number of objects it
+ * contains. The objects in `node` and `bbox` are reordered so that
+ * the objects in the first child come first. Returns false (and does
+ * nothing) if `node` is already small enough to be a leaf. */
+static bool rnode_split_sah_binned(rtree_s const *rtree, rnode_s *node,
+                                   rect3 *bbox) {
+  assert(node->type == RNODE_TYPE_LEAF);
+
+  size_t leaf_size = rnode_leaf_size(node);
+  if (leaf_size <= rtree->leaf_thresh)
+    return false;
+
+  robj_s *obj = node->leaf_data.obj;
+
+  rect3 cbox = rect3_make_empty();
+  for (size_t i = 0; i < leaf_size; ++i) {
+    dbl c[3];
+    rect3_get_centroid(&bbox[i], c);
+    rect3_insert_point(&cbox, c);
+  }
+
+  dbl cext[3];
+  rect3_get_extent(&cbox, cext);
+
+  int dmin = NO_INDEX;
+  size_t bmin = NO_INDEX;
+  dbl min_cost = INFINITY;
+  for (int d = 0; d < 3; ++d) {
+    if (cext[d] == 0)
+      continue;
+
+    size_t count[SAH_NUM_BINS] = {0};
+    rect3 bin_bbox[SAH_NUM_BINS];
+    for (size_t b = 0; b < SAH_NUM_BINS; ++b)
+      bin_bbox[b] = rect3_make_empty();
+
+    for (size_t i = 0; i < leaf_size; ++i) {
+      dbl c = (bbox[i].min[d] + bbox[i].max[d])/2;
+      size_t b = sah_get_bin(c, cbox.min[d], cext[d]);
+      ++count[b];
+      rect3_insert_rect3(&bin_bbox[b], &bbox[i]);
+    }
+
+    // Sweep from the right to get the cost of each right child...
+    dbl right_cost[SAH_NUM_BINS];
+    rect3 right_bbox = rect3_make_empty();
+    size_t right_count = 0;
+    for (size_t b = SAH_NUM_BINS - 1; b > 0; --b) {
+      rect3_insert_rect3(&right_bbox, &bin_bbox[b]);
+      right_count += count[b];
+      right_cost[b] = right_count*rect3_surface_area(&right_bbox);
+    }
+
+    // ... and then from the left to get the cost of each split.
+    rect3 left_bbox = rect3_make_empty();
+    size_t left_count = 0;
+    for (size_t b = 0; b + 1 < SAH_NUM_BINS; ++b) {
+      rect3_insert_rect3(&left_bbox, &bin_bbox[b]);
+      left_count += count[b];
+      if (left_count == 0 || left_count == leaf_size)
+        continue;
+      dbl cost = left_count*rect3_surface_area(&left_bbox) + right_cost[b + 1];
+      if (cost < min_cost) {
+        min_cost = cost;
+        dmin = d;
+        bmin = b;
+      }
+    }
+  }
+
+  // Partition the objects so that the ones in bins `[0, bmin]` along
+  // axis `dmin` come first. If we couldn't find a split (e.g., if all
+  // of the bounding boxes have the same center), we just split the
+  // objects in half.
+  size_t num_left = leaf_size/2;
+  if (dmin != NO_INDEX) {
+    size_t i = 0, j = leaf_size;
+    while (i < j) {
+      dbl c = (bbox[i].min[dmin] + bbox[i].max[dmin])/2;
+      if (sah_get_bin(c, cbox.min[dmin], cext[dmin]) <= bmin) {
+        ++i;
+      } else {
+        --j;
+        SWAP(obj[i], obj[j]);
+        SWAP(bbox[i], bbox[j]);
+      }
+    }
+    num_left = i;
+  }
+  assert(0 < num_left && num_left < leaf_size);
+
+  size_t offset[3] = {0, num_left, leaf_size};
+
+  rnode_s *child[2];
+  for (int ch = 0; ch < 2; ++ch) {
+    child[ch] = malloc(sizeof(rnode_s));
+    rnode_init(child[ch], RNODE_TYPE_LEAF);
+    rnode_append_robjs(child[ch], &obj[offset[ch]], offset[ch + 1] - offset[ch]);
+    for (size_t i = offset[ch]; i < offset[ch + 1]; ++i)
+      rect3_insert_rect3(&child[ch]->bbox, &bbox[i]);
+  }
+
+  // Convert the current node to an internal node.
+  free(obj);
+  node->type = RNODE_TYPE_INTERNAL;
+  for (int ch = 0; ch < 2; ++ch)
+    node->child[ch] = child[ch];
+
+  return true;
+}
+
+static void refine_subtree_sah_binned(rtree_s const *rtree, rnode_s *node,
+                                      rect3 *bbox) {
+  if (!rnode_split_sah_binned(rtree, node, bbox))
+    return;
+  size_t num_left = rnode_leaf_size(node->child[0]);
+  refine_subtree_sah_binned(rtree, node->child[0], bbox);
+  refine_subtree_sah_binned(rtree, node->child[1], bbox + num_left);
+}
+
+typedef struct {
+  rnode_s *node;
+  rect3 *bbox;
+} sah_task_s;
+
+typedef struct {
+  rtree_s const *rtree;
+  sah_task_s *task;
+} sah_context_s;
+
+static void refine_subtree_sah_binned_task(void *context, size_t i) {
+  sah_context_s *sah_context = (sah_context_s *)context;
+  sah_task_s *task = &sah_context->task[i];
+  refine_subtree_sah_binned(sah_context->rtree, task->node, task->bbox);
+}
+
+/* Build a tree using the binned surface area heuristic (see
+ * `rnode_split_sah_binned`). We split the top of the tree
+ * breadth-first until there are enough subtrees to keep each thread
+ * busy, and then refine the subtrees in parallel. Since each split
+ * only depends on the objects in the node being split, the resulting
+ * tree doesn't depend on the number of threads. */
+static void refine_node_sah_binned(rtree_s const *rtree, rnode_s *node) {
+  assert(node->type == RNODE_TYPE_LEAF);
+
+  // Compute the bounding box of each object once up front. These are
+  // permuted along with the objects as nodes are split.
+  size_t leaf_size = rnode_leaf_size(node);
+  rect3 *bbox = malloc(leaf_size*sizeof(rect3));
+  for (size_t i = 0; i < leaf_size; ++i) {
+    bbox[i] = rect3_make_empty();
+    robj_insert_into_bbox(&node->leaf_data.obj[i], &bbox[i]);
+  }
+
+  size_t max_num_tasks = SAH_TASKS_PER_THREAD*rtree->num_threads;
+  sah_task_s *task = malloc(2*max_num_tasks*sizeof(sah_task_s));
+  sah_task_s *next_task = malloc(2*max_num_tasks*sizeof(sah_task_s));
+
+  size_t num_tasks = 1;
+  task[0] = (sah_task_s) {.node = node, .bbox = bbox};
+
+  bool split = true;
+  while (split && num_tasks < max_num_tasks) {
+    split = false;
+    size_t num_next_tasks = 0;
+    for (size_t i = 0; i < num_tasks; ++i) {
+      rnode_s *task_node = task[i].node;
+      if (rnode_split_sah_binned(rtree, task_node, task[i].bbox)) {
+        size_t num_left = rnode_leaf_size(task_node->child[0]);
+        next_task[num_next_tasks++] = (sah_task_s) {
+          .node = task_node->child[0],
+          .bbox = task[i].bbox
+        };
+        next_task[num_next_tasks++] = (sah_task_s) {
+          .node = task_node->child[1],
+          .bbox = task[i].bbox + num_left
+        };
+        split = true;
+      } else {
+        next_task[num_next_tasks++] = task[i];
+      }
+    }
+    SWAP(task, next_task);
+    num_tasks = num_next_tasks;
+  }
+
+  sah_context_s context = {.rtree = rtree, .task = task};
+  parallel_for(num_tasks, rtree->num_threads,
+               refine_subtree_sah_binned_task, &context);
+
+  free(task);
+  free(next_task);
+  free(bbox);
+}
+
 typedef void (*refine_node_t)(rtree_s const *, rnode_s *);
 
 refine_node_t _refine_node[] = {
-  refine_node_surface_area
+  refine_node_surface_area,
+  refine_node_sah_binned
 };
 
 void refine_node(rtree_s const *rtree, rnode_s *node) {
   _refine_node[rtree->split_strategy](rtree, node);
 }
 
+/* Build the tree. This must be called after inserting objects and
+ * before intersecting rays with the tree. */
 void rtree_build(rtree_s *rtree) {
   refine_node(rtree, &rtree->root);
+  rtree_flatten(rtree);
 }
 
 rect3 rtree_get_bbox(rtree_s const *rtree) {
@@ -632,19 +1038,374 @@ size_t rtree_get_num_leaf_nodes(rtree_s const *rtree) {
   return num_leaf_nodes;
 }
 
+/**
+ * The cost of visiting an internal node relative to the cost of
+ * intersecting a ray with an object, used to compute
+ * `rtree_stats_s.sah_cost`.
+ */
+#define SAH_TRAVERSAL_COST 0.125
+
+static void rnode_get_stats(rnode_s const *node, dbl root_surf_area,
+                            size_t depth, rtree_stats_s *stats) {
+  ++stats->num_nodes;
+  stats->depth = MAX(stats->depth, depth);
+
+  // If the root's bounding box is flat, we just weight each node
+  // equally.
+  dbl p = root_surf_area > 0 ?
+    rect3_surface_area(&node->bbox)/root_surf_area : 1;
+
+  if (node->type == RNODE_TYPE_INTERNAL) {
+    stats->sah_cost += SAH_TRAVERSAL_COST*p;
+    for (int ch = 0; ch < 2; ++ch)
+      rnode_get_stats(node->child[ch], root_surf_area, depth + 1, stats);
+    return;
+  }
+
+  size_t leaf_size = rnode_leaf_size(node);
+  ++stats->num_leaves;
+  stats->sah_cost += p*leaf_size;
+
+  size_t k = 0;
+  while (k + 1 < RTREE_LEAF_SIZE_HIST_SIZE && ((size_t)2 << k) <= leaf_size)
+    ++k;
+  ++stats->leaf_size_hist[k];
+}
+
+/* Compute statistics describing the shape of the tree. This should
+ * be called after `rtree_build`. */
+void rtree_get_stats(rtree_s const *rtree, rtree_stats_s *stats) {
+  memset(stats, 0x0, sizeof(rtree_stats_s));
+  dbl root_surf_area = rect3_surface_area(&rtree->root.bbox);
+  rnode_get_stats(&rtree->root, root_surf_area, 0, stats);
+}
+
 bool rtree_query_bbox(rtree_s const *rtree, rect3 const *bbox) {
   return rnode_query_bbox(&rtree->root, bbox);
 }
 
+/* Rays are traced through the tree in packets of up to
+ * `RAY_PACKET_SIZE` rays. Coherent rays (e.g., neighboring primary
+ * rays from a camera) mostly visit the same nodes, so tracing them
+ * together amortizes the cost of walking the tree. The rays are
+ * stored in SoA form so that the loops over a packet's rays can be
+ * vectorized by the compiler. */
+#define RAY_PACKET_SIZE 8
+
+typedef struct {
+  size_t n;
+  ray3 const *ray;
+  dbl org[3][RAY_PACKET_SIZE];
+  dbl dir[3][RAY_PACKET_SIZE];
+  dbl inv_dir[3][RAY_PACKET_SIZE];
+} ray_packet_s;
+
+static void ray_packet_init(ray_packet_s *packet, ray3 const *ray, size_t n) {
+  assert(0 < n && n <= RAY_PACKET_SIZE);
+  packet->n = n;
+  packet->ray = ray;
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      packet->org[j][i] = ray[i].org[j];
+      packet->dir[j][i] = ray[i].dir[j];
+      packet->inv_dir[j][i] = 1/ray[i].dir[j];
+    }
+  }
+}
+
+/* Do a slab test (see `ray3_intersect_rect3`) for each ray in
+ * `packet`, clipping the `i`th ray to `[0, isect[i].t]` so that boxes
+ * behind the nearest hit found so far are skipped. On return, `t[i]`
+ * is where the `i`th ray enters `bbox`, or `INFINITY` if it
+ * doesn't. Returns whether any of the rays enter `bbox`. */
+static bool ray_packet_intersect_rect3(ray_packet_s const *packet,
+                                       rect3 const *bbox, isect const *isect,
+                                       dbl t[RAY_PACKET_SIZE]) {
+  bool hit = false;
+  for (size_t i = 0; i < packet->n; ++i) {
+    dbl tmin = 0, tmax = isect[i].t;
+    for (size_t j = 0; j < 3; ++j) {
+      dbl t0 = (bbox->min[j] - packet->org[j][i])*packet->inv_dir[j][i];
+      dbl t1 = (bbox->max[j] - packet->org[j][i])*packet->inv_dir[j][i];
+      /* A NaN means the ray is parallel to this slab and lies in one
+       * of its planes, so the slab doesn't clip it. */
+      if (isnan(t0) || isnan(t1)) {
+        t0 = -INFINITY;
+        t1 = INFINITY;
+      }
+      tmin = fmax(tmin, fmin(t0, t1));
+      tmax = fmin(tmax, fmax(t0, t1));
+    }
+    t[i] = tmin <= tmax ? tmin : INFINITY;
+    hit |= tmin <= tmax;
+  }
+  return hit;
+}
+
+static bool brackets_level(dbl const range[2], dbl level) {
+  return isnan(level) || (range[0] <= level && level <= range[1]);
+}
+
+/* Intersect `ray` with `fobj`, using its copy of its vertices. The
+ * bmesh33 cells are handled by `flat_cell_intersect_packet`. */
+static bool flat_obj_intersect(flat_obj_s const *fobj, ray3 const *ray,
+                               dbl *t) {
+  switch (fobj->obj.type) {
+  case ROBJ_MESH2_TRI:
+  case ROBJ_TRI3:
+    return ray3_intersects_tri3(ray, &fobj->tri, t);
+  case ROBJ_MESH3_TETRA:
+  case ROBJ_TETRA3:
+    return ray3_intersects_tetra3(ray, &fobj->tetra, t);
+  default:
+    assert(false);
+    return false;
+  }
+}
+
+/* Intersect the rays in `packet` which enter the current leaf (those
+ * with finite `t_bbox[i]`) with the level set of the bmesh33 cell
+ * `fobj` at `level` (or at the cell's own level if `level` is `NAN`).
+ * First, each ray is clipped to the cell's tetrahedron as in
+ * `ray3_clip_to_bary_map` (with the same tolerance). This is done
+ * for all of the rays in the packet at once, in SoA form and without
+ * branches, so that it can be vectorized. Most rays miss the tetrahedron or have already hit
+ * something closer, so the level set only needs to be intersected
+ * for the few that are left. */
+static void flat_cell_intersect_packet(flat_obj_s const *fobj,
+                                       ray_packet_s const *packet,
+                                       dbl const t_bbox[RAY_PACKET_SIZE],
+                                       dbl level, isect *isect) {
+  dbl const atol = 1e-13;
+
+  dbl34 const *A = &fobj->bary_map;
+
+  dbl p[4][RAY_PACKET_SIZE], q[4][RAY_PACKET_SIZE];
+  for (size_t j = 0; j < 3; ++j) {
+    for (size_t i = 0; i < packet->n; ++i) {
+      p[j][i] = (*A)[j][3];
+      q[j][i] = 0;
+    }
+    for (size_t k = 0; k < 3; ++k) {
+      for (size_t i = 0; i < packet->n; ++i) {
+        p[j][i] += (*A)[j][k]*packet->org[k][i];
+        q[j][i] += (*A)[j][k]*packet->dir[k][i];
+      }
+    }
+  }
+  for (size_t i = 0; i < packet->n; ++i) {
+    p[3][i] = 1 - p[0][i] - p[1][i] - p[2][i];
+    q[3][i] = -q[0][i] - q[1][i] - q[2][i];
+  }
+
+  dbl s[2][RAY_PACKET_SIZE];
+  for (size_t i = 0; i < packet->n; ++i) {
+    s[0][i] = 0;
+    s[1][i] = INFINITY;
+  }
+  for (size_t j = 0; j < 4; ++j) {
+    for (size_t i = 0; i < packet->n; ++i) {
+      dbl sj = -p[j][i]/q[j][i];
+      s[0][i] = q[j][i] > atol ? fmax(s[0][i], sj) : s[0][i];
+      s[1][i] = q[j][i] < -atol ? fmin(s[1][i], sj) : s[1][i];
+      s[1][i] = fabs(q[j][i]) <= atol && p[j][i] < -atol ? -INFINITY : s[1][i];
+    }
+  }
+
+  bmesh33_cell_s cell = *(bmesh33_cell_s const *)fobj->obj.data;
+  if (!isnan(level))
+    cell.level = level;
+
+  for (size_t i = 0; i < packet->n; ++i) {
+    if (isinf(t_bbox[i]) || s[0][i] > s[1][i] || isinf(s[1][i])
+        || s[0][i] >= isect[i].t)
+      continue;
+
+    dbl si[2] = {s[0][i], s[1][i]};
+    dbl4 b[2];
+    for (size_t k = 0; k < 2; ++k)
+      for (size_t j = 0; j < 4; ++j)
+        b[k][j] = p[j][i] + si[k]*q[j][i];
+
+    dbl t;
+    if (bmesh33_cell_intersect_on_interval(&cell, si, b, &t)
+        && 0 <= t && t < isect[i].t) {
+      isect[i].t = t;
+      isect[i].obj = &fobj->obj;
+    }
+  }
+}
+
+/* Intersect each object in the leaf `fnode` with the rays in `packet`
+ * which enter it (those with finite `t_bbox[i]`). */
+static void
+rtree_intersect_leaf(rtree_s const *rtree, flat_node_s const *fnode,
+                     ray_packet_s const *packet,
+                     dbl const t_bbox[RAY_PACKET_SIZE], dbl level,
+                     isect *isect, robj_s const *skip_robj) {
+  dbl t;
+  for (size_t l = fnode->offset; l < fnode->offset + fnode->num_objs; ++l) {
+    if (!brackets_level(rtree->flat_obj_level_range[l], level))
+      continue;
+    flat_obj_s const *fobj = &rtree->flat_obj[l];
+    if (robj_equal(skip_robj, &fobj->obj))
+      continue;
+    if (fobj->obj.type == ROBJ_BMESH33_CELL) {
+      flat_cell_intersect_packet(fobj, packet, t_bbox, level, isect);
+      continue;
+    }
+    for (size_t i = 0; i < packet->n; ++i) {
+      if (isinf(t_bbox[i]))
+        continue;
+      if (flat_obj_intersect(fobj, &packet->ray[i], &t)
+          && 0 <= t && t < isect[i].t) {
+        isect[i].t = t;
+        isect[i].obj = &fobj->obj;
+      }
+    }
+  }
+}
+
+/* Get the index of the child of the internal node `i` which the rays
+ * in `packet` should visit first. We use the direction of the first
+ * ray which enters the node, and pick the child whose center is
+ * nearer along it. */
+static size_t rtree_get_near_child(rtree_s const *rtree, size_t i,
+                                   ray_packet_s const *packet,
+                                   dbl const t_bbox[RAY_PACKET_SIZE]) {
+  size_t j = 0;
+  while (isinf(t_bbox[j]))
+    ++j;
+
+  size_t child[2] = {i + 1, rtree->flat_node[i].offset};
+
+  dbl c0[3], c1[3];
+  rect3_get_centroid(&rtree->flat_node[child[0]].bbox, c0);
+  rect3_get_centroid(&rtree->flat_node[child[1]].bbox, c1);
+
+  dbl dc[3];
+  dbl3_sub(c1, c0, dc);
+  return child[dbl3_dot(dc, packet->ray[j].dir) < 0];
+}
+
+/* Trace `packet` through `rtree`. Instead of recursing, the nodes
+ * left to visit are kept on an explicit stack. Its size is bounded by
+ * the depth of the tree since we push two children for every node we
+ * pop. Every ray keeps its own nearest hit, and a node is only
+ * entered if one of the rays hits its bounding box before its nearest
+ * hit, so nodes behind what's already been hit are skipped. */
+static void rtree_intersect_packet(rtree_s const *rtree,
+                                   ray_packet_s const *packet, dbl level,
+                                   isect *isect, robj_s const *skip_robj) {
+  assert(rtree->flat_node != NULL); // Call `rtree_build` first!
+
+  for (size_t i = 0; i < packet->n; ++i) {
+    isect[i].t = INFINITY;
+    isect[i].obj = NULL;
+  }
+
+  size_t stack[rtree->depth + 1];
+  size_t stack_size = 0;
+  stack[stack_size++] = 0;
+
+  dbl t_bbox[RAY_PACKET_SIZE];
+
+  while (stack_size > 0) {
+    size_t i = stack[--stack_size];
+    flat_node_s const *fnode = &rtree->flat_node[i];
+
+    /* If we're intersecting a level set and none of the objects
+     * below this node can contain it, there's nothing to do. */
+    if (!brackets_level(rtree->flat_node_level_range[i], level))
+      continue;
+
+    if (!ray_packet_intersect_rect3(packet, &fnode->bbox, isect, t_bbox))
+      continue;
+
+    if (fnode->num_objs != (size_t)NO_INDEX) {
+      rtree_intersect_leaf(rtree, fnode, packet, t_bbox, level, isect,
+                           skip_robj);
+      continue;
+    }
+
+    /* Push the far child first so that the near child is popped
+     * first. Its hits then let us skip more of the far child. */
+    size_t near = rtree_get_near_child(rtree, i, packet, t_bbox);
+    size_t far = near == i + 1 ? fnode->offset : i + 1;
+    assert(stack_size + 2 <= rtree->depth + 1);
+    stack[stack_size++] = far;
+    stack[stack_size++] = near;
+  }
+}
+
 void rtree_intersect(rtree_s const *rtree, ray3 const *ray, isect *isect,
                      robj_s const *skip_robj) {
-  isect->t = INFINITY;
-  isect->obj = NULL;
-  rnode_intersect(&rtree->root, ray, isect, skip_robj);
+  rtree_intersect_at_level(rtree, ray, NAN, isect, skip_robj);
+}
+
+/* Like `rtree_intersect`, but intersect each bmesh33 cell in `rtree`
+ * with its level set at `level` (ignoring the level it was inserted
+ * with). This lets a single R-tree built over an entire `bmesh33` be
+ * used to render any of its level sets. Subtrees which can't contain
+ * the level are skipped, so the cost of a query is roughly the same
+ * as for an R-tree built over just the cells which bracket the
+ * level. */
+void rtree_intersect_at_level(rtree_s const *rtree, ray3 const *ray, dbl level,
+                              isect *isect, robj_s const *skip_robj) {
+  ray_packet_s packet;
+  ray_packet_init(&packet, ray, 1);
+  rtree_intersect_packet(rtree, &packet, level, isect, skip_robj);
 }
 
+/* Intersect each of the `n` rays in `ray` with `rtree`. The rays are
+ * traced in packets of consecutive rays, so this is fastest when
+ * neighboring rays are coherent (e.g., a row of pixels). */
 void rtree_intersectN(rtree_s const *rtree, ray3 const *ray, size_t n,
                       isect *isect) {
-  for (size_t i = 0; i < n; ++i)
-    rtree_intersect(rtree, &ray[i], &isect[i], NULL);
+  rtree_intersectN_at_level(rtree, ray, n, NAN, isect);
+}
+
+/* Like `rtree_intersectN`, but see `rtree_intersect_at_level`. */
+void rtree_intersectN_at_level(rtree_s const *rtree, ray3 const *ray,
+                               size_t n, dbl level, isect *isect) {
+  ray_packet_s packet;
+  for (size_t i = 0; i < n; i += RAY_PACKET_SIZE) {
+    ray_packet_init(&packet, &ray[i], MIN((size_t)RAY_PACKET_SIZE, n - i));
+    rtree_intersect_packet(rtree, &packet, level, &isect[i], NULL);
+  }
+}
+
+#if JMM_TEST
+size_t rtree_get_num_flat_nodes(rtree_s const *rtree) {
+  return rtree->num_flat_nodes;
+}
+
+rect3 rtree_get_flat_node_bbox(rtree_s const *rtree, size_t i) {
+  return rtree->flat_node[i].bbox;
+}
+
+/* Get the indices of the children of flat node `i`, returning
+ * `false` if it's a leaf. */
+bool rtree_get_flat_node_children(rtree_s const *rtree, size_t i,
+                                  size_t ch[2]) {
+  flat_node_s const *fnode = &rtree->flat_node[i];
+  if (fnode->num_objs != (size_t)NO_INDEX)
+    return false;
+  ch[0] = i + 1;
+  ch[1] = fnode->offset;
+  return true;
+}
+
+size_t rtree_get_flat_node_num_objs(rtree_s const *rtree, size_t i) {
+  return rtree->flat_node[i].num_objs;
+}
+
+/* Get the `k`th object in the leaf `i` of the flattened tree */
+robj_s const *rtree_get_flat_node_obj(rtree_s const *rtree, size_t i,
+                                      size_t k) {
+  flat_node_s const *fnode = &rtree->flat_node[i];
+  assert(fnode->num_objs != (size_t)NO_INDEX);
+  assert(k < fnode->num_objs);
+  return &rtree->flat_obj[fnode->offset + k].obj;
 }
+#endif
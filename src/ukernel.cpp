@@ -0,0 +1,453 @@
+#include "ukernel.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <jmm/cubic.h>
+#include <jmm/opt.h>
+#include <jmm/util.h>
+#include <jmm/vec.h>
+
+#include "hybrid_inline.h"
+
+extern "C" {
+#include "log.h"
+}
+
+#define MAX_NITER 100
+
+/* How to evaluate each type of slowness. Each update kernel below is
+ * a template over `stype_e` which only touches the slowness through
+ * these, so that when they're instantiated the evaluations are
+ * direct (and, for `STYPE_CONSTANT`, inlined away). */
+template <stype_e S> struct slowness;
+
+template <> struct slowness<STYPE_CONSTANT> {
+  static dbl s(sfunc_s const *, dbl const *) {
+    return 1;
+  }
+
+  static void Ds(sfunc_s const *, dbl const *, dbl *Ds) {
+    Ds[0] = Ds[1] = Ds[2] = 0;
+  }
+};
+
+template <> struct slowness<STYPE_FUNC_PTR> {
+  static dbl s(sfunc_s const *sfunc, dbl const *x) {
+    return sfunc->funcs.s((dbl *)x);
+  }
+
+  static void Ds(sfunc_s const *sfunc, dbl const *x, dbl *Ds) {
+    sfunc->funcs.Ds((dbl *)x, Ds);
+  }
+};
+
+template <> struct slowness<STYPE_JET31T> {
+  static dbl s(sfunc_s const *, dbl const *) {
+    assert(false);
+    return NAN;
+  }
+
+  static void Ds(sfunc_s const *, dbl const *, dbl *Ds) {
+    assert(false);
+    Ds[0] = Ds[1] = Ds[2] = NAN;
+  }
+};
+
+/* Evaluate the callable object `f` at `x`, so that it can be passed
+ * to `hybrid_inline`. Since `hybrid_inline` is inlined, the calls to
+ * this are direct, and `f` gets inlined into its loop. */
+template <typename F>
+static dbl call(dbl x, void *f) {
+  return (*static_cast<F *>(f))(x);
+}
+
+/** Line updates */
+
+/* The cost function of a line update: T0 plus the slowness
+ * integrated along the quadratic curve from `x0` through `xm` to
+ * `xhat` by Simpson's rule, along with its gradient with respect to
+ * `xm`. */
+template <stype_e S>
+struct line_cost {
+  sfunc_s const *sfunc;
+  dbl const *x0, *xhat;
+  dbl T0, L, s0, shat;
+
+  dbl3 xm;
+  dbl f;
+  dbl3 gradf;
+
+  void set_xm(dbl3 const xm_) {
+    dbl3_copy(xm_, xm);
+
+    dbl3 phip0;
+    for (size_t i = 0; i < 3; ++i)
+      phip0[i] = (-3*x0[i] + 4*xm[i] - xhat[i])/L;
+
+    dbl3 phipL;
+    for (size_t i = 0; i < 3; ++i)
+      phipL[i] = (x0[i] - 4*xm[i] + 3*xhat[i])/L;
+
+    dbl phip0_norm = dbl3_norm(phip0);
+    dbl phipL_norm = dbl3_norm(phipL);
+
+    dbl sm = slowness<S>::s(sfunc, xm);
+
+    dbl3 gradsm;
+    slowness<S>::Ds(sfunc, xm, gradsm);
+
+    f = T0 + (L/6)*(s0*phip0_norm + 4*sm + shat*phipL_norm);
+
+    for (size_t i = 0; i < 3; ++i)
+      gradf[i] = (2./3)*(
+        L*gradsm[i] + s0*phip0[i]/phip0_norm - shat*phipL[i]/phipL_norm);
+  }
+};
+
+/* Minimize `line_cost` using gradient descent on `xm` with a
+ * backtracking line search, starting from the midpoint of `x0` and
+ * `xhat`. */
+template <stype_e S>
+static dbl line(sfunc_s const *sfunc, dbl3 const x0, dbl3 const xhat,
+                dbl T0, dbl tol, dbl3 topt) {
+  line_cost<S> cost;
+  cost.sfunc = sfunc;
+  cost.x0 = x0;
+  cost.xhat = xhat;
+  cost.T0 = T0;
+  cost.L = dbl3_dist(xhat, x0);
+  cost.s0 = slowness<S>::s(sfunc, x0);
+  cost.shat = slowness<S>::s(sfunc, xhat);
+
+  dbl3 xm0, xm, gradf0;
+  dbl alpha, f0;
+  size_t num_iter_inner;
+
+  dbl3_avg(x0, xhat, xm0);
+  cost.set_xm(xm0);
+
+  do {
+    f0 = cost.f;
+    dbl3_copy(cost.gradf, gradf0);
+    num_iter_inner = 0;
+    alpha = 1;
+  line_search:
+    dbl3_saxpy(-alpha, gradf0, xm0, xm);
+    cost.set_xm(xm);
+    if (num_iter_inner < MAX_NITER && cost.f >= f0) {
+      alpha /= 2;
+      ++num_iter_inner;
+      goto line_search;
+    }
+    /* If no step decreases the cost, we've landed on a kink (e.g.,
+     * where the ray's tangent vanishes at `x0`) and there's nowhere
+     * left to go */
+    if (cost.f >= f0) {
+      cost.set_xm(xm0);
+      break;
+    }
+    dbl3_copy(xm, xm0);
+  } while (dbl3_norm(cost.gradf) > tol);
+
+  if (topt != NULL) {
+    dbl3 phipL;
+    for (size_t i = 0; i < 3; ++i)
+      phipL[i] = (x0[i] - 4*cost.xm[i] + 3*xhat[i])/cost.L;
+    dbl3_normalized(phipL, topt);
+  }
+
+  return cost.f;
+}
+
+/* With constant slowness, the ray is the straight line from `x0` to
+ * `xhat`. */
+template <>
+dbl line<STYPE_CONSTANT>(sfunc_s const *, dbl3 const x0, dbl3 const xhat,
+                         dbl T0, dbl, dbl3 topt) {
+  if (topt != NULL) {
+    dbl3_sub(xhat, x0, topt);
+    dbl3_normalize(topt);
+  }
+  return T0 + dbl3_dist(xhat, x0);
+}
+
+/** Triangle updates */
+
+/* Solve a triangle update using a sequence of line updates: line
+ * updates are done from four points on the edge, the cubic
+ * interpolating them is minimized, and the points are contracted
+ * towards the minimizer until it stops moving. */
+template <stype_e S>
+static dbl tri(sfunc_s const *sfunc, bb31 const *T, dbl3 const xhat,
+               dbl3 const x0, dbl3 const dx, dbl tol, dbl *lam_out,
+               dbl *Df, dbl3 topt) {
+  dbl lam_prev = NAN, lam_opt = NAN;
+  dbl lam_node[4] = {0, 1./3, 2./3, 1};
+
+  dbl beta = 3;
+  dbl factor = (beta + 1)/beta;
+
+  dbl prev_error = NAN;
+
+  while (true) {
+    dbl f[4] = {NAN, NAN, NAN, NAN};
+    for (size_t i = 0; i < 4; ++i) {
+      dbl3 x_node;
+      dbl3_saxpy(lam_node[i], dx, x0, x_node);
+      dbl2 b = {1 - lam_node[i], lam_node[i]};
+      f[i] = line<S>(sfunc, x_node, xhat, bb31_f(T, b), tol, NULL);
+    }
+
+    cubic_s p = cubic_from_lagrange_data(f);
+    auto Dp = [&p](dbl lam) { return cubic_df(&p, lam); };
+
+    dbl lam = NAN;
+    if (!hybrid_inline(call<decltype(Dp)>, 0, 1, &Dp, &lam)) {
+      /* TODO: If the hybrid method failed to do its thing, we've
+       * found a boundary minimizer. For now we'll just do a stupid
+       * hack: assume this is the correct solution and bail! In many
+       * cases this will be the right thing to do. Only very
+       * occasionally should we get the other weird corner
+       * case... */
+      lam_opt = cubic_f(&p, 0) < cubic_f(&p, 1) ? 0 : 1;
+      break;
+    }
+
+    dbl error = fabs(lam - lam_prev);
+    if (error <= tol) {
+      lam_opt = lam;
+      break;
+    } else {
+      lam_prev = lam;
+    }
+
+    if (error > 2*prev_error) {
+      beta += 1;
+      factor = (beta + 1)/beta;
+    }
+
+    for (size_t i = 0; i < 4; ++i) {
+      lam_node[i] = (lam_node[i] - lam_prev)/factor + lam_prev;
+      assert(lam_node[i] >= -EPS);
+      assert(lam_node[i] <= 1 + EPS);
+    }
+
+    prev_error = error;
+  }
+
+  *lam_out = lam_opt;
+  *Df = NAN;
+
+  dbl3 x_opt;
+  dbl3_saxpy(lam_opt, dx, x0, x_opt);
+  dbl2 b = {1 - lam_opt, lam_opt};
+  return line<S>(sfunc, x_opt, xhat, bb31_f(T, b), tol, topt);
+}
+
+/* The cost function of a constant slowness triangle update, `T(lam)
+ * + |xhat - x0 - lam*dx|`. Calling it with `lam` evaluates its
+ * derivative, and leaves the value and the tangent vector of the ray
+ * at `lam` behind. */
+struct tri_cost_constant {
+  bb31 const *T;
+  dbl const *xhat, *x0, *dx;
+
+  dbl lam, f, Df;
+  dbl3 topt;
+
+  dbl operator()(dbl lam_) {
+    lam = lam_;
+
+    dbl3 xb, x_minus_xb;
+    dbl3_saxpy(lam, dx, x0, xb);
+    dbl3_sub(xhat, xb, x_minus_xb);
+    dbl L = dbl3_norm(x_minus_xb);
+    dbl3_dbl_div(x_minus_xb, L, topt);
+
+    dbl dL_dlam = -dbl3_dot(dx, x_minus_xb)/L;
+
+    dbl b[2] = {1 - lam, lam};
+    dbl a[2] = {-1, 1};
+
+    f = bb31_f(T, b) + L;
+    Df = bb31_df(T, b, a) + dL_dlam;
+
+    return Df;
+  }
+};
+
+/* With constant slowness, we can find the root of the derivative of
+ * the cost function directly. The result is the last point where the
+ * cost function was evaluated. */
+template <>
+dbl tri<STYPE_CONSTANT>(sfunc_s const *, bb31 const *T, dbl3 const xhat,
+                        dbl3 const x0, dbl3 const dx, dbl, dbl *lam_out,
+                        dbl *Df, dbl3 topt) {
+  tri_cost_constant cost = {T, xhat, x0, dx, NAN, NAN, NAN, {NAN, NAN, NAN}};
+
+  dbl lam;
+  if (!hybrid_inline(call<tri_cost_constant>, 0, 1, &cost, &lam)) {
+    cost(0);
+    dbl f0 = cost.f;
+
+    cost(1);
+    dbl f1 = cost.f;
+
+    assert(f0 != f1);
+
+    if (f0 < f1)
+      cost(0);
+  }
+
+  *lam_out = cost.lam;
+  *Df = cost.Df;
+  dbl3_copy(cost.topt, topt);
+  return cost.f;
+}
+
+/** Tetrahedron updates */
+
+static dbl eval_poly(dbl const *a, dbl const *lam) {
+  dbl x = lam[0], y = lam[1];
+  return a[0] + a[1]*x + a[2]*y + a[3]*x*x + a[4]*x*y + a[5]*y*y;
+}
+
+static void contract(dbl2 const lam_center, dbl factor, dbl2 lam) {
+  for (size_t i = 0; i < 2; ++i)
+    lam[i] = (lam[i] - lam_center[i])/factor + lam_center[i];
+}
+
+/* Fit a quadratic to line updates at six points in the base of the
+ * update, minimize it, and contract the points towards the minimizer
+ * until it stops moving (see `utetra_solve_generic`). */
+template <stype_e S>
+static dbl tetra(sfunc_s const *sfunc, bb32 const *T, dbl3 const xhat,
+                 dbl33 const X, dbl tol, dbl const *lam0, dbl lam_out[2],
+                 dbl3 topt) {
+  dbl2 lam_prev = {NAN, NAN}, lam_opt = {NAN, NAN};
+
+  dbl2 lam_node[6] = {
+    {0, 0},   {0.5, 0},   {1, 0},
+    {0, 0.5}, {0.5, 0.5},
+    {0, 1}
+  };
+
+  dbl beta = 10.0;
+  dbl factor = (beta + 1)/beta;
+  dbl prev_error = NAN;
+
+  /* If we're given a warm start, proceed as if it were the previous
+   * iterate: center the stencil on it and shrink it. If it's close
+   * to the minimizer, the first iterate is, too, and we can stop
+   * right away. */
+  if (lam0 != NULL) {
+    dbl2_copy(lam0, lam_prev);
+    for (size_t i = 0; i < 6; ++i)
+      contract(lam_prev, factor, lam_node[i]);
+  }
+
+  dbl const invV[6][6] = {
+    { 1,  0,  0,  0,  0,  0},
+    {-3,  4, -1,  0,  0,  0},
+    {-3,  0,  0,  4,  0, -1},
+    { 2, -4,  2,  0,  0,  0},
+    { 4, -4,  0, -4,  4,  0},
+    { 2,  0,  0, -4,  0,  2}
+  };
+
+  size_t num_iter = 0;
+
+  while (true) {
+    dbl f[6] = {NAN, NAN, NAN, NAN, NAN, NAN};
+    for (size_t i = 0; i < 6; ++i) {
+      dbl const *lam_ = lam_node[i];
+      dbl3 b = {1 - lam_[0] - lam_[1], lam_[0], lam_[1]};
+      dbl3 x_node;
+      dbl33_dbl3_mul(X, b, x_node);
+      f[i] = line<S>(sfunc, x_node, xhat, bb32_f(T, b), tol, NULL);
+    }
+
+    dbl a[6];
+    for (size_t i = 0; i < 6; ++i) {
+      a[i] = 0;
+      for (size_t j = 0; j < 6; ++j) {
+        a[i] += invV[i][j]*f[j];
+      }
+    }
+
+#ifndef NDEBUG
+    /* Check that everything is correct at the nodal values... */
+    dbl2 const lam_node_orig[6] = {
+      {0, 0},   {0.5, 0},   {1, 0},
+      {0, 0.5}, {0.5, 0.5},
+      {0, 1}
+    };
+    for (size_t i = 0; i < 6; ++i)
+      assert(fabs(eval_poly(a, lam_node_orig[i]) - f[i]) < 1e-12);
+#endif
+
+    triqp2_s qp;
+    qp.b[0] = a[1];
+    qp.b[1] = a[2];
+    qp.A[0][0] = 2*a[3];
+    qp.A[0][1] = qp.A[1][0] = a[4];
+    qp.A[1][1] = 2*a[5];
+    qp.x[0] = qp.x[1] = NAN;
+
+    triqp2_solve(&qp, pow(tol, 2));
+
+    dbl const *lam = &qp.x[0];
+    dbl error = dbl2_dist(lam, lam_prev);
+    if (error <= tol) {
+      dbl2_copy(lam, lam_opt);
+      break;
+    } else {
+      dbl2_copy(lam, lam_prev);
+    }
+
+    if (error > 2*prev_error) {
+      beta += 1;
+      factor = (beta + 1)/beta;
+    }
+
+    for (size_t i = 0; i < 6; ++i) {
+      contract(lam_prev, factor, lam_node[i]);
+      assert(lam_node[i][0] >= -EPS);
+      assert(lam_node[i][1] >= -EPS);
+      assert(lam_node[i][0] + lam_node[i][1] <= 1 + EPS);
+    }
+
+    prev_error = error;
+    ++num_iter;
+
+    if (num_iter == MAX_NITER) {
+      log_warn("utetra_solve: reached max no. iters");
+      dbl2_copy(lam, lam_opt);
+      break;
+    }
+  }
+
+  dbl2_copy(lam_opt, lam_out);
+
+  dbl3 bopt = {1 - lam_opt[0] - lam_opt[1], lam_opt[0], lam_opt[1]};
+  dbl3 xopt;
+  dbl33_dbl3_mul(X, bopt, xopt);
+  return line<S>(sfunc, xopt, xhat, bb32_f(T, bopt), tol, topt);
+}
+
+template <stype_e S>
+static constexpr ukernel_s make_ukernel() {
+  return {S, slowness<S>::s, line<S>, tri<S>, tetra<S>};
+}
+
+static ukernel_s const _ukernel[STYPE_NUM_STYPE] = {
+  make_ukernel<STYPE_CONSTANT>(),
+  make_ukernel<STYPE_FUNC_PTR>(),
+  make_ukernel<STYPE_JET31T>()
+};
+
+ukernel_s const *ukernel_get(stype_e stype) {
+  assert(stype < STYPE_NUM_STYPE);
+  return &_ukernel[stype];
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <jmm/bb.h>
+#include <jmm/common.h>
+#include <jmm/slow.h>
+
+/* The parts of the line, triangle, and tetrahedron updates that
+ * depend on the type of slowness, compiled once for each `stype_e`
+ * (see ukernel.cpp). `eik3_init` looks up the kernel for its
+ * slowness, and the updates call it directly instead of branching on
+ * `stype` and calling through `sfunc` each time they evaluate the
+ * slowness. For `STYPE_CONSTANT`, none of these make any indirect
+ * calls. */
+typedef struct ukernel {
+  stype_e stype;
+
+  /* The slowness at `x`. */
+  dbl (*s)(sfunc_s const *sfunc, dbl3 const x);
+
+  /* Solve the line update from `x0`, where T is `T0`, to `xhat`,
+   * returning the value at `xhat`. If `topt` isn't `NULL`, the unit
+   * tangent vector of the ray at `xhat` is written to it. */
+  dbl (*line)(sfunc_s const *sfunc, dbl3 const x0, dbl3 const xhat,
+              dbl T0, dbl tol, dbl3 topt);
+
+  /* Solve the triangle update from the edge `[x0, x0 + dx]` to
+   * `xhat`, where `T` interpolates T on the edge. This returns the
+   * value at `xhat`, and writes the minimizer to `lam`, the
+   * derivative of the cost function there to `Df` (`NAN` if it isn't
+   * computed), and the unit tangent vector of the ray at `xhat` to
+   * `topt`. */
+  dbl (*tri)(sfunc_s const *sfunc, bb31 const *T, dbl3 const xhat,
+             dbl3 const x0, dbl3 const dx, dbl tol, dbl *lam, dbl *Df,
+             dbl3 topt);
+
+  /* Solve the tetrahedron update from the triangle with vertices
+   * given by the columns of `X` to `xhat` using the surrogate loop in
+   * `utetra_solve_generic`, starting from `lam0` (which may be
+   * `NULL`). The outputs are as for `tri`, except that `lam` has two
+   * entries and there's no `Df`. */
+  dbl (*tetra)(sfunc_s const *sfunc, bb32 const *T, dbl3 const xhat,
+               dbl33 const X, dbl tol, dbl const *lam0, dbl lam[2],
+               dbl3 topt);
+} ukernel_s;
+
+ukernel_s const *ukernel_get(stype_e stype);
+
+/* The kernel selected by `eik3_init` for `eik`'s slowness (defined in
+ * eik3.c). */
+ukernel_s const *eik3_get_ukernel(eik3_s const *eik);
+
+#ifdef __cplusplus
+}
+#endif
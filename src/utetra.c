@@ -8,22 +8,23 @@
 #include <jmm/array.h>
 #include <jmm/bb.h>
 #include <jmm/eik3.h>
+#include <jmm/geom.h>
 #include <jmm/mat.h>
 #include <jmm/mesh3.h>
 #include <jmm/opt.h>
-#include <jmm/uline.h>
 #include <jmm/util.h>
 
 #include "log.h"
 #include "macros.h"
+#include "ukernel.h"
 
 #define MAX_NITER 100
 
 struct utetra {
   eik3_s const *eik;
 
-  stype_e stype;
   sfunc_s const *sfunc;
+  ukernel_s const *kernel;
 
   dbl lam[2]; // Current iterate
   dbl f;
@@ -55,6 +56,9 @@ struct utetra {
 
   // B-coefs for 9-point triangle interpolation T on base of update
   bb32 T;
+
+  /* How to solve this update, selected by `utetra_init` */
+  void (*solve)(utetra_s *, dbl const *);
 };
 
 void utetra_alloc(utetra_s **utetra) {
@@ -67,9 +71,7 @@ void utetra_dealloc(utetra_s **utetra) {
 }
 
 static void set_s_and_T_cell_inds(utetra_s *u) {
-  static int CALL_NUMBER = 0;
-
-  if (u->stype == STYPE_CONSTANT)
+  if (u->kernel->stype == STYPE_CONSTANT)
     return;
 
   mesh3_s const *mesh = eik3_get_mesh(u->eik);
@@ -95,14 +97,14 @@ static void set_s_and_T_cell_inds(utetra_s *u) {
     if (all_valid) {
       u->T_lc = fc[i];
 
-      if (u->stype == STYPE_JET31T)
+      if (u->kernel->stype == STYPE_JET31T)
         u->s_lc = fc[1 - i];
 
       break;
     }
   }
 
-  if (u->stype == STYPE_JET31T)
+  if (u->kernel->stype == STYPE_JET31T)
     assert(u->s_lc != (size_t)NO_INDEX);
 
   assert(u->T_lc != (size_t)NO_INDEX);
@@ -120,14 +122,25 @@ static void set_s_and_T_cell_inds(utetra_s *u) {
   assert(num_valid == 3);
   assert(num_trial == 1);
 #endif
-
-  ++CALL_NUMBER;
 }
 
+static void solve_stype_constant(utetra_s *u, dbl const *lam);
+
+/* Select how to solve tetrahedron updates for each type of
+ * slowness. The general surrogate loop in `utetra_solve_generic`
+ * handles every type, but only needs to be used when there isn't a
+ * specialized solver. */
+static void (*const _solve[STYPE_NUM_STYPE])(utetra_s *, dbl const *) = {
+  [STYPE_CONSTANT] = solve_stype_constant,
+  [STYPE_FUNC_PTR] = utetra_solve_generic,
+  [STYPE_JET31T] = utetra_solve_generic
+};
+
 void utetra_init(utetra_s *u, eik3_s const *eik, size_t lhat, uint3 const l) {
   u->eik = eik;
-  u->stype = eik3_get_stype(u->eik);
   u->sfunc = eik3_get_sfunc(u->eik);
+  u->kernel = eik3_get_ukernel(u->eik);
+  u->solve = _solve[u->kernel->stype];
 
   mesh3_s const *mesh = eik3_get_mesh(eik);
 
@@ -184,6 +197,81 @@ bool utetra_is_degenerate(utetra_s const *u) {
   return points_are_coplanar(x);
 }
 
+/* Get a lower bound for the value of `u` without solving it (see
+ * `utri_get_lower_bound`). */
+dbl utetra_get_lower_bound(utetra_s const *u) {
+  dbl T_min = u->T.c[0];
+  for (size_t i = 1; i < 10; ++i)
+    T_min = fmin(T_min, u->T.c[i]);
+
+  dbl s_min = u->kernel->stype == STYPE_CONSTANT ? 1 :
+    u->kernel->stype == STYPE_FUNC_PTR ? u->sfunc->s_min : 0;
+
+  dbl L_min = 0;
+  if (s_min > 0) {
+    tri3 tri;
+    memcpy(tri.v, u->Xt, sizeof(tri.v));
+    L_min = tri3_dist(&tri, u->x);
+  }
+
+  dbl lb = T_min + s_min*L_min;
+  return lb - 1e-13*fabs(lb);
+}
+
+/* Get a point to warm start `utetra_solve` from. Where the eikonal
+ * is smooth, the ray arriving at `x` points in nearly the same
+ * direction as the rays arriving at the base of the update, which we
+ * know from the gradients of their jets. We return the point where a
+ * ray arriving at `x` in their average direction crosses the plane
+ * containing the base, moved onto the base if it falls outside.
+ *
+ * If the base's gradients disagree (e.g., near a shadow boundary),
+ * this guess isn't reliable and can lead the solver to a different
+ * local minimizer than it would otherwise find, so we return `false`
+ * instead. We also do so if the ray is parallel to the base. */
+bool utetra_get_warm_start(utetra_s const *u, dbl lam[2]) {
+  dbl const min_coherence = 0.98;
+
+  jet31t const *jet = eik3_get_jet_ptr(u->eik);
+
+  dbl3 t = {0, 0, 0};
+  dbl t_norm_sum = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    if (!dbl3_isfinite(jet[u->l[i]].Df))
+      continue;
+    dbl3_add_inplace(t, jet[u->l[i]].Df);
+    t_norm_sum += dbl3_norm(jet[u->l[i]].Df);
+  }
+
+  dbl t_norm = dbl3_norm(t);
+  if (t_norm == 0 || t_norm < min_coherence*t_norm_sum)
+    return false;
+
+  /* Solve `x - s*t = x0 + lam[0]*(x1 - x0) + lam[1]*(x2 - x0)` */
+  dbl33 A;
+  for (size_t i = 0; i < 3; ++i) {
+    A[i][0] = u->Xt[1][i] - u->Xt[0][i];
+    A[i][1] = u->Xt[2][i] - u->Xt[0][i];
+    A[i][2] = t[i];
+  }
+
+  dbl3 rhs, y;
+  dbl3_sub(u->x, u->Xt[0], rhs);
+  dbl33_dbl3_solve(A, rhs, y);
+  if (!dbl3_isfinite(y))
+    return false;
+
+  lam[0] = fmax(0, y[0]);
+  lam[1] = fmax(0, y[1]);
+  dbl lam_sum = lam[0] + lam[1];
+  if (lam_sum > 1) {
+    lam[0] /= lam_sum;
+    lam[1] /= lam_sum;
+  }
+
+  return true;
+}
+
 // static void perturb_hessian_if_necessary(dbl22 H) {
 //   // Compute the trace and determinant of the Hessian
 //   dbl tr = H[0][0] + H[1][1];
@@ -818,218 +906,404 @@ bool utetra_is_degenerate(utetra_s const *u) {
 //   ++u->niter;
 // }
 
-dbl eval_poly(dbl const *a, dbl const *lam) {
-  dbl x = lam[0], y = lam[1];
-  return a[0] + a[1]*x + a[2]*y + a[3]*x*x + a[4]*x*y + a[5]*y*y;
-}
+/* Directions in barycentric coordinates corresponding to increasing
+ * `lam[0]` and `lam[1]`. */
+static dbl const a1[3] = {-1, 1, 0};
+static dbl const a2[3] = {-1, 0, 1};
+
+/* Get the projected Newton step `p` for a constant slowness update
+ * at `lam`, given the gradient `g` and Hessian `H` of its cost
+ * function. `H` is modified. */
+static void get_projected_newton_step(dbl22 H, dbl const g[2],
+                                      dbl const lam[2], dbl tol,
+                                      dbl p[2]) {
+  /* Shift the Hessian if necessary so that the Newton step below is
+   * a descent direction. The distance term is convex, so this only
+   * happens when T is strongly concave. */
+  dbl tr = H[0][0] + H[1][1];
+  dbl det = H[0][0]*H[1][1] - H[0][1]*H[1][0];
+  dbl min_eig_doubled = tr - sqrt(fmax(0, tr*tr - 4*det));
+  if (min_eig_doubled < 0) {
+    H[0][0] -= min_eig_doubled;
+    H[1][1] -= min_eig_doubled;
+  }
 
-void contract(dbl2 const lam_center, dbl factor, dbl2 lam) {
-  for (size_t i = 0; i < 2; ++i)
-    lam[i] = (lam[i] - lam_center[i])/factor + lam_center[i];
+  /* Compute the projected Newton step by solving:
+   *
+   *     minimize  y'*H*y/2 + (g - H*lam)'*y
+   *   subject to  y >= 0, sum(y) <= 1
+   *
+   * and letting `p = y - lam`. */
+  triqp2_s qp;
+  dbl2 H_lam;
+  dbl22_dbl2_mul(H, lam, H_lam);
+  dbl2_sub(g, H_lam, qp.b);
+  dbl22_copy(H, qp.A);
+  triqp2_solve(&qp, pow(tol, 2));
+  dbl2_sub(qp.x, lam, p);
 }
 
-/**
- * Do a tetrahedron update starting at `lam`, writing the result to
- * `jet`. If `lam` is `NULL`, then the first iterate will be selected
- * automatically.
- */
-void utetra_solve(utetra_s *u, dbl const *lam) {
-  static int CALL_NUMBER = 0;
-
-
-  // DEBUGGING
-
+/* When the slowness is constant (`s = 1`), the cost function of a
+ * tetrahedron update is:
+ *
+ *   F(lam) = T(b) + |x - xb|,
+ *
+ * where `b = (1 - lam[0] - lam[1], lam[0], lam[1])` and `xb = X*b`,
+ * so its gradient and Hessian can be computed directly. Writing `xb =
+ * x0 + dX'*lam` with `dX = [x1 - x0, x2 - x0]'`, and letting `L = |x -
+ * xb|` and `t = (x - xb)/L`, the gradient and Hessian of the distance
+ * term are `-dX*t` and `(dX*dX' - (dX*t)*(dX*t)')/L`.
+ *
+ * This sets `lam` and `f`, and computes the gradient `g` and the
+ * projected Newton step `p`. These are kept out of `u`: `u->g` is
+ * left unset, as it is by `utetra_solve_generic`, since
+ * `utetra_has_interior_point_solution` depends on it. */
+static void set_lambda_stype_constant(utetra_s *u, dbl const dX[2][3],
+                                      dbl const dXdXt[2][2],
+                                      dbl const lam[2], dbl g[2], dbl p[2]) {
+  u->lam[0] = lam[0];
+  u->lam[1] = lam[1];
+
+  dbl3 b = {1 - lam[0] - lam[1], lam[0], lam[1]};
+  dbl33_dbl3_mul(u->X, b, u->xb);
+  dbl3_sub(u->x, u->xb, u->x_minus_xb);
+  u->L = dbl3_norm(u->x_minus_xb);
+  assert(u->L > 0);
+
+  dbl2 DL = {
+    -dbl3_dot(dX[0], u->x_minus_xb)/u->L,
+    -dbl3_dot(dX[1], u->x_minus_xb)/u->L
+  };
+
+  u->f = bb32_f(&u->T, b) + u->L;
+
+  g[0] = bb32_df(&u->T, b, a1) + DL[0];
+  g[1] = bb32_df(&u->T, b, a2) + DL[1];
+
+  dbl22 H;
+  H[0][0] = bb32_d2f(&u->T, b, a1, a1) + (dXdXt[0][0] - DL[0]*DL[0])/u->L;
+  H[0][1] = bb32_d2f(&u->T, b, a1, a2) + (dXdXt[0][1] - DL[0]*DL[1])/u->L;
+  H[1][0] = H[0][1];
+  H[1][1] = bb32_d2f(&u->T, b, a2, a2) + (dXdXt[1][1] - DL[1]*DL[1])/u->L;
+
+  get_projected_newton_step(H, g, u->lam, u->tol, p);
+}
 
-  // FILE *fp = fopen("f.bin", "wb");
-  // for (size_t i = 0; i <= 100; ++i) {
-  //   for (size_t j = 0; j <= 100; ++j) {
-  //     dbl2 lam = {i/100., j/100.};
-  //     dbl f = NAN;
-  //     if (lam[0] + lam[1] <= 1) {
-  //       set_lambda(u, lam);
-  //       f = u->f;
-  //     }
-  //     fwrite(&f, sizeof(dbl), 1, fp);
-  //   }
-  // }
-  // fclose(fp);
+/* Solve a constant slowness update using Newton's method with a
+ * backtracking line search, starting from `lam` (or the centroid of
+ * the base of the update if `lam` is `NULL`). This usually converges
+ * in a handful of iterations. */
+static void solve_stype_constant(utetra_s *u, dbl const *lam) {
+  assert(u->kernel->stype == STYPE_CONSTANT);
 
+  dbl const atol = 1e-15, c1 = 1e-4;
 
-  // if (u->stype == STYPE_FUNC_PTR) {
+  dbl dX[2][3], dXdXt[2][2];
+  for (size_t i = 0; i < 2; ++i)
+    dbl3_sub(u->Xt[i + 1], u->Xt[0], dX[i]);
+  for (size_t i = 0; i < 2; ++i)
+    for (size_t j = 0; j < 2; ++j)
+      dXdXt[i][j] = dbl3_dot(dX[i], dX[j]);
+
+  dbl2 lam0 = {1./3, 1./3}, lam1, g, p;
+  if (lam != NULL)
+    dbl2_copy(lam, lam0);
+
+  set_lambda_stype_constant(u, dX, dXdXt, lam0, g, p);
+
+  u->niter = 0;
+  while (true) {
+    /* Once the Newton step is small enough, take it without a line
+     * search. Since it's the minimizer of a QP on the base of the
+     * update, if the minimizer of the update is on the boundary, this
+     * puts it there exactly, which `eik3` relies on. */
+    if (dbl2_norm(p) <= u->tol) {
+      dbl2_add(u->lam, p, lam1);
+      set_lambda_stype_constant(u, dX, dXdXt, lam1, g, p);
+      break;
+    }
 
-    dbl2 lam_prev = {NAN, NAN}, lam_opt = {NAN, NAN};
+    if (u->niter == MAX_NITER) {
+      log_warn("utetra_solve: reached max no. iters");
+      break;
+    }
 
-    dbl2 lam_node[6] = {
-      {0, 0},   {0.5, 0},   {1, 0},
-      {0, 0.5}, {0.5, 0.5},
-      {0, 1}
-    };
+    /* Backtracking line search along `p0` */
+    dbl f0 = u->f, c1_times_g_dot_p = c1*dbl2_dot(p, g);
+    dbl2 p0;
+    dbl2_copy(u->lam, lam0);
+    dbl2_copy(p, p0);
+
+    dbl beta = 1;
+    dbl2_saxpy(beta, p0, lam0, lam1);
+    set_lambda_stype_constant(u, dX, dXdXt, lam1, g, p);
+    while (u->f > f0 + beta*c1_times_g_dot_p + atol) {
+      beta *= 0.9;
+      if (beta < 1e-16)
+        break;
+      dbl2_saxpy(beta, p0, lam0, lam1);
+      set_lambda_stype_constant(u, dX, dXdXt, lam1, g, p);
+    }
 
-    dbl beta = 10.0;
-    dbl factor = (beta + 1)/beta;
-    dbl prev_error = NAN;
+    ++u->niter;
+  }
 
-    size_t num_iter = 0;
+  dbl3_normalized(u->x_minus_xb, u->topt);
+}
 
-    // printf("DOING S != 1 UTETRA #%d\n", CALL_NUMBER);
+/**
+ * Do a tetrahedron update starting at `lam`, writing the result to
+ * `jet`. If `lam` is `NULL`, then the first iterate will be selected
+ * automatically.
+ */
+void utetra_solve(utetra_s *u, dbl const *lam) {
+  u->solve(u, lam);
+}
 
-    while (true) {
+/* The number of lanes in a batch of constant slowness updates solved
+ * together by `solve_batch_stype_constant`. */
+#define BATCH_SIZE 8
+
+/* A batch of constant slowness updates stored as a structure of
+ * arrays, with one lane per update. The cost functions of all of the
+ * lanes are evaluated together by `batch_eval`, which is written as a
+ * single straight-line loop over the lanes so that it can be
+ * vectorized. */
+typedef struct {
+  size_t n;
+
+  /* Data for each lane, set by `batch_init`. The Bezier ordinates of
+   * T are ordered as in `bb32` (see bb.c), and `dXdXt` holds the
+   * (0, 0), (0, 1), and (1, 1) entries of `dX*dX'`. */
+  dbl x_minus_x0[3][BATCH_SIZE];
+  dbl dX[2][3][BATCH_SIZE];
+  dbl dXdXt[3][BATCH_SIZE];
+  dbl c[10][BATCH_SIZE];
+
+  /* The cost function, its gradient and Hessian (stored like
+   * `dXdXt`), and the vector `x - xb` and its length, evaluated by
+   * `batch_eval` */
+  dbl f[BATCH_SIZE];
+  dbl g[2][BATCH_SIZE];
+  dbl H[3][BATCH_SIZE];
+  dbl x_minus_xb[3][BATCH_SIZE];
+  dbl L[BATCH_SIZE];
+} batch_s;
+
+static void batch_init(batch_s *batch, utetra_s * const *u, size_t n) {
+  assert(n <= BATCH_SIZE);
+
+  batch->n = n;
+
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t k = 0; k < 3; ++k) {
+      batch->x_minus_x0[k][i] = u[i]->x[k] - u[i]->Xt[0][k];
+      batch->dX[0][k][i] = u[i]->Xt[1][k] - u[i]->Xt[0][k];
+      batch->dX[1][k][i] = u[i]->Xt[2][k] - u[i]->Xt[0][k];
+    }
 
-      // printf("* it = %lu\n", num_iter);
+    batch->dXdXt[0][i] = batch->dXdXt[1][i] = batch->dXdXt[2][i] = 0;
+    for (size_t k = 0; k < 3; ++k) {
+      batch->dXdXt[0][i] += batch->dX[0][k][i]*batch->dX[0][k][i];
+      batch->dXdXt[1][i] += batch->dX[0][k][i]*batch->dX[1][k][i];
+      batch->dXdXt[2][i] += batch->dX[1][k][i]*batch->dX[1][k][i];
+    }
 
-      dbl f[6] = {NAN, NAN, NAN, NAN, NAN, NAN};
-      for (size_t i = 0; i < 6; ++i) {
-        dbl const *lam_ = lam_node[i];
-        dbl3 x_node;
-        dbl3 b = {1 - lam_[0] - lam_[1], lam_[0], lam_[1]};
-        dbl33_dbl3_mul(u->X, b, x_node);
+    for (size_t k = 0; k < 10; ++k)
+      batch->c[k][i] = u[i]->T.c[k];
+  }
+}
 
-        dbl T = bb32_f(&u->T, b);
+/* Evaluate the cost function of each lane at `lam` (see
+ * `set_lambda_stype_constant`). The BB derivatives are computed by
+ * taking the first two de Casteljau steps at `b` once and then
+ * reducing them along each direction. */
+static void batch_eval(batch_s *batch, dbl const lam[2][BATCH_SIZE]) {
+  dbl const (*c)[BATCH_SIZE] = batch->c;
+
+  for (size_t i = 0; i < batch->n; ++i) {
+    dbl b0 = 1 - lam[0][i] - lam[1][i], b1 = lam[0][i], b2 = lam[1][i];
+
+    dbl v[3];
+    for (size_t k = 0; k < 3; ++k)
+      v[k] = batch->x_minus_x0[k][i]
+        - lam[0][i]*batch->dX[0][k][i] - lam[1][i]*batch->dX[1][k][i];
+
+    dbl L = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+
+    dbl DL0 = -(batch->dX[0][0][i]*v[0] + batch->dX[0][1][i]*v[1]
+                + batch->dX[0][2][i]*v[2])/L;
+    dbl DL1 = -(batch->dX[1][0][i]*v[0] + batch->dX[1][1][i]*v[1]
+                + batch->dX[1][2][i]*v[2])/L;
+
+    /* The quadratic ordinates after one de Casteljau step... */
+    dbl q200 = b0*c[0][i] + b1*c[1][i] + b2*c[4][i];
+    dbl q110 = b0*c[1][i] + b1*c[2][i] + b2*c[5][i];
+    dbl q020 = b0*c[2][i] + b1*c[3][i] + b2*c[6][i];
+    dbl q101 = b0*c[4][i] + b1*c[5][i] + b2*c[7][i];
+    dbl q011 = b0*c[5][i] + b1*c[6][i] + b2*c[8][i];
+    dbl q002 = b0*c[7][i] + b1*c[8][i] + b2*c[9][i];
+
+    /* ... and the linear ordinates after two */
+    dbl r100 = b0*q200 + b1*q110 + b2*q101;
+    dbl r010 = b0*q110 + b1*q020 + b2*q011;
+    dbl r001 = b0*q101 + b1*q011 + b2*q002;
+
+    batch->f[i] = b0*r100 + b1*r010 + b2*r001 + L;
+
+    batch->g[0][i] = 3*(r010 - r100) + DL0;
+    batch->g[1][i] = 3*(r001 - r100) + DL1;
+
+    batch->H[0][i] = 6*(q200 - 2*q110 + q020)
+      + (batch->dXdXt[0][i] - DL0*DL0)/L;
+    batch->H[1][i] = 6*(q200 - q110 - q101 + q011)
+      + (batch->dXdXt[1][i] - DL0*DL1)/L;
+    batch->H[2][i] = 6*(q200 - 2*q101 + q002)
+      + (batch->dXdXt[2][i] - DL1*DL1)/L;
+
+    for (size_t k = 0; k < 3; ++k)
+      batch->x_minus_xb[k][i] = v[k];
+    batch->L[i] = L;
+  }
+}
 
-        uline_s *uline;
-        uline_alloc(&uline);
-        uline_init_from_points(uline, u->eik, u->x, x_node, u->tol, T);
-        uline_solve(uline);
+typedef enum lane_state {
+  LANE_START,
+  LANE_SEARCH,
+  LANE_FINAL,
+  LANE_DONE
+} lane_state_e;
+
+/* Solve up to `BATCH_SIZE` constant slowness updates in lockstep. Each
+ * lane runs the same iteration as `solve_stype_constant`, but the
+ * lanes share each evaluation of the cost function: on each pass, the
+ * trial points of all of the lanes are evaluated together, and then
+ * each lane decides whether to accept its trial point, backtrack, or
+ * stop. Lanes which have converged sit idle until the rest finish. */
+static void solve_batch_stype_constant(utetra_s **u, dbl const **lam,
+                                       size_t n) {
+  dbl const atol = 1e-15, c1 = 1e-4;
+
+  batch_s batch;
+  batch_init(&batch, u, n);
+
+  lane_state_e state[BATCH_SIZE];
+  dbl trial[2][BATCH_SIZE], p[2][BATCH_SIZE], beta[BATCH_SIZE];
+  dbl f0[BATCH_SIZE], c1_times_g_dot_p[BATCH_SIZE];
+
+  for (size_t i = 0; i < n; ++i) {
+    assert(u[i]->kernel->stype == STYPE_CONSTANT);
+    state[i] = LANE_START;
+    trial[0][i] = lam[i] == NULL ? 1./3 : lam[i][0];
+    trial[1][i] = lam[i] == NULL ? 1./3 : lam[i][1];
+    u[i]->niter = 0;
+  }
 
-        f[i] = uline_get_value(uline);
+  size_t num_done = 0;
+  while (num_done < n) {
+    batch_eval(&batch, trial);
 
-        uline_dealloc(&uline);
-      }
+    for (size_t i = 0; i < n; ++i) {
+      if (state[i] == LANE_DONE)
+        continue;
 
-      dbl const invV[6][6] = {
-        { 1,  0,  0,  0,  0,  0},
-        {-3,  4, -1,  0,  0,  0},
-        {-3,  0,  0,  4,  0, -1},
-        { 2, -4,  2,  0,  0,  0},
-        { 4, -4,  0, -4,  4,  0},
-        { 2,  0,  0, -4,  0,  2}
-      };
-
-      dbl a[6];
-      for (size_t i = 0; i < 6; ++i) {
-        a[i] = 0;
-        for (size_t j = 0; j < 6; ++j) {
-          a[i] += invV[i][j]*f[j];
+      /* Backtrack if the trial point doesn't decrease the cost
+       * function enough (see `solve_stype_constant`) */
+      if (state[i] == LANE_SEARCH &&
+          batch.f[i] > f0[i] + beta[i]*c1_times_g_dot_p[i] + atol) {
+        beta[i] *= 0.9;
+        if (beta[i] >= 1e-16) {
+          trial[0][i] = u[i]->lam[0] + beta[i]*p[0][i];
+          trial[1][i] = u[i]->lam[1] + beta[i]*p[1][i];
+          continue;
         }
       }
 
-      /* Check that everything is correct at the nodal values... */
-      dbl2 const lam_node_orig[6] = {
-        {0, 0},   {0.5, 0},   {1, 0},
-        {0, 0.5}, {0.5, 0.5},
-        {0, 1}
-      };
-      for (size_t i = 0; i < 6; ++i)
-        assert(fabs(eval_poly(a, lam_node_orig[i]) - f[i]) < 1e-12);
-
-      // /* Write to disk... */
-      // FILE *fp = fopen("f_poly.bin", "w");
-      // for (size_t i = 0; i <= 100; ++i) {
-      //   for (size_t j = 0; j <= 100; ++j) {
-      //     dbl2 lam = {i/100., j/100.};
-      //     dbl f = NAN;
-      //     if (lam[0] + lam[1] <= 1) {
-      //       f = eval_poly(a, lam);
-      //     }
-      //     fwrite(&f, sizeof(dbl), 1, fp);
-      //   }
-      // }
-      // fclose(fp);
-
-      triqp2_s qp = {
-        .b = {a[1], a[2]},
-        .A = {{2*a[3], a[4]}, {a[4], 2*a[5]}},
-        .x = {NAN, NAN}
-      };
-
-      triqp2_solve(&qp, pow(u->tol, 2));
-
-      // printf("  - lam_node = np.array([[%g, %g]", lam_node[0][0], lam_node[0][1]);
-      // for (size_t i = 1; i < 6; ++i)
-      //   printf(", [%g, %g]", lam_node[i][0], lam_node[i][1]);
-      // printf("])\n");
-      // printf("  - lam = np.array([%g, %g]), error = %g\n", qp.x[0], qp.x[1], dbl2_dist(qp.x, lam_prev));
-
-      lam = &qp.x[0];
-      dbl error = dbl2_dist(lam, lam_prev);
-      if (error <= u->tol) {
-        dbl2_copy(lam, lam_opt);
-        break;
-      } else {
-        dbl2_copy(lam, lam_prev);
-      }
-
-      if (error > 2*prev_error) {
-        beta += 1;
-        factor = (beta + 1)/beta;
-        // printf("  ! reduced factor to %g\n", factor);
+      /* Accept the trial point */
+      u[i]->lam[0] = trial[0][i];
+      u[i]->lam[1] = trial[1][i];
+      u[i]->f = batch.f[i];
+      for (size_t k = 0; k < 3; ++k)
+        u[i]->x_minus_xb[k] = batch.x_minus_xb[k][i];
+      u[i]->L = batch.L[i];
+
+      if (state[i] == LANE_FINAL) {
+        state[i] = LANE_DONE;
+        ++num_done;
+        continue;
       }
 
-      for (size_t i = 0; i < 6; ++i) {
-        contract(lam_prev, factor, lam_node[i]);
-        assert(lam_node[i][0] >= -EPS);
-        assert(lam_node[i][1] >= -EPS);
-        assert(lam_node[i][0] + lam_node[i][1] <= 1 + EPS);
-      }
+      if (state[i] == LANE_SEARCH)
+        ++u[i]->niter;
 
-      prev_error = error;
-      ++num_iter;
+      dbl2 g = {batch.g[0][i], batch.g[1][i]}, p_;
+      dbl22 H = {{batch.H[0][i], batch.H[1][i]},
+                 {batch.H[1][i], batch.H[2][i]}};
+      get_projected_newton_step(H, g, u[i]->lam, u[i]->tol, p_);
+      p[0][i] = p_[0];
+      p[1][i] = p_[1];
 
-      if (num_iter == MAX_NITER) {
+      if (dbl2_norm(p_) <= u[i]->tol) {
+        state[i] = LANE_FINAL;
+      } else if (u[i]->niter == MAX_NITER) {
         log_warn("utetra_solve: reached max no. iters");
-        dbl2_copy(lam, lam_opt);
-        break;
+        state[i] = LANE_DONE;
+        ++num_done;
+        continue;
+      } else {
+        state[i] = LANE_SEARCH;
+        beta[i] = 1;
+        f0[i] = u[i]->f;
+        c1_times_g_dot_p[i] = c1*dbl2_dot(p_, g);
       }
-    }
-
-    /* make sure to set u->lam now */
-    dbl2_copy(lam_opt, u->lam);
-
-    /** Set f and topt now */
-
-    assert(isinf(u->f));
-    assert(dbl3_all_nan(u->topt));
-
-    dbl3 bopt = {1 - lam_opt[0] - lam_opt[1], lam_opt[0], lam_opt[1]};
-    dbl Topt = bb32_f(&u->T, bopt);
-
-    dbl3 xopt;
-    dbl33_dbl3_mul(u->X, bopt, xopt);
 
-    uline_s *uline;
-    uline_alloc(&uline);
-    uline_init_from_points(uline, u->eik, u->x, xopt, u->tol, Topt);
-    uline_solve(uline);
-
-    u->f = uline_get_value(uline);
-    uline_get_topt(uline, u->topt);
-
-    uline_dealloc(&uline);
-  // }
+      trial[0][i] = u[i]->lam[0] + p[0][i];
+      trial[1][i] = u[i]->lam[1] + p[1][i];
+    }
+  }
 
-  // /////
+  for (size_t i = 0; i < n; ++i) {
+    dbl3_sub(u[i]->x, u[i]->x_minus_xb, u[i]->xb);
+    dbl3_normalized(u[i]->x_minus_xb, u[i]->topt);
+  }
+}
 
-  // else if (u->stype == STYPE_CONSTANT) {
-  //   u->niter = 0;
+/**
+ * Solve the `n` updates in `u`, warm starting `u[i]` from `lam[i]`
+ * (which may be `NULL`, as for `utetra_solve`). When the slowness is
+ * constant, the updates are solved in lockstep in batches of
+ * `BATCH_SIZE` using the same iteration as `utetra_solve`; otherwise,
+ * they're just solved one at a time.
+ */
+void utetra_solve_batch(utetra_s **u, dbl const **lam, size_t n) {
+  if (n == 0)
+    return;
 
-  //   if (lam == NULL)
-  //     set_lambda(u, (dbl[2]) {1./3, 1./3});
-  //   else
-  //     set_lambda(u, lam);
+  if (u[0]->kernel->stype != STYPE_CONSTANT) {
+    for (size_t i = 0; i < n; ++i)
+      utetra_solve(u[i], lam[i]);
+    return;
+  }
 
-  //   int const max_niter = 100;
-  //   for (int _ = 0; _ < max_niter; ++_) {
-  //     if (dbl2_norm(u->p) <= u->tol)
-  //       break;
-  //     step(u);
-  //   }
-  //   if (dbl2_norm(u->p) > u->tol)
-  //     log_warn("utetra_solve: exceeded max no. of iters.");
-  // }
+  for (size_t i = 0; i < n; i += BATCH_SIZE)
+    solve_batch_stype_constant(&u[i], &lam[i], MIN(n - i, (size_t)BATCH_SIZE));
+}
 
-  // else { assert(false); } // TODO: stype not implemented
+/**
+ * Do a tetrahedron update using the general surrogate loop, which
+ * fits a quadratic to line updates at six points in the base of the
+ * update, minimizes it, and contracts the points towards the
+ * minimizer, regardless of which type of slowness is being used. This
+ * is what `utetra_solve` uses unless there is a specialized solver
+ * for the type of slowness, and is mainly useful for checking and
+ * benchmarking those solvers.
+ */
+void utetra_solve_generic(utetra_s *u, dbl const *lam) {
+  assert(isinf(u->f));
+  assert(dbl3_all_nan(u->topt));
 
-  ++CALL_NUMBER;
+  u->f = u->kernel->tetra(
+    u->sfunc, &u->T, u->x, u->X, u->tol, lam, u->lam, u->topt);
 }
 
 static void get_b(utetra_s const *u, dbl b[3]) {
@@ -1467,19 +1741,11 @@ bool utetras_have_same_inds(utetra_s const *u1, utetra_s const *u2) {
 }
 
 #if JMM_TEST
-void utetra_step(utetra_s *u) {
-  step(u);
-}
-
 void utetra_get_lambda(utetra_s const *u, dbl lam[2]) {
   lam[0] = u->lam[0];
   lam[1] = u->lam[1];
 }
 
-void utetra_set_lambda(utetra_s *u, dbl const lam[2]) {
-  set_lambda(u, lam);
-}
-
 size_t utetra_get_num_iter(utetra_s const *u) {
   return u->niter;
 }
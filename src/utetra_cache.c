@@ -1,7 +1,14 @@
 #include <jmm/utetra_cache.h>
 
+#include "nodemap.h"
+
+/* Cached updates are indexed by their target node, so that each
+ * query only needs to look at the updates targeting that node. */
 struct utetra_cache {
-  array_s *utetra_arr;
+  nodemap_s *utetra_map;
+
+  /* Scratch arrays used by `utetra_cache_pop_bracket` */
+  array_s *bracket, *i_arr;
 };
 
 void utetra_cache_alloc(utetra_cache_s **cache) {
@@ -14,25 +21,46 @@ void utetra_cache_dealloc(utetra_cache_s **cache) {
 }
 
 void utetra_cache_init(utetra_cache_s *cache) {
-  array_alloc(&cache->utetra_arr);
-  array_init(cache->utetra_arr, sizeof(utetra_s *), 16);
+  nodemap_alloc(&cache->utetra_map);
+  nodemap_init(cache->utetra_map, 16);
+
+  array_alloc(&cache->bracket);
+  array_init(cache->bracket, sizeof(utetra_s *), ARRAY_DEFAULT_CAPACITY);
+
+  array_alloc(&cache->i_arr);
+  array_init(cache->i_arr, sizeof(size_t), ARRAY_DEFAULT_CAPACITY);
 }
 
 void utetra_cache_deinit(utetra_cache_s *cache) {
   utetra_s *utetra;
-  for (size_t i = 0; i < array_size(cache->utetra_arr); ++i) {
-    array_get(cache->utetra_arr, i, &utetra);
-    utetra_dealloc(&utetra);
+  for (size_t i = 0; i < nodemap_num_slots(cache->utetra_map); ++i) {
+    array_s *utetra_arr = nodemap_get_slot(cache->utetra_map, i);
+    if (utetra_arr == NULL)
+      continue;
+    for (size_t j = 0; j < array_size(utetra_arr); ++j) {
+      array_get(utetra_arr, j, &utetra);
+      utetra_dealloc(&utetra);
+    }
   }
 
-  array_deinit(cache->utetra_arr);
-  array_dealloc(&cache->utetra_arr);
+  nodemap_deinit(cache->utetra_map);
+  nodemap_dealloc(&cache->utetra_map);
+
+  array_deinit(cache->bracket);
+  array_dealloc(&cache->bracket);
+
+  array_deinit(cache->i_arr);
+  array_dealloc(&cache->i_arr);
 }
 
 bool utetra_cache_contains_utetra(utetra_cache_s const *cache, utetra_s const *utetra) {
+  array_s const *utetra_arr = nodemap_get(cache->utetra_map, utetra_get_l(utetra));
+  if (utetra_arr == NULL)
+    return false;
+
   utetra_s const *utetra_other = NULL;
-  for (size_t i = 0; i < array_size(cache->utetra_arr); ++i) {
-    array_get(cache->utetra_arr, i, &utetra_other);
+  for (size_t i = 0; i < array_size(utetra_arr); ++i) {
+    array_get(utetra_arr, i, &utetra_other);
     if (utetras_have_same_inds(utetra, utetra_other))
       return true;
   }
@@ -40,72 +68,82 @@ bool utetra_cache_contains_utetra(utetra_cache_s const *cache, utetra_s const *u
 }
 
 bool utetra_cache_contains_inds(utetra_cache_s const *cache, size_t lhat, uint3 const l) {
-  for (size_t j = 0; j < array_size(cache->utetra_arr); ++j) {
+  array_s const *utetra_arr = nodemap_get(cache->utetra_map, lhat);
+  if (utetra_arr == NULL)
+    return false;
+
+  for (size_t j = 0; j < array_size(utetra_arr); ++j) {
     utetra_s *utetra;
-    array_get(cache->utetra_arr, j, &utetra);
+    array_get(utetra_arr, j, &utetra);
     if (utetra_has_inds(utetra, lhat, l))
       return true;
   }
   return false;
 }
 
+/* Look for cached updates which bracket `utetra`. If there are any,
+ * they're evicted from the cache and returned. The returned array is
+ * owned by `cache` and is only valid until the next call. If there
+ * isn't a bracket, `NULL` is returned instead. */
 array_s *utetra_cache_pop_bracket(utetra_cache_s *cache, utetra_s const *utetra) {
-  size_t l = utetra_get_l(utetra);
+  array_s *utetra_arr = nodemap_get(cache->utetra_map, utetra_get_l(utetra));
+  if (utetra_arr == NULL)
+    return NULL;
 
   /* Array containing matched bracket utetra */
-  array_s *utetras;
-  array_alloc(&utetras);
-  array_init(utetras, sizeof(utetra_s *), ARRAY_DEFAULT_CAPACITY);
+  array_s *utetras = cache->bracket;
+  array_clear(utetras);
 
   /* Array containing their indices */
-  array_s *i_arr;
-  array_alloc(&i_arr);
-  array_init(i_arr, sizeof(size_t), ARRAY_DEFAULT_CAPACITY);
+  array_s *i_arr = cache->i_arr;
+  array_clear(i_arr);
 
   /* First, find the indices of the cached utetra which share the same
    * target node and have the same active indices as `utetra`. */
-  for (size_t i = 0; i < array_size(cache->utetra_arr); ++i) {
+  for (size_t i = 0; i < array_size(utetra_arr); ++i) {
     utetra_s const *utetra_other;
-    array_get(cache->utetra_arr, i, &utetra_other);
-    if (l != utetra_get_l(utetra_other)
-        || !utetras_have_same_minimizer(utetra, utetra_other))
+    array_get(utetra_arr, i, &utetra_other);
+    if (!utetras_have_same_minimizer(utetra, utetra_other))
       continue;
     array_append(i_arr, &i);
     array_append(utetras, &utetra_other);
   }
 
   /* If the utetras bracket the ray, we evict them from the cache
-   * using the index array. If they don't, we clean up the utetra
-   * array now. */
-  if (utetra_is_bracketed_by_utetras(utetra, utetras)) {
-    array_delete_all(cache->utetra_arr, i_arr);
-  } else {
-    array_deinit(utetras);
-    array_dealloc(&utetras);
-  }
-  array_deinit(i_arr);
-  array_dealloc(&i_arr);
+   * using the index array and return them. Otherwise, we return
+   * `NULL` to signal that there isn't a bracket. */
+  if (!utetra_is_bracketed_by_utetras(utetra, utetras))
+    return NULL;
+
+  array_delete_all(utetra_arr, i_arr);
 
-  /* If we cleaned up utetras, it equals `NULL` now. So we return
-   * `NULL` if there isn't a bracket, and the array of utetras
-   * otherwise. */
   return utetras;
 }
 
-void utetra_cache_purge(utetra_cache_s *cache, size_t l) {
+/* Remove the updates targeting the node with index `l` from
+ * `cache`. If `purged` isn't `NULL`, the removed updates are appended
+ * to it so that they can be reused. Otherwise, they're freed. */
+void utetra_cache_purge(utetra_cache_s *cache, size_t l, array_s *purged) {
+  array_s *utetra_arr = nodemap_get(cache->utetra_map, l);
+  if (utetra_arr == NULL)
+    return;
+
   utetra_s *utetra;
-  for (size_t i = array_size(cache->utetra_arr); i > 0; --i) {
-    array_get(cache->utetra_arr, i - 1, &utetra);
-    if (utetra_get_l(utetra) == l) {
+  for (size_t i = 0; i < array_size(utetra_arr); ++i) {
+    array_get(utetra_arr, i, &utetra);
+    if (purged == NULL)
       utetra_dealloc(&utetra);
-      array_delete(cache->utetra_arr, i - 1);
-    }
+    else
+      array_append(purged, &utetra);
   }
+
+  nodemap_remove(cache->utetra_map, l);
 }
 
 bool utetra_cache_try_add_unique(utetra_cache_s *cache, utetra_s *utetra) {
   if (utetra_cache_contains_utetra(cache, utetra))
     return false;
-  array_append(cache->utetra_arr, &utetra);
+  array_s *utetra_arr = nodemap_get_or_insert(cache->utetra_map, utetra_get_l(utetra));
+  array_append(utetra_arr, &utetra);
   return true;
 }
@@ -8,16 +8,16 @@
 #include <jmm/array.h>
 #include <jmm/bb.h>
 #include <jmm/eik3.h>
-#include <jmm/hybrid.h>
 #include <jmm/mat.h>
 #include <jmm/mesh3.h>
 #include <jmm/slerp.h>
-#include <jmm/uline.h>
+
+#include "ukernel.h"
 
 struct utri {
   eik3_s const *eik;
-  stype_e stype;
   sfunc_s const *sfunc;
+  ukernel_s const *kernel;
   dbl tol;
 
   dbl lam;
@@ -25,8 +25,6 @@ struct utri {
   dbl3 topt;
 
   dbl Df;
-  dbl x_minus_xb[3];
-  dbl L;
 
   size_t l, l0, l1;
   dbl x[3];
@@ -45,42 +43,6 @@ void utri_dealloc(utri_s **utri) {
   *utri = NULL;
 }
 
-static void set_lambda_stype_constant(utri_s *utri, dbl lam) {
-  utri->lam = lam;
-
-  dbl xb[3];
-  dbl3_saxpy(lam, utri->x1_minus_x0, utri->x0, xb);
-  dbl3_sub(utri->x, xb, utri->x_minus_xb);
-  utri->L = dbl3_norm(utri->x_minus_xb);
-
-  dbl dL_dlam = -dbl3_dot(utri->x1_minus_x0, utri->x_minus_xb)/utri->L;
-
-  dbl b[2] = {1 - lam, lam};
-  dbl T = bb31_f(&utri->T, b);
-
-  utri->f = T + utri->L;
-
-  dbl a[2] = {-1, 1};
-  dbl dT_dlam = bb31_df(&utri->T, b, a);
-
-  utri->Df = dT_dlam + dL_dlam;
-}
-
-static void set_lambda(utri_s *utri, dbl lam) {
-  switch (utri->stype) {
-  case STYPE_CONSTANT:
-    set_lambda_stype_constant(utri, lam);
-    break;
-  default:
-    assert(false);
-  }
-}
-
-static dbl hybrid_f(dbl lam, utri_s *utri) {
-  set_lambda(utri, lam);
-  return utri->Df;
-}
-
 static void
 rotate_jet_for_diffraction(mesh3_s const *mesh,
                            size_t l_diff, size_t l_bdv,
@@ -90,15 +52,20 @@ rotate_jet_for_diffraction(mesh3_s const *mesh,
   assert(!mesh3_vert_incident_on_diff_edge(mesh, l_bdv));
   assert(mesh3_bdv(mesh, l_bdv));
 
-  /* Get the diffracting edges incident on `l_diff` */
-  size_t num_inc_diff_edges = mesh3_get_num_inc_diff_edges(mesh, l_diff);
-  assert(num_inc_diff_edges > 0);
-  size_t (*le)[2] = malloc(num_inc_diff_edges*sizeof(size_t[2]));
-  mesh3_get_inc_diff_edges(mesh, l_diff, le);
+  /* Find the first diffracting edge incident on `l_diff` */
+  size_t nvv;
+  size_t const *vv = mesh3_get_vv_ptr(mesh, l_diff, &nvv);
+  size_t le[2] = {l_diff, (size_t)NO_INDEX};
+  for (size_t i = 0; i < nvv; ++i) {
+    le[1] = vv[i];
+    if (mesh3_is_diff_edge(mesh, le))
+      break;
+  }
+  assert(mesh3_is_diff_edge(mesh, le));
 
   /* Get an incident diffracting tangent edge */
   dbl3 te;
-  mesh3_get_diff_edge_tangent(mesh, le[0], te);
+  mesh3_get_diff_edge_tangent(mesh, le, te);
 
   /* Get the diffraction vertex */
   dbl3 xe;
@@ -126,27 +93,22 @@ rotate_jet_for_diffraction(mesh3_s const *mesh,
   /* Compute the diffracted tangent vector */
   for (size_t i = 0; i < 3; ++i)
     jet->Df[i] = cos_beta*te[i] + sin_beta*tf[i];
-
-  /* Clean up */
-  free(le);
 }
 
 void utri_init(utri_s *u, eik3_s const *eik, size_t lhat, size_t const l[2]) {
   mesh3_s const *mesh = eik3_get_mesh(eik);
 
   u->eik = eik;
-  u->stype = eik3_get_stype(eik);
   u->sfunc = eik3_get_sfunc(eik);
+  u->kernel = eik3_get_ukernel(eik);
   u->tol = mesh3_get_edge_tol(mesh, l);
 
   /* Initialize `u` */
 
   u->f = INFINITY;
-  u->lam = u->f = u->Df = u->L = NAN;
+  u->lam = u->f = u->Df = NAN;
   dbl3_nan(u->topt);
 
-  u->x_minus_xb[0] = u->x_minus_xb[1] = u->x_minus_xb[2] = NAN;
-
   u->l = lhat;
   u->l0 = l[0];
   u->l1 = l[1];
@@ -191,135 +153,10 @@ void utri_init(utri_s *u, eik3_s const *eik, size_t lhat, size_t const l[2]) {
   }
 }
 
-static dbl hybrid_Dp(dbl lam, cubic_s const *p) {
-  return cubic_df(p, lam);
-}
-
 void utri_solve(utri_s *utri) {
-  static int CALL_NUMBER = 0;
-
-  if (utri->stype == STYPE_CONSTANT) {
-    dbl lam, f[2];
-
-    if (hybrid((hybrid_cost_func_t)hybrid_f, 0, 1, utri, &lam))
-      return;
-
-    set_lambda(utri, 0);
-    f[0] = utri->f;
-
-    set_lambda(utri, 1);
-    f[1] = utri->f;
-
-    assert(f[0] != f[1]);
-
-    if (f[0] < f[1])
-      set_lambda(utri, 0);
-    else
-      set_lambda(utri, 1);
-  }
-
-  else if (utri->stype == STYPE_FUNC_PTR) {
-
-    dbl lam_prev = NAN, lam_opt = NAN;
-    // dbl lam_node_orig[4] = {0, 1./3, 2./3, 1}; // just for debugging
-    dbl lam_node[4] = {0, 1./3, 2./3, 1};
-
-    dbl beta = 3;
-    dbl factor = (beta + 1)/beta;
-
-    dbl prev_error = NAN;
-
-    size_t num_iter = 0;
-
-    // printf("DOING S != 1 UTRI #%d\n", CALL_NUMBER);
-
-    while (true) {
-      // printf("* it = %lu\n", num_iter);
-
-      dbl f[4] = {NAN, NAN, NAN, NAN};
-      for (size_t i = 0; i < 4; ++i) {
-        dbl3 x_node;
-        dbl3_saxpy(lam_node[i], utri->x1_minus_x0, utri->x0, x_node);
-
-        dbl T = bb31_f(&utri->T, (dbl2) {1 - lam_node[i], lam_node[i]});
-
-        uline_s *uline;
-        uline_alloc(&uline);
-        uline_init_from_points(uline,utri->eik,utri->x,x_node,utri->tol,T);
-        uline_solve(uline);
-
-        f[i] = uline_get_value(uline);
-
-        uline_dealloc(&uline);
-      }
-
-      cubic_s p = cubic_from_lagrange_data(f);
-      // for (size_t i = 0; i < 4; ++i)
-      //   assert(fabs(cubic_f(&p, lam_node_orig[i]) - f[i]) < EPS);
-
-      dbl lam = NAN;
-      if (!hybrid((hybrid_cost_func_t)hybrid_Dp, 0, 1, &p, &lam)) {
-        /* TODO: If the hybrid method failed to do its thing, we've
-         * found a boundary minimizer. For now we'll just do a stupid
-         * hack: assume this is the correct solution and bail! In many
-         * cases this will be the right thing to do. Only very
-         * occasionally should we get the other weird corner
-         * case... */
-        lam_opt = cubic_f(&p, 0) < cubic_f(&p, 1) ? 0 : 1;
-        break;
-      }
-
-      dbl error = fabs(lam - lam_prev);
-      if (error <= utri->tol) {
-        lam_opt = lam;
-        break;
-      } else {
-        lam_prev = lam;
-      }
-
-      if (error > 2*prev_error) {
-        beta += 1;
-        factor = (beta + 1)/beta;
-        // printf("  ! reduced factor to %g\n", factor);
-      }
-
-      for (size_t i = 0; i < 4; ++i) {
-        lam_node[i] = (lam_node[i] - lam_prev)/factor + lam_prev;
-        assert(lam_node[i] >= -EPS);
-        assert(lam_node[i] <= 1 + EPS);
-      }
-
-      prev_error = error;
-      ++num_iter;
-    }
-
-    /** Set lam, f, and topt */
-
-    assert(isnan(utri->lam));
-    assert(isnan(utri->f));
-    assert(dbl3_all_nan(utri->topt));
-
-    utri->lam = lam_opt;
-
-    dbl T_opt = bb31_f(&utri->T, (dbl2) {1 - lam_opt, lam_opt});
-
-    dbl3 x_opt;
-    dbl3_saxpy(lam_opt, utri->x1_minus_x0, utri->x0, x_opt);
-
-    uline_s *uline;
-    uline_alloc(&uline);
-    uline_init_from_points(uline,utri->eik,utri->x,x_opt,utri->tol,T_opt);
-    uline_solve(uline);
-
-    utri->f = uline_get_value(uline);
-    uline_get_topt(uline, utri->topt);
-
-    uline_dealloc(&uline);
-  }
-
-  else assert(false);
-
-  ++CALL_NUMBER;
+  utri->f = utri->kernel->tri(
+    utri->sfunc, &utri->T, utri->x, utri->x0, utri->x1_minus_x0, utri->tol,
+    &utri->lam, &utri->Df, utri->topt);
 }
 
 static void get_update_inds(utri_s const *utri, size_t l[2]) {
@@ -346,18 +183,10 @@ dbl utri_get_value(utri_s const *u) {
 void utri_get_jet31t(utri_s const *utri, jet31t *jet) {
   jet->f = utri->f;
 
-  if (utri->stype == STYPE_CONSTANT) {
-    dbl3_dbl_div(utri->x_minus_xb, utri->L, jet->Df);
-  }
-
-  else if (utri->stype == STYPE_FUNC_PTR) {
-    dbl3 x_lam;
-    dbl3_saxpy(utri->lam, utri->x1_minus_x0, utri->x0, x_lam);
-    dbl shat = utri->sfunc->funcs.s(x_lam);
-    dbl3_dbl_mul(utri->topt, shat, jet->Df);
-  }
-
-  else assert(false);
+  dbl3 x_lam;
+  dbl3_saxpy(utri->lam, utri->x1_minus_x0, utri->x0, x_lam);
+  dbl shat = utri->kernel->s(utri->sfunc, x_lam);
+  dbl3_dbl_mul(utri->topt, shat, jet->Df);
 }
 
 static dbl get_lag_mult(utri_s const *utri) {
@@ -467,6 +296,36 @@ size_t utri_get_l(utri_s const *utri) {
   return utri->l;
 }
 
+/* Get a lower bound for the value of `u` without solving it. By the
+ * convex hull property, the smallest Bezier ordinate of `T` bounds it
+ * from below on the base of the update. The rest of the value is the
+ * slowness integrated along the ray (by Simpson's rule, for
+ * `STYPE_FUNC_PTR`), which is at least the smallest slowness times
+ * the distance from `x` to the base. The bound is backed off by a
+ * tiny relative tolerance so that rounding error can't make it exceed
+ * the value it bounds. */
+dbl utri_get_lower_bound(utri_s const *u) {
+  dbl T_min = fmin(fmin(u->T.c[0], u->T.c[1]), fmin(u->T.c[2], u->T.c[3]));
+
+  dbl s_min = u->kernel->stype == STYPE_CONSTANT ? 1 :
+    u->kernel->stype == STYPE_FUNC_PTR ? u->sfunc->s_min : 0;
+
+  dbl L_min = 0;
+  if (s_min > 0) {
+    dbl3 x_minus_x0;
+    dbl3_sub(u->x, u->x0, x_minus_x0);
+    dbl lam = dbl3_dot(x_minus_x0, u->x1_minus_x0)/dbl3_normsq(u->x1_minus_x0);
+    lam = fmax(0, fmin(1, lam));
+
+    dbl3 xb;
+    dbl3_saxpy(lam, u->x1_minus_x0, u->x0, xb);
+    L_min = dbl3_dist(u->x, xb);
+  }
+
+  dbl lb = T_min + s_min*L_min;
+  return lb - 1e-13*fabs(lb);
+}
+
 /* Check whether `u`'s `l`, `l0`, and `l1` are collinear (i.e.,
  * whether the `utri` is "degenerate"). */
 bool utri_is_degenerate(utri_s const *u) {
@@ -2,8 +2,12 @@
 
 #include <jmm/array.h>
 
+#include "nodemap.h"
+
+/* Cached updates are indexed by their target node, so that each
+ * query only needs to look at the updates targeting that node. */
 struct utri_cache {
-  array_s *utri_arr;
+  nodemap_s *utri_map;
 };
 
 void utri_cache_alloc(utri_cache_s **cache) {
@@ -16,27 +20,36 @@ void utri_cache_dealloc(utri_cache_s **cache) {
 }
 
 void utri_cache_init(utri_cache_s *cache) {
-  array_alloc(&cache->utri_arr);
-  array_init(cache->utri_arr, sizeof(utri_s *), 16);
+  nodemap_alloc(&cache->utri_map);
+  nodemap_init(cache->utri_map, 16);
 }
 
 void utri_cache_deinit(utri_cache_s *cache) {
   utri_s *utri;
-  for (size_t i = 0; i < array_size(cache->utri_arr); ++i) {
-    array_get(cache->utri_arr, i, &utri);
-    utri_dealloc(&utri);
+  for (size_t i = 0; i < nodemap_num_slots(cache->utri_map); ++i) {
+    array_s *utri_arr = nodemap_get_slot(cache->utri_map, i);
+    if (utri_arr == NULL)
+      continue;
+    for (size_t j = 0; j < array_size(utri_arr); ++j) {
+      array_get(utri_arr, j, &utri);
+      utri_dealloc(&utri);
+    }
   }
 
-  array_deinit(cache->utri_arr);
-  array_dealloc(&cache->utri_arr);
+  nodemap_deinit(cache->utri_map);
+  nodemap_dealloc(&cache->utri_map);
 }
 
 /* Check whether `utri` has been stored in the cache for
  * edge-diffracted updates already. */
 bool utri_cache_contains_utri(utri_cache_s const *cache, utri_s const *utri) {
+  array_s const *utri_arr = nodemap_get(cache->utri_map, utri_get_l(utri));
+  if (utri_arr == NULL)
+    return false;
+
   utri_s const *utri_other = NULL;
-  for (size_t i = 0; i < array_size(cache->utri_arr); ++i) {
-    array_get(cache->utri_arr, i, &utri_other);
+  for (size_t i = 0; i < array_size(utri_arr); ++i) {
+    array_get(utri_arr, i, &utri_other);
     if (utris_have_same_inds(utri, utri_other))
       return true;
   }
@@ -44,9 +57,13 @@ bool utri_cache_contains_utri(utri_cache_s const *cache, utri_s const *utri) {
 }
 
 bool utri_cache_contains_inds(utri_cache_s const *cache, size_t lhat, uint2 l) {
-  for (size_t j = 0; j < array_size(cache->utri_arr); ++j) {
+  array_s const *utri_arr = nodemap_get(cache->utri_map, lhat);
+  if (utri_arr == NULL)
+    return false;
+
+  for (size_t j = 0; j < array_size(utri_arr); ++j) {
     utri_s *utri;
-    array_get(cache->utri_arr, j, &utri);
+    array_get(utri_arr, j, &utri);
     if (utri_has_inds(utri, lhat, l))
       return true;
   }
@@ -63,20 +80,23 @@ utri_s *utri_cache_pop(utri_cache_s *cache, utri_s const *utri) {
   size_t l_active = utri_get_active_ind(utri);
   size_t l_inactive = utri_get_inactive_ind(utri);
 
+  /* only updates with the same target index are candidates */
+  array_s *utri_arr = nodemap_get(cache->utri_map, l);
+  if (utri_arr == NULL)
+    return NULL;
+
   utri_s *utri_other = NULL;
 
   /* iterate over the other `utri` in the cache... */
-  for (size_t i = 0; i < array_size(cache->utri_arr); ++i) {
-    array_get(cache->utri_arr, i, &utri_other);
-
-    /* if this is a distinct `utri`, with the same target index and
-     * the same active index (so, the inactive index must be
-     * different!) ... */
-    if (l == utri_get_l(utri_other) &&
-        l_active == utri_get_active_ind(utri_other) &&
+  for (size_t i = 0; i < array_size(utri_arr); ++i) {
+    array_get(utri_arr, i, &utri_other);
+
+    /* if this is a distinct `utri` with the same active index (so,
+     * the inactive index must be different!) ... */
+    if (l_active == utri_get_active_ind(utri_other) &&
         l_inactive != utri_get_inactive_ind(utri_other)) {
       /* ... then delete it and break from the loop */
-      array_delete(cache->utri_arr, i);
+      array_delete(utri_arr, i);
       break;
     }
 
@@ -90,17 +110,24 @@ utri_s *utri_cache_pop(utri_cache_s *cache, utri_s const *utri) {
 }
 
 
-/* Remove and free triangle updates targeting the node with index `l`
- * from `cache`. */
-void utri_cache_purge(utri_cache_s *cache, size_t l) {
+/* Remove triangle updates targeting the node with index `l` from
+ * `cache`. If `purged` isn't `NULL`, the removed updates are appended
+ * to it so that they can be reused. Otherwise, they're freed. */
+void utri_cache_purge(utri_cache_s *cache, size_t l, array_s *purged) {
+  array_s *utri_arr = nodemap_get(cache->utri_map, l);
+  if (utri_arr == NULL)
+    return;
+
   utri_s *utri;
-  for (size_t i = array_size(cache->utri_arr); i > 0; --i) {
-    array_get(cache->utri_arr, i - 1, &utri);
-    if (utri_get_l(utri) == l) {
+  for (size_t i = 0; i < array_size(utri_arr); ++i) {
+    array_get(utri_arr, i, &utri);
+    if (purged == NULL)
       utri_dealloc(&utri);
-      array_delete(cache->utri_arr, i - 1);
-    }
+    else
+      array_append(purged, &utri);
   }
+
+  nodemap_remove(cache->utri_map, l);
 }
 
 /* Try to add `utri` to `cache`. If `utri` is already contained, then
@@ -108,6 +135,7 @@ void utri_cache_purge(utri_cache_s *cache, size_t l) {
 bool utri_cache_try_add_unique(utri_cache_s *cache, utri_s *utri) {
   if (utri_cache_contains_utri(cache, utri))
     return false;
-  array_append(cache->utri_arr, &utri);
+  array_s *utri_arr = nodemap_get_or_insert(cache->utri_map, utri_get_l(utri));
+  array_append(utri_arr, &utri);
   return true;
 }
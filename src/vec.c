@@ -527,6 +527,14 @@ bool dbl4_valid_bary_coord(dbl4 const b) {
     && fabs(1 - dbl4_sum(b)) < atol;
 }
 
+size_t dbl4_argmin(dbl4 const u) {
+  size_t argmin = 0;
+  for (size_t i = 1; i < 4; ++i)
+    if (u[i] < u[argmin])
+      argmin = i;
+  return argmin;
+}
+
 dbl dbl4_dist(dbl4 const u, dbl4 const v) {
   dbl tmp[4] = {u[0] - v[0], u[1] - v[1], u[2] - v[2], u[3] - v[3]};
   return sqrt(tmp[0]*tmp[0] + tmp[1]*tmp[1] + tmp[2]*tmp[2] + tmp[3]*tmp[3]);
@@ -0,0 +1,62 @@
+#include "cube_mesh.h"
+
+#include <gsl/gsl_randist.h>
+#include <stdlib.h>
+
+void box_mesh_data_init(mesh3_data_s *data, size_t const shape[3],
+                        dbl3 const xmin, dbl3 const xmax, gsl_rng *rng) {
+  dbl h[3];
+  for (size_t q = 0; q < 3; ++q)
+    h[q] = (xmax[q] - xmin[q])/(shape[q] - 1);
+
+  data->nverts = shape[0]*shape[1]*shape[2];
+  data->verts = malloc(data->nverts*sizeof(dbl3));
+  for (size_t i = 0; i < shape[0]; ++i)
+    for (size_t j = 0; j < shape[1]; ++j)
+      for (size_t k = 0; k < shape[2]; ++k) {
+        size_t ind[3] = {i, j, k};
+        bool is_interior = rng != NULL;
+        for (size_t q = 0; q < 3; ++q)
+          is_interior &= 0 < ind[q] && ind[q] < shape[q] - 1;
+        dbl *x = data->verts[(i*shape[1] + j)*shape[2] + k];
+        for (size_t q = 0; q < 3; ++q) {
+          x[q] = xmin[q] + (xmax[q] - xmin[q])*ind[q]/(shape[q] - 1);
+          if (is_interior)
+            x[q] += gsl_ran_flat(rng, -h[q]/8, h[q]/8);
+        }
+      }
+
+  /* Each tetrahedron walks from one corner of the subcube to the
+   * opposite corner, taking one step along each axis */
+  size_t perm[6][3] = {
+    {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+  };
+
+  data->ncells = 6*(shape[0] - 1)*(shape[1] - 1)*(shape[2] - 1);
+  data->cells = malloc(data->ncells*sizeof(uint4));
+  size_t lc = 0;
+  for (size_t i = 0; i < shape[0] - 1; ++i)
+    for (size_t j = 0; j < shape[1] - 1; ++j)
+      for (size_t k = 0; k < shape[2] - 1; ++k)
+        for (size_t p = 0; p < 6; ++p, ++lc) {
+          size_t ind[3] = {i, j, k};
+          data->cells[lc][0] = (ind[0]*shape[1] + ind[1])*shape[2] + ind[2];
+          for (size_t q = 0; q < 3; ++q) {
+            ++ind[perm[p][q]];
+            data->cells[lc][q + 1] =
+              (ind[0]*shape[1] + ind[1])*shape[2] + ind[2];
+          }
+        }
+}
+
+void cube_mesh_data_init(mesh3_data_s *data, size_t n, dbl xmin, dbl xmax,
+                         gsl_rng *rng) {
+  size_t const shape[3] = {n, n, n};
+  dbl3 const xmin_ = {xmin, xmin, xmin}, xmax_ = {xmax, xmax, xmax};
+  box_mesh_data_init(data, shape, xmin_, xmax_, rng);
+}
+
+void cube_mesh_data_deinit(mesh3_data_s *data) {
+  free(data->verts);
+  free(data->cells);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <gsl/gsl_rng.h>
+
+#include "mesh3.h"
+
+/* Mesh the box `[xmin[0], xmax[0]] x [xmin[1], xmax[1]] x [xmin[2],
+ * xmax[2]]` using a regular grid of `shape[0]*shape[1]*shape[2]`
+ * vertices, splitting each subcube into six tetrahedra which share
+ * its main diagonal. The vertex with grid index `(i, j, k)` has index
+ * `(i*shape[1] + j)*shape[2] + k`. If `rng` isn't `NULL`, the
+ * interior vertices are perturbed by up to an eighth of the grid
+ * spacing along each axis, so that the cells aren't all the same
+ * shape. Free `data` using `cube_mesh_data_deinit`. */
+void box_mesh_data_init(mesh3_data_s *data, size_t const shape[3],
+                        dbl3 const xmin, dbl3 const xmax, gsl_rng *rng);
+
+/* Mesh the cube `[xmin, xmax]^3` using a regular grid of `n^3`
+ * vertices (see `box_mesh_data_init`). */
+void cube_mesh_data_init(mesh3_data_s *data, size_t n, dbl xmin, dbl xmax,
+                         gsl_rng *rng);
+
+void cube_mesh_data_deinit(mesh3_data_s *data);
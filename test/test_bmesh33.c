@@ -1,9 +1,14 @@
 #include <cgreen/cgreen.h>
 
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "bmesh.h"
 #include "camera.h"
 #include "mesh3.h"
 #include "rtree.h"
+#include "vec.h"
 
 Describe(bmesh33);
 
@@ -22,7 +27,7 @@ AfterEach(bmesh33) {}
  */
 static void
 create_approximate_sphere_bmesh33(
-  bmesh33_s **bmesh_handle, mesh3_s **mesh_handle, jet3 **jet_handle)
+  bmesh33_s **bmesh_handle, mesh3_s **mesh_handle, jet31t **jet_handle)
 {
   /**
    * First, set up the `mesh3_s` discretizing [-1, 1]^3.
@@ -79,25 +84,30 @@ create_approximate_sphere_bmesh33(
       for (int k = 0; k < 4; ++k)
         cells[5*i + j][k] = 8*i + cells[j][k];
 
+  mesh3_data_s data = {
+    .nverts = 64, .verts = verts,
+    .ncells = 40, .cells = cells
+  };
+
   mesh3_alloc(mesh_handle);
-  mesh3_init(*mesh_handle, &verts[0][0], 64, &cells[0][0], 40, false, NULL);
+  mesh3_init(*mesh_handle, &data, false, false, NULL);
 
   /**
    * Next, compute the jets for each vertex in `verts`.
    */
 
-  *jet_handle = malloc(64*sizeof(jet3));
+  *jet_handle = malloc(64*sizeof(jet31t));
 
   for (int i = 0; i < 8; ++i) {
     // We specially set the jet at (0, 0, 0) to zero to avoid a
     // singularity. This makes the overall approximation worse, but
     // this is just a test...
-    (*jet_handle)[8*i] = (jet3) {.f = 0, .Df = {0, 0, 0}};
+    (*jet_handle)[8*i] = (jet31t) {.f = 0, .Df = {0, 0, 0}};
 
     dbl *x;
     for (int j = 1; j < 8; ++j) {
       x = verts[8*i + j];
-      jet3 J = {.f = dbl3_norm(x)};
+      jet31t J = {.f = dbl3_norm(x)};
       dbl3_normalized(x, J.Df);
       (*jet_handle)[8*i + j] = J;
     }
@@ -113,7 +123,7 @@ create_approximate_sphere_bmesh33(
 
 static void
 destroy_approximate_sphere_bmesh33(
-  bmesh33_s **bmesh_handle, mesh3_s **mesh_handle, jet3 **jet_handle)
+  bmesh33_s **bmesh_handle, mesh3_s **mesh_handle, jet31t **jet_handle)
 {
   bmesh33_deinit(*bmesh_handle);
   bmesh33_dealloc(bmesh_handle);
@@ -128,7 +138,7 @@ destroy_approximate_sphere_bmesh33(
 #define SET_UP_APPROXIMATE_SPHERE()                         \
   bmesh33_s *bmesh;                                         \
   mesh3_s *mesh;                                            \
-  jet3 *jet;                                                \
+  jet31t *jet;                                                \
   create_approximate_sphere_bmesh33(&bmesh, &mesh, &jet);
 
 #define TEAR_DOWN_APPROXIMATE_SPHERE()                      \
@@ -183,6 +193,7 @@ Ensure(bmesh33, ray_intersects_level_works_on_approximate_sphere) {
   rtree_alloc(&rtree);
   rtree_init(rtree, 4, RTREE_SPLIT_STRATEGY_SURFACE_AREA);
   rtree_insert_bmesh33(rtree, level_bmesh);
+  rtree_build(rtree);
 
   camera_s camera = {
     .type = CAMERA_TYPE_ORTHOGRAPHIC,
@@ -196,7 +207,8 @@ Ensure(bmesh33, ray_intersects_level_works_on_approximate_sphere) {
   };
 
   FILE *fp = fopen(
-    "bmesh33_ray_intersects_level_works_on_approximate_sphere.txt", "r");
+    "data/bmesh33_ray_intersects_level_works_on_approximate_sphere.txt", "r");
+  assert_that(fp, is_non_null);
 
   ray3 ray;
   isect isect;
@@ -205,7 +217,7 @@ Ensure(bmesh33, ray_intersects_level_works_on_approximate_sphere) {
     for (size_t j = 0; j < camera.dim[1]; ++j) {
       // Shoot the (i, j)th camera ray
       ray = camera_get_ray_for_index(&camera, i, j);
-      rtree_intersect(rtree, &ray, &isect);
+      rtree_intersect(rtree, &ray, &isect, NULL);
 
       // Read the correct groundtruth value for the intersection
       // parameter from disk
@@ -215,13 +227,14 @@ Ensure(bmesh33, ray_intersects_level_works_on_approximate_sphere) {
       if (isinf(t_gt)) {
         assert_that(isinf(isect.t));
         assert_that(isect.obj, is_null);
-      } else {
-        assert_that_double(t_gt, is_nearly_double(isect.t));
-        assert_that(robj_get_type(isect.obj), is_equal_to(ROBJ_BMESH33_CELL));
+        continue;
       }
 
+      assert_that_double(t_gt, is_nearly_double(isect.t));
+      assert_that(isect.obj, is_non_null);
       if (isect.obj == NULL)
         continue;
+      assert_that(robj_get_type(isect.obj), is_equal_to(ROBJ_BMESH33_CELL));
 
       // Make sure that the intersected point lies on the correct
       // level set!
@@ -244,3 +257,102 @@ Ensure(bmesh33, ray_intersects_level_works_on_approximate_sphere) {
 
   TEAR_DOWN_APPROXIMATE_SPHERE();
 }
+
+Ensure(bmesh33, f_many_and_Df_many_match_evaluating_one_point_at_a_time) {
+  SET_UP_APPROXIMATE_SPHERE();
+
+  /* Sample a helix which winds in and out of the mesh, in order, so
+   * that most points are located by walking from the previous one.
+   * There are enough points to split them up into several blocks. */
+  size_t const n = 1000;
+  dbl3 *x = malloc(n*sizeof(dbl3));
+  for (size_t j = 0; j < n; ++j) {
+    dbl t = (dbl)j/(n - 1);
+    x[j][0] = 1.2*cos(16*JMM_PI*t);
+    x[j][1] = 1.2*sin(16*JMM_PI*t);
+    x[j][2] = 1.8*t - 0.9;
+  }
+
+  dbl *f = malloc(n*sizeof(dbl));
+  dbl3 *Df = malloc(n*sizeof(dbl3));
+
+  for (size_t num_threads = 1; num_threads <= 4; num_threads += 3) {
+    size_t num_outside = 0;
+
+    bmesh33_f_many(bmesh, n, x, f, num_threads);
+    bmesh33_Df_many(bmesh, n, x, Df, num_threads);
+
+    for (size_t j = 0; j < n; ++j) {
+      dbl f_gt = bmesh33_f(bmesh, x[j]);
+      dbl3 Df_gt; bmesh33_Df(bmesh, x[j], Df_gt);
+
+      if (isnan(f_gt)) {
+        ++num_outside;
+        assert_that(isnan(f[j]));
+        for (size_t i = 0; i < 3; ++i)
+          assert_that(isnan(Df_gt[i]) && isnan(Df[j][i]));
+        continue;
+      }
+
+      /* None of the points lie on a face shared by two cells, so
+       * they're located in the same cell both ways */
+      assert_that(f[j] == f_gt);
+      for (size_t i = 0; i < 3; ++i)
+        assert_that(Df[j][i] == Df_gt[i]);
+    }
+
+    /* Make sure we actually checked points outside of the mesh */
+    assert_that(num_outside, is_greater_than(0));
+    assert_that(num_outside, is_less_than(n));
+  }
+
+  free(x);
+  free(f);
+  free(Df);
+
+  TEAR_DOWN_APPROXIMATE_SPHERE();
+}
+
+Ensure(bmesh33, restricting_to_level_keeps_track_of_parent_cells) {
+  SET_UP_APPROXIMATE_SPHERE();
+
+  /* Without restricting, each cell is its own parent */
+  assert_that(bmesh33_get_parent_mesh_ptr(bmesh), is_equal_to(mesh));
+  for (size_t l = 0; l < bmesh33_num_cells(bmesh); ++l)
+    assert_that(bmesh33_get_parent_cell(bmesh, l), is_equal_to(l));
+
+  bmesh33_s *level_bmesh = bmesh33_restrict_to_level(bmesh, 0.5);
+  mesh3_s const *level_mesh = bmesh33_get_mesh_ptr(level_bmesh);
+  assert_that(bmesh33_get_parent_mesh_ptr(level_bmesh), is_equal_to(mesh));
+
+  /* Each cell of the level's mesh is a copy of its parent cell, and
+   * has the same Bezier tetra */
+  bool *is_parent = calloc(mesh3_ncells(mesh), sizeof(bool));
+  for (size_t l = 0; l < bmesh33_num_cells(level_bmesh); ++l) {
+    size_t lp = bmesh33_get_parent_cell(level_bmesh, l);
+    assert_that(lp, is_less_than(mesh3_ncells(mesh)));
+    assert_false(is_parent[lp]);
+    is_parent[lp] = true;
+
+    uint4 cv, cv_parent;
+    mesh3_cv(level_mesh, l, cv);
+    mesh3_cv(mesh, lp, cv_parent);
+    for (size_t i = 0; i < 4; ++i) {
+      dbl3 x, x_parent;
+      mesh3_copy_vert(level_mesh, cv[i], x);
+      mesh3_copy_vert(mesh, cv_parent[i], x_parent);
+      assert_that(dbl3_dist(x, x_parent) == 0);
+    }
+
+    bb33 const *bb = bmesh33_get_bb_ptr(level_bmesh, l);
+    bb33 const *bb_parent = bmesh33_get_bb_ptr(bmesh, lp);
+    for (size_t i = 0; i < 20; ++i)
+      assert_that(bb->c[i] == bb_parent->c[i]);
+  }
+  free(is_parent);
+
+  bmesh33_deinit(level_bmesh);
+  bmesh33_dealloc(&level_bmesh);
+
+  TEAR_DOWN_APPROXIMATE_SPHERE();
+}
@@ -0,0 +1,159 @@
+#include <cgreen/cgreen.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cube_mesh.h"
+#include "eik3.h"
+#include "eik3_batch.h"
+#include "mesh3.h"
+
+/* The number of vertices along each side of the test mesh */
+#define N 7
+
+#define NUM_SRCS 5
+
+/* Vertices of the cube mesh, on its boundary and inside it. */
+static dbl3 const xsrc[NUM_SRCS] = {
+  {-1, -1, -1}, {1, -1, 1}, {0, 0, 0}, {-1./3, 2./3, 1}, {1, 1, 1}
+};
+
+static dbl const rfac[NUM_SRCS] = {0.3, 0.3, 0.5, 0.2, 0.3};
+
+/* Solve for a single point source with `eik3`. */
+static eik3_s *solve_serially(mesh3_s const *mesh, dbl3 const xsrc,
+                              dbl rfac, jmm_error_e *error) {
+  eik3_s *eik;
+  eik3_alloc(&eik);
+  eik3_init(eik, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
+  eik3_add_pt_src_bcs(eik, xsrc, rfac);
+  *error = eik3_solve(eik);
+  return eik;
+}
+
+Describe(eik3_batch);
+BeforeEach(eik3_batch) {}
+AfterEach(eik3_batch) {}
+
+Ensure (eik3_batch, solves_match_serial_solves) {
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, NULL);
+
+  mesh3_s *mesh;
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, true, false, NULL);
+
+  size_t nverts = mesh3_nverts(mesh);
+
+  eik3_batch_s *batch;
+  eik3_batch_alloc(&batch);
+  eik3_batch_init(batch, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY,
+                  NUM_SRCS, xsrc, rfac, 3);
+  assert_that(eik3_batch_num_srcs(batch), is_equal_to(NUM_SRCS));
+  assert_that(eik3_batch_num_threads(batch), is_equal_to(3));
+  assert_that(eik3_batch_solve(batch), is_equal_to(JMM_ERROR_NONE));
+
+  jet31t const *jets = eik3_batch_get_jets_ptr(batch);
+
+  for (size_t i = 0; i < NUM_SRCS; ++i) {
+    assert_that(eik3_batch_get_error(batch, i), is_equal_to(JMM_ERROR_NONE));
+    assert_that(eik3_batch_get_jet_ptr(batch, i) == &jets[i*nverts]);
+
+    jmm_error_e error;
+    eik3_s *eik = solve_serially(mesh, xsrc[i], rfac[i], &error);
+    assert_that(error, is_equal_to(JMM_ERROR_NONE));
+
+    /* The solves don't share any state, so they should be exactly the
+     * same */
+    jet31t const *jet = eik3_get_jet_ptr(eik);
+    assert_that(memcmp(&jets[i*nverts], jet, nverts*sizeof(jet31t)),
+                is_equal_to(0));
+
+    eik3_deinit(eik);
+    eik3_dealloc(&eik);
+  }
+
+  eik3_batch_deinit(batch);
+  eik3_batch_dealloc(&batch);
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  cube_mesh_data_deinit(&data);
+}
+
+Ensure (eik3_batch, errors_are_reported_for_each_source) {
+  /* Add two tetrahedra which only share a vertex off to the side of
+   * the cube mesh. Once the shared vertex is accepted, the rest of
+   * the second tetrahedron can't be updated from it, so the solve
+   * for a source in the first tetrahedron fails. */
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, NULL);
+
+  size_t nverts = data.nverts + 7, ncells = data.ncells + 2;
+  dbl3 *verts = malloc(nverts*sizeof(dbl3));
+  memcpy(verts, data.verts, data.nverts*sizeof(dbl3));
+  dbl3 const bowtie_verts[7] = {
+    {3, 0, 0}, {4, 0, 0}, {3, 1, 0}, {3, 0, 1},
+    {5, 0, 0}, {5, 1, 0}, {5, 0, 1}
+  };
+  memcpy(&verts[data.nverts], bowtie_verts, sizeof(bowtie_verts));
+
+  uint4 *cells = malloc(ncells*sizeof(uint4));
+  memcpy(cells, data.cells, data.ncells*sizeof(uint4));
+  size_t l = data.nverts;
+  uint4 const bowtie_cells[2] = {
+    {l, l + 1, l + 2, l + 3},
+    {l + 1, l + 4, l + 5, l + 6}
+  };
+  memcpy(&cells[data.ncells], bowtie_cells, sizeof(bowtie_cells));
+
+  mesh3_data_s bowtie_data = {
+    .nverts = nverts, .verts = verts,
+    .ncells = ncells, .cells = cells
+  };
+
+  mesh3_s *mesh;
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &bowtie_data, true, false, NULL);
+
+  /* Alternate between sources in the cube mesh and the bowtie */
+  dbl3 const xsrc_bowtie[4] = {
+    {-1, -1, -1}, {3, 0, 0}, {0, 0, 0}, {3, 1, 0}
+  };
+  dbl const rfac_bowtie[4] = {0.3, 0.1, 0.3, 0.1};
+
+  eik3_batch_s *batch;
+  eik3_batch_alloc(&batch);
+  eik3_batch_init(batch, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY,
+                  4, xsrc_bowtie, rfac_bowtie, 2);
+
+  /* The first error is returned, and the other solves still run */
+  assert_that(eik3_batch_solve(batch), is_equal_to(JMM_ERROR_RUNTIME_ERROR));
+
+  for (size_t i = 0; i < 4; ++i) {
+    jmm_error_e error;
+    eik3_s *eik = solve_serially(mesh, xsrc_bowtie[i], rfac_bowtie[i], &error);
+    assert_that(error, is_equal_to(i % 2 == 0 ? JMM_ERROR_NONE :
+                                   JMM_ERROR_RUNTIME_ERROR));
+    assert_that(eik3_batch_get_error(batch, i), is_equal_to(error));
+
+    jet31t const *jet = eik3_get_jet_ptr(eik);
+    assert_that(memcmp(eik3_batch_get_jet_ptr(batch, i), jet,
+                       nverts*sizeof(jet31t)), is_equal_to(0));
+
+    eik3_deinit(eik);
+    eik3_dealloc(&eik);
+  }
+
+  eik3_batch_deinit(batch);
+  eik3_batch_dealloc(&batch);
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  free(verts);
+  free(cells);
+
+  cube_mesh_data_deinit(&data);
+}
@@ -0,0 +1,97 @@
+#include <cgreen/cgreen.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "cube_mesh.h"
+#include "eik3.h"
+#include "mesh3.h"
+#include "vec.h"
+
+/* The number of vertices along each side of the test mesh */
+#define N 11
+
+/* A slowness which increases linearly along the main diagonal of
+ * the cube, from 5/8 to 11/8. The generic solvers are slow to
+ * converge for slownesses which vary much faster than this. */
+static dbl s(dbl3 x) {
+  return 1 + dbl3_sum(x)/8;
+}
+
+static void Ds(dbl3 x, dbl3 Ds) {
+  (void)x;
+  Ds[0] = Ds[1] = Ds[2] = 1.0/8;
+}
+
+static void D2s(dbl3 x, dbl33 D2s) {
+  (void)x;
+  dbl33_zero(D2s);
+}
+
+static sfunc_s const sfunc_linear = {
+  .stype = STYPE_FUNC_PTR,
+  .funcs = {.s = s, .Ds = Ds, .D2s = D2s},
+  .data_jet31t = NULL,
+  .s_min = 5.0/8
+};
+
+/* With the point source in the middle of the mesh, plenty of the
+ * updates for each node come after it already has a good value, and
+ * can be skipped */
+static dbl3 const xsrc = {0, 0, 0};
+static dbl const rfac = 0.3;
+
+static mesh3_s *mesh;
+
+Describe(eik3_skip);
+
+BeforeEach(eik3_skip) {
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, NULL);
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, true, false, NULL);
+  cube_mesh_data_deinit(&data);
+}
+
+AfterEach(eik3_skip) {
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+}
+
+/* Solve for the point source with each slowness, with and without
+ * skipping updates which can't improve on the current value of the
+ * node they update, and check that the solutions are identical. */
+Ensure (eik3_skip, skipping_updates_does_not_change_solution) {
+  sfunc_s const *sfunc[2] = {&SFUNC_CONSTANT, &sfunc_linear};
+
+  for (size_t k = 0; k < 2; ++k) {
+    eik3_s *eik[2];
+    for (size_t i = 0; i < 2; ++i) {
+      eik3_alloc(&eik[i]);
+      eik3_init(eik[i], mesh, sfunc[k], HEAP_TYPE_BINARY);
+      eik3_set_skip_updates(eik[i], i == 0);
+      eik3_add_pt_src_bcs(eik[i], xsrc, rfac);
+      assert_that(eik3_solve(eik[i]), is_equal_to(JMM_ERROR_NONE));
+    }
+
+    /* Make sure that the lower bounds actually let us skip some of
+     * both kinds of updates, and that nothing is skipped otherwise */
+    assert_that(eik3_num_utetra_skipped(eik[0]), is_greater_than(0));
+    assert_that(eik3_num_utri_skipped(eik[0]), is_greater_than(0));
+    assert_that(eik3_num_utetra_skipped(eik[1]), is_equal_to(0));
+    assert_that(eik3_num_utri_skipped(eik[1]), is_equal_to(0));
+
+    for (size_t l = 0; l < mesh3_nverts(mesh); ++l) {
+      jet31t jet[2] = {eik3_get_jet(eik[0], l), eik3_get_jet(eik[1], l)};
+      assert_that(jet[0].f == jet[1].f);
+      for (size_t j = 0; j < 3; ++j)
+        assert_that(jet[0].Df[j] == jet[1].Df[j]
+                    || (isnan(jet[0].Df[j]) && isnan(jet[1].Df[j])));
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+      eik3_deinit(eik[i]);
+      eik3_dealloc(&eik[i]);
+    }
+  }
+}
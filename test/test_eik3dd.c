@@ -0,0 +1,90 @@
+#include <cgreen/cgreen.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "cube_mesh.h"
+#include "eik3.h"
+#include "eik3dd.h"
+#include "mesh3.h"
+
+/* The number of vertices along each side of the test mesh */
+#define N 11
+
+static mesh3_s *mesh;
+static eik3_s *eik;
+
+static dbl3 const xsrc = {-1, -1, -1};
+static dbl const rfac = 0.3;
+
+Describe(eik3dd);
+
+BeforeEach(eik3dd) {
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, NULL);
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, true, false, NULL);
+  cube_mesh_data_deinit(&data);
+
+  eik3_alloc(&eik);
+  eik3_init(eik, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
+  eik3_add_pt_src_bcs(eik, xsrc, rfac);
+  assert_that(eik3_solve(eik), is_equal_to(JMM_ERROR_NONE));
+}
+
+AfterEach(eik3dd) {
+  eik3_deinit(eik);
+  eik3_dealloc(&eik);
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+}
+
+Ensure (eik3dd, one_subdomain_matches_eik3) {
+  eik3dd_s *dd;
+  eik3dd_alloc(&dd);
+  eik3dd_init(dd, mesh, &SFUNC_CONSTANT, 1, 1);
+  eik3dd_add_pt_src_bcs(dd, xsrc, rfac);
+  assert_that(eik3dd_solve(dd, 0), is_equal_to(JMM_ERROR_NONE));
+  assert_that(eik3dd_num_rounds(dd), is_equal_to(1));
+
+  for (size_t l = 0; l < mesh3_nverts(mesh); ++l)
+    assert_that(eik3dd_get_T(dd, l) == eik3_get_T(eik, l));
+
+  eik3dd_deinit(dd);
+  eik3dd_dealloc(&dd);
+}
+
+Ensure (eik3dd, several_subdomains_match_eik3) {
+  /* The order nodes are accepted in depends on how the mesh is
+   * split up, and the values of T depend a little on that order. The
+   * two solutions should agree up to the discretization error. */
+  dbl h = 2.0/(N - 1);
+  double_absolute_tolerance_is(h*h/4);
+  double_relative_tolerance_is(1e-15);
+
+  for (size_t num_subdomains = 2; num_subdomains <= 8; num_subdomains *= 2) {
+    eik3dd_s *dd[2];
+    for (size_t i = 0; i < 2; ++i) {
+      eik3dd_alloc(&dd[i]);
+      eik3dd_init(dd[i], mesh, &SFUNC_CONSTANT, num_subdomains, 1 + 3*i);
+      eik3dd_add_pt_src_bcs(dd[i], xsrc, rfac);
+      assert_that(eik3dd_solve(dd[i], 0), is_equal_to(JMM_ERROR_NONE));
+    }
+    assert_that(eik3dd_num_rounds(dd[0]), is_greater_than(1));
+    assert_that(eik3dd_num_rounds(dd[1]), is_equal_to(eik3dd_num_rounds(dd[0])));
+
+    for (size_t l = 0; l < mesh3_nverts(mesh); ++l) {
+      dbl T = eik3dd_get_T(dd[0], l);
+      assert_that_double(T, is_nearly_double(eik3_get_T(eik, l)));
+
+      /* Using more threads shouldn't change anything */
+      assert_that(eik3dd_get_T(dd[1], l) == T);
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+      eik3dd_deinit(dd[i]);
+      eik3dd_dealloc(&dd[i]);
+    }
+  }
+}
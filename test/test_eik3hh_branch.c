@@ -0,0 +1,173 @@
+#include <cgreen/cgreen.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "camera.h"
+#include "cube_mesh.h"
+#include "eik3hh.h"
+#include "eik3hh_branch.h"
+#include "mesh3.h"
+#include "vec.h"
+
+/* The number of vertices along each side of the test mesh */
+#define N 9
+
+/* Look at the origin from `pos` with a perspective camera. */
+static void init_camera(camera_s *camera, dbl3 const pos,
+                        size_t num_rows, size_t num_cols) {
+  camera_reset(camera);
+  camera->type = CAMERA_TYPE_PERSPECTIVE;
+  dbl3_copy(pos, camera->pos);
+  dbl3_normalized(pos, camera->look);
+  dbl3_negate(camera->look);
+
+  dbl3 e3 = {0, 0, 1};
+  dbl3_cross(e3, camera->look, camera->left);
+  dbl3_normalize(camera->left);
+  dbl3_cross(camera->look, camera->left, camera->up);
+
+  camera->fovy = 45;
+  camera->aspect = ((dbl)num_cols)/num_rows;
+  camera->dim[0] = num_rows;
+  camera->dim[1] = num_cols;
+}
+
+static dbl3 const xsrc = {0, 0, 0};
+
+/* The level set which is rendered. It lies inside of the cube, so
+ * the rays for many pixels hit the surface, the level set, and then
+ * the surface again. */
+static dbl const T = 0.6;
+
+static mesh3_s *mesh;
+static eik3hh_s *hh;
+static eik3hh_branch_s *branch;
+
+Describe(eik3hh_branch);
+
+BeforeEach(eik3hh_branch) {
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, NULL);
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, true, false, NULL);
+  cube_mesh_data_deinit(&data);
+
+  eik3hh_alloc(&hh);
+  eik3hh_init_with_pt_src(hh, mesh, 340.3, 0.3, xsrc);
+
+  branch = eik3hh_get_root_branch(hh);
+  eik3hh_branch_solve(branch, false);
+}
+
+AfterEach(eik3hh_branch) {
+  eik3hh_deinit(hh);
+  eik3hh_dealloc(&hh);
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+}
+
+Ensure (eik3hh_branch, cached_render_matches_uncached_render) {
+  /* Hits with the cube's faces along its edges and corners are traced
+   * in a slightly different order depending on whether the ray is
+   * advanced past the level set, so allow for a little roundoff */
+  double_absolute_tolerance_is(1e-12);
+  double_relative_tolerance_is(1e-12);
+
+  camera_s camera;
+  init_camera(&camera, (dbl3){3, 2, 1.5}, 40, 56);
+
+  size_t num_pixels = camera.dim[0]*camera.dim[1];
+  dbl4 *img[2];
+  for (size_t k = 0; k < 2; ++k)
+    img[k] = malloc(num_pixels*sizeof(dbl4));
+
+  eik3hh_branch_render_frame(branch, &camera, T, false, img[0]);
+  size_t num_uncached =
+    eik3hh_branch_render_frame(branch, &camera, T, true, img[1]);
+
+  /* The surface is half opaque, so no ray needs enough surface hits
+   * to overflow the cache */
+  assert_that(num_uncached, is_equal_to(0));
+
+  size_t num_opaque = 0;
+  for (size_t p = 0; p < num_pixels; ++p) {
+    for (size_t k = 0; k < 4; ++k)
+      assert_that_double(img[1][p][k], is_nearly_double(img[0][p][k]));
+    num_opaque += img[0][p][3] == 1;
+  }
+
+  /* Make sure the cube is actually in view */
+  assert_that(num_opaque, is_greater_than(num_pixels/4));
+  assert_that(num_opaque, is_less_than(num_pixels));
+
+  for (size_t k = 0; k < 2; ++k)
+    free(img[k]);
+}
+
+Ensure (eik3hh_branch, finished_preview_matches_full_render) {
+  camera_s camera;
+  init_camera(&camera, (dbl3){3, 2, 1.5}, 40, 56);
+
+  size_t num_pixels = camera.dim[0]*camera.dim[1];
+  dbl4 *img[2];
+  for (size_t k = 0; k < 2; ++k)
+    img[k] = malloc(num_pixels*sizeof(dbl4));
+
+  eik3hh_branch_render_frame(branch, &camera, T, false, img[0]);
+
+  eik3hh_branch_preview_s *preview;
+  eik3hh_branch_preview_alloc(&preview);
+  eik3hh_branch_preview_init(preview, branch, 8, 2);
+  eik3hh_branch_preview_begin(preview, &camera, T);
+
+  /* The coarsest lattice covers the image with 5 x 7 blocks */
+  size_t num_traced = eik3hh_branch_preview_get_num_traced(preview);
+  assert_that(num_traced, is_equal_to(6*8));
+
+  size_t num_refinements = 0;
+  while (eik3hh_branch_preview_refine(preview)) {
+    size_t num_traced_new = eik3hh_branch_preview_get_num_traced(preview);
+    assert_that(num_traced_new, is_greater_than(num_traced));
+    num_traced = num_traced_new;
+    ++num_refinements;
+  }
+  assert_that(num_refinements, is_equal_to(3));
+
+  /* Finishing a finished preview shouldn't trace anything else */
+  eik3hh_branch_preview_finish(preview);
+  assert_that(eik3hh_branch_preview_get_num_traced(preview),
+              is_equal_to(num_traced));
+
+  eik3hh_branch_preview_get_image(preview, img[1]);
+
+  /* Every sampled pixel is traced exactly as in the full render. The
+   * rest were interpolated from samples whose channels agree to within
+   * 0.05, and the image is smooth enough away from the samples that
+   * they shouldn't be off by much more than that */
+  size_t num_sampled = 0;
+  dbl max_diff = 0;
+  for (size_t i = 0; i < camera.dim[0]; ++i) {
+    for (size_t j = 0; j < camera.dim[1]; ++j) {
+      size_t p = i*camera.dim[1] + j;
+      bool sampled = eik3hh_branch_preview_is_sampled(preview, i, j);
+      num_sampled += sampled;
+      for (size_t k = 0; k < 4; ++k) {
+        if (sampled)
+          assert_that(img[1][p][k] == img[0][p][k]);
+        max_diff = fmax(max_diff, fabs(img[1][p][k] - img[0][p][k]));
+      }
+    }
+  }
+  assert_that_double(max_diff, is_less_than_double(0.1));
+
+  /* The preview should have saved some work */
+  assert_that(num_sampled, is_less_than(num_pixels));
+
+  eik3hh_branch_preview_deinit(preview);
+  eik3hh_branch_preview_dealloc(&preview);
+
+  for (size_t k = 0; k < 2; ++k)
+    free(img[k]);
+}
@@ -0,0 +1,145 @@
+#include <cgreen/cgreen.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framesink.h"
+
+#define PATH "test_framesink.bin"
+
+static size_t const dim[2] = {3, 5};
+
+/* Fill `img` with a pattern which depends on the frame `k`. The
+ * channels are multiples of 1/4, so they survive being quantized. */
+static void fill_frame(dbl4 *img, size_t k) {
+  for (size_t i = 0; i < dim[0]*dim[1]; ++i)
+    for (size_t j = 0; j < 4; ++j)
+      img[i][j] = ((i + j + k)%5)/4.0;
+}
+
+static void write_frames(framesink_format_e format, size_t k0, size_t k1,
+                         bool background) {
+  framesink_s *sink;
+  framesink_alloc(&sink);
+  assert_that(framesink_init(sink, FRAMESINK_TYPE_CONTAINER, PATH, format,
+                             dim, background), is_equal_to(JMM_ERROR_NONE));
+  assert_that(framesink_get_num_frames(sink), is_equal_to(k0));
+
+  dbl4 *img = malloc(dim[0]*dim[1]*sizeof(dbl4));
+  for (size_t k = k0; k < k1; ++k) {
+    fill_frame(img, k);
+    assert_that(framesink_write(sink, img, k/10.0),
+                is_equal_to(JMM_ERROR_NONE));
+  }
+  free(img);
+
+  assert_that(framesink_flush(sink), is_equal_to(JMM_ERROR_NONE));
+  assert_that(framesink_get_num_frames(sink), is_equal_to(k1));
+
+  assert_that(framesink_deinit(sink), is_equal_to(JMM_ERROR_NONE));
+  framesink_dealloc(&sink);
+}
+
+/* Read the container back following the layout documented in
+ * framesink.h, and check that it holds frames `0, ..., num_frames - 1`
+ * as written by `write_frames`. */
+static void check_container(size_t num_frames) {
+  FILE *fp = fopen(PATH, "rb");
+  assert_that(fp, is_non_null);
+
+  char magic[8];
+  uint32_t version, format;
+  uint64_t header_dim[2];
+  assert_that(fread(magic, sizeof(magic), 1, fp), is_equal_to(1));
+  assert_that(fread(&version, sizeof(version), 1, fp), is_equal_to(1));
+  assert_that(fread(&format, sizeof(format), 1, fp), is_equal_to(1));
+  assert_that(fread(header_dim, sizeof(header_dim), 1, fp), is_equal_to(1));
+  assert_that(memcmp(magic, FRAMESINK_MAGIC, sizeof(magic)), is_equal_to(0));
+  assert_that(version, is_equal_to(FRAMESINK_VERSION));
+  assert_that(format, is_equal_to(FRAMESINK_FORMAT_RGBA16));
+  assert_that(header_dim[0], is_equal_to(dim[0]));
+  assert_that(header_dim[1], is_equal_to(dim[1]));
+
+  uint64_t index_offset, footer_num_frames;
+  assert_that(fseek(fp, -24, SEEK_END), is_equal_to(0));
+  assert_that(fread(&index_offset, sizeof(uint64_t), 1, fp), is_equal_to(1));
+  assert_that(fread(&footer_num_frames, sizeof(uint64_t), 1, fp),
+              is_equal_to(1));
+  assert_that(fread(magic, sizeof(magic), 1, fp), is_equal_to(1));
+  assert_that(memcmp(magic, FRAMESINK_MAGIC, sizeof(magic)), is_equal_to(0));
+  assert_that(footer_num_frames, is_equal_to(num_frames));
+
+  /* The index should be right before the footer */
+  size_t frame_size = dim[0]*dim[1]*4*sizeof(uint16_t);
+  assert_that(index_offset, is_equal_to(32 + num_frames*frame_size));
+  assert_that(ftell(fp),
+              is_equal_to(index_offset + num_frames*2*sizeof(uint64_t) + 24));
+
+  dbl4 *img = malloc(dim[0]*dim[1]*sizeof(dbl4));
+  uint16_t *buf = malloc(frame_size);
+  for (size_t k = 0; k < num_frames; ++k) {
+    uint64_t offset;
+    dbl time;
+    assert_that(fseek(fp, index_offset + k*2*sizeof(uint64_t), SEEK_SET),
+                is_equal_to(0));
+    assert_that(fread(&offset, sizeof(offset), 1, fp), is_equal_to(1));
+    assert_that(fread(&time, sizeof(time), 1, fp), is_equal_to(1));
+    assert_that(offset, is_equal_to(32 + k*frame_size));
+    assert_that(time == k/10.0);
+
+    assert_that(fseek(fp, offset, SEEK_SET), is_equal_to(0));
+    assert_that(fread(buf, frame_size, 1, fp), is_equal_to(1));
+    fill_frame(img, k);
+    for (size_t i = 0; i < dim[0]*dim[1]; ++i)
+      for (size_t j = 0; j < 4; ++j)
+        assert_that(buf[4*i + j] == (uint16_t)(UINT16_MAX*img[i][j] + 0.5));
+  }
+  free(buf);
+  free(img);
+
+  fclose(fp);
+}
+
+Describe(framesink);
+
+BeforeEach(framesink) {
+  remove(PATH);
+}
+
+AfterEach(framesink) {
+  remove(PATH);
+}
+
+Ensure (framesink, container_can_be_reopened_and_appended_to) {
+  for (int background = 0; background < 2; ++background) {
+    remove(PATH);
+
+    write_frames(FRAMESINK_FORMAT_RGBA16, 0, 3, background);
+    check_container(3);
+
+    /* Appending should pick up after the frames already written */
+    write_frames(FRAMESINK_FORMAT_RGBA16, 3, 7, !background);
+    check_container(7);
+
+    /* Reopening without writing anything should leave it as is */
+    write_frames(FRAMESINK_FORMAT_RGBA16, 7, 7, background);
+    check_container(7);
+  }
+}
+
+Ensure (framesink, reopening_with_different_format_fails) {
+  write_frames(FRAMESINK_FORMAT_RGBA16, 0, 2, false);
+
+  framesink_s *sink;
+  framesink_alloc(&sink);
+  assert_that(framesink_init(sink, FRAMESINK_TYPE_CONTAINER, PATH,
+                             FRAMESINK_FORMAT_RGBA8, dim, false),
+              is_equal_to(JMM_ERROR_BAD_ARGUMENTS));
+  assert_that(framesink_deinit(sink), is_equal_to(JMM_ERROR_BAD_ARGUMENTS));
+  framesink_dealloc(&sink);
+
+  /* The container should be left alone */
+  check_container(2);
+}
@@ -112,3 +112,106 @@ Ensure(geom, ray3_intersects_tri3_works) {
   assert_that(hit);
   assert_that_double(t, is_nearly_double(0));
 }
+
+Ensure(geom, ray3_intersect_rect3_works) {
+  rect3 rect = {.min = {0, 0, 0}, .max = {1, 1, 1}};
+  ray3 ray;
+
+  ray = (ray3) {
+    .org = {-1, 0.5, 0.5},
+    .dir = {1, 0, 0}
+  };
+  assert_that_double(ray3_intersect_rect3(&ray, &rect), is_nearly_double(1));
+
+  ray = (ray3) {
+    .org = {0.5, 0.5, 0.5},
+    .dir = {1/SQRT3, 1/SQRT3, 1/SQRT3}
+  };
+  assert_that_double(ray3_intersect_rect3(&ray, &rect), is_nearly_double(0));
+
+  ray = (ray3) {
+    .org = {-1, 0.5, 0.5},
+    .dir = {-1, 0, 0}
+  };
+  assert_that(isinf(ray3_intersect_rect3(&ray, &rect)));
+
+  ray = (ray3) {
+    .org = {-1, 0, 0.5},
+    .dir = {1, 0, 0}
+  };
+  assert_that_double(ray3_intersect_rect3(&ray, &rect), is_nearly_double(1));
+
+  ray = (ray3) {
+    .org = {-1, 1.5, 0.5},
+    .dir = {1, 0, 0}
+  };
+  assert_that(isinf(ray3_intersect_rect3(&ray, &rect)));
+}
+
+Ensure(geom, rect3_surface_area_works) {
+  rect3 rect = {.min = {0, 0, 0}, .max = {1, 2, 3}};
+  assert_that_double(rect3_surface_area(&rect), is_nearly_double(22));
+
+  rect3_insert_rect3(&rect, &(rect3) {.min = {-1, 0, 0}, .max = {0, 1, 1}});
+  assert_that_double(rect3_surface_area(&rect), is_nearly_double(32));
+}
+
+Ensure(geom, ray3_clip_to_bary_map_works) {
+  tetra3 tetra = {.v = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+
+  dbl34 A;
+  tetra3_get_bary_map(&tetra, A);
+
+  ray3 ray;
+  dbl s[2];
+  dbl4 b[2];
+
+  ray = (ray3) {
+    .org = {-1, 0.25, 0.25},
+    .dir = {1, 0, 0}
+  };
+  assert_that(ray3_clip_to_bary_map(&ray, A, s, b));
+  assert_that_double(s[0], is_nearly_double(1));
+  assert_that_double(s[1], is_nearly_double(1.5));
+  assert_that_double(b[0][0], is_nearly_double(0.5));
+  assert_that_double(b[0][1], is_nearly_double(0));
+  assert_that_double(b[1][0], is_nearly_double(0));
+  assert_that_double(b[1][1], is_nearly_double(0.5));
+
+  ray = (ray3) {
+    .org = {0.1, 0.1, 0.1},
+    .dir = {0, 0, 1}
+  };
+  assert_that(ray3_clip_to_bary_map(&ray, A, s, b));
+  assert_that_double(s[0], is_nearly_double(0));
+  assert_that_double(s[1], is_nearly_double(0.7));
+
+  ray = (ray3) {
+    .org = {-1, 0.25, 0.25},
+    .dir = {-1, 0, 0}
+  };
+  assert_false(ray3_clip_to_bary_map(&ray, A, s, b));
+
+  ray = (ray3) {
+    .org = {-1, 1, 1},
+    .dir = {1, 0, 0}
+  };
+  assert_false(ray3_clip_to_bary_map(&ray, A, s, b));
+
+  /* A ray lying in a face should be clipped by both of the
+   * tetrahedra sharing it, even though rounding error makes the
+   * barycentric coordinate opposite the face slightly negative along
+   * the ray (without a tolerance, it misses both of these) */
+  tetra3 shared_face_tetra[2] = {
+    {.v = {{0.1, 0.1, -1}, {0, 0.25, -1}, {-1, 0, -1}, {0.5, 1, -0.5}}},
+    {.v = {{0.1, 0.1, -1}, {0, 0.25, -1}, {-1, 0, -1}, {0.5, 1, -1.5}}}
+  };
+  for (size_t i = 0; i < 2; ++i) {
+    tetra3_get_bary_map(&shared_face_tetra[i], A);
+    ray = (ray3) {
+      .org = {-5, (0.1 + 0.25)/3, -1},
+      .dir = {1, 0, 0}
+    };
+    assert_that(ray3_clip_to_bary_map(&ray, A, s, b));
+  }
+}
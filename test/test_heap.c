@@ -0,0 +1,153 @@
+#include <cgreen/cgreen.h>
+
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_rng.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "heap.h"
+
+#define N 1000
+
+/* The keys and positions of the nodes in a test heap. The keys are
+ * shared between heaps so that they can be compared node for
+ * node. */
+typedef struct {
+  dbl *key;
+  int pos[N];
+} context_s;
+
+static dbl value(void *context, int ind) {
+  return ((context_s *)context)->key[ind];
+}
+
+static void setpos(void *context, int ind, int pos) {
+  ((context_s *)context)->pos[ind] = pos;
+}
+
+/* A node waiting in a bucket has a negative position other than
+ * `NO_INDEX` (see heap.h) */
+static bool is_deferred(context_s const *context, int ind) {
+  return context->pos[ind] < 0 && context->pos[ind] != NO_INDEX;
+}
+
+static gsl_rng *rng;
+static dbl key[N];
+static context_s bin_context, bkt_context;
+static heap_s *bin, *bkt;
+
+Describe(heap);
+
+BeforeEach(heap) {
+  rng = gsl_rng_alloc(gsl_rng_mt19937);
+
+  for (int i = 0; i < N; ++i) {
+    key[i] = INFINITY;
+    bin_context.pos[i] = bkt_context.pos[i] = NO_INDEX;
+  }
+  bin_context.key = bkt_context.key = key;
+
+  heap_alloc(&bin);
+  heap_init(bin, HEAP_TYPE_BINARY, 16, value, setpos, &bin_context);
+
+  heap_alloc(&bkt);
+  heap_init(bkt, HEAP_TYPE_BUCKET, 16, value, setpos, &bkt_context);
+  heap_set_bucket_width(bkt, 1.0/32);
+}
+
+AfterEach(heap) {
+  heap_deinit(bkt);
+  heap_dealloc(&bkt);
+
+  heap_deinit(bin);
+  heap_dealloc(&bin);
+
+  gsl_rng_free(rng);
+}
+
+Ensure (heap, bucket_heap_buckets_nodes_inserted_with_infinite_keys) {
+  /* Insert every node with an infinite key, like `eik3` does when a
+   * node becomes `TRIAL`, and then give each a finite key */
+  for (int i = 0; i < N; ++i) {
+    heap_insert(bin, i);
+    heap_insert(bkt, i);
+  }
+  assert_that(heap_size(bkt), is_equal_to(N));
+
+  key[0] = 0;
+  heap_swim(bin, bin_context.pos[0]);
+  heap_swim(bkt, bkt_context.pos[0]);
+  assert_false(is_deferred(&bkt_context, 0));
+
+  for (int i = 1; i < N; ++i) {
+    key[i] = gsl_ran_flat(rng, 0, 1);
+    heap_swim(bin, bin_context.pos[i]);
+    heap_swim(bkt, bkt_context.pos[i]);
+  }
+  assert_that(heap_size(bkt), is_equal_to(N));
+
+  /* Every node whose key is past the first bucket should have been
+   * moved into a bucket */
+  int num_deferred = 0;
+  for (int i = 0; i < N; ++i) {
+    if (key[i] >= 1.0/32)
+      assert_true(is_deferred(&bkt_context, i));
+    num_deferred += is_deferred(&bkt_context, i);
+  }
+  assert_that(num_deferred, is_greater_than(N/2));
+
+  /* Make sure the nodes come out in the same order */
+  for (int i = 0; i < N; ++i) {
+    int ind = heap_front(bin);
+    assert_that(heap_front(bkt), is_equal_to(ind));
+    heap_pop(bin);
+    heap_pop(bkt);
+    assert_that(bkt_context.pos[ind], is_equal_to(NO_INDEX));
+  }
+  assert_that(heap_size(bkt), is_equal_to(0));
+}
+
+Ensure (heap, bucket_heap_pops_in_same_order_as_binary_heap) {
+  /* Simulate a marching method: each time a node is popped, some of
+   * the remaining nodes are inserted or have their keys decreased to
+   * values a little past the popped node's key */
+  bool inserted[N] = {false};
+
+  key[0] = 0;
+  inserted[0] = true;
+  heap_insert(bin, 0);
+  heap_insert(bkt, 0);
+
+  int num_popped = 0, num_deferred = 0;
+  while (heap_size(bin) > 0) {
+    assert_that(heap_size(bkt), is_equal_to(heap_size(bin)));
+
+    int ind = heap_front(bin);
+    assert_that(heap_front(bkt), is_equal_to(ind));
+    dbl key0 = key[ind];
+    heap_pop(bin);
+    heap_pop(bkt);
+    ++num_popped;
+
+    for (int j = 0; j < 8; ++j) {
+      int i = (int)gsl_ran_flat(rng, 0, N);
+      if (i == N || (inserted[i] && bin_context.pos[i] == NO_INDEX))
+        continue;
+      if (!inserted[i]) {
+        inserted[i] = true;
+        heap_insert(bin, i);
+        heap_insert(bkt, i);
+      }
+      dbl new_key = key0 + gsl_ran_flat(rng, 0, 1);
+      if (new_key < key[i]) {
+        key[i] = new_key;
+        heap_swim(bin, bin_context.pos[i]);
+        heap_swim(bkt, bkt_context.pos[i]);
+      }
+      num_deferred += is_deferred(&bkt_context, i);
+    }
+  }
+  assert_that(heap_size(bkt), is_equal_to(0));
+  assert_that(num_popped, is_greater_than(N/2));
+  assert_that(num_deferred, is_greater_than(0));
+}
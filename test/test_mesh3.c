@@ -1,33 +1,47 @@
 #include <cgreen/cgreen.h>
 
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_rng.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cube_mesh.h"
 #include "mesh3.h"
 #include "util.h"
+#include "vec.h"
+
+#include "macros.h"
 
 Describe(mesh3);
 BeforeEach(mesh3) {}
 AfterEach(mesh3) {}
 
 #define SET_UP_CUBE_MESH()                          \
-  dbl verts[24] = {                                 \
-    0, 0, 0,                                        \
-    0, 0, 1,                                        \
-    0, 1, 0,                                        \
-    0, 1, 1,                                        \
-    1, 0, 0,                                        \
-    1, 0, 1,                                        \
-    1, 1, 0,                                        \
-    1, 1, 1                                         \
+  dbl3 verts[8] = {                                 \
+    {0, 0, 0},                                      \
+    {0, 0, 1},                                      \
+    {0, 1, 0},                                      \
+    {0, 1, 1},                                      \
+    {1, 0, 0},                                      \
+    {1, 0, 1},                                      \
+    {1, 1, 0},                                      \
+    {1, 1, 1}                                       \
   };                                                \
-  size_t cells[20] = {                              \
-    0, 2, 3, 6,                                     \
-    0, 4, 5, 6,                                     \
-    0, 3, 5, 6,                                     \
-    0, 1, 3, 5,                                     \
-    3, 5, 6, 7                                      \
+  uint4 cells[5] = {                                \
+    {0, 2, 3, 6},                                   \
+    {0, 4, 5, 6},                                   \
+    {0, 3, 5, 6},                                   \
+    {0, 1, 3, 5},                                   \
+    {3, 5, 6, 7}                                    \
+  };                                                \
+  mesh3_data_s data = {                             \
+    .nverts = 8, .verts = verts,                    \
+    .ncells = 5, .cells = cells                     \
   };                                                \
   mesh3_s *mesh;                                    \
   mesh3_alloc(&mesh);                               \
-  mesh3_init(mesh, verts, 8, cells, 5, true, NULL);
+  mesh3_init(mesh, &data, true, false, NULL);
 
 #define TEAR_DOWN_MESH()                        \
   mesh3_deinit(mesh);                           \
@@ -83,6 +97,113 @@ Ensure (mesh3, nvv_works_for_cube) {
   TEAR_DOWN_MESH();
 }
 
+Ensure (mesh3, vv_ptr_works_for_cube) {
+  SET_UP_CUBE_MESH();
+
+  size_t nvv_gt[8] = {6, 3, 3, 6, 3, 6, 6, 3};
+  size_t vv_gt[8][6] = {
+    {1, 2, 3, 4, 5, 6},
+    {0, 3, 5},
+    {0, 3, 6},
+    {0, 1, 2, 5, 6, 7},
+    {0, 5, 6},
+    {0, 1, 3, 4, 6, 7},
+    {0, 2, 3, 4, 5, 7},
+    {3, 5, 6}
+  };
+
+  for (int i = 0; i < 8; ++i) {
+    size_t nvv;
+    size_t const *vv_ptr = mesh3_get_vv_ptr(mesh, i, &nvv);
+    assert_that(nvv, is_equal_to(nvv_gt[i]));
+
+    /* The order of the neighbors isn't specified, so sort them
+     * before comparing */
+    size_t vv[6];
+    memcpy(vv, vv_ptr, nvv*sizeof(size_t));
+    qsort(vv, nvv, sizeof(size_t), (compar_t)compar_size_t);
+
+    for (size_t j = 0; j < nvv; ++j)
+      assert_that(vv[j], is_equal_to(vv_gt[i][j]));
+  }
+
+  TEAR_DOWN_MESH();
+}
+
+static bool has_edge(size_t const (*ve)[2], size_t nve, size_t const le[2]) {
+  for (size_t i = 0; i < nve; ++i)
+    if ((ve[i][0] == le[0] && ve[i][1] == le[1]) ||
+        (ve[i][0] == le[1] && ve[i][1] == le[0]))
+      return true;
+  return false;
+}
+
+Ensure (mesh3, topology_matches_on_the_fly_queries_for_cube) {
+  SET_UP_CUBE_MESH();
+
+  mesh3_s *topo;
+  mesh3_alloc(&topo);
+  mesh3_init(topo, &data, false, true, NULL);
+
+  assert_that(mesh3_has_topology(mesh), is_false);
+  assert_that(mesh3_has_topology(topo), is_true);
+
+  /* 5 cells with 4 faces each, and 12 boundary faces which are only
+   * counted once */
+  assert_that(mesh3_nfaces(topo), is_equal_to(16));
+
+  for (size_t i = 0; i < mesh3_nfaces(topo); ++i) {
+    uint3 lf;
+    mesh3_get_face(topo, i, lf);
+    assert_that(lf[0] < lf[1] && lf[1] < lf[2]);
+    assert_that(mesh3_get_face_index(topo, lf), is_equal_to(i));
+    assert_that(mesh3_get_face_index(topo, (uint3) {lf[2], lf[0], lf[1]}),
+                is_equal_to(i));
+
+    uint2 fc, fc_gt;
+    mesh3_fc(topo, lf, fc);
+    mesh3_fc(mesh, lf, fc_gt);
+    assert_that(mesh3_nfc(topo, lf), is_equal_to(mesh3_nfc(mesh, lf)));
+    if (fc_gt[1] != (size_t)NO_INDEX && fc_gt[0] > fc_gt[1])
+      SWAP(fc_gt[0], fc_gt[1]);
+    assert_that(fc[0], is_equal_to(fc_gt[0]));
+    assert_that(fc[1], is_equal_to(fc_gt[1]));
+  }
+
+  /* (0, 1, 7) isn't a face of the mesh */
+  assert_that(mesh3_get_face_index(topo, (uint3) {0, 1, 7}),
+              is_equal_to((size_t)NO_INDEX));
+
+  for (size_t l = 0; l < 8; ++l) {
+    size_t nvf;
+    size_t const *vf = mesh3_get_vf_ptr(topo, l, &nvf);
+    assert_that(nvf, is_equal_to(mesh3_nvf(mesh, l)));
+
+    size_t vf_gt[8][3];
+    mesh3_vf(mesh, l, vf_gt);
+    for (size_t i = 0; i < nvf; ++i) {
+      uint3 lf;
+      mesh3_get_face(topo, vf[i], lf);
+      SORT3(vf_gt[i][0], vf_gt[i][1], vf_gt[i][2]);
+      assert_that(lf, is_equal_to_contents_of(vf_gt[i], sizeof(uint3)));
+    }
+
+    size_t nve;
+    uint2 const *ve = mesh3_get_ve_ptr(topo, l, &nve);
+    assert_that(nve, is_equal_to(mesh3_nve(mesh, l)));
+
+    size_t ve_gt[16][2];
+    mesh3_ve(mesh, l, ve_gt);
+    for (size_t i = 0; i < nve; ++i)
+      assert_that(has_edge(ve_gt, nve, ve[i]));
+  }
+
+  mesh3_deinit(topo);
+  mesh3_dealloc(&topo);
+
+  TEAR_DOWN_MESH();
+}
+
 Ensure (mesh3, ncc_works_for_cube) {
   SET_UP_CUBE_MESH();
 
@@ -160,8 +281,10 @@ Ensure (mesh3, nec_works_for_cube) {
   int nec, k;
   for (size_t i = 0; i < 8; ++i) {
     for (size_t j = 0; j < 8; ++j) {
+      if (i == j)
+        continue;
       k = find_edge(edges, num_edges, i, j);
-      nec = mesh3_nec(mesh, i, j);
+      nec = mesh3_nec(mesh, (size_t[2]) {i, j});
       if (k < num_edges) {
         assert_that(nec, is_equal_to(nec_gt[k]));
       } else {
@@ -250,7 +373,7 @@ Ensure (mesh3, ec_works_for_cube) {
   size_t ec[3];
 
   for (int i = 0; i < num_edges; ++i) {
-    mesh3_ec(mesh, edges[i][0], edges[i][1], ec);
+    mesh3_ec(mesh, (size_t[2]) {edges[i][0], edges[i][1]}, ec);
     qsort(ec, nec[i], sizeof(size_t), (compar_t)compar_size_t);
     assert_that(ec, is_equal_to_contents_of(ec_gt[i], nec[i]*sizeof(size_t)));
   }
@@ -309,3 +432,341 @@ Ensure (mesh3, get_num_diffractors_for_cube) {
 
   TEAR_DOWN_MESH();
 }
+
+Ensure (mesh3, submesh_inherits_bd_info_for_cube) {
+  SET_UP_CUBE_MESH();
+
+  /* Cut the cell in the middle of the cube out, leaving the four
+   * corner cells. Number the vertices backwards. */
+  size_t l[8] = {7, 6, 5, 4, 3, 2, 1, 0};
+  size_t lc[4] = {0, 1, 3, 4};
+
+  mesh3_s *sub;
+  mesh3_alloc(&sub);
+  mesh3_init_submesh(sub, mesh, 8, l, 4, lc);
+
+  assert_that(mesh3_nverts(sub), is_equal_to(8));
+  assert_that(mesh3_ncells(sub), is_equal_to(4));
+
+  for (size_t i = 0; i < 8; ++i)
+    assert_that(mesh3_bdv(sub, i), is_equal_to(mesh3_bdv(mesh, l[i])));
+
+  /* Each corner cell has three faces on the boundary of the cube,
+   * which are all of its boundary faces. The faces of the middle
+   * cell aren't boundary faces, even though they're exposed. */
+  assert_that(mesh3_nbdf(sub), is_equal_to(mesh3_nbdf(mesh)));
+  for (size_t i = 0; i < mesh3_nbdf(sub); ++i) {
+    size_t lf[3];
+    mesh3_get_bdf_inds(sub, i, lf);
+    for (size_t j = 0; j < 3; ++j)
+      lf[j] = l[lf[j]];
+    assert_true(mesh3_is_bdf(mesh, lf));
+  }
+  assert_false(mesh3_is_bdf(sub, (size_t[3]) {7 - 0, 7 - 3, 7 - 5}));
+
+  assert_that(mesh3_nbde(sub), is_equal_to(mesh3_nbde(mesh)));
+
+  assert_that(mesh3_get_num_diffractors(sub), is_equal_to(0));
+
+  mesh3_deinit(sub);
+  mesh3_dealloc(&sub);
+
+  TEAR_DOWN_MESH();
+}
+
+/* The number of vertices along each side of the grid mesh */
+/* The number of vertices along each side of the jittered cube mesh
+ * used for the point location tests */
+#define N 7
+
+/* Find the first cell containing `x` by checking every cell. */
+static size_t find_cell_by_linear_scan(mesh3_s const *mesh, dbl3 const x) {
+  for (size_t lc = 0; lc < mesh3_ncells(mesh); ++lc)
+    if (mesh3_cell_contains_point(mesh, lc, x))
+      return lc;
+  return (size_t)NO_INDEX;
+}
+
+/* Get a random point in the convex hull of `num_verts` of the
+ * vertices of cell `lc`. */
+static void get_random_point_in_cell(mesh3_s const *mesh, size_t lc,
+                                     size_t num_verts, gsl_rng *rng,
+                                     dbl3 x) {
+  uint4 cv;
+  mesh3_cv(mesh, lc, cv);
+
+  /* Shuffle the vertices so that we pick a random subset of them */
+  gsl_ran_shuffle(rng, cv, 4, sizeof(size_t));
+
+  dbl b[4], b_sum = 0;
+  for (size_t i = 0; i < num_verts; ++i)
+    b_sum += b[i] = gsl_rng_uniform(rng);
+
+  dbl3_zero(x);
+  for (size_t i = 0; i < num_verts; ++i) {
+    dbl3 v;
+    mesh3_copy_vert(mesh, cv[i], v);
+    dbl3_saxpy_inplace(b[i]/b_sum, v, x);
+  }
+}
+
+Ensure (mesh3, find_cell_containing_point_matches_linear_scan) {
+  gsl_rng *rng = gsl_rng_alloc(gsl_rng_mt19937);
+
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, rng);
+  mesh3_s *mesh;
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, false, false, NULL);
+
+  size_t ncells = mesh3_ncells(mesh);
+
+  /* Points in the interiors of cells, on the faces and edges shared
+   * by neighboring cells, and at the vertices */
+  for (size_t num_verts = 1; num_verts <= 4; ++num_verts) {
+    for (size_t k = 0; k < 1000; ++k) {
+      size_t lc = gsl_rng_uniform_int(rng, ncells);
+      dbl3 x;
+      get_random_point_in_cell(mesh, lc, num_verts, rng, x);
+
+      size_t lc_gt = find_cell_by_linear_scan(mesh, x);
+      assert_that(lc_gt, is_not_equal_to(NO_INDEX));
+      assert_that(mesh3_find_cell_containing_point(mesh, x, NO_INDEX),
+                  is_equal_to(lc_gt));
+
+      /* A hint which doesn't contain `x` shouldn't change anything */
+      size_t lc_hint = (lc + ncells/2) % ncells;
+      if (!mesh3_cell_contains_point(mesh, lc_hint, x))
+        assert_that(mesh3_find_cell_containing_point(mesh, x, lc_hint),
+                    is_equal_to(lc_gt));
+    }
+  }
+
+  /* Uniformly random points in the mesh */
+  for (size_t k = 0; k < 1000; ++k) {
+    dbl3 x;
+    for (size_t i = 0; i < 3; ++i)
+      x[i] = gsl_ran_flat(rng, -1, 1);
+    assert_that(mesh3_find_cell_containing_point(mesh, x, NO_INDEX),
+                is_equal_to(find_cell_by_linear_scan(mesh, x)));
+  }
+
+  rect3 bbox;
+  mesh3_get_bbox(mesh, &bbox);
+
+  /* The corners of the bounding box, which are also corners of the
+   * mesh, and points just outside of them */
+  for (size_t k = 0; k < 8; ++k) {
+    dbl3 x, dx;
+    for (size_t i = 0; i < 3; ++i) {
+      bool is_max = (k >> i) & 1;
+      x[i] = is_max ? bbox.max[i] : bbox.min[i];
+      dx[i] = is_max ? 1e-3 : -1e-3;
+    }
+
+    size_t lc_gt = find_cell_by_linear_scan(mesh, x);
+    assert_that(lc_gt, is_not_equal_to(NO_INDEX));
+    assert_that(mesh3_find_cell_containing_point(mesh, x, NO_INDEX),
+                is_equal_to(lc_gt));
+
+    dbl3_add_inplace(x, dx);
+    assert_that(find_cell_by_linear_scan(mesh, x), is_equal_to(NO_INDEX));
+    assert_that(mesh3_find_cell_containing_point(mesh, x, NO_INDEX),
+                is_equal_to(NO_INDEX));
+  }
+
+  /* Points outside of the bounding box, both near it and far away */
+  for (size_t k = 0; k < 1000; ++k) {
+    dbl3 x;
+    for (size_t i = 0; i < 3; ++i)
+      x[i] = gsl_ran_flat(rng, -3, 3);
+    if (dbl3_maxnorm(x) <= 1 + 1e-3)
+      continue;
+    assert_that(find_cell_by_linear_scan(mesh, x), is_equal_to(NO_INDEX));
+    assert_that(mesh3_find_cell_containing_point(mesh, x, NO_INDEX),
+                is_equal_to(NO_INDEX));
+    assert_false(mesh3_contains_point(mesh, x));
+  }
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  cube_mesh_data_deinit(&data);
+
+  gsl_rng_free(rng);
+}
+
+Ensure (mesh3, walk_to_point_matches_find_cell_containing_point) {
+  gsl_rng *rng = gsl_rng_alloc(gsl_rng_mt19937);
+
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, rng);
+  mesh3_s *mesh;
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, false, false, NULL);
+
+  size_t ncells = mesh3_ncells(mesh);
+
+  /* Walk from random cells to points in the interiors of cells, on
+   * shared faces and edges, and at the vertices. Points in the
+   * interior of a cell can only be found in that cell, but the walk
+   * may stop in any of the cells containing the other points. */
+  for (size_t num_verts = 1; num_verts <= 4; ++num_verts) {
+    for (size_t k = 0; k < 1000; ++k) {
+      size_t lc = gsl_rng_uniform_int(rng, ncells);
+      dbl3 x;
+      get_random_point_in_cell(mesh, lc, num_verts, rng, x);
+
+      size_t lc_start = gsl_rng_uniform_int(rng, ncells);
+      size_t lc_walk = mesh3_walk_to_point(mesh, x, lc_start);
+      assert_that(lc_walk, is_not_equal_to(NO_INDEX));
+      assert_true(mesh3_cell_contains_point(mesh, lc_walk, x));
+      if (num_verts == 4) {
+        assert_that(lc_walk, is_equal_to(lc));
+        assert_that(lc_walk, is_equal_to(
+                      mesh3_find_cell_containing_point(mesh, x, NO_INDEX)));
+      }
+
+      /* Starting in a cell which contains `x` shouldn't go anywhere */
+      assert_that(mesh3_walk_to_point(mesh, x, lc_walk), is_equal_to(lc_walk));
+    }
+  }
+
+  /* Walks to points outside of the mesh leave it and fail */
+  for (size_t k = 0; k < 1000; ++k) {
+    dbl3 x;
+    for (size_t i = 0; i < 3; ++i)
+      x[i] = gsl_ran_flat(rng, -3, 3);
+    if (dbl3_maxnorm(x) <= 1 + 1e-3)
+      continue;
+    size_t lc_start = gsl_rng_uniform_int(rng, ncells);
+    assert_that(mesh3_walk_to_point(mesh, x, lc_start), is_equal_to(NO_INDEX));
+  }
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  cube_mesh_data_deinit(&data);
+
+  gsl_rng_free(rng);
+}
+
+Ensure (mesh3, walk_to_point_falls_back_when_walk_fails) {
+  gsl_rng *rng = gsl_rng_alloc(gsl_rng_mt19937);
+
+  /* Mesh two parallel bars of 40 unit cubes each, which don't touch
+   * each other. Walking from one end of a bar to the other takes at
+   * least one step per cube, which is more than the walk is allowed
+   * to take, and walking from one bar to the other has to leave the
+   * mesh, so in both cases we have to fall back to searching for the
+   * cell. */
+  size_t const shape[3] = {41, 2, 2};
+  dbl3 const xmin[2] = {{0, 0, 0}, {0, 3, 0}};
+  dbl3 const xmax[2] = {{40, 1, 1}, {40, 4, 1}};
+  mesh3_data_s bar_data[2];
+  for (size_t i = 0; i < 2; ++i)
+    box_mesh_data_init(&bar_data[i], shape, xmin[i], xmax[i], NULL);
+
+  size_t bar_nverts = bar_data[0].nverts, bar_ncells = bar_data[0].ncells;
+
+  mesh3_data_s data = {
+    .nverts = 2*bar_nverts,
+    .verts = malloc(2*bar_nverts*sizeof(dbl3)),
+    .ncells = 2*bar_ncells,
+    .cells = malloc(2*bar_ncells*sizeof(uint4))
+  };
+  for (size_t i = 0; i < 2; ++i) {
+    memcpy(&data.verts[i*bar_nverts], bar_data[i].verts,
+           bar_nverts*sizeof(dbl3));
+    for (size_t lc = 0; lc < bar_ncells; ++lc)
+      for (size_t j = 0; j < 4; ++j)
+        data.cells[i*bar_ncells + lc][j] =
+          i*bar_nverts + bar_data[i].cells[lc][j];
+    cube_mesh_data_deinit(&bar_data[i]);
+  }
+
+  /* Cells in the first and last cube of each bar */
+  size_t lc_first[2] = {0, bar_ncells};
+  size_t lc_last[2] = {bar_ncells - 6, 2*bar_ncells - 6};
+
+  /* Crossing a face works differently with and without the mesh's
+   * topology, so check both */
+  for (int compute_topology = 0; compute_topology <= 1; ++compute_topology) {
+    mesh3_s *mesh;
+    mesh3_alloc(&mesh);
+    mesh3_init(mesh, &data, false, compute_topology, NULL);
+
+    for (size_t k = 0; k < 100; ++k) {
+      size_t p = gsl_rng_uniform_int(rng, 6);
+
+      for (size_t i = 0; i < 2; ++i) {
+        dbl3 x;
+
+        /* From one end of a bar to the other */
+        get_random_point_in_cell(mesh, lc_last[i] + p, 4, rng, x);
+        assert_that(mesh3_walk_to_point(mesh, x, lc_first[i]),
+                    is_equal_to(lc_last[i] + p));
+
+        /* From one bar to the other */
+        get_random_point_in_cell(mesh, lc_first[1 - i] + p, 4, rng, x);
+        assert_that(mesh3_walk_to_point(mesh, x, lc_first[i]),
+                    is_equal_to(lc_first[1 - i] + p));
+      }
+    }
+
+    /* Between the bars, where there aren't any cells at all */
+    dbl3 x = {20.5, 2, 0.5};
+    assert_that(mesh3_walk_to_point(mesh, x, lc_first[0]),
+                is_equal_to(NO_INDEX));
+
+    mesh3_deinit(mesh);
+    mesh3_dealloc(&mesh);
+  }
+
+  free(data.verts);
+  free(data.cells);
+
+  gsl_rng_free(rng);
+}
+
+Ensure (mesh3, linterp_in_cell_is_exact_for_linear_functions) {
+  double_absolute_tolerance_is(1e-14);
+  double_relative_tolerance_is(1e-14);
+
+  gsl_rng *rng = gsl_rng_alloc(gsl_rng_mt19937);
+
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, rng);
+  mesh3_s *mesh;
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, false, false, NULL);
+
+  size_t nverts = mesh3_nverts(mesh), ncells = mesh3_ncells(mesh);
+
+  dbl const a = 0.3;
+  dbl3 const g = {-1.2, 0.5, 2.1};
+
+  dbl *values = malloc(nverts*sizeof(dbl));
+  for (size_t l = 0; l < nverts; ++l)
+    values[l] = a + dbl3_dot(g, mesh3_get_vert_ptr(mesh, l));
+
+  for (size_t k = 0; k < 1000; ++k) {
+    size_t lc = gsl_rng_uniform_int(rng, ncells);
+    dbl3 x;
+    get_random_point_in_cell(mesh, lc, 4, rng, x);
+
+    dbl value = mesh3_linterp_in_cell(mesh, values, lc, x);
+    assert_that_double(value, is_nearly_double(a + dbl3_dot(g, x)));
+    assert_that_double(
+      value, is_nearly_double(mesh3_linterp(mesh, values, x)));
+  }
+
+  free(values);
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  cube_mesh_data_deinit(&data);
+
+  gsl_rng_free(rng);
+}
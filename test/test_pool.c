@@ -0,0 +1,38 @@
+#include <cgreen/cgreen.h>
+
+#include <stdint.h>
+
+#include "pool.h"
+
+static pool_s *pool;
+
+Describe(pool);
+
+BeforeEach(pool) {
+  pool_alloc(&pool);
+  pool_init(pool, 64);
+}
+
+AfterEach(pool) {
+  pool_deinit(pool);
+  pool_dealloc(&pool);
+}
+
+static bool is_aligned(void const *ptr) {
+  return (uintptr_t)ptr % __alignof__(long double) == 0;
+}
+
+Ensure (pool, get_aligns_every_pointer) {
+  /* Request odd numbers of bytes (like an array of `bool`s followed
+   * by an array of `double`s) so that the pool has to pad them, and
+   * enough of them that it grows and gets reset a few times */
+  for (size_t k = 0; k < 3; ++k) {
+    for (size_t num_bytes = 1; num_bytes < 200; num_bytes += 7) {
+      char *ptr = pool_get(pool, num_bytes);
+      assert_true(is_aligned(ptr));
+      for (size_t i = 0; i < num_bytes; ++i)
+        ptr[i] = 0;
+    }
+    pool_reset(pool);
+  }
+}
@@ -0,0 +1,377 @@
+#include <cgreen/cgreen.h>
+
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_rng.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "bmesh.h"
+#include "cube_mesh.h"
+#include "geom.h"
+#include "mesh3.h"
+#include "rtree.h"
+#include "vec.h"
+
+/* The number of vertices along each side of the test mesh */
+#define N 9
+
+#define NUM_RAYS 1000
+
+static bool rect3_contains_rect3(rect3 const *rect, rect3 const *other) {
+  for (size_t i = 0; i < 3; ++i)
+    if (other->min[i] < rect->min[i] || other->max[i] > rect->max[i])
+      return false;
+  return true;
+}
+
+static gsl_rng *rng;
+static mesh3_s *mesh;
+
+Describe(rtree);
+
+BeforeEach(rtree) {
+  rng = gsl_rng_alloc(gsl_rng_mt19937);
+
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -1, 1, rng);
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, false, false, NULL);
+  cube_mesh_data_deinit(&data);
+}
+
+AfterEach(rtree) {
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  gsl_rng_free(rng);
+}
+
+static rtree_s *build_rtree(rtree_split_strategy_e split_strategy,
+                            size_t num_threads) {
+  rtree_s *rtree;
+  rtree_alloc(&rtree);
+  rtree_init(rtree, 4, split_strategy);
+  rtree_set_num_threads(rtree, num_threads);
+  rtree_insert_mesh3(rtree, mesh);
+  rtree_build(rtree);
+  return rtree;
+}
+
+static void free_rtree(rtree_s **rtree) {
+  rtree_deinit(*rtree);
+  rtree_dealloc(rtree);
+}
+
+Ensure (rtree, sah_binned_flat_tree_is_well_formed) {
+  rtree_s *rtree = build_rtree(RTREE_SPLIT_STRATEGY_SAH_BINNED, 4);
+
+  size_t num_flat_nodes = rtree_get_num_flat_nodes(rtree);
+  size_t ncells = mesh3_ncells(mesh);
+  size_t *count = calloc(ncells, sizeof(size_t));
+
+  size_t num_leaves = 0;
+  for (size_t i = 0; i < num_flat_nodes; ++i) {
+    rect3 bbox = rtree_get_flat_node_bbox(rtree, i);
+
+    size_t ch[2];
+    if (rtree_get_flat_node_children(rtree, i, ch)) {
+      for (size_t j = 0; j < 2; ++j) {
+        assert_that(ch[j], is_greater_than(i));
+        assert_that(ch[j], is_less_than(num_flat_nodes));
+        rect3 ch_bbox = rtree_get_flat_node_bbox(rtree, ch[j]);
+        assert_true(rect3_contains_rect3(&bbox, &ch_bbox));
+      }
+      continue;
+    }
+
+    size_t num_objs = rtree_get_flat_node_num_objs(rtree, i);
+    ++num_leaves;
+
+    for (size_t k = 0; k < num_objs; ++k) {
+      robj_s const *obj = rtree_get_flat_node_obj(rtree, i, k);
+      assert_that(robj_get_type(obj), is_equal_to(ROBJ_MESH3_TETRA));
+
+      rect3 obj_bbox = rect3_make_empty();
+      robj_insert_into_bbox(obj, &obj_bbox);
+      assert_true(rect3_contains_rect3(&bbox, &obj_bbox));
+
+      mesh3_tetra_s const *tetra = robj_get_data(obj);
+      assert_that(tetra->l, is_less_than(ncells));
+      ++count[tetra->l];
+    }
+  }
+
+  /* Every cell should be in exactly one leaf */
+  for (size_t l = 0; l < ncells; ++l)
+    assert_that(count[l], is_equal_to(1));
+
+  /* The stats should describe the same tree */
+  rtree_stats_s stats;
+  rtree_get_stats(rtree, &stats);
+  assert_that(stats.num_nodes, is_equal_to(num_flat_nodes));
+  assert_that(stats.num_leaves, is_equal_to(num_leaves));
+  assert_that(rtree_get_num_leaf_nodes(rtree), is_equal_to(num_leaves));
+  assert_that(stats.num_nodes, is_equal_to(2*num_leaves - 1));
+
+  size_t num_hist = 0;
+  for (size_t k = 0; k < RTREE_LEAF_SIZE_HIST_SIZE; ++k)
+    num_hist += stats.leaf_size_hist[k];
+  assert_that(num_hist, is_equal_to(num_leaves));
+
+  /* The tree should be cheaper than intersecting every object */
+  assert_that_double(stats.sah_cost, is_greater_than_double(0));
+  assert_that_double(stats.sah_cost, is_less_than_double(ncells));
+
+  free(count);
+  free_rtree(&rtree);
+}
+
+Ensure (rtree, sah_binned_build_does_not_depend_on_num_threads) {
+  rtree_s *rtree[3] = {
+    build_rtree(RTREE_SPLIT_STRATEGY_SAH_BINNED, 1),
+    build_rtree(RTREE_SPLIT_STRATEGY_SAH_BINNED, 4),
+    build_rtree(RTREE_SPLIT_STRATEGY_SURFACE_AREA, 1)
+  };
+
+  rtree_stats_s stats[2];
+  for (size_t i = 0; i < 2; ++i)
+    rtree_get_stats(rtree[i], &stats[i]);
+  assert_that(stats[1].num_nodes, is_equal_to(stats[0].num_nodes));
+  assert_that(stats[1].depth, is_equal_to(stats[0].depth));
+  assert_that_double(stats[1].sah_cost, is_nearly_double(stats[0].sah_cost));
+
+  /* Shoot rays from outside the mesh through random points inside of
+   * it. Every tree should find the same first hit. */
+  ray3 ray[NUM_RAYS];
+  for (size_t i = 0; i < NUM_RAYS; ++i) {
+    dbl3 x;
+    for (size_t j = 0; j < 3; ++j) {
+      ray[i].org[j] = gsl_ran_flat(rng, -2, 2);
+      x[j] = gsl_ran_flat(rng, -1, 1);
+    }
+    ray[i].org[gsl_rng_uniform(rng) < 0.5 ? 0 : 1] = 3;
+    dbl3_sub(x, ray[i].org, ray[i].dir);
+    dbl3_normalize(ray[i].dir);
+  }
+
+  isect hit[3][NUM_RAYS];
+  for (size_t k = 0; k < 3; ++k)
+    for (size_t i = 0; i < NUM_RAYS; ++i)
+      rtree_intersect(rtree[k], &ray[i], &hit[k][i], NULL);
+
+  for (size_t i = 0; i < NUM_RAYS; ++i) {
+    assert_that(hit[0][i].obj, is_non_null);
+    for (size_t k = 1; k < 3; ++k) {
+      assert_that_double(hit[k][i].t, is_nearly_double(hit[0][i].t));
+      assert_true(robj_equal(hit[k][i].obj, hit[0][i].obj));
+    }
+  }
+
+  for (size_t k = 0; k < 3; ++k)
+    free_rtree(&rtree[k]);
+}
+
+/* Find the first hit of `ray` with the level set of `bmesh` at
+ * `level` by intersecting it with every cell. */
+static isect intersect_level_by_linear_scan(bmesh33_s const *bmesh,
+                                            ray3 const *ray, dbl level) {
+  isect hit = {.t = INFINITY, .obj = NULL};
+  for (size_t l = 0; l < bmesh33_num_cells(bmesh); ++l) {
+    bmesh33_cell_s cell = bmesh33_get_cell(bmesh, l);
+    cell.level = level;
+    dbl t;
+    if (bmesh33_cell_intersect(&cell, ray, &t) && t < hit.t)
+      hit.t = t;
+  }
+  return hit;
+}
+
+/* Get the cell of the parent mesh which `hit` lies in. */
+static size_t get_hit_parent_cell(isect const *hit) {
+  assert_that(robj_get_type(hit->obj), is_equal_to(ROBJ_BMESH33_CELL));
+  bmesh33_cell_s const *cell = robj_get_data(hit->obj);
+  return bmesh33_get_parent_cell(cell->bmesh, cell->l);
+}
+
+/* Interpolate the distance from a point off to the side of the mesh,
+ * so that its level sets are spherical shells which cut through the
+ * mesh. */
+static bmesh33_s *create_distance_bmesh33(jet31t **jet) {
+  dbl3 const xsrc = {-1.5, 0.2, 0.1};
+  size_t nverts = mesh3_nverts(mesh);
+  *jet = malloc(nverts*sizeof(jet31t));
+  for (size_t l = 0; l < nverts; ++l) {
+    dbl3 x;
+    mesh3_copy_vert(mesh, l, x);
+    dbl3_sub(x, xsrc, (*jet)[l].Df);
+    (*jet)[l].f = dbl3_norm((*jet)[l].Df);
+    dbl3_dbl_div_inplace((*jet)[l].Df, (*jet)[l].f);
+  }
+
+  bmesh33_s *bmesh;
+  bmesh33_alloc(&bmesh);
+  bmesh33_init_from_mesh3_and_jets(bmesh, mesh, *jet);
+  return bmesh;
+}
+
+Ensure (rtree, intersect_at_level_matches_restricting_to_level) {
+  jet31t *jet;
+  bmesh33_s *bmesh = create_distance_bmesh33(&jet);
+
+  /* A single R-tree over the whole bmesh33, which is pruned to the
+   * subtrees which can contain each level during traversal */
+  rtree_s *rtree;
+  rtree_alloc(&rtree);
+  rtree_init(rtree, 4, RTREE_SPLIT_STRATEGY_SAH_BINNED);
+  rtree_insert_bmesh33(rtree, bmesh);
+  rtree_build(rtree);
+
+  ray3 ray[NUM_RAYS];
+  for (size_t i = 0; i < NUM_RAYS; ++i) {
+    dbl3 x;
+    for (size_t j = 0; j < 3; ++j) {
+      ray[i].org[j] = gsl_ran_flat(rng, -2, 2);
+      x[j] = gsl_ran_flat(rng, -1, 1);
+    }
+    ray[i].org[gsl_rng_uniform(rng) < 0.5 ? 0 : 1] = 3;
+    dbl3_sub(x, ray[i].org, ray[i].dir);
+    dbl3_normalize(ray[i].dir);
+  }
+
+  dbl const level[4] = {0.75, 1.25, 1.75, 2.25};
+
+  for (size_t k = 0; k < 4; ++k) {
+    /* Another R-tree built over just the cells which bracket the
+     * level, which is traversed without any pruning */
+    bmesh33_s *level_bmesh = bmesh33_restrict_to_level(bmesh, level[k]);
+
+    rtree_s *level_rtree;
+    rtree_alloc(&level_rtree);
+    rtree_init(level_rtree, 4, RTREE_SPLIT_STRATEGY_SAH_BINNED);
+    rtree_insert_bmesh33(level_rtree, level_bmesh);
+    rtree_build(level_rtree);
+
+    size_t num_hits = 0;
+
+    for (size_t i = 0; i < NUM_RAYS; ++i) {
+      isect hit, level_hit;
+      rtree_intersect_at_level(rtree, &ray[i], level[k], &hit, NULL);
+      rtree_intersect(level_rtree, &ray[i], &level_hit, NULL);
+
+      isect hit_gt = intersect_level_by_linear_scan(bmesh, &ray[i], level[k]);
+
+      if (isinf(hit_gt.t)) {
+        assert_that(hit.obj, is_null);
+        assert_that(level_hit.obj, is_null);
+        continue;
+      }
+
+      ++num_hits;
+
+      assert_that(hit.obj, is_non_null);
+      assert_that(level_hit.obj, is_non_null);
+      if (hit.obj == NULL || level_hit.obj == NULL)
+        continue;
+
+      assert_that_double(hit.t, is_nearly_double(hit_gt.t));
+      assert_that_double(level_hit.t, is_nearly_double(hit_gt.t));
+      assert_that(get_hit_parent_cell(&hit),
+                  is_equal_to(get_hit_parent_cell(&level_hit)));
+    }
+
+    /* Make sure that the level set was actually hit */
+    assert_that(num_hits, is_greater_than(0));
+    assert_that(num_hits, is_less_than(NUM_RAYS));
+
+    rtree_deinit(level_rtree);
+    rtree_dealloc(&level_rtree);
+
+    bmesh33_deinit(level_bmesh);
+    bmesh33_dealloc(&level_bmesh);
+  }
+
+  rtree_deinit(rtree);
+  rtree_dealloc(&rtree);
+
+  bmesh33_deinit(bmesh);
+  bmesh33_dealloc(&bmesh);
+
+  free(jet);
+}
+
+Ensure (rtree, intersectN_matches_intersecting_one_ray_at_a_time) {
+  rtree_s *rtree = build_rtree(RTREE_SPLIT_STRATEGY_SAH_BINNED, 1);
+
+  jet31t *jet;
+  bmesh33_s *bmesh = create_distance_bmesh33(&jet);
+  rtree_s *bmesh_rtree;
+  rtree_alloc(&bmesh_rtree);
+  rtree_init(bmesh_rtree, 4, RTREE_SPLIT_STRATEGY_SAH_BINNED);
+  rtree_insert_bmesh33(bmesh_rtree, bmesh);
+  rtree_build(bmesh_rtree);
+
+  dbl const level = 1.5;
+
+  /* Aim the rays at points in a box twice as big as the mesh, so
+   * that a packet mixes rays which hit and miss */
+  ray3 ray[NUM_RAYS];
+  for (size_t i = 0; i < NUM_RAYS; ++i) {
+    dbl3 x;
+    for (size_t j = 0; j < 3; ++j) {
+      ray[i].org[j] = gsl_ran_flat(rng, -2, 2);
+      x[j] = gsl_ran_flat(rng, -2, 2);
+    }
+    ray[i].org[gsl_rng_uniform(rng) < 0.5 ? 0 : 1] = 3;
+    dbl3_sub(x, ray[i].org, ray[i].dir);
+    dbl3_normalize(ray[i].dir);
+  }
+
+  isect hit[2][NUM_RAYS];
+  for (size_t i = 0; i < NUM_RAYS; ++i) {
+    rtree_intersect(rtree, &ray[i], &hit[0][i], NULL);
+    rtree_intersect_at_level(bmesh_rtree, &ray[i], level, &hit[1][i], NULL);
+  }
+
+  size_t num_hits[2] = {0, 0};
+  for (size_t k = 0; k < 2; ++k)
+    for (size_t i = 0; i < NUM_RAYS; ++i)
+      num_hits[k] += hit[k][i].obj != NULL;
+  for (size_t k = 0; k < 2; ++k) {
+    assert_that(num_hits[k], is_greater_than(0));
+    assert_that(num_hits[k], is_less_than(NUM_RAYS));
+  }
+
+  /* The rays are traced in packets of `RAY_PACKET_SIZE` (8) rays, so
+   * intersecting up to 24 rays at a time covers a single ray, full
+   * packets, and full packets followed by a partial one */
+  isect hitN[NUM_RAYS];
+  for (size_t n = 1; n <= 24; ++n) {
+    for (size_t i0 = 0; i0 + n <= NUM_RAYS; i0 += n) {
+      for (size_t k = 0; k < 2; ++k) {
+        if (k == 0)
+          rtree_intersectN(rtree, &ray[i0], n, &hitN[i0]);
+        else
+          rtree_intersectN_at_level(bmesh_rtree, &ray[i0], n, level,
+                                    &hitN[i0]);
+
+        /* Intersecting a ray with an object doesn't depend on the
+         * rest of its packet, so the nearest hits should be exactly
+         * the same */
+        for (size_t i = i0; i < i0 + n; ++i) {
+          assert_that(hitN[i].t == hit[k][i].t);
+          assert_that(hitN[i].obj == hit[k][i].obj);
+        }
+      }
+    }
+  }
+
+  rtree_deinit(bmesh_rtree);
+  rtree_dealloc(&bmesh_rtree);
+
+  bmesh33_deinit(bmesh);
+  bmesh33_dealloc(&bmesh);
+
+  free(jet);
+
+  free_rtree(&rtree);
+}
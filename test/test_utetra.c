@@ -0,0 +1,519 @@
+#include <cgreen/cgreen.h>
+
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_rng.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "cube_mesh.h"
+#include "eik3.h"
+#include "mesh3.h"
+#include "utetra.h"
+#include "vec.h"
+
+#define NUM_UPDATES 1000
+
+/* The length of the edges of the base of each update */
+#define H 0.1
+
+/* Set up a mesh for one update: the first cell is the update itself,
+ * with `x[0]` being the node which is updated and `x[1]`, `x[2]`,
+ * `x[3]` the base. The second cell is off to the side, so that the
+ * diameter of the mesh is a couple dozen times `H`, which gives the update
+ * a tolerance like it would have in a typical mesh (see
+ * `mesh3_get_face_tol`). */
+static void init_update_mesh_data(mesh3_data_s *data, gsl_rng *rng) {
+  data->nverts = 8;
+  data->verts = malloc(data->nverts*sizeof(dbl3));
+
+  /* The base is a perturbed equilateral triangle in the xy-plane,
+   * and the updated node lies above it */
+  for (size_t i = 0; i < 3; ++i) {
+    dbl theta = 2*JMM_PI*i/3;
+    data->verts[i + 1][0] = H*(cos(theta)/sqrt(3) + gsl_ran_flat(rng, -.1, .1));
+    data->verts[i + 1][1] = H*(sin(theta)/sqrt(3) + gsl_ran_flat(rng, -.1, .1));
+    data->verts[i + 1][2] = H*gsl_ran_flat(rng, -0.1, 0.1);
+  }
+  data->verts[0][0] = H*gsl_ran_flat(rng, -0.5, 0.5);
+  data->verts[0][1] = H*gsl_ran_flat(rng, -0.5, 0.5);
+  data->verts[0][2] = H*gsl_ran_flat(rng, 0.5, 1);
+
+  for (size_t i = 4; i < 8; ++i)
+    for (size_t j = 0; j < 3; ++j)
+      data->verts[i][j] = 1 + (i - 4 == j ? H : 0);
+
+  data->ncells = 2;
+  data->cells = malloc(data->ncells*sizeof(uint4));
+  for (size_t i = 0; i < 8; ++i)
+    data->cells[i/4][i%4] = i;
+}
+
+/* The number of vertices along each side of the grid mesh */
+#define N 7
+
+/* A slowness which varies by 25% about 1. */
+static dbl s(dbl3 x) {
+  return 1 + sin(dbl3_sum(x))/4;
+}
+
+static void Ds(dbl3 x, dbl3 Ds) {
+  Ds[0] = Ds[1] = Ds[2] = cos(dbl3_sum(x))/4;
+}
+
+static void D2s(dbl3 x, dbl33 D2s) {
+  for (size_t i = 0; i < 3; ++i)
+    for (size_t j = 0; j < 3; ++j)
+      D2s[i][j] = -sin(dbl3_sum(x))/4;
+}
+
+static sfunc_s const sfunc_sin = {
+  .stype = STYPE_FUNC_PTR,
+  .funcs = {.s = s, .Ds = Ds, .D2s = D2s},
+  .data_jet31t = NULL,
+  .s_min = 0.75
+};
+
+/* Get the jet of a point source at `xsrc` at `x`. */
+static jet31t get_pt_src_jet(dbl3 const xsrc, dbl3 const x) {
+  jet31t jet;
+  dbl3_sub(x, xsrc, jet.Df);
+  jet.f = dbl3_norm(jet.Df);
+  dbl3_dbl_div_inplace(jet.Df, jet.f);
+  return jet;
+}
+
+static gsl_rng *rng;
+
+Describe(utetra);
+
+BeforeEach(utetra) {
+  rng = gsl_rng_alloc(gsl_rng_mt19937);
+}
+
+AfterEach(utetra) {
+  gsl_rng_free(rng);
+}
+
+Ensure (utetra, solve_stype_constant_agrees_with_solve_generic) {
+  uint3 const l = {1, 2, 3};
+
+  size_t num_interior = 0, num_boundary = 0;
+
+  for (size_t k = 0; k < NUM_UPDATES; ++k) {
+    mesh3_data_s data;
+    init_update_mesh_data(&data, rng);
+
+    mesh3_s *mesh;
+    mesh3_alloc(&mesh);
+    mesh3_init(mesh, &data, false, false, NULL);
+
+    /* Put a point source below the base. Sources which are far off to
+     * the side send rays which miss the base, so that the minimizer
+     * is on the boundary of the base. */
+    dbl3 xsrc;
+    xsrc[0] = H*gsl_ran_flat(rng, -4, 4);
+    xsrc[1] = H*gsl_ran_flat(rng, -4, 4);
+    xsrc[2] = -H*gsl_ran_flat(rng, 1, 4);
+
+    eik3_s *eik;
+    eik3_alloc(&eik);
+    eik3_init(eik, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
+    for (size_t i = 0; i < 3; ++i)
+      eik3_add_bc(eik, l[i], get_pt_src_jet(xsrc, data.verts[l[i]]));
+
+    utetra_s *u[2];
+    for (size_t i = 0; i < 2; ++i) {
+      utetra_alloc(&u[i]);
+      utetra_init(u[i], eik, 0, l);
+      assert_false(utetra_is_degenerate(u[i]));
+    }
+
+    utetra_solve(u[0], NULL);
+    utetra_solve_generic(u[1], NULL);
+
+    /* Both solvers stop once they're within the update's tolerance of
+     * the minimizer. Newton's method converges much faster, so the
+     * generic solver is the one which is off, and since its minimizer
+     * is still feasible, its value can only be larger. The value is
+     * flat at the minimizer, so it's much closer than the minimizer
+     * and the jet. */
+    dbl tol = mesh3_get_face_tol(mesh, l);
+    double_relative_tolerance_is(0);
+
+    dbl lam[2][2];
+    for (size_t i = 0; i < 2; ++i)
+      utetra_get_lambda(u[i], lam[i]);
+    double_absolute_tolerance_is(100*tol);
+    for (size_t j = 0; j < 2; ++j)
+      assert_that_double(lam[0][j], is_nearly_double(lam[1][j]));
+
+    dbl f[2];
+    for (size_t i = 0; i < 2; ++i)
+      f[i] = utetra_get_value(u[i]);
+    assert_that_double(f[0], is_less_than_double(f[1] + 1e-15));
+    assert_that_double(f[1], is_less_than_double(f[0] + tol));
+
+    /* The value is at least the distance to the source, since the
+     * interpolated T is exact at the base's vertices and very nearly
+     * so in between */
+    assert_that_double(f[0], is_greater_than_double(
+                         dbl3_dist(data.verts[0], xsrc) - H*H));
+
+    jet31t jet[2];
+    for (size_t i = 0; i < 2; ++i)
+      utetra_get_jet31t(u[i], &jet[i]);
+    assert_that(jet[0].f == f[0]);
+    assert_that(jet[1].f == f[1]);
+    for (size_t j = 0; j < 3; ++j)
+      assert_that_double(jet[0].Df[j], is_nearly_double(jet[1].Df[j]));
+
+    /* Newton's method puts boundary minimizers exactly on the
+     * boundary */
+    dbl b_min = fmin(1 - lam[0][0] - lam[0][1], fmin(lam[0][0], lam[0][1]));
+    if (b_min > 0)
+      ++num_interior;
+    else
+      ++num_boundary;
+
+    for (size_t i = 0; i < 2; ++i)
+      utetra_dealloc(&u[i]);
+
+    eik3_deinit(eik);
+    eik3_dealloc(&eik);
+
+    mesh3_deinit(mesh);
+    mesh3_dealloc(&mesh);
+
+    free(data.verts);
+    free(data.cells);
+  }
+
+  /* Make sure both kinds of minimizers were tested */
+  assert_that(num_interior, is_greater_than(NUM_UPDATES/10));
+  assert_that(num_boundary, is_greater_than(NUM_UPDATES/10));
+}
+
+Ensure (utetra, lower_bound_is_at_most_value) {
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -3, 3, NULL);
+
+  mesh3_s *mesh;
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, true, false, NULL);
+
+  sfunc_s const *sfunc[2] = {&SFUNC_CONSTANT, &sfunc_sin};
+
+  utetra_s *u;
+  utetra_alloc(&u);
+
+  size_t num_tested[2] = {0, 0}, num_tight[2] = {0, 0};
+
+  while (num_tested[0] + num_tested[1] < NUM_UPDATES) {
+    size_t k = num_tested[0] <= num_tested[1] ? 0 : 1;
+
+    /* Pick a random vertex at least two away from the boundary of the
+     * mesh, and update it from the opposite face of one of its cells,
+     * which is then an interior face */
+    size_t ind[3];
+    for (size_t i = 0; i < 3; ++i)
+      ind[i] = 2 + gsl_rng_uniform_int(rng, N - 4);
+    size_t lhat = (ind[0]*N + ind[1])*N + ind[2];
+
+    size_t nvc;
+    size_t const *vc = mesh3_get_vc_ptr(mesh, lhat, &nvc);
+    size_t lc = vc[gsl_rng_uniform_int(rng, nvc)];
+    uint4 cv;
+    mesh3_cv(mesh, lc, cv);
+    uint3 l;
+    for (size_t i = 0, j = 0; i < 4; ++i)
+      if (cv[i] != lhat)
+        l[j++] = cv[i];
+
+    /* The solver expects the cell on the other side of the base to be
+     * valid, so find its remaining vertex */
+    uint2 fc;
+    mesh3_fc(mesh, l, fc);
+    mesh3_cv(mesh, fc[0] == lc ? fc[1] : fc[0], cv);
+    size_t lopp = NO_INDEX;
+    for (size_t i = 0; i < 4; ++i)
+      if (cv[i] != l[0] && cv[i] != l[1] && cv[i] != l[2])
+        lopp = cv[i];
+
+    /* Put a point source somewhere upwind of the base, and use its
+     * jets as the data on the base */
+    dbl3 xsrc;
+    for (size_t i = 0; i < 3; ++i)
+      xsrc[i] = gsl_ran_flat(rng, -3, 3);
+    dbl T_min = INFINITY, T_max = -INFINITY;
+    for (size_t i = 0; i < 3; ++i) {
+      dbl T = dbl3_dist(data.verts[l[i]], xsrc);
+      T_min = fmin(T_min, T);
+      T_max = fmax(T_max, T);
+    }
+    if (dbl3_dist(data.verts[lhat], xsrc) <= T_max)
+      continue;
+
+    eik3_s *eik;
+    eik3_alloc(&eik);
+    eik3_init(eik, mesh, sfunc[k], HEAP_TYPE_BINARY);
+    for (size_t i = 0; i < 3; ++i)
+      eik3_add_bc(eik, l[i], get_pt_src_jet(xsrc, data.verts[l[i]]));
+    eik3_add_bc(eik, lopp, get_pt_src_jet(xsrc, data.verts[lopp]));
+
+    utetra_init(u, eik, lhat, l);
+    assert_false(utetra_is_degenerate(u));
+
+    dbl lb = utetra_get_lower_bound(u);
+    utetra_solve(u, NULL);
+    dbl f = utetra_get_value(u);
+    assert_that_double(lb, is_less_than_double(f));
+
+    /* The bound should do better than the data on the base */
+    num_tight[k] += lb > T_min + 0.5;
+
+    ++num_tested[k];
+
+    eik3_deinit(eik);
+    eik3_dealloc(&eik);
+  }
+
+  for (size_t k = 0; k < 2; ++k)
+    assert_that(num_tight[k], is_greater_than(num_tested[k]/2));
+
+  utetra_dealloc(&u);
+
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  cube_mesh_data_deinit(&data);
+}
+
+Ensure (utetra, warm_start_is_exact_for_plane_waves) {
+  uint3 const l = {1, 2, 3};
+
+  for (size_t k = 0; k < NUM_UPDATES; ++k) {
+    mesh3_data_s data;
+    init_update_mesh_data(&data, rng);
+
+    mesh3_s *mesh;
+    mesh3_alloc(&mesh);
+    mesh3_init(mesh, &data, false, false, NULL);
+
+    /* Pick the minimizer in the interior of the base, and send a plane
+     * wave through it towards the updated node. The characteristics
+     * are straight lines parallel to the wave's direction, so the ray
+     * arriving at the updated node comes from the minimizer. */
+    dbl lam_gt[2], b0;
+    do {
+      lam_gt[0] = gsl_rng_uniform(rng);
+      lam_gt[1] = gsl_rng_uniform(rng);
+      b0 = 1 - lam_gt[0] - lam_gt[1];
+    } while (b0 < 0.05 || lam_gt[0] < 0.05 || lam_gt[1] < 0.05);
+
+    dbl3 x_lam = {0, 0, 0};
+    dbl3_saxpy_inplace(b0, data.verts[l[0]], x_lam);
+    dbl3_saxpy_inplace(lam_gt[0], data.verts[l[1]], x_lam);
+    dbl3_saxpy_inplace(lam_gt[1], data.verts[l[2]], x_lam);
+
+    dbl3 n;
+    dbl3_sub(data.verts[0], x_lam, n);
+    dbl3_normalize(n);
+
+    eik3_s *eik;
+    eik3_alloc(&eik);
+    eik3_init(eik, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
+    for (size_t i = 0; i < 3; ++i) {
+      jet31t jet = {.f = dbl3_dot(n, data.verts[l[i]])};
+      dbl3_copy(n, jet.Df);
+      eik3_add_bc(eik, l[i], jet);
+    }
+
+    utetra_s *u;
+    utetra_alloc(&u);
+    utetra_init(u, eik, 0, l);
+
+    dbl lam_warm[2];
+    assert_true(utetra_get_warm_start(u, lam_warm));
+    double_relative_tolerance_is(0);
+    double_absolute_tolerance_is(1e-12);
+    for (size_t j = 0; j < 2; ++j)
+      assert_that_double(lam_warm[j], is_nearly_double(lam_gt[j]));
+
+    /* T is linear on the base, so solving from the warm start finds
+     * the same minimizer */
+    utetra_solve(u, lam_warm);
+    dbl lam[2];
+    utetra_get_lambda(u, lam);
+    double_absolute_tolerance_is(100*mesh3_get_face_tol(mesh, l));
+    for (size_t j = 0; j < 2; ++j)
+      assert_that_double(lam[j], is_nearly_double(lam_gt[j]));
+
+    utetra_dealloc(&u);
+
+    eik3_deinit(eik);
+    eik3_dealloc(&eik);
+
+    mesh3_deinit(mesh);
+    mesh3_dealloc(&mesh);
+
+    free(data.verts);
+    free(data.cells);
+  }
+}
+
+Ensure (utetra, no_warm_start_if_gradients_disagree) {
+  uint3 const l = {1, 2, 3};
+
+  size_t num_coherent = 0, num_incoherent = 0;
+
+  for (size_t k = 0; k < NUM_UPDATES; ++k) {
+    mesh3_data_s data;
+    init_update_mesh_data(&data, rng);
+
+    mesh3_s *mesh;
+    mesh3_alloc(&mesh);
+    mesh3_init(mesh, &data, false, false, NULL);
+
+    /* Put a point source below the base. The closer it is, the more
+     * the directions of the rays arriving at the base's vertices
+     * differ. */
+    dbl3 xsrc;
+    xsrc[0] = H*gsl_ran_flat(rng, -1, 1);
+    xsrc[1] = H*gsl_ran_flat(rng, -1, 1);
+    xsrc[2] = -H*exp(gsl_ran_flat(rng, log(0.1), log(100)));
+
+    eik3_s *eik;
+    eik3_alloc(&eik);
+    eik3_init(eik, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
+
+    /* The ratio of the norm of the sum of the gradients to the sum of
+     * their norms measures how well they agree */
+    dbl3 Df_sum = {0, 0, 0};
+    for (size_t i = 0; i < 3; ++i) {
+      jet31t jet = get_pt_src_jet(xsrc, data.verts[l[i]]);
+      eik3_add_bc(eik, l[i], jet);
+      dbl3_add_inplace(Df_sum, jet.Df);
+    }
+    dbl coherence = dbl3_norm(Df_sum)/3;
+
+    utetra_s *u;
+    utetra_alloc(&u);
+    utetra_init(u, eik, 0, l);
+
+    dbl lam[2];
+    bool warm = utetra_get_warm_start(u, lam);
+    if (coherence < 0.98) {
+      assert_false(warm);
+      ++num_incoherent;
+    } else if (coherence > 0.98 + 1e-12) {
+      assert_true(warm);
+      assert_that_double(lam[0], is_greater_than_double(-1e-15));
+      assert_that_double(lam[1], is_greater_than_double(-1e-15));
+      assert_that_double(lam[0] + lam[1], is_less_than_double(1 + 1e-15));
+      ++num_coherent;
+    }
+
+    utetra_dealloc(&u);
+
+    eik3_deinit(eik);
+    eik3_dealloc(&eik);
+
+    mesh3_deinit(mesh);
+    mesh3_dealloc(&mesh);
+
+    free(data.verts);
+    free(data.cells);
+  }
+
+  /* Make sure both cases were tested */
+  assert_that(num_coherent, is_greater_than(NUM_UPDATES/10));
+  assert_that(num_incoherent, is_greater_than(NUM_UPDATES/10));
+}
+
+Ensure (utetra, solve_batch_agrees_with_solve) {
+  /* The updates are solved in batches of `BATCH_SIZE` (8) updates, so
+   * solving up to 24 updates at once covers a single update, full
+   * batches, and full batches followed by a partial one */
+  size_t const max_n = 24;
+
+  uint3 const l = {1, 2, 3};
+
+  mesh3_data_s data[max_n];
+  mesh3_s *mesh[max_n];
+  eik3_s *eik[max_n];
+  utetra_s *u[2][max_n];
+  dbl lam[max_n][2];
+  dbl const *lam_ptr[max_n];
+
+  for (size_t n = 1; n <= max_n; ++n) {
+    /* First solve without warm starts, then with warm starts for
+     * some of the updates */
+    for (size_t pass = 0; pass < 2; ++pass) {
+      for (size_t i = 0; i < n; ++i) {
+        init_update_mesh_data(&data[i], rng);
+        mesh3_alloc(&mesh[i]);
+        mesh3_init(mesh[i], &data[i], false, false, NULL);
+
+        dbl3 xsrc;
+        xsrc[0] = H*gsl_ran_flat(rng, -4, 4);
+        xsrc[1] = H*gsl_ran_flat(rng, -4, 4);
+        xsrc[2] = -H*gsl_ran_flat(rng, 1, 4);
+
+        eik3_alloc(&eik[i]);
+        eik3_init(eik[i], mesh[i], &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
+        for (size_t j = 0; j < 3; ++j)
+          eik3_add_bc(eik[i], l[j],
+                      get_pt_src_jet(xsrc, data[i].verts[l[j]]));
+
+        for (size_t k = 0; k < 2; ++k) {
+          utetra_alloc(&u[k][i]);
+          utetra_init(u[k][i], eik[i], 0, l);
+        }
+
+        lam_ptr[i] = NULL;
+        if (pass == 1 && gsl_rng_uniform(rng) < 0.5) {
+          lam[i][0] = gsl_rng_uniform(rng);
+          lam[i][1] = (1 - lam[i][0])*gsl_rng_uniform(rng);
+          lam_ptr[i] = lam[i];
+        }
+      }
+
+      for (size_t i = 0; i < n; ++i)
+        utetra_solve(u[0][i], lam_ptr[i]);
+      utetra_solve_batch(u[1], lam_ptr, n);
+
+      /* The batched solver does the same iterations, but evaluates
+       * some expressions in a different order, so the results differ
+       * by rounding error: the values by less than 1e-14, and the
+       * minimizers (where the values are flat) by less than 1e-13 */
+      double_relative_tolerance_is(0);
+      for (size_t i = 0; i < n; ++i) {
+        assert_that(utetra_get_num_iter(u[1][i]),
+                    is_equal_to(utetra_get_num_iter(u[0][i])));
+
+        double_absolute_tolerance_is(1e-14);
+        assert_that_double(utetra_get_value(u[1][i]),
+                           is_nearly_double(utetra_get_value(u[0][i])));
+
+        double_absolute_tolerance_is(1e-13);
+        dbl lam_solve[2][2];
+        for (size_t k = 0; k < 2; ++k)
+          utetra_get_lambda(u[k][i], lam_solve[k]);
+        for (size_t j = 0; j < 2; ++j)
+          assert_that_double(lam_solve[1][j],
+                             is_nearly_double(lam_solve[0][j]));
+      }
+
+      for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 0; k < 2; ++k)
+          utetra_dealloc(&u[k][i]);
+        eik3_deinit(eik[i]);
+        eik3_dealloc(&eik[i]);
+        mesh3_deinit(mesh[i]);
+        mesh3_dealloc(&mesh[i]);
+        free(data[i].verts);
+        free(data[i].cells);
+      }
+    }
+  }
+}
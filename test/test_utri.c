@@ -1,21 +1,83 @@
 #include <cgreen/cgreen.h>
 
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_rng.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "cube_mesh.h"
+#include "eik3.h"
+#include "mesh3.h"
 #include "utri.h"
+#include "vec.h"
+
+/* The number of vertices along each side of the test mesh */
+#define N 7
+
+#define NUM_UPDATES 1000
+
+/* A slowness which varies by 25% about 1. */
+static dbl s(dbl3 x) {
+  return 1 + sin(dbl3_sum(x))/4;
+}
+
+static void Ds(dbl3 x, dbl3 Ds) {
+  Ds[0] = Ds[1] = Ds[2] = cos(dbl3_sum(x))/4;
+}
+
+static void D2s(dbl3 x, dbl33 D2s) {
+  for (size_t i = 0; i < 3; ++i)
+    for (size_t j = 0; j < 3; ++j)
+      D2s[i][j] = -sin(dbl3_sum(x))/4;
+}
+
+static sfunc_s const sfunc_sin = {
+  .stype = STYPE_FUNC_PTR,
+  .funcs = {.s = s, .Ds = Ds, .D2s = D2s},
+  .data_jet31t = NULL,
+  .s_min = 0.75
+};
+
+/* Get the jet of a point source at `xsrc` at `x`. */
+static jet31t get_pt_src_jet(dbl3 const xsrc, dbl3 const x) {
+  jet31t jet;
+  dbl3_sub(x, xsrc, jet.Df);
+  jet.f = dbl3_norm(jet.Df);
+  dbl3_dbl_div_inplace(jet.Df, jet.f);
+  return jet;
+}
+
+static gsl_rng *rng;
+static mesh3_s *mesh;
 
 Describe(utri);
 
 BeforeEach(utri) {
   double_absolute_tolerance_is(1e-15);
   double_relative_tolerance_is(1e-15);
+
+  rng = gsl_rng_alloc(gsl_rng_mt19937);
+
+  mesh3_data_s data;
+  cube_mesh_data_init(&data, N, -3, 3, NULL);
+  mesh3_alloc(&mesh);
+  mesh3_init(mesh, &data, true, false, NULL);
+  cube_mesh_data_deinit(&data);
 }
 
-AfterEach(utri) {}
+AfterEach(utri) {
+  mesh3_deinit(mesh);
+  mesh3_dealloc(&mesh);
+
+  gsl_rng_free(rng);
+}
 
 Ensure (utri, tri11_works) {
-  dbl x[3] = {1, 1, 0};
-  dbl Xt[2][3] = {{1, 0, 0}, {0, 1, 0}};
-  dbl jet_data[2][4] = {{1, 1, 0, 0}, {1, 0, 1, 0}};
-  jet3 jet[2];
+  /* The base of the update needs to be an edge of the mesh, so the
+   * update is reflected across the plane y = 0. */
+  dbl x[3] = {1, -1, 0};
+  dbl Xt[2][3] = {{1, 0, 0}, {0, -1, 0}};
+  jet31t jet[2] = {{.f = 1, .Df = {1, 0, 0}}, {.f = 1, .Df = {0, -1, 0}}};
 
   utri_s *utri;
   utri_alloc(&utri);
@@ -34,25 +96,33 @@ Ensure (utri, tri11_works) {
   dbl const lam_gt = 0.5;
 
   dbl3 x_perm, Xt_perm[2];
-  dbl jet_data_perm[2][4];
+  jet31t jet_perm[2];
 
-  jet_data_perm[0][0] = jet_data[0][0];
-  jet_data_perm[1][0] = jet_data[1][0];
+  jet_perm[0].f = jet[0].f;
+  jet_perm[1].f = jet[1].f;
 
   for (int i = 0; i < 6; ++i) {
     for (int j = 0; j < 3; ++j) {
       x_perm[j] = x[perm[i][j]];
       Xt_perm[0][j] = Xt[0][perm[i][j]];
       Xt_perm[1][j] = Xt[1][perm[i][j]];
-      jet_data_perm[0][1 + j] = jet_data[0][1 + perm[i][j]];
-      jet_data_perm[1][1 + j] = jet_data[1][1 + perm[i][j]];
+      jet_perm[0].Df[j] = jet[0].Df[perm[i][j]];
+      jet_perm[1].Df[j] = jet[1].Df[perm[i][j]];
     }
 
-    memcpy(&jet[0], jet_data_perm[0], 4*sizeof(dbl));
-    memcpy(&jet[1], jet_data_perm[1], 4*sizeof(dbl));
+    size_t lhat = mesh3_get_vert_index(mesh, x_perm);
+    size_t l[2] = {
+      mesh3_get_vert_index(mesh, Xt_perm[0]),
+      mesh3_get_vert_index(mesh, Xt_perm[1])
+    };
+
+    eik3_s *eik;
+    eik3_alloc(&eik);
+    eik3_init(eik, mesh, &SFUNC_CONSTANT, HEAP_TYPE_BINARY);
+    eik3_add_bc(eik, l[0], jet_perm[0]);
+    eik3_add_bc(eik, l[1], jet_perm[1]);
 
-    utri_spec_s spec = utri_spec_from_raw_data(x_perm, Xt_perm, jet);
-    utri_init(utri, &spec);
+    utri_init(utri, eik, lhat, l);
     assert_that(utri_is_causal(utri));
 
     utri_solve(utri);
@@ -62,7 +132,83 @@ Ensure (utri, tri11_works) {
 
     lam = utri_get_lambda(utri);
     assert_that_double(lam, is_nearly_double(lam_gt));
+
+    eik3_deinit(eik);
+    eik3_dealloc(&eik);
   }
 
   utri_dealloc(&utri);
 }
+
+/* Pick a random vertex at least two away from the boundary of the
+ * mesh, so that its neighbors are all interior vertices. */
+static size_t get_random_interior_vert(void) {
+  size_t ind[3];
+  for (size_t i = 0; i < 3; ++i)
+    ind[i] = 2 + gsl_rng_uniform_int(rng, N - 4);
+  return (ind[0]*N + ind[1])*N + ind[2];
+}
+
+Ensure (utri, lower_bound_is_at_most_value) {
+  sfunc_s const *sfunc[2] = {&SFUNC_CONSTANT, &sfunc_sin};
+
+  utri_s *utri;
+  utri_alloc(&utri);
+
+  size_t num_tested[2] = {0, 0}, num_tight[2] = {0, 0};
+
+  while (num_tested[0] + num_tested[1] < NUM_UPDATES) {
+    size_t k = num_tested[0] <= num_tested[1] ? 0 : 1;
+
+    /* Pick an update from an edge which neighbors `lhat` */
+    size_t lhat = get_random_interior_vert();
+
+    size_t nvv;
+    size_t const *vv = mesh3_get_vv_ptr(mesh, lhat, &nvv);
+    size_t l[2];
+    l[0] = vv[gsl_rng_uniform_int(rng, nvv)];
+    l[1] = vv[gsl_rng_uniform_int(rng, nvv)];
+    if (!mesh3_is_edge(mesh, l))
+      continue;
+
+    /* Put a point source somewhere upwind of the base, and use its
+     * jets as the data on the base */
+    dbl3 xsrc, x[3];
+    for (size_t i = 0; i < 3; ++i)
+      xsrc[i] = gsl_ran_flat(rng, -3, 3);
+    mesh3_copy_vert(mesh, lhat, x[0]);
+    mesh3_copy_vert(mesh, l[0], x[1]);
+    mesh3_copy_vert(mesh, l[1], x[2]);
+    if (dbl3_dist(x[0], xsrc) <= fmax(dbl3_dist(x[1], xsrc),
+                                      dbl3_dist(x[2], xsrc)))
+      continue;
+
+    eik3_s *eik;
+    eik3_alloc(&eik);
+    eik3_init(eik, mesh, sfunc[k], HEAP_TYPE_BINARY);
+    for (size_t i = 0; i < 2; ++i)
+      eik3_add_bc(eik, l[i], get_pt_src_jet(xsrc, x[i + 1]));
+
+    utri_init(utri, eik, lhat, l);
+    if (!utri_is_degenerate(utri)) {
+      dbl lb = utri_get_lower_bound(utri);
+      utri_solve(utri);
+      dbl f = utri_get_value(utri);
+      assert_that_double(lb, is_less_than_double(f));
+
+      /* The bound should do better than the data on the base */
+      dbl T_min = fmin(dbl3_dist(x[1], xsrc), dbl3_dist(x[2], xsrc));
+      num_tight[k] += lb > T_min + 0.5;
+
+      ++num_tested[k];
+    }
+
+    eik3_deinit(eik);
+    eik3_dealloc(&eik);
+  }
+
+  for (size_t k = 0; k < 2; ++k)
+    assert_that(num_tight[k], is_greater_than(num_tested[k]/2));
+
+  utri_dealloc(&utri);
+}
@@ -61,7 +61,7 @@ cdef extern from "jmm/mesh3.h":
 
     void mesh3_alloc(mesh3 **mesh)
     void mesh3_dealloc(mesh3 **mesh)
-    void mesh3_init(mesh3 *mesh, const mesh3_data *data, bool compute_bd_info, const dbl *eps)
+    void mesh3_init(mesh3 *mesh, const mesh3_data *data, bool compute_bd_info, bool compute_topology, const dbl *eps)
     const size_t *mesh3_get_cells_ptr(const mesh3 *mesh)
     const dbl *mesh3_get_verts_ptr(const mesh3 *mesh)
     size_t mesh3_ncells(const mesh3 *mesh)
@@ -120,9 +120,10 @@ cdef class Mesh3:
     def __dealloc__(self):
         mesh3_dealloc(&self.mesh)
 
-    def __init__(self, Mesh3Data mesh_data, bool compute_bd_info=True, eps=None):
+    def __init__(self, Mesh3Data mesh_data, bool compute_bd_info=True,
+                 eps=None, bool compute_topology=False):
         cdef dbl eps_ = np.nan if eps is None else eps
-        mesh3_init(self.mesh, &mesh_data.data, compute_bd_info, &eps_)
+        mesh3_init(self.mesh, &mesh_data.data, compute_bd_info, compute_topology, &eps_)
 
     @property
     def cells(self):
@@ -180,10 +181,21 @@ cdef class Sfunc:
         else:
             raise NotImplementedError(f'stype == {stype}')
 
+cdef extern from "jmm/heap.h":
+    cdef enum heap_type:
+        HEAP_TYPE_BINARY = 0
+        HEAP_TYPE_4ARY = 1
+        HEAP_TYPE_BUCKET = 2
+
+class HeapType(Enum):
+    Binary = HEAP_TYPE_BINARY
+    FourAry = HEAP_TYPE_4ARY
+    Bucket = HEAP_TYPE_BUCKET
+
 cdef extern from "jmm/eik3.h":
     void eik3_alloc(eik3 **eik)
     void eik3_dealloc(eik3 **eik)
-    void eik3_init(eik3 *eik, const mesh3 *mesh, const sfunc *sfunc)
+    void eik3_init(eik3 *eik, const mesh3 *mesh, const sfunc *sfunc, heap_type heap_type)
 
 cdef class Eik3:
     cdef eik3 *eik
@@ -194,8 +206,8 @@ cdef class Eik3:
     def __dealloc__(self):
         eik3_dealloc(&self.eik)
 
-    def __init__(self, Mesh3 mesh, Sfunc sfunc):
-        eik3_init(self.eik, mesh.mesh, &sfunc.sfunc)
+    def __init__(self, Mesh3 mesh, Sfunc sfunc, heap_type=HeapType.Binary):
+        eik3_init(self.eik, mesh.mesh, &sfunc.sfunc, heap_type.value)
 
 cdef extern from "jmm/eik3hh_branch.h":
     cdef enum eik3hh_branch_type: